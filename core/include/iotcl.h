@@ -9,7 +9,7 @@
  * This library's functions generally return error codes defined in iotcl_constants.h as int,
  * unless otherwise noted or obvious.
  *
- * The library requires dynamic memory allocation. Lifetimes of values allocated on heap are specified in corresponding
+ * The library requires dynamic memory allocation, unless built with IOTCL_NO_HEAP (see iotcl_cfg.h). Lifetimes of values allocated on heap are specified in corresponding
  * functions and where the user may or may not be responsible for freeing those values with noted functions.
  * Functions which return values that need to be freed are generally prefixed with "create" or "clone".
  * Otherwise they are prefixed with "get" or other general prefixes.
@@ -86,6 +86,33 @@
  *
  * Also see https://docs.iotconnect.io/iotconnect/sdk/message-protocol/device-message-2-1/d2c-messages/#Device
  * and https://en.wikipedia.org/wiki/Year_2038_problem
+ *
+ * ---- ACK OUTBOX GUIDE ----
+ * Bulk operations from the IoTConnect web UI can deliver dozens of commands at once. Instead of publishing
+ * an ack for each command or OTA status change with iotcl_mqtt_send_cmd_ack() and iotcl_mqtt_send_ota_ack(),
+ * the application can queue acks with iotcl_mqtt_queue_cmd_ack() and iotcl_mqtt_queue_ota_ack().
+ * Queued acks are stored in a fixed size outbox (see IOTCL_ACK_OUTBOX_CAPACITY in iotcl_cfg.h) without allocating,
+ * and are coalesced by ack ID. The protocol carries a single ack per message, so only the last queued status
+ * for each ack ID is published - for example a "downloading" OTA status followed by "done" results in one publish.
+ * Pending acks are flushed, in the order in which they were first queued:
+ *  - When IotclAckOutboxConfig.max_pending acks are pending.
+ *  - When the oldest pending ack is max_delay_s old and iotcl_mqtt_flush_acks_if_due() is called.
+ *  - Ahead of any telemetry sent with iotcl_mqtt_send_telemetry().
+ *  - When iotcl_mqtt_flush_acks() is called.
+ * Pending acks are kept when iotcl_init() is called again to reconfigure the library, and discarded by iotcl_deinit().
+ * The outbox is not protected by a lock. If acks are queued from a different thread than the one sending telemetry,
+ * the calls should be serialized by the application.
+ *
+ * ---- PARALLEL SERIALIZATION GUIDE ----
+ * Backfill and batch uploads can have thousands of data sets in a single telemetry message. The library has no
+ * threads of its own, but it can serialize such messages on the application's worker threads. Provide an executor
+ * function in IotclParallelConfig that runs the given number of jobs, for example on a thread pool or one thread
+ * per job, and returns once all of them are done. The "d" array of the message is split into num_jobs ranges
+ * of data sets, each job serializes one range into its own buffer, and the pieces are joined with a single copy.
+ * Messages with fewer than IOTCL_TELEMETRY_PARALLEL_MIN_DATA_SETS data sets and pretty printed messages
+ * are serialized on the calling thread.
+ * The jobs allocate memory concurrently, so the functions passed to iotcl_configure_dynamic_memory()
+ * must be thread safe. Parallel serialization is not available in IOTCL_NO_HEAP mode.
  */
 
 #include <stdint.h>
@@ -107,6 +134,13 @@ typedef void (*IotclMqttTransportSend)(const char *topic, const char *json_str);
 
 typedef time_t (*IotclTimeFunction)(void);
 
+// A job that serializes a part of a message. Index is from 0 to num_jobs - 1.
+typedef void (*IotclParallelJob)(void *context, size_t index);
+
+// Calls job(context, index) for each index from 0 to num_jobs - 1, possibly concurrently,
+// and returns once all calls have returned.
+typedef void (*IotclParallelExecutor)(IotclParallelJob job, void *context, size_t num_jobs);
+
 // This structure's instance is a part of IoTConnect library's global configuration and is
 // permanently kept by the library after iotcl_init() is called, and until iotcl_deinit().
 // The client can use provided values in order to configure their mqtt client.
@@ -134,7 +168,9 @@ typedef enum {
     IOTCL_DCT_AZURE_DEDICATED,
 
     // Use this for custom or with Discovery/Identity Rest API module.
-    // When using this option, the configuration can be obtained by calling iotcl_get_global_config() in iotcl_internal.h
+    // When using this option, the MQTT configuration can be set up by the user through iotcl_mqtt_get_custom_config().
+    // Setting it up through iotcl_mqtt_get_config() still works, but is deprecated. To migrate, replace
+    // iotcl_mqtt_get_config() with iotcl_mqtt_get_custom_config() in the code that sets the topics.
     IOTCL_DCT_CUSTOM,
 
     // used for error/sanity checking
@@ -156,6 +192,20 @@ typedef struct {
     const char *host; // Set this value if using Azure (IOTCL_DCT_AZURE_SHARED or IOTCL_DCT_AZURE_DEDICATED)
 } IotclDeviceConfig;
 
+// See ACK OUTBOX GUIDE in the header of this file.
+// If max_pending is zero (default), acks passed to iotcl_mqtt_queue_* functions are published immediately.
+typedef struct {
+    int max_pending;    // Flush once this many acks are pending. Must not exceed IOTCL_ACK_OUTBOX_CAPACITY.
+    int max_delay_s;    // Optional. Flush once the oldest pending ack is this many seconds old. Requires time_fn.
+} IotclAckOutboxConfig;
+
+// See PARALLEL SERIALIZATION GUIDE in the header of this file.
+// If executor is NULL (default), messages are always serialized on the calling thread.
+typedef struct {
+    IotclParallelExecutor executor;
+    size_t num_jobs;    // Number of ranges to split large messages into. Typically the number of worker threads.
+} IotclParallelConfig;
+
 typedef struct {
 
     // See DEVICE CONFIGURATION GUIDE at the header of this file.
@@ -174,6 +224,12 @@ typedef struct {
     // Optional. See TIME CONFIGURATION GUIDE at the header of this file.
     IotclTimeFunction time_fn;
 
+    // Optional. See ACK OUTBOX GUIDE at the header of this file.
+    IotclAckOutboxConfig ack_outbox;
+
+    // Optional. See PARALLEL SERIALIZATION GUIDE at the header of this file.
+    IotclParallelConfig parallel;
+
     // This QOL check can be disabled in case of some special requirements.
     // Received string characters from MQTT are checked against isprint(), isspace() and newline and warning is printed
     // if they are not printable, but could fail on some untested locales.
@@ -198,6 +254,11 @@ void iotcl_init_client_config(IotclClientConfig *c);
 
 // Sets up the library's global configuration instance per passed local configuration instance.
 // User is not responsible for maintaining memory references to any of the provided values in the IotclClientConfig object.
+// All IotclMqttConfig strings are stored in a single allocation. If iotcl_init() is called again (eg. to reconfigure
+// the library after a reconnect), the new MQTT configuration is built in a separate allocation and then replaces
+// the current one as a new snapshot, so other threads can keep using the library. See iotcl_mqtt_acquire_config().
+// The replaced allocation is kept and reused by the next iotcl_init() if the new strings fit into it,
+// so reconfiguring the library repeatedly does not allocate after the second call.
 int iotcl_init(IotclClientConfig *c);
 
 // Same as iotcl_init(), but prints a device config summary to help troubleshoot issue.
@@ -207,8 +268,29 @@ int iotcl_init_and_print_config(IotclClientConfig *c);
 void iotcl_deinit(void);
 
 // Returns the MQTT topics for this device. NULL, if not configured.
+// The returned values are replaced when the library is reconfigured (iotcl_init() or the DRA identity module),
+// so if other threads may reconfigure the library while the values are in use, use iotcl_mqtt_acquire_config() instead.
+// DEPRECATED: Modifying the configuration through the returned pointer. Use iotcl_mqtt_get_custom_config()
+// with IOTCL_DCT_CUSTOM instead. The returned pointer will become const in a future release.
 IotclMqttConfig *iotcl_mqtt_get_config(void);
 
+// With IOTCL_DCT_CUSTOM, returns the empty MQTT configuration published by iotcl_init(), so that the user can set
+// its strings. The strings will be freed with iotcl_free(). Set them up before other threads use the library.
+// Returns NULL if the library is not configured with IOTCL_DCT_CUSTOM, or if the configuration was already
+// replaced (eg. by the DRA identity module), since other threads may be reading the published configuration.
+IotclMqttConfig *iotcl_mqtt_get_custom_config(void);
+
+// Returns the current MQTT configuration snapshot, which stays valid and unchanged until released with
+// iotcl_mqtt_release_config(), even if the library is reconfigured by another thread in the meantime.
+// This is lock-free and intended for publisher and receiver threads on the hot path. Replaced snapshots are reclaimed
+// by the next reconfiguration once no snapshot is held, so release the snapshot as soon as possible.
+// Returns NULL if the library is not configured, in which case the release is not needed.
+// The iotcl_mqtt_send* and iotcl_mqtt_receive* functions acquire the config internally.
+const IotclMqttConfig *iotcl_mqtt_acquire_config(void);
+
+// Releases a snapshot returned by iotcl_mqtt_acquire_config(). Passing NULL is allowed.
+void iotcl_mqtt_release_config(const IotclMqttConfig *mc);
+
 // Prints the current IoTConnect mqtt config if the library is configured. Could be useful for troubleshooting.
 // If value is null, it is not printed.
 void iotcl_mqtt_print_config(void);
@@ -231,6 +313,24 @@ int iotcl_mqtt_send_cmd_ack(
         const char *message // Optional message to be sent along with the ack. Set to NULL or empty if no message.
 );
 
+// Queues a command ack into the ack outbox. See ACK OUTBOX GUIDE in the header of this file.
+// Arguments are the same as for iotcl_mqtt_send_cmd_ack(). The values are copied, and the message may be truncated
+// to IOTCL_ACK_OUTBOX_MSG_MAX_LEN. Returns an error if the ack could not be queued, or a flush has failed.
+int iotcl_mqtt_queue_cmd_ack(const char *ack_id, int cmd_status, const char *message);
+
+// Queues an OTA ack into the ack outbox. See iotcl_mqtt_queue_cmd_ack().
+int iotcl_mqtt_queue_ota_ack(const char *ack_id, int ota_status, const char *message);
+
+// Publishes all pending acks from the ack outbox.
+int iotcl_mqtt_flush_acks(void);
+
+// Publishes all pending acks, if the oldest pending ack has waited for IotclAckOutboxConfig.max_delay_s or longer.
+// Call this function periodically from your main loop if max_delay_s is configured.
+int iotcl_mqtt_flush_acks_if_due(void);
+
+// Returns the number of acks that are waiting in the ack outbox.
+int iotcl_mqtt_get_pending_ack_count(void);
+
 // iotcl_mqtt_receive* functions are a safe way to route the inbound messages to appropriate subsystems,
 // or ignore the message based on the topic supplied, in case a common inbound MQTT message entry point is used.
 // As opposed to processing the messages directly with functions in iotcl_c2d.h (or future shadow/twin implementations)
@@ -264,6 +364,25 @@ void *iotcl_malloc(size_t size);
 // This function will redirect to iotcl_configure_dynamic_memory() configured values, if provided.
 void iotcl_free(void *ptr);
 
+#ifdef IOTCL_NO_HEAP
+// A bump allocator over caller provided storage. In IOTCL_NO_HEAP mode, iotcl_malloc() allocates from
+// the active arena and iotcl_free() does nothing. All memory is released at once when the storage is discarded.
+// The library activates its own arenas for telemetry messages, C2D events and acks. The user can activate an arena
+// in order to use other functions that allocate, like those in the device REST API module.
+typedef struct {
+    uint8_t *buffer;
+    size_t size;
+    size_t used;
+} IotclArena;
+
+// Sets up the arena to use the storage. The storage does not need to be aligned.
+void iotcl_arena_init(IotclArena *arena, void *storage, size_t storage_size);
+
+// Makes the arena active for the calling thread (see IOTCL_THREAD_LOCAL) and returns the previously active arena,
+// which should be restored with another iotcl_arena_activate() call once done. Pass NULL to deactivate.
+IotclArena *iotcl_arena_activate(IotclArena *arena);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
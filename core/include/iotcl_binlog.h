@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Deferred binary logging.
+ *
+ * With IOTCL_ENABLE_BINARY_LOG defined in your IOTCL_USER_CONFIG_FILE (see iotcl_cfg.h), IOTCL_ERROR, IOTCL_WARN
+ * and IOTCL_INFO do not call printf. Instead, the format string pointer, which also identifies the log statement,
+ * and the raw argument values are stored into a fixed size lock-free ring buffer. String arguments are copied
+ * (and truncated) because they may not be valid by the time the record is decoded.
+ * The application formats the records later, from a low priority task or a background thread,
+ * by calling iotcl_binlog_drain() or iotcl_binlog_print_pending().
+ *
+ * Records can also be read with iotcl_binlog_read() and stored or sent as they are, to be decoded offline.
+ * The format pointer can be resolved into the format string with the map or ELF file of the same firmware image.
+ *
+ * Any number of threads can write and read records concurrently. Writing never blocks. If the ring is full,
+ * the record is dropped and counted. Once a clock is configured, repeated errors and warnings from the same
+ * log statement are rate limited. The number of records suppressed is reported with the next record that gets through.
+ *
+ * Format strings must be string literals, as the pointer is dereferenced when the record is decoded.
+ * Supported conversions are d, i, u, o, x, X, c, s, p, f, F, e, E, g, G, a and A with flags, width and precision
+ * (including *) and the hh, h, l, ll and z length modifiers.
+ *
+ * Example, with a background thread or a low priority task:
+ *   iotcl_binlog_configure_clock(my_millis);
+ *   for (;;) {
+ *       iotcl_binlog_print_pending();
+ *       sleep_ms(100);
+ *   }
+ */
+
+#ifndef IOTCL_BINLOG_H
+#define IOTCL_BINLOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "iotcl_cfg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    IOTCL_BINLOG_LEVEL_ERROR = 0,
+    IOTCL_BINLOG_LEVEL_WARN,
+    IOTCL_BINLOG_LEVEL_INFO
+} IotclBinlogLevel;
+
+typedef struct {
+    const char *format;     // the format string literal passed to the log macro. Also identifies the log statement.
+    uint32_t timestamp_ms;  // 0 if no clock is configured
+    int err_code;
+    uint16_t suppressed;    // records from the same statement dropped by rate limiting since the previous record
+    uint8_t level;          // IotclBinlogLevel
+    uint8_t num_args;
+    uint64_t args[IOTCL_BINLOG_MAX_ARGS]; // raw values. String arguments are offsets into strings.
+    char strings[IOTCL_BINLOG_STRING_SPACE];
+} IotclBinlogRecord;
+
+// Should return a free-running millisecond counter. It is fine if it wraps around.
+typedef uint32_t (*IotclBinlogClockFunction)(void);
+
+// Receives each record drained with iotcl_binlog_drain(), along with its formatted (and possibly truncated) text.
+typedef void (*IotclBinlogSinkFunction)(void *context, const IotclBinlogRecord *record, const char *text);
+
+#if defined(__GNUC__) || defined(__clang__)
+#define IOTCL_BINLOG_FORMAT_CHECK __attribute__((format(printf, 3, 4)))
+#else
+#define IOTCL_BINLOG_FORMAT_CHECK
+#endif
+
+// Enables timestamps and rate limiting. Pass NULL to disable them.
+void iotcl_binlog_configure_clock(IotclBinlogClockFunction now_ms_fn);
+
+// Called by the IOTCL_ERROR, IOTCL_WARN and IOTCL_INFO macros.
+void iotcl_binlog_write(IotclBinlogLevel level, int err_code, const char *format, ...) IOTCL_BINLOG_FORMAT_CHECK;
+
+// Removes the oldest record from the ring and copies it into record. Returns false if the ring is empty.
+bool iotcl_binlog_read(IotclBinlogRecord *record);
+
+// Formats the message of the record into the buffer, null terminated. Returns the length of the text
+// that would have been written if the buffer was large enough, like snprintf does.
+size_t iotcl_binlog_format(const IotclBinlogRecord *record, char *buffer, size_t buffer_size);
+
+// Reads all pending records and passes them to the sink. Returns the number of records drained.
+int iotcl_binlog_drain(IotclBinlogSinkFunction sink, void *context);
+
+// Drains the ring with printf, in the same format as the default IOTCL_ERROR, IOTCL_WARN and IOTCL_INFO macros.
+// Records dropped because the ring was full since the last call are reported as a warning.
+void iotcl_binlog_print_pending(void);
+
+// Number of records dropped because the ring was full, since the start or iotcl_binlog_reset().
+unsigned long iotcl_binlog_get_dropped_count(void);
+
+// Discards all records, counters and rate limiting state. Must not be called while other threads are logging.
+void iotcl_binlog_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCL_BINLOG_H
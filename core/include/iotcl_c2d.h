@@ -27,7 +27,9 @@
 #ifndef IOTCL_C2D_H
 #define IOTCL_C2D_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 // MBEDTLS config file style - include your own to override the config. See iotcl_example_config.h
 #if defined(IOTCL_USER_CONFIG_FILE)
@@ -63,13 +65,30 @@ typedef void (*IotclOtaCallback)(IotclC2dEventData data);
 
 typedef void (*IotclCommandCallback)(IotclC2dEventData data);
 
+// Handler for commands registered with iotcl_c2d_register_command().
+// The command line is split on whitespace and argv[0] is the command name. argv[argc] is NULL.
+// The default command handler can receive argc of zero if the command line is empty.
+// The argument strings are valid until the event data is destroyed.
+typedef void (*IotclCommandHandler)(IotclC2dEventData data, int argc, char **argv);
+
 // Callback configuration for the events module.
 // NOTE: It is safe to destroy the event data early by calling iotcl_c2d_destroy_event inside the callback
 // in order to free up some heap, as long as no other calls other functions in this file are made that depend on event data.
 // For more information, see iotcl_c2d_destroy_event().
+// Duplicate filter: With QoS 1, brokers can redeliver C2D messages after reconnects. If is_duplicate_filter_enabled
+// is set, the ack IDs of recently processed messages are remembered in a fixed size cache
+// (see IOTCL_C2D_DEDUP_CACHE_SIZE in iotcl_cfg.h) and messages with a known ack ID are dropped before
+// the callbacks are invoked. In that case, iotcl_c2d_process_event* functions return IOTCL_ERR_IGNORED.
+// Commands that are sent without the "receipt required" option have no ack ID and are never filtered.
+// An ack ID is remembered once its message is dispatched to a callback or acked, so a redelivered message
+// that previously failed to be parsed or dispatched is processed again. The cache is cleared by iotcl_deinit().
+// If is_duplicate_ack_resend_enabled is also set, the last status sent with iotcl_mqtt_send_cmd_ack()
+// or iotcl_mqtt_send_ota_ack() for the ack ID is sent again (without the message) when a duplicate is dropped.
 typedef struct {
     IotclOtaCallback ota_cb;        // callback for OTA events.
     IotclCommandCallback cmd_cb;    // callback for command events.
+    bool is_duplicate_filter_enabled;
+    bool is_duplicate_ack_resend_enabled;
 } IotclEventConfig;
 
 // The user should supply the event received json form the cloud.
@@ -82,6 +101,28 @@ int iotcl_c2d_process_event(const char *str);
 //  received on the c2d topic. The buffer contents should be a JSON string.
 int iotcl_c2d_process_event_with_length(const uint8_t *data, size_t data_len);
 
+// COMMAND REGISTRY
+// Instead of handling every command in cmd_cb, handlers can be registered per command name.
+// When a command event is received, the command name (first word of the command line) is looked up
+// in a hash table and the matching handler is called with the command line split into arguments.
+// If the name is not registered, the default command handler is called.
+// If there is no default command handler, cmd_cb is called with the unmodified command line.
+// The command line is split in place, so iotcl_c2d_get_command() will return only the command name
+// when called from a registered or default handler.
+// The registry is cleared by iotcl_deinit(), so commands should be registered after calling iotcl_init().
+// Calling iotcl_init() again to reconfigure the library keeps the registered commands.
+
+// Registers a handler for the command with the given name. Registering the same name again replaces the handler.
+// The name string is not copied and must remain valid until the registry is cleared (typically a string literal).
+// Returns IOTCL_ERR_OVERFLOW if the registry is full. See IOTCL_C2D_COMMAND_REGISTRY_SIZE in iotcl_cfg.h.
+int iotcl_c2d_register_command(const char *name, IotclCommandHandler handler);
+
+// Sets the handler that will be called for commands that are not registered. Pass NULL to clear it.
+void iotcl_c2d_set_default_command_handler(IotclCommandHandler handler);
+
+// Removes all registered command handlers and the default command handler.
+void iotcl_c2d_clear_commands(void);
+
 // Returns a malloc-ed copy of the command line message parameter.
 // The user must manually free the returned string when it is no longer needed.
 const char *iotcl_c2d_get_command(IotclC2dEventData data);
@@ -99,10 +140,14 @@ const char *iotcl_c2d_get_ota_url(IotclC2dEventData data, int index);
 // Extracts the OTA hostname from the OTA download URL with a given zero-based array index.
 // This path will include and URL parameters passed. For example, if URL is "https://acme.corp/path?user=me"
 // the function will return "acme.corp".
-// NOTE: This string will be internally allocated and freed once iotcl_c2d_destroy_event is called.
-// The call can NULL is this allocation fails.
+// NOTE: Hostnames for all URLs are extracted once when the OTA event is received and are freed
+// once iotcl_c2d_destroy_event is called. This function does not allocate.
 const char *iotcl_c2d_get_ota_url_hostname(IotclC2dEventData data, int index);
 
+// Same as iotcl_c2d_get_ota_url_hostname(), but returns a pointer to the hostname inside the download URL string
+// and its length via hostname_len. The returned string is NOT null terminated at the end of the hostname.
+const char *iotcl_c2d_get_ota_url_hostname_span(IotclC2dEventData data, int index, size_t *hostname_len);
+
 // Extracts the OTA URL path with leading slash and trailing URL parameters
 // from the OTA download URL with a given zero-based array index.
 // This path will include and URL parameters passed. For example, if URL is "https://acme.corp/path?user=me"
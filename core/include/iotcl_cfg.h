@@ -31,6 +31,7 @@ extern "C" {
 #define IOTCL_ERR_CONFIG_MISSING    7 // Global config or an optional config item is missing - specific call cannot complete.
 #define IOTCL_ERR_OVERFLOW          8 // A buffer or a value would overflow.
 #define IOTCL_ERR_IGNORED           9 // A message or an event is ignored. Eg. topic not intended, or command without ack.
+#define IOTCL_ERR_EXPIRED          10 // A cached or time-limited value is no longer valid.
 
 
 // -------  TIME FORMATTING -------
@@ -56,7 +57,7 @@ extern "C" {
 
 
 // --------------- LIMITS DEFINITIONS ---------------
-// These definitions are not currently utilized by the library but can be used by the client code
+// These definitions are not utilized by the library (except in IOTCL_NO_HEAP mode) but can be used by the client code
 #define IOTCL_CONFIG_DUID_MAX_LEN 64
 #define IOTCL_CONFIG_CPID_MAX_LEN 63
 #define IOTCL_CONFIG_ENV_MAX_LEN 20
@@ -64,10 +65,178 @@ extern "C" {
 // IoTHub and AWS IoT Core max device id is 128, which is "<CPID>-<DUID>" (with a dash)
 #define IOTCL_CONFIG_CLIENTID_MAX_LEN 128
 
+#ifndef IOTCL_CONFIG_HOST_MAX_LEN
+#define IOTCL_CONFIG_HOST_MAX_LEN 128
+#endif
+
+#ifndef IOTCL_CONFIG_CD_MAX_LEN
+#define IOTCL_CONFIG_CD_MAX_LEN 15
+#endif
+
 // Useful define: This value is not used in the actual library, but the user code can reference
 // it if it needs to store ACKs in flash to be able to send a success/failure after reboot
 #define IOTCL_MAX_ACK_LENGTH 36
 
+// Number of acknowledgements that can be held by the ack outbox before it is forced to flush.
+// See iotcl_mqtt_queue_cmd_ack() in iotcl.h. Each entry takes roughly IOTCL_ACK_OUTBOX_MSG_MAX_LEN + 48 bytes of RAM.
+#ifndef IOTCL_ACK_OUTBOX_CAPACITY
+#define IOTCL_ACK_OUTBOX_CAPACITY 16
+#endif
+
+// Acknowledgement messages queued into the ack outbox that are longer than this will be truncated.
+#ifndef IOTCL_ACK_OUTBOX_MSG_MAX_LEN
+#define IOTCL_ACK_OUTBOX_MSG_MAX_LEN 63
+#endif
+
+// Number of recently seen C2D ack IDs that are remembered in order to drop duplicate (redelivered) C2D messages.
+// See IotclEventConfig.is_duplicate_filter_enabled in iotcl_c2d.h. Should be a multiple of IOTCL_C2D_DEDUP_WAYS.
+// Each entry takes roughly IOTCL_MAX_ACK_LENGTH + 16 bytes of RAM.
+#ifndef IOTCL_C2D_DEDUP_CACHE_SIZE
+#define IOTCL_C2D_DEDUP_CACHE_SIZE 32
+#endif
+
+// Number of cache entries that can hold a given ack ID. The least recently used of those is evicted on insert.
+#ifndef IOTCL_C2D_DEDUP_WAYS
+#define IOTCL_C2D_DEDUP_WAYS 4
+#endif
+
+// Number of slots in the command registry hash table. See iotcl_c2d_register_command() in iotcl_c2d.h.
+// Must be a power of two. For fast lookups, keep it at least 1.5 times larger than the number of registered commands.
+// Each slot takes 2-3 pointers of RAM.
+#ifndef IOTCL_C2D_COMMAND_REGISTRY_SIZE
+#define IOTCL_C2D_COMMAND_REGISTRY_SIZE 32
+#endif
+
+// Maximum number of arguments (including the command name) that a command line is split into
+// before it is passed to a registered command handler. The last argument will contain the remainder of the line.
+#ifndef IOTCL_C2D_COMMAND_MAX_ARGS
+#define IOTCL_C2D_COMMAND_MAX_ARGS 8
+#endif
+
+// Number of slots in the telemetry precision registry hash table. See iotcl_telemetry_configure_precision().
+// Must be a power of two. Each slot takes 2 pointers of RAM.
+#ifndef IOTCL_TELEMETRY_PRECISION_REGISTRY_SIZE
+#define IOTCL_TELEMETRY_PRECISION_REGISTRY_SIZE 32
+#endif
+
+// Telemetry data sets with at least this many values and objects get a hash index of their keys, so that setting
+// a value or finding its parent object does not search the data set linearly. Smaller data sets are searched,
+// which avoids allocating the index. The index takes 2 pointers per slot and is reused by the following data sets.
+#ifndef IOTCL_TELEMETRY_KEY_INDEX_MIN_KEYS
+#define IOTCL_TELEMETRY_KEY_INDEX_MIN_KEYS 16
+#endif
+
+// Bytes of compressed samples in each IotclSampleBlock of a sample ring. See iotcl_sample_ring.h.
+// The first sample in a block takes 16 bytes, and the following take from 2 bits up to about 19 bytes.
+#ifndef IOTCL_SAMPLE_RING_BLOCK_SIZE
+#define IOTCL_SAMPLE_RING_BLOCK_SIZE 256
+#endif
+
+// Telemetry messages with at least this many data sets are serialized in parallel, if a parallel executor
+// is configured. See PARALLEL SERIALIZATION GUIDE in iotcl.h.
+#ifndef IOTCL_TELEMETRY_PARALLEL_MIN_DATA_SETS
+#define IOTCL_TELEMETRY_PARALLEL_MIN_DATA_SETS 64
+#endif
+
+// Width of number slots in telemetry templates. See iotcl_telemetry_template.h.
+// The default fits any double with 17 significant digits. Lower it to make the messages shorter if all values
+// fit into fewer characters, like integers or numbers with declared precision.
+#ifndef IOTCL_TELEMETRY_TEMPLATE_NUMBER_WIDTH
+#define IOTCL_TELEMETRY_TEMPLATE_NUMBER_WIDTH 24
+#endif
+
+// --------------- NO-HEAP MODE ---------------
+// Define IOTCL_NO_HEAP in your IOTCL_USER_CONFIG_FILE to build the library without any heap usage:
+//  o IotclMqttConfig strings are stored in a static buffer of IOTCL_NO_HEAP_MQTT_CONFIG_SIZE bytes.
+//  o Telemetry messages must be created with iotcl_telemetry_create_in_storage() in caller provided storage.
+//  o C2D events and acks are processed in storage on the stack of the caller of iotcl_mqtt_receive*()
+//    and iotcl_mqtt_send_*_ack() functions, sized by IOTCL_NO_HEAP_C2D_STORAGE_SIZE and IOTCL_NO_HEAP_ACK_STORAGE_SIZE.
+//  o Any other allocation is served from the arena activated with iotcl_arena_activate(). See iotcl.h.
+// iotcl_configure_dynamic_memory() cannot be used in this mode.
+// #define IOTCL_NO_HEAP
+
+// Upper bound for all IotclMqttConfig strings combined, given the IOTCL_CONFIG_*_MAX_LEN limits.
+#ifndef IOTCL_NO_HEAP_MQTT_CONFIG_SIZE
+#define IOTCL_NO_HEAP_MQTT_CONFIG_SIZE \
+    (2 * IOTCL_CONFIG_HOST_MAX_LEN + 5 * IOTCL_CONFIG_CLIENTID_MAX_LEN + 3 * IOTCL_CONFIG_CD_MAX_LEN + 256)
+#endif
+
+// Storage for a parsed C2D message. An OTA message with a long signed URL needs about 3KB on a 64-bit system.
+#ifndef IOTCL_NO_HEAP_C2D_STORAGE_SIZE
+#define IOTCL_NO_HEAP_C2D_STORAGE_SIZE 3072
+#endif
+
+// Storage for an acknowledgement message, including its JSON string.
+#ifndef IOTCL_NO_HEAP_ACK_STORAGE_SIZE
+#define IOTCL_NO_HEAP_ACK_STORAGE_SIZE 768
+#endif
+
+// --------------- RUNTIME STATS ---------------
+// Define IOTCL_ENABLE_STATS in your IOTCL_USER_CONFIG_FILE to collect counters and latency histograms
+// for telemetry, MQTT sends, C2D processing, acks and device REST API parsing. See iotcl_stats.h.
+// Each counted operation adds one or two atomic increments, plus two clock reads if a clock is configured.
+// #define IOTCL_ENABLE_STATS
+
+// --------------- DEFERRED BINARY LOGGING ---------------
+// Define IOTCL_ENABLE_BINARY_LOG in your IOTCL_USER_CONFIG_FILE to have IOTCL_ERROR, IOTCL_WARN and IOTCL_INFO
+// store only the format string pointer and raw argument values into a lock-free ring buffer.
+// Text is produced later, when the application drains the ring. See iotcl_binlog.h.
+// #define IOTCL_ENABLE_BINARY_LOG
+
+// Number of records in the ring. Must be a power of two. Records are dropped (and counted) when the ring is full.
+// Each record takes roughly IOTCL_BINLOG_STRING_SPACE + 8 * IOTCL_BINLOG_MAX_ARGS + 32 bytes of RAM.
+#ifndef IOTCL_BINLOG_RING_SIZE
+#define IOTCL_BINLOG_RING_SIZE 64
+#endif
+
+// Maximum number of arguments captured per record. Any further arguments are not printed.
+#ifndef IOTCL_BINLOG_MAX_ARGS
+#define IOTCL_BINLOG_MAX_ARGS 8
+#endif
+
+// Bytes available for copies of all string arguments of a record. Longer strings are truncated.
+#ifndef IOTCL_BINLOG_STRING_SPACE
+#define IOTCL_BINLOG_STRING_SPACE 96
+#endif
+
+// Errors and warnings from the same log statement beyond IOTCL_BINLOG_RATE_LIMIT_BURST records
+// in IOTCL_BINLOG_RATE_LIMIT_WINDOW_MS are dropped and counted. Requires a clock. See iotcl_binlog_configure_clock().
+#ifndef IOTCL_BINLOG_RATE_LIMIT_BURST
+#define IOTCL_BINLOG_RATE_LIMIT_BURST 5
+#endif
+
+#ifndef IOTCL_BINLOG_RATE_LIMIT_WINDOW_MS
+#define IOTCL_BINLOG_RATE_LIMIT_WINDOW_MS 1000
+#endif
+
+// Number of log statements that can be rate limited. Must be a power of two.
+#ifndef IOTCL_BINLOG_RATE_LIMIT_SITES
+#define IOTCL_BINLOG_RATE_LIMIT_SITES 32
+#endif
+
+// --------------- PIPELINE TRACING ---------------
+// Define IOTCL_ENABLE_TRACE in your IOTCL_USER_CONFIG_FILE to record trace spans around the stages of sending telemetry,
+// receiving and dispatching C2D messages, creating acks and parsing device REST API responses.
+// The spans can be exported in the Chrome trace event format. See iotcl_trace.h.
+// #define IOTCL_ENABLE_TRACE
+
+// Number of spans kept per thread. Older spans are overwritten. Each span takes 2 pointers of RAM.
+#ifndef IOTCL_TRACE_BUFFER_SIZE
+#define IOTCL_TRACE_BUFFER_SIZE 256
+#endif
+
+// Number of threads that can record spans. Spans from any additional threads are not recorded.
+// Threads can have their own buffers only if IOTCL_THREAD_LOCAL is defined. Otherwise, all threads share the first one.
+#ifndef IOTCL_TRACE_MAX_THREADS
+#define IOTCL_TRACE_MAX_THREADS 4
+#endif
+
+// The active arena is tracked per thread if this is defined as a thread local storage specifier (eg. __thread).
+// The default is suitable for single threaded applications.
+#ifndef IOTCL_THREAD_LOCAL
+#define IOTCL_THREAD_LOCAL
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -9,9 +9,12 @@
 #define IOTCL_INTERNAL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 #include "cJSON.h"
 #include "iotcl.h"
+#include "iotcl_stats.h"
+#include "iotcl_trace.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -31,10 +34,11 @@ extern "C" {
 
 typedef struct {
     bool is_valid;
-    IotclMqttConfig mqtt_config;
     IotclMqttTransportSend mqtt_send_cb;
     IotclEventConfig event_functions;
     IotclTimeFunction time_fn;
+    IotclAckOutboxConfig ack_outbox;
+    IotclParallelConfig parallel;
     bool disable_printable_check;
 } IotclGlobalConfig;
 
@@ -46,6 +50,169 @@ IotclGlobalConfig *iotcl_get_global_config(void);
 // A helper function to clone a string from cJSON structure and return NULL if type is invalid etc.
 char *iotcl_strdup_json_string(cJSON *cjson, const char *value_name);
 
+// Atomic operations used for lock-free data shared between threads. Define these to match your compiler
+// if it is not GCC or Clang compatible. The fallback is only suitable for single-threaded use.
+#ifndef IOTCL_ATOMIC_LOAD
+#if defined(__GNUC__) || defined(__clang__)
+#define IOTCL_ATOMIC_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_SEQ_CST)
+#define IOTCL_ATOMIC_STORE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_SEQ_CST)
+#define IOTCL_ATOMIC_ADD_FETCH(ptr, value) __atomic_add_fetch((ptr), (value), __ATOMIC_SEQ_CST)
+#define IOTCL_ATOMIC_SUB_FETCH(ptr, value) __atomic_sub_fetch((ptr), (value), __ATOMIC_SEQ_CST)
+// Stores desired if *ptr equals *expected_ptr and returns true. Otherwise, stores *ptr into *expected_ptr.
+#define IOTCL_ATOMIC_COMPARE_EXCHANGE(ptr, expected_ptr, desired) \
+    __atomic_compare_exchange_n((ptr), (expected_ptr), (desired), 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+#else
+#define IOTCL_ATOMIC_LOAD(ptr) (*(ptr))
+#define IOTCL_ATOMIC_STORE(ptr, value) (*(ptr) = (value))
+#define IOTCL_ATOMIC_ADD_FETCH(ptr, value) (*(ptr) += (value))
+#define IOTCL_ATOMIC_SUB_FETCH(ptr, value) (*(ptr) -= (value))
+#define IOTCL_ATOMIC_COMPARE_EXCHANGE(ptr, expected_ptr, desired) \
+    (*(ptr) == *(expected_ptr) ? (*(ptr) = (desired), true) : (*(expected_ptr) = *(ptr), false))
+#endif
+#endif
+
+// Runtime statistics instrumentation. See iotcl_stats.h.
+// With IOTCL_ENABLE_STATS undefined, these compile to nothing and their arguments are not evaluated.
+#ifdef IOTCL_ENABLE_STATS
+uint32_t iotcl_stats_now_us(void);
+void iotcl_stats_add(IotclStatsCounter counter, unsigned long value);
+void iotcl_stats_record_latency(IotclStatsHistogramId histogram, uint32_t start_us);
+#define IOTCL_STATS_ADD(counter, value) iotcl_stats_add((counter), (unsigned long) (value))
+#define IOTCL_STATS_INC(counter) iotcl_stats_add((counter), 1)
+// Declares a variable that holds the start time. Must be paired with IOTCL_STATS_TIME_END.
+#define IOTCL_STATS_TIME_START(var) const uint32_t var = iotcl_stats_now_us()
+#define IOTCL_STATS_TIME_END(histogram, var) iotcl_stats_record_latency((histogram), (var))
+#else
+#define IOTCL_STATS_ADD(counter, value) do { } while (0)
+#define IOTCL_STATS_INC(counter) do { } while (0)
+#define IOTCL_STATS_TIME_START(var) do { } while (0)
+#define IOTCL_STATS_TIME_END(histogram, var) do { } while (0)
+#endif
+
+// Trace spans. See iotcl_trace.h. Names must be string literals.
+// With IOTCL_ENABLE_TRACE undefined, these compile to nothing and their arguments are not evaluated.
+#ifdef IOTCL_ENABLE_TRACE
+uint32_t iotcl_trace_now_us(void);
+void iotcl_trace_record(const char *name, uint32_t start_us);
+// Declares a variable that holds the start time of the span. Must be paired with IOTCL_TRACE_END.
+#define IOTCL_TRACE_BEGIN(var) const uint32_t var = iotcl_trace_now_us()
+#define IOTCL_TRACE_END(name, var) iotcl_trace_record((name), (var))
+#else
+#define IOTCL_TRACE_BEGIN(var) do { } while (0)
+#define IOTCL_TRACE_END(name, var) do { } while (0)
+#endif
+
+// MQTT configuration snapshots. See iotcl_mqtt_config.c.
+// Returns the current snapshot without acquiring it, or NULL.
+IotclMqttConfig *iotcl_mqtt_config_get_current(void);
+
+// Returns a new empty snapshot and a block of at least strings_size bytes into which all of its strings should be placed.
+// A reclaimed snapshot is reused if it is large enough. Returns NULL if out of memory.
+// The snapshot should be either published or discarded.
+IotclMqttConfig *iotcl_mqtt_config_create_snapshot(size_t strings_size, char **strings);
+
+// Makes the snapshot current. The previous snapshot is reclaimed once no reader is holding it.
+// Strings that are not in the snapshot's block (eg. supplied by the user with custom config) are freed at that time.
+void iotcl_mqtt_config_publish_snapshot(IotclMqttConfig *mc);
+
+// Discards a snapshot created with iotcl_mqtt_config_create_snapshot() that was not published.
+void iotcl_mqtt_config_discard_snapshot(IotclMqttConfig *mc);
+
+// Publishes an empty snapshot, if a snapshot is currently published.
+void iotcl_mqtt_config_clear(void);
+
+// Unpublishes the current snapshot and frees all snapshot memory. Only iotcl_deinit() should call this.
+void iotcl_mqtt_config_destroy(void);
+
+// Serializes the JSON item. The returned string should be freed with cJSON_free().
+// In IOTCL_NO_HEAP mode, the string is placed into the remaining space of the active arena.
+char *iotcl_json_print(cJSON *item, bool formatted);
+
+#ifdef IOTCL_NO_HEAP
+// Returns the arena that is active for the calling thread or NULL.
+IotclArena *iotcl_arena_get_active(void);
+
+// Allocates size bytes from the arena. Returns NULL if arena is NULL or if there is not enough space.
+void *iotcl_arena_alloc(IotclArena *arena, size_t size);
+
+// Evaluates expr with a temporary arena of storage_size bytes on the stack active and assigns the value to result.
+// The values allocated while evaluating expr must not be used after this statement.
+#define IOTCL_WITH_STACK_ARENA(storage_size, result, expr) \
+    do { \
+        uint8_t iotcl_arena_storage_[storage_size]; \
+        IotclArena iotcl_arena_; \
+        iotcl_arena_init(&iotcl_arena_, iotcl_arena_storage_, sizeof(iotcl_arena_storage_)); \
+        IotclArena *iotcl_previous_arena_ = iotcl_arena_activate(&iotcl_arena_); \
+        (result) = (expr); \
+        (void) iotcl_arena_activate(iotcl_previous_arena_); \
+    } while (0)
+#else
+#define IOTCL_WITH_STACK_ARENA(storage_size, result, expr) \
+    do { \
+        (result) = (expr); \
+    } while (0)
+#endif
+
+// FNV-1a hash of len bytes of str. Used by the lookup tables in this library.
+uint32_t iotcl_hash_fnv1a(const char *str, size_t len);
+
+// Buffer size that can hold any 64-bit integer in decimal, with the sign and the null terminator.
+#define IOTCL_INT64_STR_SIZE 21
+
+// Write the decimal representation of value into buffer of at least IOTCL_INT64_STR_SIZE bytes, null terminated.
+// Return the length of the text.
+size_t iotcl_uint64_to_str(uint64_t value, char *buffer);
+size_t iotcl_int64_to_str(int64_t value, char *buffer);
+
+// Buffer size that can hold any fixed-point number written by iotcl_fixed_point_to_str().
+#define IOTCL_FIXED_POINT_STR_SIZE (IOTCL_INT64_STR_SIZE + 2)
+
+// Write value * 10^-decimals in decimal into buffer of at least IOTCL_FIXED_POINT_STR_SIZE bytes, null terminated,
+// with trailing fractional zeros removed. Decimals must be from 0 to 18. Return the length of the text.
+size_t iotcl_fixed_point_to_str(int64_t value, int decimals, char *buffer);
+
+// Returns the number of decimals declared for the telemetry path, or -1 if not declared.
+// See iotcl_telemetry_precision.c.
+int iotcl_telemetry_get_precision(const char *path);
+
+// Rounds the value to the decimals (0 to IOTCL_TELEMETRY_MAX_DECIMALS) and writes it as a fixed-point number
+// into buffer of at least IOTCL_FIXED_POINT_STR_SIZE bytes. Returns false if the value is not finite
+// or too large to be rounded exactly.
+bool iotcl_telemetry_round_to_str(double value, int decimals, char *buffer);
+
+// Returns the root JSON object of the telemetry message. Used by iotcl_telemetry_template.c.
+cJSON *iotcl_telemetry_get_root(IotclMessageHandle message);
+
+#ifdef IOTCL_NO_HEAP
+// Returns the arena of the telemetry message storage.
+IotclArena *iotcl_telemetry_get_arena(IotclMessageHandle message);
+#endif
+
+// Dispatches a command event to a handler registered with iotcl_c2d_register_command() or the default command handler.
+// Returns false if no such handler is configured, in which case cmd_cb should be used.
+bool iotcl_c2d_registry_dispatch(IotclC2dEventData data, char *command_line);
+
+// Discards any acks pending in the ack outbox. Called by iotcl_deinit().
+void iotcl_ack_outbox_clear(void);
+
+// Returns true if the raw C2D message contains an ack ID that was recently seen by the duplicate filter.
+// This check is done before the message is parsed. Resends the ack for the duplicate, if configured.
+bool iotcl_c2d_dedup_check_raw(const char *data, size_t data_len);
+
+// Returns true if ack_id was recently seen. Resends the ack for the duplicate, if configured.
+bool iotcl_c2d_dedup_check(const char *ack_id);
+
+// Records ack_id as seen. Called once the message has been dispatched, so that a message that failed to be
+// processed is not dropped as a duplicate when it is redelivered.
+void iotcl_c2d_dedup_record(const char *ack_id, bool is_ota);
+
+// Records an ack status that was sent for ack_id, so that it can be sent again if a duplicate is received.
+// Also records ack_id as seen, if it is not already.
+void iotcl_c2d_dedup_record_ack_status(const char *ack_id, bool is_ota, int status);
+
+// Forgets all recorded ack IDs. Called by iotcl_deinit().
+void iotcl_c2d_dedup_clear(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -31,6 +31,20 @@ extern "C" {
 #define IOTCL_ENDLN "\r\n"
 #endif
 
+// With deferred binary logging, the text is printed later. See iotcl_binlog.h.
+#if defined(IOTCL_ENABLE_BINARY_LOG)
+#include "iotcl_binlog.h"
+#ifndef IOTCL_ERROR
+#define IOTCL_ERROR(err_code, ...) iotcl_binlog_write(IOTCL_BINLOG_LEVEL_ERROR, (err_code), __VA_ARGS__)
+#endif
+#ifndef IOTCL_WARN
+#define IOTCL_WARN(err_code, ...) iotcl_binlog_write(IOTCL_BINLOG_LEVEL_WARN, (err_code), __VA_ARGS__)
+#endif
+#ifndef IOTCL_INFO
+#define IOTCL_INFO(...) iotcl_binlog_write(IOTCL_BINLOG_LEVEL_INFO, 0, __VA_ARGS__)
+#endif
+#endif
+
 #ifndef IOTCL_ERROR
 #define IOTCL_ERROR(err_code, ...) \
     do { \
@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * High rate sample buffering for a single numeric attribute, like vibration or current sensors sampled at 1-10 kHz.
+ *
+ * Instead of creating a data set and calling iotcl_telemetry_set_number() for each sample, the sampling code
+ * adds (timestamp, value) pairs into a ring, where they are compressed the same way as in Facebook's Gorilla
+ * time series database: timestamps as delta-of-deltas and values as XOR against the previous value.
+ * A regularly sampled timestamp takes 1 bit and a slowly changing value typically takes 10-30 bits,
+ * compared to 16 bytes for a raw pair, or a few hundred bytes for a data set in a telemetry message.
+ *
+ * Later, the application flushes the ring into a telemetry message, either as one data set per sample,
+ * or as one data set per time window with the minimum, maximum, average and count of the samples in the window.
+ * The flush stops when the estimated size of the added JSON would exceed the given budget, so that the rest
+ * of the samples can be sent with the next message.
+ *
+ * The ring is made of IotclSampleBlock blocks provided by the caller. Each block starts with an uncompressed sample,
+ * so that it can be decoded on its own. Once all blocks are full, new samples are dropped (and counted)
+ * until the oldest block is flushed.
+ *
+ * One thread (or interrupt handler) can add samples while another flushes the ring, without locking.
+ * This requires IOTCL_ATOMIC_* operations to be available for your compiler. See iotcl_internal.h.
+ * Calls to iotcl_sample_ring_add() on the same ring must not run concurrently, and the same applies to flushing.
+ *
+ * Numbers are serialized with iotcl_telemetry_set_number(), so iotcl_telemetry_configure_precision()
+ * applies to the flushed values. See the PRECISION REGISTRY in iotcl_telemetry.h.
+ *
+ * Example:
+ *   static IotclSampleBlock vibration_blocks[16];
+ *   static IotclSampleRing vibration;
+ *   iotcl_sample_ring_init(&vibration, "vibration", vibration_blocks, 16);
+ *   ... in the sampling loop:
+ *   iotcl_sample_ring_add(&vibration, now_us, read_vibration());
+ *   ... periodically:
+ *   IotclSampleRingFlushOptions options = {.max_bytes = 4096, .window_ms = 100};
+ *   IotclMessageHandle msg = iotcl_telemetry_create();
+ *   iotcl_sample_ring_flush(&vibration, msg, &options, NULL);
+ *   iotcl_mqtt_send_telemetry(msg, false);
+ *   iotcl_telemetry_destroy(msg);
+ */
+
+#ifndef IOTCL_SAMPLE_RING_H
+#define IOTCL_SAMPLE_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iotcl_cfg.h"
+#include "iotcl_telemetry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Storage for compressed samples. Declare an array of these and pass it to iotcl_sample_ring_init().
+// Members are internal.
+typedef struct {
+    uint32_t count; // number of samples in the block
+    uint8_t data[IOTCL_SAMPLE_RING_BLOCK_SIZE];
+} IotclSampleBlock;
+
+// Internal: state of the previous sample that the next one is compressed against.
+typedef struct {
+    uint64_t timestamp_us;
+    int64_t delta_us;
+    uint64_t value_bits;
+    uint8_t leading_zeros; // IOTCL_SAMPLE_RING_NO_WINDOW if the value window is not set yet
+    uint8_t trailing_zeros;
+} IotclSampleCodecState;
+
+// The ring. Members are internal.
+typedef struct {
+    const char *path;
+    IotclSampleBlock *blocks;
+    uint32_t num_blocks;
+    uint32_t head; // block being written. Written only by the producer.
+    uint32_t tail; // oldest block not fully flushed. Written only by the consumer.
+    unsigned long dropped;
+    size_t path_cost; // estimated JSON length of the path, see the flush budget
+    struct {
+        IotclSampleCodecState codec;
+        uint32_t count;
+        size_t bit_pos;
+        uint8_t partial_byte;
+    } writer;
+    struct {
+        uint32_t read_count; // samples in the tail block that are already flushed
+        bool has_window;
+        uint64_t window_index;
+        double min;
+        double max;
+        double sum;
+        unsigned long count;
+    } reader;
+} IotclSampleRing;
+
+#define IOTCL_SAMPLE_RING_NO_WINDOW 0xFF
+
+typedef struct {
+    // Upper bound on the number of bytes the flush may add to the serialized message. 0 for no limit.
+    // The size of each data set is estimated conservatively, so the actual size is usually smaller.
+    size_t max_bytes;
+
+    // 0 to add one data set per sample, timestamped with millisecond precision.
+    // Otherwise, one data set is added per window of window_ms milliseconds (aligned to the Unix epoch),
+    // timestamped with the start of the window. Instead of the path, the data set contains
+    // <path>_min, <path>_max, <path>_avg and <path>_count.
+    uint32_t window_ms;
+
+    // With window_ms, the last window is kept in the ring, because more samples may fall into it later.
+    // Set this to true to add it as well, like before stopping sampling.
+    bool include_open_window;
+} IotclSampleRingFlushOptions;
+
+// Blocks are used by the ring until they are flushed. num_blocks must be a power of two, and at least 2.
+// The path must remain valid while the ring is used. Same rules as for iotcl_telemetry_set_number() apply to it.
+int iotcl_sample_ring_init(IotclSampleRing *ring, const char *path, IotclSampleBlock *blocks, size_t num_blocks);
+
+// Adds a sample. Timestamps are microseconds since the Unix epoch and should be increasing, but that is not required.
+// Returns IOTCL_ERR_OVERFLOW if the ring is full. The error is not logged, as this may happen at a high rate,
+// but the dropped samples are counted.
+int iotcl_sample_ring_add(IotclSampleRing *ring, uint64_t timestamp_us, double value);
+
+// Adds the buffered samples to the message as new data sets. See IotclSampleRingFlushOptions.
+// Options can be NULL to flush everything as one data set per sample.
+// num_data_sets, if not NULL, is set to the number of data sets that were added.
+// Returns IOTCL_ERR_OVERFLOW, without logging an error, if the budget was reached before all samples were added.
+// The remaining samples stay in the ring for the next flush.
+// If adding a data set fails, the error is returned and its samples are flushed again next time.
+// If a data set was added, but setting one of its values failed (when out of memory), the error is returned
+// and the data set is left incomplete in the message. Its samples are not flushed again, so that the message
+// never contains the same data set twice.
+int iotcl_sample_ring_flush(
+        IotclSampleRing *ring,
+        IotclMessageHandle message,
+        const IotclSampleRingFlushOptions *options,
+        size_t *num_data_sets
+);
+
+// Returns the number of samples dropped because the ring was full.
+unsigned long iotcl_sample_ring_get_dropped_count(IotclSampleRing *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCL_SAMPLE_RING_H
@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Runtime statistics: counters and latency histograms for telemetry, MQTT sends, C2D processing, acks
+ * and device REST API response parsing.
+ *
+ * Statistics are compiled in only if IOTCL_ENABLE_STATS is defined in your IOTCL_USER_CONFIG_FILE (see iotcl_cfg.h).
+ * Otherwise, the instrumentation compiles to nothing and iotcl_stats_snapshot() returns IOTCL_ERR_CONFIG_MISSING.
+ * Counters are updated atomically, so they can be collected while the library is used from multiple threads.
+ * A snapshot is not taken atomically as a whole, so related counters may be off by an operation in progress.
+ *
+ * Latencies are recorded only if a microsecond clock is provided with iotcl_stats_configure_clock().
+ * The statistics are not cleared by iotcl_init() or iotcl_deinit(). Use iotcl_stats_reset() for that.
+ *
+ * Example:
+ *   iotcl_stats_configure_clock(my_micros);
+ *   ...
+ *   IotclStatsSnapshot snapshot;
+ *   size_t length;
+ *   if (IOTCL_SUCCESS == iotcl_stats_snapshot(&snapshot)
+ *       && IOTCL_SUCCESS == iotcl_stats_export_prometheus(&snapshot, buffer, sizeof(buffer), &length)) {
+ *       // serve buffer as text/plain; version=0.0.4 on your /metrics endpoint
+ *   }
+ */
+
+#ifndef IOTCL_STATS_H
+#define IOTCL_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    IOTCL_STATS_TELEMETRY_CREATED = 0,
+    IOTCL_STATS_TELEMETRY_VALUES_SET,
+    IOTCL_STATS_TELEMETRY_ERRORS,       // failed set, add data set and serialize calls
+    IOTCL_STATS_TELEMETRY_SERIALIZED,
+    IOTCL_STATS_TELEMETRY_BYTES,        // length of serialized telemetry strings
+    IOTCL_STATS_MQTT_MESSAGES_SENT,     // telemetry and acks passed to mqtt_send_cb
+    IOTCL_STATS_MQTT_BYTES_SENT,
+    IOTCL_STATS_C2D_RECEIVED,
+    IOTCL_STATS_C2D_DISPATCHED,         // parsed and passed to the callbacks
+    IOTCL_STATS_C2D_IGNORED,            // duplicates, or otherwise ignored. See IOTCL_ERR_IGNORED.
+    IOTCL_STATS_C2D_REJECTED,           // parsing errors or unsupported messages
+    IOTCL_STATS_ACKS_CREATED,
+    IOTCL_STATS_ACKS_SENT,
+    IOTCL_STATS_DRA_RESPONSES_PARSED,   // successfully parsed discovery and identity responses
+    IOTCL_STATS_DRA_ERRORS,             // discovery and identity responses that failed to parse or reported an error
+    IOTCL_STATS_COUNTER_MAX
+} IotclStatsCounter;
+
+typedef enum {
+    IOTCL_STATS_TELEMETRY_SET_LATENCY = 0,  // iotcl_telemetry_set_* calls
+    IOTCL_STATS_TELEMETRY_SERIALIZE_LATENCY,
+    IOTCL_STATS_MQTT_SEND_LATENCY,          // time spent in mqtt_send_cb
+    IOTCL_STATS_C2D_PROCESS_LATENCY,        // parsing and dispatch, including the time spent in the user callbacks
+    IOTCL_STATS_ACK_CREATE_LATENCY,
+    IOTCL_STATS_DRA_PARSE_LATENCY,
+    IOTCL_STATS_HISTOGRAM_MAX
+} IotclStatsHistogramId;
+
+// Upper bounds of the latency histogram buckets in microseconds. An extra bucket counts all larger values.
+#define IOTCL_STATS_BUCKET_LIMITS_US {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 50000}
+#define IOTCL_STATS_NUM_BUCKETS 15
+
+typedef struct {
+    unsigned long count;
+    unsigned long sum_us;
+    unsigned long buckets[IOTCL_STATS_NUM_BUCKETS]; // number of values in each bucket. Not cumulative.
+} IotclStatsHistogram;
+
+typedef struct {
+    unsigned long counters[IOTCL_STATS_COUNTER_MAX];
+    IotclStatsHistogram histograms[IOTCL_STATS_HISTOGRAM_MAX];
+} IotclStatsSnapshot;
+
+// Should return a free-running microsecond counter. It is fine if it wraps around.
+typedef uint32_t (*IotclStatsClockFunction)(void);
+
+// Enables latency histograms. Pass NULL to disable them.
+void iotcl_stats_configure_clock(IotclStatsClockFunction now_us_fn);
+
+// Copies the current values into the snapshot.
+// Returns IOTCL_ERR_CONFIG_MISSING and a zeroed snapshot, without logging, if IOTCL_ENABLE_STATS is not defined.
+int iotcl_stats_snapshot(IotclStatsSnapshot *snapshot);
+
+void iotcl_stats_reset(void);
+
+// Writes the snapshot into the buffer in Prometheus text exposition format (version 0.0.4), null terminated.
+// length is set to the length of the text (excluding the null) even if it does not fit into the buffer,
+// so the function can be called with a NULL buffer and zero size to get the required size.
+// Returns IOTCL_ERR_OVERFLOW if the buffer is too small.
+int iotcl_stats_export_prometheus(const IotclStatsSnapshot *snapshot, char *buffer, size_t buffer_size, size_t *length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCL_STATS_H
@@ -7,7 +7,10 @@
 #define IOTCL_TELEMETRY_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
+#include "iotcl_cfg.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -23,6 +26,17 @@ typedef struct IotclMessageHandleTag *IotclMessageHandle;
  */
 IotclMessageHandle iotcl_telemetry_create(void);
 
+#ifdef IOTCL_NO_HEAP
+/*
+ * Use this function instead of iotcl_telemetry_create() when IOTCL_NO_HEAP is defined.
+ * The message handle, all of its values and its serialized string are placed in the caller provided storage.
+ * Functions in this module will fail with an out of memory error when the storage is exhausted.
+ * The storage must remain valid until the message is sent and destroyed. Destroying the message does not
+ * need to touch the storage, so the storage can be simply reused afterwards.
+ */
+IotclMessageHandle iotcl_telemetry_create_in_storage(void *storage, size_t storage_size);
+#endif
+
 /*
  * Destroys the IoTConnect message handle.
  */
@@ -46,10 +60,44 @@ int iotcl_telemetry_add_new_data_set(IotclMessageHandle message, const char *iso
  * The path argument is the name of the value the user wants to set.
  * The path argument can be passed in dot notation to set nested values of the IoTConnect OBJECT type values.
  * fore example "accelerometer.x" or "accelerometer.y" set x and y respectively in the accelerometer object.
+ * Objects can be nested to any depth, for example "motor.phase_a.current".
  * Use iotcl_telemetry_set_number to set DOUBLE, INTEGER, LONG and similar IoTConnect data types.
+ * Setting a path that is already set in the current data set replaces its value. Value names are case sensitive,
+ * but object names are matched regardless of case, so "accel.x" and "Accel.y" are set in the same object.
  */
 int iotcl_telemetry_set_number(IotclMessageHandle message, const char *path, double value);
 
+// Use these functions to set INTEGER and LONG IoTConnect types, and other integer values like counters or timestamps.
+// Unlike iotcl_telemetry_set_number(), the full 64-bit range is preserved, and serialization is faster.
+int iotcl_telemetry_set_int64(IotclMessageHandle message, const char *path, int64_t value);
+int iotcl_telemetry_set_uint64(IotclMessageHandle message, const char *path, uint64_t value);
+
+// Sets a fixed-point decimal number, which is value * 10^-decimals. For example, value 2153 with 2 decimals is 21.53.
+// Decimals can be from 0 to IOTCL_TELEMETRY_MAX_FIXED_POINT_DECIMALS. Trailing zeros are not serialized.
+// Use this for sensor readings that are already integers in scaled units to avoid floating point altogether.
+int iotcl_telemetry_set_fixed_point(IotclMessageHandle message, const char *path, int64_t value, int decimals);
+
+#define IOTCL_TELEMETRY_MAX_FIXED_POINT_DECIMALS 18
+
+// PRECISION REGISTRY
+// By default, iotcl_telemetry_set_number() values are serialized with up to 17 significant digits, for example
+// 21.53 may be serialized as 21.530000000000001. Declaring the number of decimals for a path makes the value
+// rounded and serialized as a fixed-point number with trailing zeros removed, which is shorter and faster.
+// Values that are too large to be rounded exactly (more than 2^53 after scaling) are serialized in full.
+// The registry is cleared by iotcl_deinit(), so precision should be configured after calling iotcl_init().
+// Calling iotcl_init() again to reconfigure the library keeps the declared precision.
+
+// Declares the number of decimals (0 to IOTCL_TELEMETRY_MAX_DECIMALS) for numbers set at the path, for example
+// "temperature" or "accel.x". Pass a negative value for decimals to go back to full precision.
+// The path string is not copied and must remain valid until the registry is cleared (typically a string literal).
+// Returns IOTCL_ERR_OVERFLOW if the registry is full. See IOTCL_TELEMETRY_PRECISION_REGISTRY_SIZE in iotcl_cfg.h.
+int iotcl_telemetry_configure_precision(const char *path, int decimals);
+
+#define IOTCL_TELEMETRY_MAX_DECIMALS 9
+
+// Removes all declared precisions.
+void iotcl_telemetry_clear_precision(void);
+
 // Use this function to set STRING, DATE, TIME, DATETIME and similar IoTConnect types that use JSON string.
 int iotcl_telemetry_set_string(IotclMessageHandle message, const char *path, const char *value);
 
@@ -61,6 +109,7 @@ int iotcl_telemetry_set_null(IotclMessageHandle message, const char *path);
 
 // Generates a JSON string on the heap that the user can send to the reporting topic
 // The user must call iotcl_telemetry_destroy_serialized_string() when done.
+// In IOTCL_NO_HEAP mode, the string is placed into the message storage and is valid while the message storage is valid.
 char *iotcl_telemetry_create_serialized_string(IotclMessageHandle message, bool pretty);
 
 // Frees the JSON string created by iotcl_telemetry_create_serialized_string(). Call this once the data is shipped via MQTT.
@@ -0,0 +1,98 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Pre-serialized telemetry messages for devices that send the same set of values every cycle.
+ *
+ * A template is created once from a telemetry message with a single data set. The message is serialized
+ * with each value (and the timestamp, if the data set has one) placed into a fixed-width slot. Afterwards,
+ * setting a value only formats it into its slot in the serialized string and pads the rest of the slot
+ * with spaces, which are valid JSON whitespace. No JSON objects are created or walked to send the message.
+ *
+ * Slot widths:
+ *  o Numbers, integers, fixed-point numbers and nulls: IOTCL_TELEMETRY_TEMPLATE_NUMBER_WIDTH characters.
+ *  o Booleans: 5 characters, which fits "false" and "null".
+ *  o Strings: the serialized length of the string in the message, including the quotes.
+ *    Set the string to its longest expected value before creating the template.
+ *  o The timestamp: the length of an ISO timestamp, including the quotes.
+ * Any setter can be used with any slot if the value fits. Otherwise, IOTCL_ERR_OVERFLOW is returned
+ * and the slot keeps its previous value.
+ *
+ * Precision declared with iotcl_telemetry_configure_precision() before creating the template
+ * applies to iotcl_telemetry_template_set_number().
+ *
+ * Setters and the serialized string share the same buffer, so they must not be used concurrently.
+ * Copy the string if the MQTT client keeps it while the next values are being set.
+ *
+ * Example:
+ *   IotclMessageHandle msg = iotcl_telemetry_create();
+ *   iotcl_telemetry_set_number(msg, "temperature", 0);
+ *   iotcl_telemetry_set_number(msg, "accel.x", 0);
+ *   IotclTelemetryTemplate tmpl = iotcl_telemetry_template_create(msg);
+ *   iotcl_telemetry_destroy(msg);
+ *   const int temperature = iotcl_telemetry_template_find_slot(tmpl, "temperature");
+ *   const int accel_x = iotcl_telemetry_template_find_slot(tmpl, "accel.x");
+ *   ... in the reporting loop:
+ *   iotcl_telemetry_template_set_timestamp(tmpl, NULL);
+ *   iotcl_telemetry_template_set_number(tmpl, temperature, read_temperature());
+ *   iotcl_telemetry_template_set_number(tmpl, accel_x, read_accel_x());
+ *   iotcl_mqtt_send_telemetry_template(tmpl);
+ */
+
+#ifndef IOTCL_TELEMETRY_TEMPLATE_H
+#define IOTCL_TELEMETRY_TEMPLATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iotcl_cfg.h"
+#include "iotcl_telemetry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct IotclTelemetryTemplateTag *IotclTelemetryTemplate;
+
+// Creates a template from the values of a message that has exactly one data set.
+// The message is not modified. It can be destroyed afterwards, but in IOTCL_NO_HEAP mode, the template is placed
+// in the message storage, so that storage must not be reused (eg. for the next message) while the template is used.
+// Returns NULL on error.
+IotclTelemetryTemplate iotcl_telemetry_template_create(IotclMessageHandle message);
+
+// Frees the template. In IOTCL_NO_HEAP mode, this does nothing, and the template memory is released
+// by reusing the message storage it was created from.
+void iotcl_telemetry_template_destroy(IotclTelemetryTemplate tmpl);
+
+// Returns the slot index of the value at the path, like "temperature" or "accel.x", or -1 if the template
+// does not have it. Look the slots up once, after creating the template.
+int iotcl_telemetry_template_find_slot(IotclTelemetryTemplate tmpl, const char *path);
+
+// Sets the timestamp of the data set. Pass NULL to use the current time of the configured time function.
+// Returns IOTCL_ERR_MISSING_VALUE if the message did not have a timestamp when the template was created.
+int iotcl_telemetry_template_set_timestamp(IotclTelemetryTemplate tmpl, const char *iso_timestamp);
+
+// These functions work the same way as their iotcl_telemetry_set_*() counterparts.
+int iotcl_telemetry_template_set_number(IotclTelemetryTemplate tmpl, int slot, double value);
+int iotcl_telemetry_template_set_int64(IotclTelemetryTemplate tmpl, int slot, int64_t value);
+int iotcl_telemetry_template_set_uint64(IotclTelemetryTemplate tmpl, int slot, uint64_t value);
+int iotcl_telemetry_template_set_fixed_point(IotclTelemetryTemplate tmpl, int slot, int64_t value, int decimals);
+int iotcl_telemetry_template_set_string(IotclTelemetryTemplate tmpl, int slot, const char *value);
+int iotcl_telemetry_template_set_bool(IotclTelemetryTemplate tmpl, int slot, bool value);
+int iotcl_telemetry_template_set_null(IotclTelemetryTemplate tmpl, int slot);
+
+// Returns the serialized message with the current values. The string is owned by the template
+// and its length does not change when values are set.
+const char *iotcl_telemetry_template_get_string(IotclTelemetryTemplate tmpl);
+
+// Sends the serialized message the same way as iotcl_mqtt_send_telemetry().
+int iotcl_mqtt_send_telemetry_template(IotclTelemetryTemplate tmpl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCL_TELEMETRY_TEMPLATE_H
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Pipeline tracing: timed spans around the stages of sending telemetry (timestamp generation, path parsing,
+ * adding values to the JSON tree, serialization, the transport callback), receiving and dispatching C2D messages,
+ * creating acks and parsing device REST API responses.
+ *
+ * Spans are recorded only if IOTCL_ENABLE_TRACE is defined in your IOTCL_USER_CONFIG_FILE (see iotcl_cfg.h)
+ * and a microsecond clock is provided with iotcl_trace_configure_clock(). Otherwise, the instrumentation
+ * compiles to nothing and iotcl_trace_export_chrome() returns IOTCL_ERR_CONFIG_MISSING.
+ *
+ * Each thread records into its own fixed size buffer, keeping the most recent IOTCL_TRACE_BUFFER_SIZE spans,
+ * so recording requires no locking. This requires IOTCL_THREAD_LOCAL to be defined. Otherwise, only one thread
+ * should use the library while tracing is enabled.
+ * Export while the library is idle. Spans recorded while exporting may be missing or garbled.
+ *
+ * The export is in the Chrome trace event JSON format. Open it with https://ui.perfetto.dev or chrome://tracing.
+ *
+ * Example:
+ *   iotcl_trace_configure_clock(my_micros);
+ *   iotcl_trace_set_thread_name("main");
+ *   ... send telemetry, receive C2D messages ...
+ *   size_t length;
+ *   iotcl_trace_export_chrome(NULL, 0, &length); // get the required size
+ *   char *json = malloc(length + 1);
+ *   iotcl_trace_export_chrome(json, length + 1, &length);
+ *   ... write json into a file ...
+ */
+
+#ifndef IOTCL_TRACE_H
+#define IOTCL_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Should return a free-running microsecond counter. It is fine if it wraps around, but spans that cross
+// the wraparound point will be displayed at the wrong time.
+typedef uint32_t (*IotclTraceClockFunction)(void);
+
+// Enables recording. Pass NULL to stop recording.
+void iotcl_trace_configure_clock(IotclTraceClockFunction now_us_fn);
+
+// Names the calling thread in the exported trace. The name must stay valid until the export.
+void iotcl_trace_set_thread_name(const char *name);
+
+// Writes all recorded spans into the buffer in Chrome trace event JSON format, null terminated.
+// length is set to the length of the text (excluding the null) even if it does not fit into the buffer,
+// so the function can be called with a NULL buffer and zero size to get the required size.
+// Returns IOTCL_ERR_OVERFLOW if the buffer is too small.
+int iotcl_trace_export_chrome(char *buffer, size_t buffer_size, size_t *length);
+
+// Discards all recorded spans. Thread names are kept.
+void iotcl_trace_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCL_TRACE_H
@@ -3,7 +3,9 @@
  * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
  */
 
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -13,11 +15,21 @@
 #include "iotcl_internal.h"
 #include "iotcl_util.h"
 #include "iotcl.h"
+#include "iotcl_telemetry_template.h"
 
 static IotclGlobalConfig config = {0};
 
+// The empty snapshot published by iotcl_init() with IOTCL_DCT_CUSTOM, which the user is allowed to fill in.
+static IotclMqttConfig *custom_mqtt_config = NULL;
+
+#ifdef IOTCL_NO_HEAP
+static IOTCL_THREAD_LOCAL IotclArena *active_arena = NULL;
+#endif
+
+#ifndef IOTCL_NO_HEAP
 static IoTclMallocFunction cfg_malloc_fn = malloc;
 static IoTclFreeFunction cfg_free_fn = free;
+#endif
 
 static bool iotcl_topics_match_cfg(const char *cfg_topic, const char *topic, size_t topic_length) {
     if (!topic || 0 == topic_length || !cfg_topic) {
@@ -32,10 +44,66 @@ static bool iotcl_topics_match_cfg(const char *cfg_topic, const char *topic, siz
     return (cfg_topic[topic_length] == 0);
 }
 
+static bool iotcl_topic_is_sub_c2d(const char *topic, size_t topic_length) {
+    const IotclMqttConfig *mc = iotcl_mqtt_acquire_config();
+    const bool is_match = mc && iotcl_topics_match_cfg(mc->sub_c2d, topic, topic_length);
+    iotcl_mqtt_release_config(mc);
+    return is_match;
+}
+
 static void print_value_if_not_null(const char* heading, const char* value) {
     if (value) IOTCL_INFO("%s: %s", heading, value);
 }
 
+#ifdef IOTCL_NO_HEAP
+// Alignment suitable for any of the structures allocated by the library and cJSON
+#define IOTCL_ARENA_ALIGNMENT sizeof(union { void *p; double d; long long l; })
+
+void iotcl_arena_init(IotclArena *arena, void *storage, size_t storage_size) {
+    arena->buffer = (uint8_t *) storage;
+    arena->size = storage ? storage_size : 0;
+    arena->used = 0;
+}
+
+IotclArena *iotcl_arena_activate(IotclArena *arena) {
+    IotclArena *previous = active_arena;
+    active_arena = arena;
+    return previous;
+}
+
+IotclArena *iotcl_arena_get_active(void) {
+    return active_arena;
+}
+
+void *iotcl_arena_alloc(IotclArena *arena, size_t size) {
+    if (!arena || !arena->buffer) {
+        return NULL;
+    }
+    const uintptr_t base = (uintptr_t) arena->buffer;
+    const uintptr_t aligned = (base + arena->used + IOTCL_ARENA_ALIGNMENT - 1) & ~((uintptr_t) IOTCL_ARENA_ALIGNMENT - 1);
+    const size_t start = (size_t) (aligned - base);
+    if (start > arena->size || size > arena->size - start) {
+        return NULL;
+    }
+    arena->used = start + size;
+    return &arena->buffer[start];
+}
+
+void *iotcl_malloc(size_t size) {
+    return iotcl_arena_alloc(active_arena, size);
+}
+
+void iotcl_free(void *ptr) {
+    // memory is released when the arena storage is discarded
+    (void) ptr;
+}
+
+void iotcl_configure_dynamic_memory(IoTclMallocFunction malloc_fn, IoTclFreeFunction free_fn) {
+    (void) malloc_fn;
+    (void) free_fn;
+    IOTCL_ERROR(IOTCL_ERR_CONFIG_ERROR, "iotcl_configure_dynamic_memory: Cannot be used when IOTCL_NO_HEAP is defined");
+}
+#else
 void *iotcl_malloc(size_t size) {
     return cfg_malloc_fn(size);
 }
@@ -60,23 +128,63 @@ void iotcl_configure_dynamic_memory(IoTclMallocFunction malloc_fn, IoTclFreeFunc
     cjson_hooks.free_fn = free_fn;
     cJSON_InitHooks(&cjson_hooks);
 }
+#endif
 
 void iotcl_init_client_config(IotclClientConfig *c) {
     memset(c, 0, sizeof(IotclClientConfig));
 }
 
-int iotcl_init(IotclClientConfig *c) {
-    int ret;
-    iotcl_deinit();
+// Upper bound for the length of a string produced by a format with only %s specifiers, including the null terminator.
+// A "%s" is two characters long, so the format length plus the lengths of arguments is always sufficient.
+#define IOTCL_FORMAT_SIZE_BOUND(format, args_len) (sizeof(format) + (args_len))
+
+// Formats a string into the mqtt config snapshot strings block at *p and advances *p past the null terminator.
+static char *iotcl_mqtt_config_block_printf(char **p, const char *end, const char *format, ...) {
+    char *str = *p;
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(str, (size_t) (end - str), format, args);
+    va_end(args);
+    // the block is sized with IOTCL_FORMAT_SIZE_BOUND, so this should never happen
+    if (len < 0 || (size_t) len >= (size_t) (end - str)) {
+        IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "iotcl_init: Topic string does not fit into the allocated block!");
+        return NULL;
+    }
+    *p += len + 1;
+    return str;
+}
+
+// Updates the global config in place. Each field goes from the old value to the new one directly,
+// so that a re-init never exposes a zeroed config to the threads that are still using the library.
+static void iotcl_apply_client_config(const IotclClientConfig *c) {
+    config.disable_printable_check = c->disable_printable_check;
+    memcpy(&config.event_functions, &c->events, sizeof(config.event_functions));
+    config.time_fn = c->time_fn;
+    config.ack_outbox = c->ack_outbox;
+    config.parallel = c->parallel;
+    config.mqtt_send_cb = c->mqtt_send_cb;
+    config.is_valid = true;
+}
+
+// Validates the client config and builds the new MQTT configuration snapshot before touching the current
+// configuration. The new snapshot replaces the current one with a single atomic pointer store,
+// so concurrent readers see either the old or the new configuration, but never none.
+// The ack outbox, the command registry, the duplicate filter cache and the telemetry precision registry are kept,
+// and cleared by iotcl_deinit() only.
+static int iotcl_configure(IotclClientConfig *c) {
+#ifdef IOTCL_NO_HEAP
+    // route all cJSON allocations to the active arena
+    cJSON_Hooks cjson_hooks;
+    cjson_hooks.malloc_fn = iotcl_malloc;
+    cjson_hooks.free_fn = iotcl_free;
+    cJSON_InitHooks(&cjson_hooks);
+#endif
 
     if (NULL == c) {
         IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_init: Client config is NULL");
         return IOTCL_ERR_MISSING_VALUE;
     }
 
-    config.disable_printable_check = c->disable_printable_check;
-
-
     // Shortcuts for shorter conditions
     const IotclDeviceConfigType itype = c->device.instance_type;
 
@@ -109,114 +217,110 @@ int iotcl_init(IotclClientConfig *c) {
         return IOTCL_ERR_MISSING_VALUE;
     }
 
-    memcpy(&config.event_functions, &c->events, sizeof(config.event_functions));
-    config.time_fn = c->time_fn;
-    config.mqtt_send_cb = c->mqtt_send_cb;
+    if (c->ack_outbox.max_pending < 0 || c->ack_outbox.max_pending > IOTCL_ACK_OUTBOX_CAPACITY) {
+        IOTCL_ERROR(IOTCL_ERR_CONFIG_ERROR, "iotcl_init: Ack outbox max_pending must be between 0 and %d", IOTCL_ACK_OUTBOX_CAPACITY);
+        return IOTCL_ERR_CONFIG_ERROR;
+    }
+
+    if (c->ack_outbox.max_delay_s > 0 && !c->time_fn) {
+        IOTCL_ERROR(IOTCL_ERR_CONFIG_ERROR, "iotcl_init: Ack outbox max_delay_s requires time_fn to be configured");
+        return IOTCL_ERR_CONFIG_ERROR;
+    }
+
+    if (c->parallel.executor && c->parallel.num_jobs < 2) {
+        IOTCL_ERROR(IOTCL_ERR_CONFIG_ERROR, "iotcl_init: Parallel executor requires num_jobs to be at least 2");
+        return IOTCL_ERR_CONFIG_ERROR;
+    }
 
     // MQTT configuration is not processed for custom configs, so skip it altogether to simplify the logic below
     if (is_custom) {
-        config.is_valid = true;
+        // publish an empty snapshot that the user can fill in through iotcl_mqtt_get_custom_config()
+        IotclMqttConfig *custom_mc = iotcl_mqtt_config_create_snapshot(0, NULL);
+        if (!custom_mc) goto cleanup_print_oom;
+        iotcl_mqtt_config_publish_snapshot(custom_mc);
+        custom_mqtt_config = custom_mc;
+        iotcl_apply_client_config(c);
         return IOTCL_SUCCESS;
     }
 
-    char *p; // "that last string allocated" - shortcut for OOM checks and sprintfs
+    // Compute the size of all strings in a single pass so that they can be stored in a single block
+    const size_t duid_len = strlen(c->device.duid);
+    const size_t client_id_len = is_shared ? strlen(c->device.cpid) + 1 + duid_len : duid_len;
+    const size_t host_len = c->device.host ? strlen(c->device.host) : 0;
+    const size_t cd_len = is_azure ? strlen(c->device.cd) : 0;
+    size_t block_size = client_id_len + 1;
+    if (c->device.host) {
+        block_size += host_len + 1;
+    }
+    if (is_azure) {
+        block_size += IOTCL_FORMAT_SIZE_BOUND(IOTCL_AZURE_USERNAME_FORMAT, host_len + client_id_len);
+        block_size += IOTCL_FORMAT_SIZE_BOUND(IOTCL_AZURE_PUB_RPT_FORMAT, client_id_len + cd_len);
+        block_size += IOTCL_FORMAT_SIZE_BOUND(IOTCL_AZURE_PUB_ACK_FORMAT, client_id_len + cd_len);
+        block_size += IOTCL_FORMAT_SIZE_BOUND(IOTCL_AZURE_SUB_C2D_FORMAT, client_id_len);
+        block_size += cd_len + 1;
+    } else {
+        block_size += IOTCL_FORMAT_SIZE_BOUND(IOTCL_AWS_PUB_RPT_FORMAT, client_id_len);
+        block_size += IOTCL_FORMAT_SIZE_BOUND(IOTCL_AWS_PUB_ACK_FORMAT, client_id_len);
+        block_size += IOTCL_FORMAT_SIZE_BOUND(IOTCL_AWS_SUB_C2D_FORMAT, client_id_len);
+    }
+
+    char *p = NULL;
+    IotclMqttConfig *mc = iotcl_mqtt_config_create_snapshot(block_size, &p);
+    if (!mc) goto cleanup_print_oom;
+    const char *end = p + block_size;
+
     if (is_shared) {
-        p = config.mqtt_config.client_id = iotcl_malloc(strlen(c->device.duid) + strlen(c->device.cpid) + 1);
-        if (!p) goto cleanup_print_oom;
-        strcpy(p, c->device.cpid);
-        strcat(p, "-");
-        strcat(p, c->device.duid);
+        mc->client_id = iotcl_mqtt_config_block_printf(&p, end, "%s-%s", c->device.cpid, c->device.duid);
     } else {
-        p = config.mqtt_config.client_id = iotcl_strdup(c->device.duid);
-        if (!p) goto cleanup_print_oom;
+        mc->client_id = iotcl_mqtt_config_block_printf(&p, end, "%s", c->device.duid);
     }
+    if (!mc->client_id) goto cleanup;
 
     if (c->device.host) {
-        p = config.mqtt_config.host = iotcl_strdup(c->device.host);
-        if (!p) goto cleanup_print_oom;
+        mc->host = iotcl_mqtt_config_block_printf(&p, end, "%s", c->device.host);
+        if (!mc->host) goto cleanup;
     }
 
-    config.mqtt_config.version = IOTCL_PROTOCOL_VERSION_DEFAULT;
+    mc->version = IOTCL_PROTOCOL_VERSION_DEFAULT;
 
     if (is_azure) {
-        // we use snprintf with null to calculate buffer size
-        p = config.mqtt_config.username = iotcl_malloc(
-                1 + (size_t) snprintf(NULL, 0, IOTCL_AZURE_USERNAME_FORMAT,
-                             config.mqtt_config.host,
-                             config.mqtt_config.client_id
-                )
-        );
-        if (!p) goto cleanup_print_oom;
-        sprintf(p, IOTCL_AZURE_USERNAME_FORMAT, config.mqtt_config.host, config.mqtt_config.client_id);
-
-        p = config.mqtt_config.pub_rpt = iotcl_malloc(
-                1 + (size_t) snprintf(NULL, 0, IOTCL_AZURE_PUB_RPT_FORMAT,
-                             config.mqtt_config.host,
-                             config.mqtt_config.client_id
-                )
-        );
-        if (!p) goto cleanup_print_oom;
-        sprintf(p, IOTCL_AZURE_PUB_RPT_FORMAT, config.mqtt_config.client_id, c->device.cd);
-
-        p = config.mqtt_config.pub_ack = iotcl_malloc(
-                1 + (size_t) snprintf(NULL, 0, IOTCL_AZURE_PUB_ACK_FORMAT,
-                             config.mqtt_config.client_id,
-                             c->device.cd
-                )
-        );
-        if (!p) goto cleanup_print_oom;
-        sprintf(p, IOTCL_AZURE_PUB_ACK_FORMAT, config.mqtt_config.client_id, c->device.cd);
-
-        p = config.mqtt_config.sub_c2d = iotcl_malloc(
-                1 + (size_t) snprintf(NULL, 0, IOTCL_AZURE_SUB_C2D_FORMAT,
-                             config.mqtt_config.client_id
-                )
-        );
-        if (!p) goto cleanup_print_oom;
-        sprintf(p, IOTCL_AZURE_SUB_C2D_FORMAT, config.mqtt_config.client_id);
-
-        p = config.mqtt_config.cd = iotcl_strdup(c->device.cd);
-        if (!p) goto cleanup_print_oom;
-
+        mc->username = iotcl_mqtt_config_block_printf(&p, end, IOTCL_AZURE_USERNAME_FORMAT, mc->host, mc->client_id);
+        mc->pub_rpt = iotcl_mqtt_config_block_printf(&p, end, IOTCL_AZURE_PUB_RPT_FORMAT, mc->client_id, c->device.cd);
+        mc->pub_ack = iotcl_mqtt_config_block_printf(&p, end, IOTCL_AZURE_PUB_ACK_FORMAT, mc->client_id, c->device.cd);
+        mc->sub_c2d = iotcl_mqtt_config_block_printf(&p, end, IOTCL_AZURE_SUB_C2D_FORMAT, mc->client_id);
+        mc->cd = iotcl_mqtt_config_block_printf(&p, end, "%s", c->device.cd);
+        if (!mc->username || !mc->pub_rpt || !mc->pub_ack || !mc->sub_c2d || !mc->cd) goto cleanup;
     } else {
-        p = config.mqtt_config.pub_rpt = iotcl_malloc(
-                1 + (size_t) snprintf(NULL, 0, IOTCL_AWS_PUB_RPT_FORMAT,
-                             config.mqtt_config.client_id
-                )
-        );
-        if (!p) goto cleanup_print_oom;
-        sprintf(p, IOTCL_AWS_PUB_RPT_FORMAT, config.mqtt_config.client_id);
-
-        p = config.mqtt_config.pub_ack = iotcl_malloc(
-                1 + (size_t) snprintf(NULL, 0,IOTCL_AWS_PUB_ACK_FORMAT,
-                             config.mqtt_config.client_id
-                )
-        );
-        if (!p) goto cleanup_print_oom;
-        sprintf(p, IOTCL_AWS_PUB_ACK_FORMAT, config.mqtt_config.client_id);
-
-        p = config.mqtt_config.sub_c2d = iotcl_malloc(
-                1 + (size_t) snprintf(NULL, 0, IOTCL_AWS_SUB_C2D_FORMAT,
-                             config.mqtt_config.client_id
-                )
-        );
-        if (!p) goto cleanup_print_oom;
-        sprintf(p, IOTCL_AWS_SUB_C2D_FORMAT, config.mqtt_config.client_id);
+        mc->pub_rpt = iotcl_mqtt_config_block_printf(&p, end, IOTCL_AWS_PUB_RPT_FORMAT, mc->client_id);
+        mc->pub_ack = iotcl_mqtt_config_block_printf(&p, end, IOTCL_AWS_PUB_ACK_FORMAT, mc->client_id);
+        mc->sub_c2d = iotcl_mqtt_config_block_printf(&p, end, IOTCL_AWS_SUB_C2D_FORMAT, mc->client_id);
+        if (!mc->pub_rpt || !mc->pub_ack || !mc->sub_c2d) goto cleanup;
     }
 
-    config.is_valid = true;
+    iotcl_mqtt_config_publish_snapshot(mc);
+    custom_mqtt_config = NULL;
+    iotcl_apply_client_config(c);
     return IOTCL_SUCCESS;
 
     cleanup_print_oom:
     IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "iotcl_init: Out of memory error while allocating topic strings!");
-    ret = IOTCL_ERR_OUT_OF_MEMORY;
+    return IOTCL_ERR_OUT_OF_MEMORY;
 
-    // free up everything and invalidate the config
-    iotcl_deinit();
+    cleanup:
+    iotcl_mqtt_config_discard_snapshot(mc);
+    return IOTCL_ERR_OVERFLOW; // the called function will print the error
+}
 
-    return ret; // default IOTCL_ERR_OUT_OF_MEMORY, if not set
+int iotcl_init(IotclClientConfig *c) {
+    int status = iotcl_configure(c);
+    if (IOTCL_SUCCESS != status) {
+        // free up everything and invalidate the config
+        iotcl_deinit();
+    }
+    return status;
 }
 
+
 int iotcl_init_and_print_config(IotclClientConfig *c) {
     int status = iotcl_init(c);
     if (IOTCL_SUCCESS != status) {
@@ -231,15 +335,13 @@ int iotcl_init_and_print_config(IotclClientConfig *c) {
 }
 
 void iotcl_deinit(void) {
+    iotcl_ack_outbox_clear();
+    iotcl_c2d_clear_commands();
+    iotcl_c2d_dedup_clear();
+    iotcl_telemetry_clear_precision();
 
-    iotcl_free(config.mqtt_config.username);
-    iotcl_free(config.mqtt_config.client_id);
-    iotcl_free(config.mqtt_config.host);
-    iotcl_free(config.mqtt_config.pub_rpt);
-    iotcl_free(config.mqtt_config.pub_ack);
-    iotcl_free(config.mqtt_config.sub_c2d);
-    iotcl_free(config.mqtt_config.cd);
-    // config.mqtt_config.version is a constant string always in this implementation
+    custom_mqtt_config = NULL;
+    iotcl_mqtt_config_destroy();
 
     // config.is_valid = false; after memset
     memset(&config, 0, sizeof(config));
@@ -260,15 +362,27 @@ IotclMqttConfig *iotcl_mqtt_get_config(void) {
         IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "iotcl_get_global_config: IotConnect Library is not configured!");
         return NULL;
     }
-    return &config.mqtt_config;
+    return iotcl_mqtt_config_get_current();
 }
+
+IotclMqttConfig *iotcl_mqtt_get_custom_config(void) {
+    if (!custom_mqtt_config || custom_mqtt_config != iotcl_mqtt_config_get_current()) {
+        IOTCL_ERROR(IOTCL_ERR_CONFIG_ERROR, "iotcl_mqtt_get_custom_config: The library is not configured with IOTCL_DCT_CUSTOM or the MQTT configuration was already replaced!");
+        return NULL;
+    }
+    return custom_mqtt_config;
+}
+
 void iotcl_mqtt_print_config(void) {
     if (!config.is_valid) {
         // if the user intended to configure the library topics etc. manually, they can init with "custom" instance type.
         IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "iotcl_get_global_config: IotConnect Library is not configured!");
         return;
     }
-    IotclMqttConfig* mc = &config.mqtt_config;
+    const IotclMqttConfig *mc = iotcl_mqtt_acquire_config();
+    if (!mc) {
+        return;
+    }
     IOTCL_INFO("-- IOTCL MQTT Config --");
     print_value_if_not_null("Client ID", mc->client_id);
     print_value_if_not_null("Username ", mc->username);
@@ -277,27 +391,96 @@ void iotcl_mqtt_print_config(void) {
     print_value_if_not_null("Pub ACK  ", mc->pub_ack);
     print_value_if_not_null("Sub C2D  ", mc->sub_c2d);
     print_value_if_not_null("CD       ", mc->cd);
+    iotcl_mqtt_release_config(mc);
 }
 
-int iotcl_mqtt_send_telemetry(IotclMessageHandle msg, bool pretty) {
+// Passes the message to the user's send callback, which must be configured
+static void iotcl_mqtt_send_message(const char *topic, const char *json_str) {
+    IOTCL_STATS_TIME_START(stats_start);
+    IOTCL_TRACE_BEGIN(trace_start);
+    config.mqtt_send_cb(topic, json_str);
+    IOTCL_TRACE_END("mqtt_send_cb", trace_start);
+    IOTCL_STATS_TIME_END(IOTCL_STATS_MQTT_SEND_LATENCY, stats_start);
+    IOTCL_STATS_INC(IOTCL_STATS_MQTT_MESSAGES_SENT);
+    IOTCL_STATS_ADD(IOTCL_STATS_MQTT_BYTES_SENT, strlen(json_str));
+}
+
+// Sends the template string if tmpl is not NULL, or serializes and sends the message
+static int iotcl_mqtt_send_report(const char *function_name, IotclMessageHandle msg, bool pretty, IotclTelemetryTemplate tmpl) {
     if (!config.is_valid) {
-        IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "iotcl_mqtt_send_telemetry: Library not configured!");
+        IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "%s: Library not configured!", function_name);
         return IOTCL_ERR_CONFIG_MISSING;
     }
-    if (!config.mqtt_config.pub_rpt) {
-        IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "iotcl_mqtt_send_telemetry: pub_rpt topic is not configured!");
-        return IOTCL_ERR_CONFIG_MISSING;
+    int status = IOTCL_SUCCESS;
+    IOTCL_TRACE_BEGIN(trace_start);
+    const IotclMqttConfig *mc = iotcl_mqtt_acquire_config();
+    if (!mc || !mc->pub_rpt) {
+        IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "%s: pub_rpt topic is not configured!", function_name);
+        status = IOTCL_ERR_CONFIG_MISSING;
+        goto cleanup;
     }
     if (!config.mqtt_send_cb) {
-        IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "iotcl_mqtt_send_telemetry: mqtt_send_cb callback is not configured!");
+        IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "%s: mqtt_send_cb callback is not configured!", function_name);
+        status = IOTCL_ERR_CONFIG_MISSING;
+        goto cleanup;
+    }
+    if (iotcl_mqtt_get_pending_ack_count() > 0) {
+        // acks take priority over telemetry. The called function will print any errors.
+        IOTCL_TRACE_BEGIN(flush_start);
+        (void) iotcl_mqtt_flush_acks();
+        IOTCL_TRACE_END("flush_acks", flush_start);
+    }
+    if (tmpl) {
+        const char *json_str = iotcl_telemetry_template_get_string(tmpl);
+        iotcl_mqtt_send_message(mc->pub_rpt, json_str);
+        IOTCL_STATS_INC(IOTCL_STATS_TELEMETRY_SERIALIZED);
+        IOTCL_STATS_ADD(IOTCL_STATS_TELEMETRY_BYTES, strlen(json_str));
+        goto cleanup;
+    }
+    char *json_str = iotcl_telemetry_create_serialized_string(msg, pretty);
+    if (!json_str) {
+        status = IOTCL_ERR_FAILED; // called function will print the error
+        goto cleanup;
+    }
+    iotcl_mqtt_send_message(mc->pub_rpt, json_str);
+    iotcl_telemetry_destroy_serialized_string(json_str);
+
+    cleanup:
+    iotcl_mqtt_release_config(mc);
+    IOTCL_TRACE_END("iotcl_mqtt_send_telemetry", trace_start);
+    return status;
+}
+
+int iotcl_mqtt_send_telemetry(IotclMessageHandle msg, bool pretty) {
+    return iotcl_mqtt_send_report("iotcl_mqtt_send_telemetry", msg, pretty, NULL);
+}
+
+int iotcl_mqtt_send_telemetry_template(IotclTelemetryTemplate tmpl) {
+    if (!tmpl) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_mqtt_send_telemetry_template: The template argument is required!");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    return iotcl_mqtt_send_report("iotcl_mqtt_send_telemetry_template", NULL, false, tmpl);
+}
+
+static int iotcl_mqtt_publish_ack(bool is_ota, const char *ack_id, int status, const char *message) {
+    const IotclMqttConfig *mc = iotcl_mqtt_acquire_config();
+    if (!mc || !mc->pub_ack) {
+        IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "iotcl_mqtt_send_%s_ack: pub_ack topic is not configured!", is_ota ? "ota" : "cmd");
+        iotcl_mqtt_release_config(mc);
         return IOTCL_ERR_CONFIG_MISSING;
     }
-    char * json_str = iotcl_telemetry_create_serialized_string(msg, pretty);
+    char *json_str = is_ota ?
+                     iotcl_c2d_create_ota_ack_json(ack_id, status, message) :
+                     iotcl_c2d_create_cmd_ack_json(ack_id, status, message);
     if (!json_str) {
+        iotcl_mqtt_release_config(mc);
         return IOTCL_ERR_FAILED; // called function will print the error
     }
-    config.mqtt_send_cb(config.mqtt_config.pub_rpt, json_str);
-    iotcl_telemetry_destroy_serialized_string(json_str);
+    iotcl_mqtt_send_message(mc->pub_ack, json_str);
+    IOTCL_STATS_INC(IOTCL_STATS_ACKS_SENT);
+    iotcl_c2d_destroy_ack_json(json_str);
+    iotcl_mqtt_release_config(mc);
     return IOTCL_SUCCESS;
 }
 
@@ -306,20 +489,16 @@ int iotcl_mqtt_send_ota_ack(const char *ack_id, int ota_status, const char *mess
         IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "iotcl_mqtt_send_ota_ack: Library not configured!");
         return IOTCL_ERR_CONFIG_MISSING;
     }
-    if (!config.mqtt_config.pub_ack) {
-        IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "iotcl_mqtt_send_ota_ack: pub_ack topic is not configured!");
-        return IOTCL_ERR_CONFIG_MISSING;
-    }
     if (!config.mqtt_send_cb) {
         IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "iotcl_mqtt_send_ota_ack: mqtt_send_cb callback is not configured!");
         return IOTCL_ERR_CONFIG_MISSING;
     }
-    char *json_str = iotcl_c2d_create_ota_ack_json(ack_id, ota_status, message);
-    if (!json_str) {
-        return IOTCL_ERR_FAILED; // called function will print the error
+    int status;
+    IOTCL_WITH_STACK_ARENA(IOTCL_NO_HEAP_ACK_STORAGE_SIZE, status, iotcl_mqtt_publish_ack(true, ack_id, ota_status, message));
+    if (IOTCL_SUCCESS != status) {
+        return status; // called function will print the error
     }
-    config.mqtt_send_cb(config.mqtt_config.pub_ack, json_str);
-    iotcl_c2d_destroy_ack_json(json_str);
+    iotcl_c2d_dedup_record_ack_status(ack_id, true, ota_status);
     return IOTCL_SUCCESS;
 }
 
@@ -328,20 +507,16 @@ int iotcl_mqtt_send_cmd_ack(const char *ack_id, int cmd_status, const char *mess
         IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "iotcl_mqtt_send_cmd_ack: Library not configured!");
         return IOTCL_ERR_CONFIG_MISSING;
     }
-    if (!config.mqtt_config.pub_ack) {
-        IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "iotcl_mqtt_send_cmd_ack: pub_rpt topic is not configured!");
-        return IOTCL_ERR_CONFIG_MISSING;
-    }
     if (!config.mqtt_send_cb) {
         IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "iotcl_mqtt_send_cmd_ack: mqtt_send_cb callback is not configured!");
         return IOTCL_ERR_CONFIG_MISSING;
     }
-    char *json_str = iotcl_c2d_create_cmd_ack_json(ack_id, cmd_status, message);
-    if (!json_str) {
-        return IOTCL_ERR_FAILED; // called function will print the error
+    int status;
+    IOTCL_WITH_STACK_ARENA(IOTCL_NO_HEAP_ACK_STORAGE_SIZE, status, iotcl_mqtt_publish_ack(false, ack_id, cmd_status, message));
+    if (IOTCL_SUCCESS != status) {
+        return status; // called function will print the error
     }
-    config.mqtt_send_cb(config.mqtt_config.pub_ack, json_str);
-    iotcl_c2d_destroy_ack_json(json_str);
+    iotcl_c2d_dedup_record_ack_status(ack_id, false, cmd_status);
     return IOTCL_SUCCESS;
 }
 
@@ -354,7 +529,7 @@ int iotcl_mqtt_receive(const char *topic_name, const char *str) {
     if (!iotcl_is_printable("iotcl_mqtt_receive_with_length: topic_name", topic_name, topic_len)) {
         return IOTCL_ERR_BAD_VALUE;
     }
-    if (!iotcl_topics_match_cfg(config.mqtt_config.sub_c2d, topic_name, topic_len)) {
+    if (!iotcl_topic_is_sub_c2d(topic_name, topic_len)) {
         return IOTCL_ERR_IGNORED;
     }
     return iotcl_mqtt_receive_c2d(str);
@@ -369,7 +544,7 @@ int iotcl_mqtt_receive_with_length(const char *topic_name, const uint8_t *data,
     if (!iotcl_is_printable("iotcl_mqtt_receive_with_length: topic_name", topic_name, topic_len)) {
         return IOTCL_ERR_BAD_VALUE;
     }
-    if (!iotcl_topics_match_cfg(config.mqtt_config.sub_c2d, topic_name, topic_len)) {
+    if (!iotcl_topic_is_sub_c2d(topic_name, topic_len)) {
         return IOTCL_ERR_IGNORED;
     }
     return iotcl_mqtt_receive_c2d_with_length(data, data_len);
@@ -379,13 +554,19 @@ int iotcl_mqtt_receive_c2d(const char *str) {
     if (!iotcl_is_printable("iotcl_mqtt_receive: str", str, strlen(str))) {
         return IOTCL_ERR_BAD_VALUE;
     }
-    return iotcl_c2d_process_event(str);
+    IOTCL_TRACE_BEGIN(trace_start);
+    const int status = iotcl_c2d_process_event(str);
+    IOTCL_TRACE_END("iotcl_mqtt_receive_c2d", trace_start);
+    return status;
 }
 
 int iotcl_mqtt_receive_c2d_with_length(const uint8_t *data, size_t data_len) {
     if (!iotcl_is_printable("iotcl_mqtt_receive_with_length: str", (const char *) data, data_len)) {
         return IOTCL_ERR_BAD_VALUE;
     }
-    return iotcl_c2d_process_event_with_length(data, data_len);
+    IOTCL_TRACE_BEGIN(trace_start);
+    const int status = iotcl_c2d_process_event_with_length(data, data_len);
+    IOTCL_TRACE_END("iotcl_mqtt_receive_c2d", trace_start);
+    return status;
 }
 
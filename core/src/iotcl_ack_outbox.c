@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "iotcl_log.h"
+#include "iotcl_internal.h"
+#include "iotcl.h"
+
+typedef struct {
+    char ack_id[IOTCL_MAX_ACK_LENGTH + 1];
+    char message[IOTCL_ACK_OUTBOX_MSG_MAX_LEN + 1];
+    int status;
+    bool is_ota;
+} IotclAckOutboxEntry;
+
+static struct {
+    IotclAckOutboxEntry entries[IOTCL_ACK_OUTBOX_CAPACITY];
+    int count;
+    time_t oldest_queued_at; // Only valid if time_fn is configured and there are pending entries
+} outbox;
+
+static int iotcl_ack_outbox_send(bool is_ota, const char *ack_id, int status, const char *message) {
+    if (is_ota) {
+        return iotcl_mqtt_send_ota_ack(ack_id, status, message);
+    } else {
+        return iotcl_mqtt_send_cmd_ack(ack_id, status, message);
+    }
+}
+
+static int iotcl_ack_outbox_queue(
+        const char *function_name,
+        bool is_ota,
+        const char *ack_id,
+        int status,
+        const char *message
+) {
+    IotclGlobalConfig *config = iotcl_get_global_config();
+    if (!config->is_valid) {
+        return IOTCL_ERR_CONFIG_MISSING; // called function will print the error
+    }
+    if (!ack_id || 0 == strlen(ack_id)) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: ack_id is required!", function_name);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+
+    // outbox is disabled
+    if (0 == config->ack_outbox.max_pending) {
+        return iotcl_ack_outbox_send(is_ota, ack_id, status, message);
+    }
+
+    const size_t ack_id_len = strlen(ack_id);
+    if (ack_id_len > IOTCL_MAX_ACK_LENGTH) {
+        IOTCL_WARN(IOTCL_ERR_OVERFLOW, "%s: Ack ID \"%s\" is too long to be queued. Sending it now.", function_name, ack_id);
+        return iotcl_ack_outbox_send(is_ota, ack_id, status, message);
+    }
+
+    // Only the last status for an ack ID is relevant to the back end, so update the pending entry, if there is one.
+    IotclAckOutboxEntry *entry = NULL;
+    for (int i = 0; i < outbox.count; i++) {
+        if (outbox.entries[i].is_ota == is_ota && 0 == strcmp(outbox.entries[i].ack_id, ack_id)) {
+            entry = &outbox.entries[i];
+            break;
+        }
+    }
+
+    if (!entry) {
+        if (0 == outbox.count && config->time_fn) {
+            outbox.oldest_queued_at = config->time_fn();
+        }
+        entry = &outbox.entries[outbox.count];
+        outbox.count++;
+        memcpy(entry->ack_id, ack_id, ack_id_len + 1);
+        entry->is_ota = is_ota;
+    }
+
+    entry->status = status;
+    entry->message[0] = '\0';
+    if (message) {
+        size_t message_len = strlen(message);
+        if (message_len > IOTCL_ACK_OUTBOX_MSG_MAX_LEN) {
+            IOTCL_WARN(IOTCL_ERR_OVERFLOW, "%s: Ack message will be truncated to %d characters", function_name, IOTCL_ACK_OUTBOX_MSG_MAX_LEN);
+            message_len = IOTCL_ACK_OUTBOX_MSG_MAX_LEN;
+        }
+        memcpy(entry->message, message, message_len);
+        entry->message[message_len] = '\0';
+    }
+
+    if (outbox.count >= config->ack_outbox.max_pending) {
+        return iotcl_mqtt_flush_acks();
+    }
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_mqtt_queue_cmd_ack(const char *ack_id, int cmd_status, const char *message) {
+    return iotcl_ack_outbox_queue("iotcl_mqtt_queue_cmd_ack", false, ack_id, cmd_status, message);
+}
+
+int iotcl_mqtt_queue_ota_ack(const char *ack_id, int ota_status, const char *message) {
+    return iotcl_ack_outbox_queue("iotcl_mqtt_queue_ota_ack", true, ack_id, ota_status, message);
+}
+
+int iotcl_mqtt_flush_acks(void) {
+    int status = IOTCL_SUCCESS;
+    for (int i = 0; i < outbox.count; i++) {
+        const IotclAckOutboxEntry *entry = &outbox.entries[i];
+        int send_status = iotcl_ack_outbox_send(entry->is_ota, entry->ack_id, entry->status, entry->message);
+        if (IOTCL_SUCCESS != send_status) {
+            status = send_status; // the called function will print the error
+        }
+    }
+    // failed acks are dropped like they would be if they were sent immediately
+    outbox.count = 0;
+    return status;
+}
+
+int iotcl_mqtt_flush_acks_if_due(void) {
+    if (0 == outbox.count) {
+        return IOTCL_SUCCESS;
+    }
+    IotclGlobalConfig *config = iotcl_get_global_config();
+    if (!config->is_valid) {
+        return IOTCL_ERR_CONFIG_MISSING; // called function will print the error
+    }
+    if (config->ack_outbox.max_delay_s <= 0 || !config->time_fn) {
+        return IOTCL_SUCCESS;
+    }
+    if (difftime(config->time_fn(), outbox.oldest_queued_at) >= config->ack_outbox.max_delay_s) {
+        return iotcl_mqtt_flush_acks();
+    }
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_mqtt_get_pending_ack_count(void) {
+    return outbox.count;
+}
+
+void iotcl_ack_outbox_clear(void) {
+    if (outbox.count > 0) {
+        IOTCL_WARN(IOTCL_ERR_IGNORED, "Discarding %d pending acks from the ack outbox", outbox.count);
+    }
+    outbox.count = 0;
+}
@@ -0,0 +1,561 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "iotcl_internal.h"
+#include "iotcl_cfg.h"
+#include "iotcl_log.h"
+#include "iotcl_binlog.h"
+
+// IOTCL_ERROR and similar macros must not be used in this file, as they may end up calling back into it.
+
+// Buffer used to format a single record by iotcl_binlog_drain()
+#define IOTCL_BINLOG_LINE_MAX_LEN 256
+
+// Longest conversion specification that will be copied and passed to snprintf, like "%-+#012.*lld"
+#define IOTCL_BINLOG_SPEC_MAX_LEN 16
+
+typedef enum {
+    IOTCL_BINLOG_ARG_NONE = 0, // %%
+    IOTCL_BINLOG_ARG_INT,
+    IOTCL_BINLOG_ARG_LONG,
+    IOTCL_BINLOG_ARG_LLONG,
+    IOTCL_BINLOG_ARG_SIZE,
+    IOTCL_BINLOG_ARG_DOUBLE,
+    IOTCL_BINLOG_ARG_STRING,
+    IOTCL_BINLOG_ARG_POINTER,
+    IOTCL_BINLOG_ARG_UNSUPPORTED
+} IotclBinlogArgType;
+
+typedef struct {
+    IotclBinlogArgType type;
+    int num_stars;      // number of int arguments for width and precision that precede the value
+    bool has_precision; // a precision is given, either as a number or with a *
+    bool is_precision_star;
+    int precision;      // if given as a number
+    size_t length;      // length of the specification, including the %
+} IotclBinlogSpec;
+
+// Parses the conversion specification that starts with the % at format.
+static void iotcl_binlog_parse_spec(const char *format, IotclBinlogSpec *spec) {
+    const char *p = &format[1];
+    int long_count = 0;
+    bool is_size = false;
+
+    memset(spec, 0, sizeof(IotclBinlogSpec));
+    while (*p && strchr("-+ #0", *p)) p++;
+    if ('*' == *p) {
+        spec->num_stars++;
+        p++;
+    }
+    while (*p >= '0' && *p <= '9') p++;
+    if ('.' == *p) {
+        p++;
+        spec->has_precision = true;
+        if ('*' == *p) {
+            spec->num_stars++;
+            spec->is_precision_star = true;
+            p++;
+        }
+        while (*p >= '0' && *p <= '9') {
+            spec->precision = spec->precision * 10 + (*p - '0');
+            p++;
+        }
+    }
+    for (;; p++) {
+        if ('l' == *p) {
+            long_count++;
+        } else if ('z' == *p) {
+            is_size = true;
+        } else if ('h' != *p) {
+            break;
+        }
+    }
+
+    spec->type = IOTCL_BINLOG_ARG_UNSUPPORTED;
+    switch (*p) {
+        case '%':
+            spec->type = IOTCL_BINLOG_ARG_NONE;
+            break;
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+        case 'c':
+            if (is_size) {
+                spec->type = IOTCL_BINLOG_ARG_SIZE;
+            } else if (long_count > 1) {
+                spec->type = IOTCL_BINLOG_ARG_LLONG;
+            } else if (long_count > 0) {
+                spec->type = IOTCL_BINLOG_ARG_LONG;
+            } else {
+                spec->type = IOTCL_BINLOG_ARG_INT; // char and short are promoted to int
+            }
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            spec->type = IOTCL_BINLOG_ARG_DOUBLE;
+            break;
+        case 's':
+            spec->type = long_count ? IOTCL_BINLOG_ARG_UNSUPPORTED : IOTCL_BINLOG_ARG_STRING;
+            break;
+        case 'p':
+            spec->type = IOTCL_BINLOG_ARG_POINTER;
+            break;
+        default:
+            break;
+    }
+    if (*p) {
+        p++;
+    }
+    spec->length = (size_t) (p - format);
+}
+
+static IotclBinlogClockFunction clock_fn = NULL;
+
+void iotcl_binlog_configure_clock(IotclBinlogClockFunction now_ms_fn) {
+    IOTCL_ATOMIC_STORE(&clock_fn, now_ms_fn);
+}
+
+#ifdef IOTCL_ENABLE_BINARY_LOG
+
+#if (IOTCL_BINLOG_RING_SIZE & (IOTCL_BINLOG_RING_SIZE - 1)) != 0
+#error "IOTCL_BINLOG_RING_SIZE must be a power of two"
+#endif
+#if (IOTCL_BINLOG_RATE_LIMIT_SITES & (IOTCL_BINLOG_RATE_LIMIT_SITES - 1)) != 0
+#error "IOTCL_BINLOG_RATE_LIMIT_SITES must be a power of two"
+#endif
+
+// Bounded multi-producer multi-consumer queue (D. Vyukov). A cell can be written when its sequence equals
+// the enqueue position and read when it equals the dequeue position + 1. To avoid the need for an init function,
+// the cell index is subtracted from the stored sequence, so that zeroed memory is the initial state.
+typedef struct {
+    size_t sequence;
+    IotclBinlogRecord record;
+} IotclBinlogCell;
+
+typedef struct {
+    const char *format;     // claimed once and never released, until iotcl_binlog_reset()
+    uint32_t window_start_ms;
+    uint32_t count;         // records in the current window
+    uint32_t suppressed;
+} IotclBinlogSite;
+
+static IotclBinlogCell cells[IOTCL_BINLOG_RING_SIZE];
+static size_t enqueue_pos = 0;
+static size_t dequeue_pos = 0;
+static unsigned long dropped_count = 0;
+static unsigned long dropped_count_reported = 0;
+static IotclBinlogSite sites[IOTCL_BINLOG_RATE_LIMIT_SITES];
+
+// Returns the site for the log statement, or NULL if the table is full.
+static IotclBinlogSite *iotcl_binlog_find_site(const char *format) {
+    const uintptr_t hash = (uintptr_t) format;
+    size_t index = (size_t) ((hash >> 3) ^ (hash >> 11)) & (IOTCL_BINLOG_RATE_LIMIT_SITES - 1);
+    for (int i = 0; i < IOTCL_BINLOG_RATE_LIMIT_SITES; i++) {
+        IotclBinlogSite *site = &sites[index];
+        const char *site_format = IOTCL_ATOMIC_LOAD(&site->format);
+        if (site_format == format) {
+            return site;
+        }
+        if (!site_format) {
+            const char *expected = NULL;
+            if (IOTCL_ATOMIC_COMPARE_EXCHANGE(&site->format, &expected, format) || expected == format) {
+                return site;
+            }
+        }
+        index = (index + 1) & (IOTCL_BINLOG_RATE_LIMIT_SITES - 1);
+    }
+    return NULL;
+}
+
+// Returns false if the record should be dropped. Otherwise, returns the number of records suppressed so far.
+// Counting is not exact when multiple threads log from the same statement at the window boundary.
+static bool iotcl_binlog_rate_limit(const char *format, uint32_t now_ms, uint16_t *suppressed) {
+    IotclBinlogSite *site = iotcl_binlog_find_site(format);
+    if (!site) {
+        return true;
+    }
+    const uint32_t window_start_ms = IOTCL_ATOMIC_LOAD(&site->window_start_ms);
+    if ((uint32_t) (now_ms - window_start_ms) >= IOTCL_BINLOG_RATE_LIMIT_WINDOW_MS
+        || 0 == IOTCL_ATOMIC_LOAD(&site->count)) {
+        IOTCL_ATOMIC_STORE(&site->window_start_ms, now_ms);
+        IOTCL_ATOMIC_STORE(&site->count, 0);
+    }
+    if (IOTCL_ATOMIC_ADD_FETCH(&site->count, 1) > IOTCL_BINLOG_RATE_LIMIT_BURST) {
+        IOTCL_ATOMIC_ADD_FETCH(&site->suppressed, 1);
+        return false;
+    }
+    uint32_t count = IOTCL_ATOMIC_LOAD(&site->suppressed);
+    while (count && !IOTCL_ATOMIC_COMPARE_EXCHANGE(&site->suppressed, &count, 0)) {
+        // another thread changed the count. Try again.
+    }
+    *suppressed = (uint16_t) (count > UINT16_MAX ? UINT16_MAX : count);
+    return true;
+}
+
+// Copies the string into the record and returns its offset. The last byte of strings is always kept null.
+static uint64_t iotcl_binlog_copy_string(IotclBinlogRecord *r, size_t *used, const char *str, const IotclBinlogSpec *spec,
+                                         int star_precision) {
+    static const char *const null_str = "(null)";
+    const size_t offset = *used;
+    const size_t available = IOTCL_BINLOG_STRING_SPACE - 1 - offset;
+    size_t limit = available;
+    size_t len = 0;
+
+    if (!str) {
+        str = null_str;
+    }
+    if (spec->has_precision) {
+        const int precision = spec->is_precision_star ? star_precision : spec->precision;
+        if (precision >= 0 && (size_t) precision < limit) {
+            limit = (size_t) precision;
+        }
+    }
+    while (len < limit && str[len]) {
+        r->strings[offset + len] = str[len];
+        len++;
+    }
+    // mark truncation if the string did not fit, as opposed to being limited by the precision
+    if (len == available && str[len] && len >= 3) {
+        memcpy(&r->strings[offset + len - 3], "...", 3);
+    }
+    if (offset + len < IOTCL_BINLOG_STRING_SPACE - 1) {
+        r->strings[offset + len] = '\0';
+        *used = offset + len + 1;
+    } else {
+        *used = IOTCL_BINLOG_STRING_SPACE - 1;
+    }
+    return (uint64_t) offset;
+}
+
+static void iotcl_binlog_capture_args(IotclBinlogRecord *r, const char *format, va_list args) {
+    size_t strings_used = 0;
+    r->num_args = 0;
+    r->strings[IOTCL_BINLOG_STRING_SPACE - 1] = '\0';
+
+    for (const char *p = strchr(format, '%'); p; p = strchr(p, '%')) {
+        IotclBinlogSpec spec;
+        iotcl_binlog_parse_spec(p, &spec);
+        p += spec.length;
+        if (IOTCL_BINLOG_ARG_NONE == spec.type) {
+            continue;
+        }
+        if (IOTCL_BINLOG_ARG_UNSUPPORTED == spec.type
+            || r->num_args + spec.num_stars + 1 > IOTCL_BINLOG_MAX_ARGS) {
+            // the remaining arguments cannot be reliably fetched
+            return;
+        }
+        int star_value = 0;
+        for (int i = 0; i < spec.num_stars; i++) {
+            star_value = va_arg(args, int);
+            r->args[r->num_args++] = (uint64_t) (int64_t) star_value;
+        }
+        uint64_t value = 0;
+        switch (spec.type) {
+            case IOTCL_BINLOG_ARG_INT:
+                value = (uint64_t) (int64_t) va_arg(args, int);
+                break;
+            case IOTCL_BINLOG_ARG_LONG:
+                value = (uint64_t) (int64_t) va_arg(args, long);
+                break;
+            case IOTCL_BINLOG_ARG_LLONG:
+                value = (uint64_t) va_arg(args, long long);
+                break;
+            case IOTCL_BINLOG_ARG_SIZE:
+                value = (uint64_t) va_arg(args, size_t);
+                break;
+            case IOTCL_BINLOG_ARG_DOUBLE: {
+                const double d = va_arg(args, double);
+                memcpy(&value, &d, sizeof(value));
+                break;
+            }
+            case IOTCL_BINLOG_ARG_STRING:
+                value = iotcl_binlog_copy_string(r, &strings_used, va_arg(args, const char *), &spec, star_value);
+                break;
+            case IOTCL_BINLOG_ARG_POINTER:
+                value = (uint64_t) (uintptr_t) va_arg(args, void *);
+                break;
+            default:
+                break;
+        }
+        r->args[r->num_args++] = value;
+    }
+}
+
+void iotcl_binlog_write(IotclBinlogLevel level, int err_code, const char *format, ...) {
+    IotclBinlogClockFunction fn = IOTCL_ATOMIC_LOAD(&clock_fn);
+    const uint32_t now_ms = fn ? fn() : 0;
+    uint16_t suppressed = 0;
+
+    if (!format) {
+        return;
+    }
+    if (fn && IOTCL_BINLOG_LEVEL_INFO != level && !iotcl_binlog_rate_limit(format, now_ms, &suppressed)) {
+        return;
+    }
+
+    // claim a cell
+    IotclBinlogCell *cell;
+    size_t pos = IOTCL_ATOMIC_LOAD(&enqueue_pos);
+    for (;;) {
+        cell = &cells[pos & (IOTCL_BINLOG_RING_SIZE - 1)];
+        const size_t sequence = IOTCL_ATOMIC_LOAD(&cell->sequence) + (pos & (IOTCL_BINLOG_RING_SIZE - 1));
+        if (sequence == pos) {
+            if (IOTCL_ATOMIC_COMPARE_EXCHANGE(&enqueue_pos, &pos, pos + 1)) {
+                break;
+            }
+        } else if ((ptrdiff_t) (sequence - pos) < 0) {
+            IOTCL_ATOMIC_ADD_FETCH(&dropped_count, 1);
+            return;
+        } else {
+            pos = IOTCL_ATOMIC_LOAD(&enqueue_pos);
+        }
+    }
+
+    IotclBinlogRecord *r = &cell->record;
+    r->format = format;
+    r->timestamp_ms = now_ms;
+    r->err_code = err_code;
+    r->suppressed = suppressed;
+    r->level = (uint8_t) level;
+    va_list args;
+    va_start(args, format);
+    iotcl_binlog_capture_args(r, format, args);
+    va_end(args);
+
+    // publish
+    IOTCL_ATOMIC_STORE(&cell->sequence, pos + 1 - (pos & (IOTCL_BINLOG_RING_SIZE - 1)));
+}
+
+bool iotcl_binlog_read(IotclBinlogRecord *record) {
+    IotclBinlogCell *cell;
+    size_t pos = IOTCL_ATOMIC_LOAD(&dequeue_pos);
+    for (;;) {
+        cell = &cells[pos & (IOTCL_BINLOG_RING_SIZE - 1)];
+        const size_t sequence = IOTCL_ATOMIC_LOAD(&cell->sequence) + (pos & (IOTCL_BINLOG_RING_SIZE - 1));
+        if (sequence == pos + 1) {
+            if (IOTCL_ATOMIC_COMPARE_EXCHANGE(&dequeue_pos, &pos, pos + 1)) {
+                break;
+            }
+        } else if ((ptrdiff_t) (sequence - (pos + 1)) < 0) {
+            return false; // empty
+        } else {
+            pos = IOTCL_ATOMIC_LOAD(&dequeue_pos);
+        }
+    }
+    memcpy(record, &cell->record, sizeof(IotclBinlogRecord));
+    // release the cell for the writer one lap ahead
+    IOTCL_ATOMIC_STORE(&cell->sequence, pos + IOTCL_BINLOG_RING_SIZE - (pos & (IOTCL_BINLOG_RING_SIZE - 1)));
+    return true;
+}
+
+unsigned long iotcl_binlog_get_dropped_count(void) {
+    return IOTCL_ATOMIC_LOAD(&dropped_count);
+}
+
+void iotcl_binlog_reset(void) {
+    memset(cells, 0, sizeof(cells));
+    memset(sites, 0, sizeof(sites));
+    IOTCL_ATOMIC_STORE(&enqueue_pos, 0);
+    IOTCL_ATOMIC_STORE(&dequeue_pos, 0);
+    IOTCL_ATOMIC_STORE(&dropped_count, 0);
+    IOTCL_ATOMIC_STORE(&dropped_count_reported, 0);
+}
+
+#else
+
+void iotcl_binlog_write(IotclBinlogLevel level, int err_code, const char *format, ...) {
+    (void) level;
+    (void) err_code;
+    (void) format;
+}
+
+bool iotcl_binlog_read(IotclBinlogRecord *record) {
+    (void) record;
+    return false;
+}
+
+unsigned long iotcl_binlog_get_dropped_count(void) {
+    return 0;
+}
+
+void iotcl_binlog_reset(void) {
+}
+
+#endif // IOTCL_ENABLE_BINARY_LOG
+
+typedef struct {
+    char *buffer;
+    size_t size;
+    size_t length;
+} IotclBinlogWriter;
+
+// Appends to the buffer while it fits and keeps counting the length beyond that.
+static void iotcl_binlog_append(IotclBinlogWriter *w, const char *format, ...) {
+    va_list args;
+    char *dest = NULL;
+    size_t remaining = 0;
+    if (w->buffer && w->length < w->size) {
+        dest = &w->buffer[w->length];
+        remaining = w->size - w->length;
+    }
+    va_start(args, format);
+    const int len = vsnprintf(dest, remaining, format, args);
+    va_end(args);
+    if (len > 0) {
+        w->length += (size_t) len;
+    }
+}
+
+static void iotcl_binlog_append_text(IotclBinlogWriter *w, const char *text, size_t len) {
+    if (len > (size_t) INT32_MAX) {
+        len = (size_t) INT32_MAX;
+    }
+    iotcl_binlog_append(w, "%.*s", (int) len, text);
+}
+
+size_t iotcl_binlog_format(const IotclBinlogRecord *record, char *buffer, size_t buffer_size) {
+    IotclBinlogWriter w = {buffer, buffer_size, 0};
+    const char *p = record ? record->format : NULL;
+    int arg_index = 0;
+
+    if (buffer && buffer_size > 0) {
+        buffer[0] = '\0';
+    }
+    if (!p) {
+        return 0;
+    }
+    for (;;) {
+        const char *percent = strchr(p, '%');
+        if (!percent) {
+            iotcl_binlog_append_text(&w, p, strlen(p));
+            break;
+        }
+        iotcl_binlog_append_text(&w, p, (size_t) (percent - p));
+
+        IotclBinlogSpec spec;
+        iotcl_binlog_parse_spec(percent, &spec);
+        p = &percent[spec.length];
+        if (IOTCL_BINLOG_ARG_NONE == spec.type) {
+            iotcl_binlog_append(&w, "%%");
+            continue;
+        }
+        if (IOTCL_BINLOG_ARG_UNSUPPORTED == spec.type || spec.length >= IOTCL_BINLOG_SPEC_MAX_LEN
+            || arg_index + spec.num_stars + 1 > record->num_args) {
+            // the argument was not captured. Print the specification as is.
+            iotcl_binlog_append_text(&w, percent, spec.length);
+            if (IOTCL_BINLOG_ARG_UNSUPPORTED == spec.type) {
+                iotcl_binlog_append_text(&w, p, strlen(p));
+                break;
+            }
+            continue;
+        }
+
+        char spec_str[IOTCL_BINLOG_SPEC_MAX_LEN];
+        memcpy(spec_str, percent, spec.length);
+        spec_str[spec.length] = '\0';
+        int stars[2] = {0, 0};
+        for (int i = 0; i < spec.num_stars; i++) {
+            stars[i] = (int) (int64_t) record->args[arg_index++];
+        }
+        const uint64_t value = record->args[arg_index++];
+
+        // The values are passed with their original types, so the specification can be handed to snprintf.
+        // Unused trailing arguments are ignored by snprintf.
+#define IOTCL_BINLOG_APPEND_VALUE(v) \
+        do { \
+            if (0 == spec.num_stars) iotcl_binlog_append(&w, spec_str, v); \
+            else if (1 == spec.num_stars) iotcl_binlog_append(&w, spec_str, stars[0], v); \
+            else iotcl_binlog_append(&w, spec_str, stars[0], stars[1], v); \
+        } while (0)
+
+        switch (spec.type) {
+            case IOTCL_BINLOG_ARG_INT:
+                IOTCL_BINLOG_APPEND_VALUE((int) (int64_t) value);
+                break;
+            case IOTCL_BINLOG_ARG_LONG:
+                IOTCL_BINLOG_APPEND_VALUE((long) (int64_t) value);
+                break;
+            case IOTCL_BINLOG_ARG_LLONG:
+                IOTCL_BINLOG_APPEND_VALUE((long long) value);
+                break;
+            case IOTCL_BINLOG_ARG_SIZE:
+                IOTCL_BINLOG_APPEND_VALUE((size_t) value);
+                break;
+            case IOTCL_BINLOG_ARG_DOUBLE: {
+                double d;
+                memcpy(&d, &value, sizeof(d));
+                IOTCL_BINLOG_APPEND_VALUE(d);
+                break;
+            }
+            case IOTCL_BINLOG_ARG_STRING:
+                IOTCL_BINLOG_APPEND_VALUE(value < IOTCL_BINLOG_STRING_SPACE ? &record->strings[value] : "");
+                break;
+            case IOTCL_BINLOG_ARG_POINTER:
+                IOTCL_BINLOG_APPEND_VALUE((void *) (uintptr_t) value);
+                break;
+            default:
+                break;
+        }
+#undef IOTCL_BINLOG_APPEND_VALUE
+    }
+    return w.length;
+}
+
+int iotcl_binlog_drain(IotclBinlogSinkFunction sink, void *context) {
+    IotclBinlogRecord record;
+    char text[IOTCL_BINLOG_LINE_MAX_LEN];
+    int count = 0;
+    while (iotcl_binlog_read(&record)) {
+        iotcl_binlog_format(&record, text, sizeof(text));
+        if (sink) {
+            sink(context, &record, text);
+        }
+        count++;
+    }
+    return count;
+}
+
+static void iotcl_binlog_print_sink(void *context, const IotclBinlogRecord *record, const char *text) {
+    (void) context;
+    if (record->suppressed) {
+        printf("IOTCL WARN [%d]: %u similar messages were suppressed%s", IOTCL_ERR_IGNORED, (unsigned int) record->suppressed, IOTCL_ENDLN);
+    }
+    switch (record->level) {
+        case IOTCL_BINLOG_LEVEL_ERROR:
+            printf("IOTCL ERROR [%d]: %s%s", record->err_code, text, IOTCL_ENDLN);
+            break;
+        case IOTCL_BINLOG_LEVEL_WARN:
+            printf("IOTCL WARN [%d]: %s%s", record->err_code, text, IOTCL_ENDLN);
+            break;
+        default:
+            printf("%s%s", text, IOTCL_ENDLN);
+            break;
+    }
+}
+
+void iotcl_binlog_print_pending(void) {
+    iotcl_binlog_drain(iotcl_binlog_print_sink, NULL);
+#ifdef IOTCL_ENABLE_BINARY_LOG
+    const unsigned long dropped = IOTCL_ATOMIC_LOAD(&dropped_count);
+    const unsigned long reported = IOTCL_ATOMIC_LOAD(&dropped_count_reported);
+    if (dropped != reported) {
+        IOTCL_ATOMIC_STORE(&dropped_count_reported, dropped);
+        printf("IOTCL WARN [%d]: %lu log messages were dropped%s", IOTCL_ERR_OVERFLOW, dropped - reported, IOTCL_ENDLN);
+    }
+#endif
+}
@@ -36,10 +36,21 @@ typedef enum {
     IOTCL_C2D_ET_STOP_HEARTBEAT = 111,
 } IotclC2dEventType;
 
+// OTA URL table entry. Built once when an OTA event is dispatched, so that the getters do not need to search or allocate.
+typedef struct {
+    const char *url;        // Points into the parsed JSON. NULL if the array item has no "url" string.
+    const char *hostname;   // Null terminated copy stored along with the table. NULL if url is not valid.
+    const char *resource;   // Points into the URL, right after the hostname. NULL if url is not valid.
+    const char *filename;   // Points into the parsed JSON.
+    size_t url_len;
+    size_t hostname_len;
+} IotclC2dOtaUrl;
+
 struct IotclC2dEventDataTag {
     cJSON *root;
     IotclC2dEventType type;
-    char *hostname; // May ore may not be allocated. Temporary storage for parsed hostname string.
+    IotclC2dOtaUrl *ota_urls; // OTA events only. A single allocation holding the table and hostname strings.
+    int ota_url_count;
 };
 
 static int iotcl_c2d_process_callback(struct IotclC2dEventDataTag *event_data) {
@@ -50,11 +61,17 @@ static int iotcl_c2d_process_callback(struct IotclC2dEventDataTag *event_data) {
     }
 
     switch (event_data->type) {
-        case IOTCL_C2D_ET_DEVICE_COMMAND:
+        case IOTCL_C2D_ET_DEVICE_COMMAND: {
+            cJSON *j_cmd = cJSON_GetObjectItemCaseSensitive(event_data->root, "cmd");
+            char *command_line = cJSON_IsString(j_cmd) ? j_cmd->valuestring : NULL;
+            if (iotcl_c2d_registry_dispatch(event_data, command_line)) {
+                break;
+            }
             if (config->event_functions.cmd_cb) {
                 config->event_functions.cmd_cb(event_data);
             }
             break;
+        }
         case IOTCL_C2D_ET_DEVICE_OTA:
             if (config->event_functions.ota_cb) {
                 config->event_functions.ota_cb(event_data);
@@ -72,6 +89,81 @@ static bool is_valid_string(const cJSON *json) {
     return (NULL != json && cJSON_IsString(json) && json->valuestring != NULL);
 }
 
+// Splits the URL into hostname and resource. Returns false if URL is not valid.
+static bool iotcl_c2d_split_ota_url(const char *url, const char **hostname, size_t *hostname_len, const char **resource) {
+    const size_t https_prefix_len = strlen(HTTPS_PREFIX);
+    if (!url || 0 != strncmp(url, HTTPS_PREFIX, https_prefix_len)) {
+        return false;
+    }
+    *hostname = &url[https_prefix_len];
+    *resource = strchr(*hostname, '/');
+    if (!*resource || *resource == *hostname) {
+        return false;
+    }
+    *hostname_len = (size_t) (*resource - *hostname);
+    return true;
+}
+
+static int iotcl_c2d_build_ota_url_table(struct IotclC2dEventDataTag *event_data) {
+    cJSON *urls = cJSON_GetObjectItemCaseSensitive(event_data->root, "urls");
+    if (NULL == urls || !cJSON_IsArray(urls)) {
+        // let the user handle the event anyway. They will get errors when attempting to access the URLs.
+        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "the \"urls\" array is not found in c2d response");
+        return IOTCL_SUCCESS;
+    }
+
+    // first pass: count the items and compute the storage needed for hostname strings
+    int count = 0;
+    size_t hostnames_size = 0;
+    cJSON *item;
+    cJSON_ArrayForEach(item, urls) {
+        const char *hostname;
+        const char *resource;
+        size_t hostname_len;
+        const char *url = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "url"));
+        if (iotcl_c2d_split_ota_url(url, &hostname, &hostname_len, &resource)) {
+            hostnames_size += hostname_len + 1;
+        }
+        count++;
+    }
+    if (0 == count) {
+        return IOTCL_SUCCESS;
+    }
+
+    IotclC2dOtaUrl *table = iotcl_malloc((size_t) count * sizeof(IotclC2dOtaUrl) + hostnames_size);
+    if (!table) {
+        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "Out of memory while allocating the OTA URL table");
+        return IOTCL_ERR_OUT_OF_MEMORY;
+    }
+    char *hostnames = (char *) &table[count];
+
+    // second pass: fill the table
+    int i = 0;
+    cJSON_ArrayForEach(item, urls) {
+        IotclC2dOtaUrl *entry = &table[i];
+        const char *hostname;
+        size_t hostname_len;
+        memset(entry, 0, sizeof(IotclC2dOtaUrl));
+        entry->url = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "url"));
+        entry->filename = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "fileName"));
+        if (entry->url) {
+            entry->url_len = strlen(entry->url);
+        }
+        if (iotcl_c2d_split_ota_url(entry->url, &hostname, &hostname_len, &entry->resource)) {
+            memcpy(hostnames, hostname, hostname_len);
+            hostnames[hostname_len] = '\0';
+            entry->hostname = hostnames;
+            entry->hostname_len = hostname_len;
+            hostnames += hostname_len + 1;
+        }
+        i++;
+    }
+
+    event_data->ota_urls = table;
+    event_data->ota_url_count = count;
+    return IOTCL_SUCCESS;
+}
+
 static int iotcl_c2d_parse_json(cJSON *root) {
     int status; // unknown in case someone forgot to set it
 
@@ -103,13 +195,40 @@ static int iotcl_c2d_parse_json(cJSON *root) {
         goto cleanup;
     }
 
+    const char *ack_id = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(root, "ack"));
+    if (iotcl_c2d_dedup_check(ack_id)) {
+        status = IOTCL_ERR_IGNORED; // the called function will print a warning
+        goto cleanup;
+    }
+    // The callback may destroy the event, so keep a copy of the ack ID to record it after dispatching.
+    // Ack IDs that are too long are not recorded by the duplicate filter anyway.
+    char dedup_ack_id[IOTCL_MAX_ACK_LENGTH + 1] = "";
+    if (ack_id && strlen(ack_id) < sizeof(dedup_ack_id)) {
+        strcpy(dedup_ack_id, ack_id);
+    }
+
     struct IotclC2dEventDataTag event_data = {0};
     event_data.root = root;
     event_data.type = type;
 
     root = NULL; // Clear this pointer to avoid a double free in case some other step that can fail is added below
 
+    if (IOTCL_C2D_ET_DEVICE_OTA == event_data.type) {
+        IOTCL_TRACE_BEGIN(trace_start);
+        status = iotcl_c2d_build_ota_url_table(&event_data);
+        IOTCL_TRACE_END("c2d_ota_urls", trace_start);
+        if (IOTCL_SUCCESS != status) {
+            iotcl_c2d_destroy_event(&event_data); // the called function will print the error
+            return status;
+        }
+    }
+
+    IOTCL_TRACE_BEGIN(trace_start);
     status = iotcl_c2d_process_callback(&event_data);
+    IOTCL_TRACE_END("c2d_dispatch", trace_start);
+    if (IOTCL_SUCCESS == status) {
+        iotcl_c2d_dedup_record(dedup_ack_id, IOTCL_C2D_ET_DEVICE_OTA == type);
+    }
     iotcl_c2d_destroy_event(&event_data);
     return status;
 
@@ -142,30 +261,25 @@ static int iotcl_c2d_validate_data_and_type(
     return IOTCL_SUCCESS;
 }
 
-static cJSON *iotcl_c2d_get_ota_url_array_item(IotclC2dEventData data, int index) {
-    if (IOTCL_SUCCESS != iotcl_c2d_validate_data_and_type(data, IOTCL_C2D_ET_DEVICE_OTA, "download URL")) {
-        return NULL;
-    }
-    cJSON *urls = cJSON_GetObjectItemCaseSensitive(data->root, "urls");
-    if (NULL == urls || !cJSON_IsArray(urls)) {
-        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "the \"urls\" array is not found in c2d response");
+static const IotclC2dOtaUrl *iotcl_c2d_get_ota_url_entry(IotclC2dEventData data, int index, const char *what) {
+    if (IOTCL_SUCCESS != iotcl_c2d_validate_data_and_type(data, IOTCL_C2D_ET_DEVICE_OTA, what)) {
         return NULL;
     }
-    if (index < 0 || cJSON_GetArraySize(urls) > index) {
-        // this URL should never be null...
-        return cJSON_GetArrayItem(urls, (int) index);
-    } else {
+    if (index < 0 || index >= data->ota_url_count) {
         IOTCL_ERROR(
                 IOTCL_ERR_BAD_VALUE,
                 "Attempting to access the OTA url item at index %d, but there are only %d items in the array",
-                (int) index,
-                cJSON_GetArraySize(urls)
+                index,
+                data->ota_url_count
         );
         return NULL;
     }
+    return &data->ota_urls[index];
 }
 
 static char *iotcl_c2d_create_ack(IotclC2dEventType type, const char *ack_id, int status, const char *message) {
+    IOTCL_STATS_TIME_START(stats_start);
+    IOTCL_TRACE_BEGIN(trace_start);
     char *result = NULL;
 
     cJSON *ack_json = cJSON_CreateObject();
@@ -179,11 +293,14 @@ static char *iotcl_c2d_create_ack(IotclC2dEventType type, const char *ack_id, in
     if (message && strlen(message) > 0) {
         if (!cJSON_AddStringToObject(ack_d, "msg", message)) goto cleanup;
     }
-    result = cJSON_PrintUnformatted(ack_json);
+    result = iotcl_json_print(ack_json, false);
     if (!result) goto cleanup;
 
     cJSON_Delete(ack_json);
 
+    IOTCL_STATS_INC(IOTCL_STATS_ACKS_CREATED);
+    IOTCL_STATS_TIME_END(IOTCL_STATS_ACK_CREATE_LATENCY, stats_start);
+    IOTCL_TRACE_END("ack_create", trace_start);
     return result;
 
     cleanup:
@@ -194,8 +311,16 @@ static char *iotcl_c2d_create_ack(IotclC2dEventType type, const char *ack_id, in
     return NULL;
 }
 
-int iotcl_c2d_process_event(const char *str) {
+static int iotcl_c2d_parse_and_process(const char *str) {
+    IOTCL_TRACE_BEGIN(dedup_start);
+    const bool is_duplicate = iotcl_c2d_dedup_check_raw(str, strlen(str));
+    IOTCL_TRACE_END("c2d_dedup", dedup_start);
+    if (is_duplicate) {
+        return IOTCL_ERR_IGNORED; // the called function will print a warning
+    }
+    IOTCL_TRACE_BEGIN(parse_start);
     cJSON *root = cJSON_Parse(str);
+    IOTCL_TRACE_END("c2d_json_parse", parse_start);
     if (!root) {
         IOTCL_ERROR(
                 IOTCL_ERR_PARSING_ERROR,
@@ -207,8 +332,16 @@ int iotcl_c2d_process_event(const char *str) {
     return iotcl_c2d_parse_json(root);
 }
 
-int iotcl_c2d_process_event_with_length(const uint8_t *data, size_t data_len) {
+static int iotcl_c2d_parse_and_process_with_length(const uint8_t *data, size_t data_len) {
+    IOTCL_TRACE_BEGIN(dedup_start);
+    const bool is_duplicate = iotcl_c2d_dedup_check_raw((const char *) data, data_len);
+    IOTCL_TRACE_END("c2d_dedup", dedup_start);
+    if (is_duplicate) {
+        return IOTCL_ERR_IGNORED; // the called function will print a warning
+    }
+    IOTCL_TRACE_BEGIN(parse_start);
     cJSON *root = cJSON_ParseWithLength((const char *) data, data_len);
+    IOTCL_TRACE_END("c2d_json_parse", parse_start);
     if (!root) {
         IOTCL_ERROR(
                 IOTCL_ERR_PARSING_ERROR,
@@ -221,96 +354,104 @@ int iotcl_c2d_process_event_with_length(const uint8_t *data, size_t data_len) {
     return iotcl_c2d_parse_json(root);
 }
 
-const char *iotcl_c2d_get_ota_url(IotclC2dEventData data, int index) {
-    if (IOTCL_SUCCESS != iotcl_c2d_validate_data_and_type(data, IOTCL_C2D_ET_DEVICE_OTA, "OTA URL")) {
-        return NULL;
+static int iotcl_c2d_count_result(int status) {
+    IOTCL_STATS_INC(IOTCL_STATS_C2D_RECEIVED);
+    switch (status) {
+        case IOTCL_SUCCESS:
+            IOTCL_STATS_INC(IOTCL_STATS_C2D_DISPATCHED);
+            break;
+        case IOTCL_ERR_IGNORED:
+            IOTCL_STATS_INC(IOTCL_STATS_C2D_IGNORED);
+            break;
+        default:
+            IOTCL_STATS_INC(IOTCL_STATS_C2D_REJECTED);
+            break;
     }
-    cJSON *url_array_item = iotcl_c2d_get_ota_url_array_item(data, index);
-    if (!url_array_item) {
+    return status;
+}
+
+int iotcl_c2d_process_event(const char *str) {
+    int status;
+    IOTCL_STATS_TIME_START(stats_start);
+    // In IOTCL_NO_HEAP mode, the event is parsed into storage on the stack
+    IOTCL_WITH_STACK_ARENA(IOTCL_NO_HEAP_C2D_STORAGE_SIZE, status, iotcl_c2d_parse_and_process(str));
+    IOTCL_STATS_TIME_END(IOTCL_STATS_C2D_PROCESS_LATENCY, stats_start);
+    return iotcl_c2d_count_result(status);
+}
+
+int iotcl_c2d_process_event_with_length(const uint8_t *data, size_t data_len) {
+    int status;
+    IOTCL_STATS_TIME_START(stats_start);
+    IOTCL_WITH_STACK_ARENA(IOTCL_NO_HEAP_C2D_STORAGE_SIZE, status, iotcl_c2d_parse_and_process_with_length(data, data_len));
+    IOTCL_STATS_TIME_END(IOTCL_STATS_C2D_PROCESS_LATENCY, stats_start);
+    return iotcl_c2d_count_result(status);
+}
+
+const char *iotcl_c2d_get_ota_url(IotclC2dEventData data, int index) {
+    const IotclC2dOtaUrl *entry = iotcl_c2d_get_ota_url_entry(data, index, "OTA URL");
+    if (!entry) {
         // called function logs the error
         return NULL;
     }
-    return iotcl_c2d_get_string_value(url_array_item, true, "url");
+    if (!entry->url) {
+        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "\"%s\" was not found in c2d response", "url");
+    }
+    return entry->url;
 }
 
 const char *iotcl_c2d_get_ota_url_hostname(IotclC2dEventData data, int index) {
-    if (IOTCL_SUCCESS != iotcl_c2d_validate_data_and_type(data, IOTCL_C2D_ET_DEVICE_OTA, "OTA URL hostname")) {
+    const IotclC2dOtaUrl *entry = iotcl_c2d_get_ota_url_entry(data, index, "OTA URL hostname");
+    if (!entry) {
+        // called function logs the error
         return NULL;
     }
-    // shortcut... we've already done the parsing and allocation
-    if (data->hostname) {
-        return data->hostname;
+    if (!entry->hostname) {
+        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "The download URL does not appear to be correctly formatted");
     }
-    cJSON *url_array_item = iotcl_c2d_get_ota_url_array_item(data, index);
-    if (!url_array_item) {
-        // called function logs the error
-        return NULL;
+    return entry->hostname;
+}
+
+const char *iotcl_c2d_get_ota_url_hostname_span(IotclC2dEventData data, int index, size_t *hostname_len) {
+    if (hostname_len) {
+        *hostname_len = 0;
     }
-    const char *url = iotcl_c2d_get_string_value(url_array_item, true, "url");
-    if (!url) {
+    const IotclC2dOtaUrl *entry = iotcl_c2d_get_ota_url_entry(data, index, "OTA URL hostname");
+    if (!entry) {
         // called function logs the error
         return NULL;
     }
-    if (!strstr(url, HTTPS_PREFIX)) {
-        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "The download URL is missing the leading \"https://\"");
-        return NULL;
-    }
-    const char *host_start = &url[strlen(HTTPS_PREFIX)]; // cannot be null because strstr(url, HTTPS_PREFIX) check
-    const char *resource_start = strstr(host_start, "/");
-    if (!resource_start) {
+    if (!entry->hostname) {
         IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "The download URL does not appear to be correctly formatted");
         return NULL;
     }
-    size_t hostname_str_len = (size_t) (resource_start - host_start);
-    char *hostname = iotcl_malloc(hostname_str_len + 1 /* for null terminator */);
-    if (!hostname) {
-        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "Out of memory while allocating the OTA hostname string");
-        return NULL;
+    if (hostname_len) {
+        *hostname_len = entry->hostname_len;
     }
-    strncpy(hostname, host_start, hostname_str_len);
-    hostname[hostname_str_len] = '\0'; // just to be sure
-    data->hostname = hostname; // record it so we can free it and shortcut it
-    return hostname;
+    return &entry->url[strlen(HTTPS_PREFIX)];
 }
 
 const char *iotcl_c2d_get_ota_url_resource(IotclC2dEventData data, int index) {
-    if (IOTCL_SUCCESS != iotcl_c2d_validate_data_and_type(data, IOTCL_C2D_ET_DEVICE_OTA, "OTA URL resource")) {
-        return NULL;
-    }
-    cJSON *url_array_item = iotcl_c2d_get_ota_url_array_item(data, index);
-    if (!url_array_item) {
+    const IotclC2dOtaUrl *entry = iotcl_c2d_get_ota_url_entry(data, index, "OTA URL resource");
+    if (!entry) {
         // called function logs the error
         return NULL;
     }
-
-    const char *url = iotcl_c2d_get_string_value(url_array_item, true, "url");
-    if (!url) {
-        // called function logs the error
-        return NULL;
-    }
-    if (!strstr(url, HTTPS_PREFIX)) {
-        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "The download URL is missing the leading \"https://\"");
-        return NULL;
-    }
-    const char *host_start = &url[strlen(HTTPS_PREFIX)];
-    char *resource_start = strstr(host_start, "/");
-    if (!resource_start) {
+    if (!entry->resource) {
         IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "The download URL does not appear to be correctly formatted");
-        return NULL;
     }
-    return resource_start;
+    return entry->resource;
 }
 
 const char *iotcl_c2d_get_ota_original_filename(IotclC2dEventData data, int index) {
-    if (IOTCL_SUCCESS != iotcl_c2d_validate_data_and_type(data, IOTCL_C2D_ET_DEVICE_OTA, "OTA original filename")) {
-        return NULL;
-    }
-    cJSON *url_array_item = iotcl_c2d_get_ota_url_array_item(data, index);
-    if (!url_array_item) {
+    const IotclC2dOtaUrl *entry = iotcl_c2d_get_ota_url_entry(data, index, "OTA original filename");
+    if (!entry) {
         // called function logs the error
         return NULL;
     }
-    return iotcl_c2d_get_string_value(url_array_item, true, "fileName");
+    if (!entry->filename) {
+        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "\"%s\" was not found in c2d response", "fileName");
+    }
+    return entry->filename;
 }
 
 const char *iotcl_c2d_get_command(IotclC2dEventData data) {
@@ -324,12 +465,7 @@ int iotcl_c2d_get_ota_url_count(IotclC2dEventData data) {
     if (IOTCL_SUCCESS != iotcl_c2d_validate_data_and_type(data, IOTCL_C2D_ET_DEVICE_OTA, "URL count")) {
         return 0;
     }
-    cJSON *urls = cJSON_GetObjectItemCaseSensitive(data->root, "urls");
-    if (NULL == urls || !cJSON_IsArray(urls)) {
-        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "the \"urls\" array is not found in c2d response");
-        return 0;
-    }
-    return cJSON_GetArraySize(urls);
+    return data->ota_url_count;
 }
 
 const char *iotcl_c2d_get_ota_sw_version(IotclC2dEventData data) {
@@ -381,6 +517,7 @@ void iotcl_c2d_destroy_ack_json(char *ack_json_ptr) {
 void iotcl_c2d_destroy_event(IotclC2dEventData data) {
     cJSON_Delete(data->root);
     data->root = NULL;
-    iotcl_free(data->hostname); // in case it was created
-    data->hostname = NULL;
+    iotcl_free(data->ota_urls);
+    data->ota_urls = NULL;
+    data->ota_url_count = 0;
 }
@@ -0,0 +1,199 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Duplicate C2D message filter. See IotclEventConfig in iotcl_c2d.h.
+ * The cache is a set-associative table: an ack ID hashes to a set of IOTCL_C2D_DEDUP_WAYS entries
+ * and the least recently used entry of that set is evicted when a new ack ID is recorded.
+ * Lookups and inserts are O(IOTCL_C2D_DEDUP_WAYS) and the cache does not allocate.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "iotcl_log.h"
+#include "iotcl_internal.h"
+#include "iotcl.h"
+
+#if (IOTCL_C2D_DEDUP_CACHE_SIZE < IOTCL_C2D_DEDUP_WAYS) || (IOTCL_C2D_DEDUP_CACHE_SIZE % IOTCL_C2D_DEDUP_WAYS != 0)
+#error "IOTCL_C2D_DEDUP_CACHE_SIZE must be a non-zero multiple of IOTCL_C2D_DEDUP_WAYS"
+#endif
+
+#define IOTCL_C2D_DEDUP_NUM_SETS (IOTCL_C2D_DEDUP_CACHE_SIZE / IOTCL_C2D_DEDUP_WAYS)
+
+typedef struct {
+    char ack_id[IOTCL_MAX_ACK_LENGTH + 1]; // empty string if the entry is not used
+    uint32_t hash;
+    uint32_t last_used;
+    int ack_status;
+    bool has_ack_status;
+    bool is_ota;
+} IotclC2dDedupEntry;
+
+static IotclC2dDedupEntry dedup_cache[IOTCL_C2D_DEDUP_CACHE_SIZE];
+static uint32_t dedup_use_counter = 0;
+
+static IotclC2dDedupEntry *iotcl_c2d_dedup_get_set(uint32_t hash) {
+    return &dedup_cache[(hash % IOTCL_C2D_DEDUP_NUM_SETS) * IOTCL_C2D_DEDUP_WAYS];
+}
+
+static IotclC2dDedupEntry *iotcl_c2d_dedup_find(const char *ack_id, size_t ack_id_len, uint32_t hash) {
+    IotclC2dDedupEntry *set = iotcl_c2d_dedup_get_set(hash);
+    for (int i = 0; i < IOTCL_C2D_DEDUP_WAYS; i++) {
+        IotclC2dDedupEntry *entry = &set[i];
+        if (entry->hash == hash
+            && 0 == strncmp(entry->ack_id, ack_id, ack_id_len)
+            && '\0' == entry->ack_id[ack_id_len]) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static bool iotcl_c2d_dedup_is_enabled(void) {
+    IotclGlobalConfig *config = iotcl_get_global_config();
+    return config->is_valid && config->event_functions.is_duplicate_filter_enabled;
+}
+
+static void iotcl_c2d_dedup_handle_duplicate(IotclC2dDedupEntry *entry) {
+    entry->last_used = ++dedup_use_counter;
+    IOTCL_WARN(IOTCL_ERR_IGNORED, "Ignoring a duplicate C2D message with ack ID %s", entry->ack_id);
+    if (entry->has_ack_status && iotcl_get_global_config()->event_functions.is_duplicate_ack_resend_enabled) {
+        if (entry->is_ota) {
+            (void) iotcl_mqtt_send_ota_ack(entry->ack_id, entry->ack_status, NULL);
+        } else {
+            (void) iotcl_mqtt_send_cmd_ack(entry->ack_id, entry->ack_status, NULL);
+        }
+    }
+}
+
+bool iotcl_c2d_dedup_check_raw(const char *data, size_t data_len) {
+    static const char ACK_KEY[] = "\"ack\"";
+    const size_t ack_key_len = sizeof(ACK_KEY) - 1;
+
+    if (!iotcl_c2d_dedup_is_enabled() || data_len <= ack_key_len) {
+        return false;
+    }
+
+    // Look for "ack" : "<value>" in the raw message. This scan is best effort. If anything looks unusual,
+    // we return false and let the full parse and iotcl_c2d_dedup_check() deal with it.
+    const char *end = data + data_len;
+    const char *p = data;
+    while (p + ack_key_len < end) {
+        if (0 == memcmp(p, ACK_KEY, ack_key_len)) {
+            break;
+        }
+        p++;
+    }
+    if (p + ack_key_len >= end) {
+        return false;
+    }
+    p += ack_key_len;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+    if (p >= end || *p != ':') {
+        return false;
+    }
+    p++;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+    if (p >= end || *p != '"') {
+        return false;
+    }
+    p++;
+    const char *ack_id = p;
+    while (p < end && *p != '"') {
+        if (*p == '\\') {
+            return false; // ack IDs should never contain escape sequences
+        }
+        p++;
+    }
+    const size_t ack_id_len = (size_t) (p - ack_id);
+    if (p >= end || 0 == ack_id_len || ack_id_len > IOTCL_MAX_ACK_LENGTH) {
+        return false;
+    }
+
+    IotclC2dDedupEntry *entry = iotcl_c2d_dedup_find(ack_id, ack_id_len, iotcl_hash_fnv1a(ack_id, ack_id_len));
+    if (!entry) {
+        return false;
+    }
+    iotcl_c2d_dedup_handle_duplicate(entry);
+    return true;
+}
+
+// Returns the length of a valid ack ID, or 0 if ack_id cannot be recorded.
+static size_t iotcl_c2d_dedup_get_ack_id_len(const char *ack_id) {
+    if (!ack_id || !iotcl_c2d_dedup_is_enabled()) {
+        return 0;
+    }
+    const size_t ack_id_len = strlen(ack_id);
+    return ack_id_len > IOTCL_MAX_ACK_LENGTH ? 0 : ack_id_len;
+}
+
+// Returns the existing entry for ack_id, or a free or least recently used entry initialized for it.
+static IotclC2dDedupEntry *iotcl_c2d_dedup_record_entry(const char *ack_id, size_t ack_id_len, bool is_ota) {
+    const uint32_t hash = iotcl_hash_fnv1a(ack_id, ack_id_len);
+    IotclC2dDedupEntry *entry = iotcl_c2d_dedup_find(ack_id, ack_id_len, hash);
+    if (entry) {
+        return entry;
+    }
+
+    // pick a free entry or the least recently used one in the set
+    IotclC2dDedupEntry *set = iotcl_c2d_dedup_get_set(hash);
+    entry = &set[0];
+    for (int i = 0; i < IOTCL_C2D_DEDUP_WAYS; i++) {
+        if ('\0' == set[i].ack_id[0]) {
+            entry = &set[i];
+            break;
+        }
+        if ((uint32_t) (dedup_use_counter - set[i].last_used) > (uint32_t) (dedup_use_counter - entry->last_used)) {
+            entry = &set[i];
+        }
+    }
+    memcpy(entry->ack_id, ack_id, ack_id_len + 1);
+    entry->hash = hash;
+    entry->last_used = ++dedup_use_counter;
+    entry->has_ack_status = false;
+    entry->is_ota = is_ota;
+    return entry;
+}
+
+bool iotcl_c2d_dedup_check(const char *ack_id) {
+    const size_t ack_id_len = iotcl_c2d_dedup_get_ack_id_len(ack_id);
+    if (0 == ack_id_len) {
+        return false;
+    }
+    IotclC2dDedupEntry *entry = iotcl_c2d_dedup_find(ack_id, ack_id_len, iotcl_hash_fnv1a(ack_id, ack_id_len));
+    if (!entry) {
+        return false;
+    }
+    iotcl_c2d_dedup_handle_duplicate(entry);
+    return true;
+}
+
+void iotcl_c2d_dedup_record(const char *ack_id, bool is_ota) {
+    const size_t ack_id_len = iotcl_c2d_dedup_get_ack_id_len(ack_id);
+    if (0 != ack_id_len) {
+        // if the callback already sent an ack, the entry exists and keeps the ack status
+        (void) iotcl_c2d_dedup_record_entry(ack_id, ack_id_len, is_ota);
+    }
+}
+
+void iotcl_c2d_dedup_record_ack_status(const char *ack_id, bool is_ota, int status) {
+    const size_t ack_id_len = iotcl_c2d_dedup_get_ack_id_len(ack_id);
+    if (0 == ack_id_len) {
+        return;
+    }
+    // Acks are usually sent from the C2D callback, before the message is recorded after dispatching it.
+    // An ack means that the message was processed, so record it now.
+    IotclC2dDedupEntry *entry = iotcl_c2d_dedup_record_entry(ack_id, ack_id_len, is_ota);
+    entry->ack_status = status;
+    entry->has_ack_status = true;
+    entry->is_ota = is_ota;
+}
+
+void iotcl_c2d_dedup_clear(void) {
+    memset(dedup_cache, 0, sizeof(dedup_cache));
+    dedup_use_counter = 0;
+}
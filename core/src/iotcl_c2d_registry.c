@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Command registry. See COMMAND REGISTRY in iotcl_c2d.h.
+ * Handlers are stored in an open addressing (linear probing) hash table keyed by the command name.
+ * Entries are never removed individually, so lookups can stop at the first empty slot.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "iotcl_log.h"
+#include "iotcl_internal.h"
+#include "iotcl.h"
+#include "iotcl_c2d.h"
+
+#if (IOTCL_C2D_COMMAND_REGISTRY_SIZE <= 0) || ((IOTCL_C2D_COMMAND_REGISTRY_SIZE & (IOTCL_C2D_COMMAND_REGISTRY_SIZE - 1)) != 0)
+#error "IOTCL_C2D_COMMAND_REGISTRY_SIZE must be a power of two"
+#endif
+
+#if (IOTCL_C2D_COMMAND_MAX_ARGS < 1)
+#error "IOTCL_C2D_COMMAND_MAX_ARGS must be at least 1"
+#endif
+
+#define IOTCL_C2D_REGISTRY_MASK ((uint32_t) IOTCL_C2D_COMMAND_REGISTRY_SIZE - 1)
+
+typedef struct {
+    const char *name; // NULL if the slot is not used
+    size_t name_len;
+    IotclCommandHandler handler;
+} IotclC2dCommandSlot;
+
+static struct {
+    IotclC2dCommandSlot slots[IOTCL_C2D_COMMAND_REGISTRY_SIZE];
+    int count;
+    IotclCommandHandler default_handler;
+} registry;
+
+static bool is_command_whitespace(char c) {
+    return ' ' == c || '\t' == c || '\r' == c || '\n' == c;
+}
+
+// Returns the slot holding the name, or the empty slot where it should be inserted,
+// or NULL if the name is not found and the table is full.
+static IotclC2dCommandSlot *iotcl_c2d_registry_find_slot(const char *name, size_t name_len) {
+    uint32_t index = iotcl_hash_fnv1a(name, name_len) & IOTCL_C2D_REGISTRY_MASK;
+    for (int i = 0; i < IOTCL_C2D_COMMAND_REGISTRY_SIZE; i++) {
+        IotclC2dCommandSlot *slot = &registry.slots[index];
+        if (!slot->name) {
+            return slot;
+        }
+        if (slot->name_len == name_len && 0 == memcmp(slot->name, name, name_len)) {
+            return slot;
+        }
+        index = (index + 1) & IOTCL_C2D_REGISTRY_MASK;
+    }
+    return NULL;
+}
+
+int iotcl_c2d_register_command(const char *name, IotclCommandHandler handler) {
+    if (!name || 0 == strlen(name) || !handler) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_c2d_register_command: Command name and handler are required!");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    const size_t name_len = strlen(name);
+    for (size_t i = 0; i < name_len; i++) {
+        if (is_command_whitespace(name[i])) {
+            IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "iotcl_c2d_register_command: Command name \"%s\" cannot contain whitespace", name);
+            return IOTCL_ERR_BAD_VALUE;
+        }
+    }
+
+    IotclC2dCommandSlot *slot = iotcl_c2d_registry_find_slot(name, name_len);
+    if (!slot) {
+        IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "iotcl_c2d_register_command: The command registry is full. Increase IOTCL_C2D_COMMAND_REGISTRY_SIZE.");
+        return IOTCL_ERR_OVERFLOW;
+    }
+    if (!slot->name) {
+        slot->name = name;
+        slot->name_len = name_len;
+        registry.count++;
+        // warn once, when crossing the threshold
+        if (registry.count * 3 > IOTCL_C2D_COMMAND_REGISTRY_SIZE * 2
+            && (registry.count - 1) * 3 <= IOTCL_C2D_COMMAND_REGISTRY_SIZE * 2) {
+            IOTCL_WARN(IOTCL_ERR_OVERFLOW, "The command registry is more than 2/3 full. Consider increasing IOTCL_C2D_COMMAND_REGISTRY_SIZE.");
+        }
+    }
+    slot->handler = handler;
+    return IOTCL_SUCCESS;
+}
+
+void iotcl_c2d_set_default_command_handler(IotclCommandHandler handler) {
+    registry.default_handler = handler;
+}
+
+void iotcl_c2d_clear_commands(void) {
+    memset(&registry, 0, sizeof(registry));
+}
+
+bool iotcl_c2d_registry_dispatch(IotclC2dEventData data, char *command_line) {
+    if (!command_line || (0 == registry.count && !registry.default_handler)) {
+        return false;
+    }
+
+    // Look up the command name before modifying the command line, so that cmd_cb gets the original if we return false
+    char *p = command_line;
+    while (is_command_whitespace(*p)) p++;
+    const char *name = p;
+    while (*p && !is_command_whitespace(*p)) p++;
+    const size_t name_len = (size_t) (p - name);
+
+    IotclCommandHandler handler = registry.default_handler;
+    if (name_len > 0 && registry.count > 0) {
+        IotclC2dCommandSlot *slot = iotcl_c2d_registry_find_slot(name, name_len);
+        if (slot && slot->name) {
+            handler = slot->handler;
+        }
+    }
+    if (!handler) {
+        return false;
+    }
+
+    // Split the command line in place. The last argument gets the remainder of the line.
+    char *argv[IOTCL_C2D_COMMAND_MAX_ARGS + 1];
+    int argc = 0;
+    p = command_line;
+    while (*p && argc < IOTCL_C2D_COMMAND_MAX_ARGS) {
+        while (is_command_whitespace(*p)) p++;
+        if (!*p) {
+            break;
+        }
+        argv[argc++] = p;
+        if (argc == IOTCL_C2D_COMMAND_MAX_ARGS) {
+            break;
+        }
+        while (*p && !is_command_whitespace(*p)) p++;
+        if (*p) {
+            *p = '\0';
+            p++;
+        }
+    }
+    argv[argc] = NULL;
+
+    handler(data, argc, argv);
+    return true;
+}
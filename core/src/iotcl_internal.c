@@ -2,6 +2,9 @@
  * Copyright (C) 2024 Avnet
  * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
  */
+#include <limits.h>
+#include <string.h>
+
 #include "cJSON.h"
 #include "iotcl_util.h"
 #include "iotcl_internal.h"
@@ -17,3 +20,112 @@ char *iotcl_strdup_json_string(cJSON *cjson, const char *value_name) {
     }
     return iotcl_strdup(str_value);
 }
+
+uint32_t iotcl_hash_fnv1a(const char *str, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t) str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Two digits are converted at a time, which halves the number of divisions compared to a simple loop.
+static const char digit_pairs[201] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+size_t iotcl_uint64_to_str(uint64_t value, char *buffer) {
+    char digits[IOTCL_INT64_STR_SIZE];
+    char *p = &digits[sizeof(digits)];
+    while (value >= 100) {
+        const unsigned int pair = (unsigned int) (value % 100) * 2;
+        value /= 100;
+        *--p = digit_pairs[pair + 1];
+        *--p = digit_pairs[pair];
+    }
+    if (value >= 10) {
+        const unsigned int pair = (unsigned int) value * 2;
+        *--p = digit_pairs[pair + 1];
+        *--p = digit_pairs[pair];
+    } else {
+        *--p = (char) ('0' + value);
+    }
+    const size_t len = (size_t) (&digits[sizeof(digits)] - p);
+    memcpy(buffer, p, len);
+    buffer[len] = '\0';
+    return len;
+}
+
+size_t iotcl_int64_to_str(int64_t value, char *buffer) {
+    if (value < 0) {
+        buffer[0] = '-';
+        // negate in unsigned arithmetic, so that INT64_MIN does not overflow
+        return 1 + iotcl_uint64_to_str((uint64_t) 0 - (uint64_t) value, &buffer[1]);
+    }
+    return iotcl_uint64_to_str((uint64_t) value, buffer);
+}
+
+size_t iotcl_fixed_point_to_str(int64_t value, int decimals, char *buffer) {
+    // Pad the digits of the magnitude with leading zeros, so that there is at least one integer digit.
+    // For example, 5 with 3 decimals is "0005", which gives "0.005".
+    char digits[IOTCL_INT64_STR_SIZE + IOTCL_INT64_STR_SIZE];
+    const uint64_t magnitude = value < 0 ? (uint64_t) 0 - (uint64_t) value : (uint64_t) value;
+    const size_t num_decimals = (size_t) decimals;
+    size_t num_digits = iotcl_uint64_to_str(magnitude, digits);
+    if (num_digits <= num_decimals) {
+        const size_t padding = num_decimals + 1 - num_digits;
+        memmove(&digits[padding], digits, num_digits);
+        memset(digits, '0', padding);
+        num_digits += padding;
+    }
+    const size_t integer_digits = num_digits - num_decimals;
+    size_t fraction_digits = num_decimals;
+    while (fraction_digits > 0 && '0' == digits[integer_digits + fraction_digits - 1]) {
+        fraction_digits--;
+    }
+
+    size_t len = 0;
+    if (value < 0) {
+        buffer[len++] = '-';
+    }
+    memcpy(&buffer[len], digits, integer_digits);
+    len += integer_digits;
+    if (fraction_digits > 0) {
+        buffer[len++] = '.';
+        memcpy(&buffer[len], &digits[integer_digits], fraction_digits);
+        len += fraction_digits;
+    }
+    buffer[len] = '\0';
+    return len;
+}
+
+char *iotcl_json_print(cJSON *item, bool formatted) {
+#ifdef IOTCL_NO_HEAP
+    // Print directly into the free space of the active arena, so that cJSON does not need to grow its print buffer.
+    IotclArena *arena = iotcl_arena_get_active();
+    if (!arena || !arena->buffer || arena->used >= arena->size) {
+        return NULL;
+    }
+    char *buffer = (char *) &arena->buffer[arena->used];
+    size_t available = arena->size - arena->used;
+    if (available > INT_MAX) {
+        available = INT_MAX;
+    }
+    if (!cJSON_PrintPreallocated(item, buffer, (int) available, formatted)) {
+        return NULL;
+    }
+    arena->used += strlen(buffer) + 1;
+    return buffer;
+#else
+    return formatted ? cJSON_Print(item) : cJSON_PrintUnformatted(item);
+#endif
+}
@@ -0,0 +1,229 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * MQTT configuration snapshots. See iotcl_mqtt_acquire_config() in iotcl.h.
+ * Each configuration is an IotclMqttConfig followed by its strings in a single block. Once published through
+ * an atomic pointer, a snapshot is never modified by the library. Readers increment the reader count
+ * before loading the pointer, so the writer can safely reclaim replaced (retired) snapshots
+ * once it observes a reader count of zero after publishing.
+ * Writers (iotcl_init(), iotcl_deinit() and the DRA identity module) are not expected to run concurrently
+ * with each other, so the retired list and the spare snapshot are not protected.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "iotcl_log.h"
+#include "iotcl_internal.h"
+#include "iotcl.h"
+
+typedef struct IotclMqttConfigSnapshotTag {
+    IotclMqttConfig mqtt_config; // Must be the first member, so that the IotclMqttConfig pointer can be converted back.
+    struct IotclMqttConfigSnapshotTag *next_retired;
+    char *strings;
+    size_t strings_size;
+} IotclMqttConfigSnapshot;
+
+static IotclMqttConfigSnapshot *current_snapshot = NULL; // access with IOTCL_ATOMIC_* only
+static int num_readers = 0; // access with IOTCL_ATOMIC_* only
+
+static IotclMqttConfigSnapshot *retired_snapshots = NULL;
+
+// A reclaimed snapshot that is kept for reuse, so that re-init does not need to allocate.
+static IotclMqttConfigSnapshot *spare_snapshot = NULL;
+
+#ifdef IOTCL_NO_HEAP
+// The current and the next snapshot. A third one may be needed if readers hold the current one for a long time,
+// in which case the configuration change will fail.
+static struct {
+    IotclMqttConfigSnapshot snapshot;
+    char strings[IOTCL_NO_HEAP_MQTT_CONFIG_SIZE];
+    bool is_used;
+} snapshot_slots[2];
+#endif
+
+static bool iotcl_snapshot_owns_string(const IotclMqttConfigSnapshot *s, const char *str) {
+    if (!s->strings || !str) {
+        return false;
+    }
+    const uintptr_t addr = (uintptr_t) str;
+    const uintptr_t start = (uintptr_t) s->strings;
+    return addr >= start && addr < start + s->strings_size;
+}
+
+static void iotcl_snapshot_free_string(const IotclMqttConfigSnapshot *s, char **str) {
+    // The user or other modules may have supplied strings that are not in the block (custom config)
+    if (!iotcl_snapshot_owns_string(s, *str)) {
+        iotcl_free(*str);
+    }
+    *str = NULL;
+}
+
+static void iotcl_snapshot_clear(IotclMqttConfigSnapshot *s) {
+    IotclMqttConfig *mc = &s->mqtt_config;
+    iotcl_snapshot_free_string(s, &mc->username);
+    iotcl_snapshot_free_string(s, &mc->client_id);
+    iotcl_snapshot_free_string(s, &mc->host);
+    iotcl_snapshot_free_string(s, &mc->pub_rpt);
+    iotcl_snapshot_free_string(s, &mc->pub_ack);
+    iotcl_snapshot_free_string(s, &mc->sub_c2d);
+    iotcl_snapshot_free_string(s, &mc->cd);
+    mc->version = NULL; // version is a constant string always in this implementation
+    s->next_retired = NULL;
+}
+
+static IotclMqttConfigSnapshot *iotcl_snapshot_alloc(size_t strings_size) {
+#ifdef IOTCL_NO_HEAP
+    if (strings_size > IOTCL_NO_HEAP_MQTT_CONFIG_SIZE) {
+        IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "MQTT configuration needs %lu bytes. Increase IOTCL_NO_HEAP_MQTT_CONFIG_SIZE.", (unsigned long) strings_size);
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof(snapshot_slots) / sizeof(snapshot_slots[0]); i++) {
+        if (!snapshot_slots[i].is_used) {
+            snapshot_slots[i].is_used = true;
+            IotclMqttConfigSnapshot *s = &snapshot_slots[i].snapshot;
+            s->strings = snapshot_slots[i].strings;
+            s->strings_size = sizeof(snapshot_slots[i].strings);
+            return s;
+        }
+    }
+    IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "MQTT configuration cannot be changed while readers are holding it!");
+    return NULL;
+#else
+    IotclMqttConfigSnapshot *s = iotcl_malloc(sizeof(IotclMqttConfigSnapshot) + strings_size);
+    if (!s) {
+        return NULL;
+    }
+    s->strings = (char *) &s[1];
+    s->strings_size = strings_size;
+    return s;
+#endif
+}
+
+static void iotcl_snapshot_free(IotclMqttConfigSnapshot *s) {
+    if (!s) {
+        return;
+    }
+    iotcl_snapshot_clear(s);
+#ifdef IOTCL_NO_HEAP
+    for (size_t i = 0; i < sizeof(snapshot_slots) / sizeof(snapshot_slots[0]); i++) {
+        if (&snapshot_slots[i].snapshot == s) {
+            snapshot_slots[i].is_used = false;
+        }
+    }
+#else
+    iotcl_free(s);
+#endif
+}
+
+// Keeps the larger of the spare and the snapshot for reuse and frees the other one.
+static void iotcl_snapshot_make_spare(IotclMqttConfigSnapshot *s) {
+    iotcl_snapshot_clear(s);
+    if (spare_snapshot && spare_snapshot->strings_size >= s->strings_size) {
+        iotcl_snapshot_free(s);
+    } else {
+        iotcl_snapshot_free(spare_snapshot);
+        spare_snapshot = s;
+    }
+}
+
+static void iotcl_mqtt_config_reclaim(void) {
+    if (!retired_snapshots || 0 != IOTCL_ATOMIC_LOAD(&num_readers)) {
+        return;
+    }
+    // The retired snapshots are no longer reachable by new readers and no reader is holding one
+    while (retired_snapshots) {
+        IotclMqttConfigSnapshot *s = retired_snapshots;
+        retired_snapshots = s->next_retired;
+        iotcl_snapshot_make_spare(s);
+    }
+}
+
+const IotclMqttConfig *iotcl_mqtt_acquire_config(void) {
+    // Register as a reader before loading the pointer. See the comment at the top of this file.
+    (void) IOTCL_ATOMIC_ADD_FETCH(&num_readers, 1);
+    IotclMqttConfigSnapshot *s = IOTCL_ATOMIC_LOAD(&current_snapshot);
+    if (!s) {
+        (void) IOTCL_ATOMIC_SUB_FETCH(&num_readers, 1);
+        return NULL;
+    }
+    return &s->mqtt_config;
+}
+
+void iotcl_mqtt_release_config(const IotclMqttConfig *mc) {
+    if (mc) {
+        (void) IOTCL_ATOMIC_SUB_FETCH(&num_readers, 1);
+    }
+}
+
+IotclMqttConfig *iotcl_mqtt_config_get_current(void) {
+    IotclMqttConfigSnapshot *s = IOTCL_ATOMIC_LOAD(&current_snapshot);
+    return s ? &s->mqtt_config : NULL;
+}
+
+IotclMqttConfig *iotcl_mqtt_config_create_snapshot(size_t strings_size, char **strings) {
+    iotcl_mqtt_config_reclaim();
+
+    IotclMqttConfigSnapshot *s = spare_snapshot;
+    if (s && s->strings_size >= strings_size) {
+        spare_snapshot = NULL;
+    } else {
+        s = iotcl_snapshot_alloc(strings_size);
+        if (!s) {
+            return NULL; // the caller should print the error
+        }
+    }
+    memset(&s->mqtt_config, 0, sizeof(s->mqtt_config));
+    s->next_retired = NULL;
+    if (strings) {
+        *strings = s->strings;
+    }
+    return &s->mqtt_config;
+}
+
+void iotcl_mqtt_config_discard_snapshot(IotclMqttConfig *mc) {
+    if (mc) {
+        iotcl_snapshot_make_spare((IotclMqttConfigSnapshot *) mc);
+    }
+}
+
+void iotcl_mqtt_config_publish_snapshot(IotclMqttConfig *mc) {
+    IotclMqttConfigSnapshot *previous = IOTCL_ATOMIC_LOAD(&current_snapshot);
+    IOTCL_ATOMIC_STORE(&current_snapshot, (IotclMqttConfigSnapshot *) mc);
+    if (previous) {
+        previous->next_retired = retired_snapshots;
+        retired_snapshots = previous;
+    }
+    iotcl_mqtt_config_reclaim();
+}
+
+void iotcl_mqtt_config_clear(void) {
+    if (!IOTCL_ATOMIC_LOAD(&current_snapshot)) {
+        return;
+    }
+    IotclMqttConfig *mc = iotcl_mqtt_config_create_snapshot(0, NULL);
+    if (!mc) {
+        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "Out of memory while clearing the MQTT configuration!");
+        return;
+    }
+    iotcl_mqtt_config_publish_snapshot(mc);
+}
+
+void iotcl_mqtt_config_destroy(void) {
+    iotcl_mqtt_config_publish_snapshot(NULL);
+    if (retired_snapshots) {
+        // this should not happen if the application releases the config correctly before calling iotcl_deinit()
+        IOTCL_WARN(IOTCL_ERR_FAILED, "iotcl_deinit: MQTT configuration is still held by readers. Freeing it anyway.");
+        while (retired_snapshots) {
+            IotclMqttConfigSnapshot *s = retired_snapshots;
+            retired_snapshots = s->next_retired;
+            iotcl_snapshot_free(s);
+        }
+    }
+    iotcl_snapshot_free(spare_snapshot);
+    spare_snapshot = NULL;
+}
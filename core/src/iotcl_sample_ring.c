@@ -0,0 +1,459 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Sample ring. See iotcl_sample_ring.h.
+ *
+ * Block bit stream, most significant bit first:
+ *   First sample: 64-bit timestamp, 64-bit IEEE 754 value.
+ *   Each following sample:
+ *     Timestamp delta-of-delta (dod):
+ *       '0'                   dod is 0
+ *       '10'    + 7 bits      dod in [-64, 63]
+ *       '110'   + 9 bits      dod in [-256, 255]
+ *       '1110'  + 12 bits     dod in [-2048, 2047]
+ *       '11110' + 32 bits     dod in the 32-bit range
+ *       '11111' + 64 bits     otherwise
+ *     Value XOR against the previous value:
+ *       '0'                   same value
+ *       '10' + meaningful bits within the previous leading/trailing zeros window
+ *       '11' + 5 bits of leading zeros + 6 bits of meaningful bit count - 1 + meaningful bits
+ *
+ * The producer publishes a sample by storing the block sample count after its bits are written.
+ * Each byte is stored atomically, including the partially written last byte, so that the consumer
+ * can decode the published samples while the producer keeps adding to the same block.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "iotcl_internal.h"
+#include "iotcl_log.h"
+#include "iotcl_util.h"
+#include "iotcl_sample_ring.h"
+
+#if IOTCL_SAMPLE_RING_BLOCK_SIZE < 64
+#error "IOTCL_SAMPLE_RING_BLOCK_SIZE must be at least 64"
+#endif
+
+#define IOTCL_SAMPLE_MAX_BITS (5 + 64 + 2 + 5 + 6 + 64)
+#define IOTCL_SAMPLE_BLOCK_BITS ((size_t) IOTCL_SAMPLE_RING_BLOCK_SIZE * 8)
+
+// Conservative estimates for the flush budget
+#define IOTCL_SAMPLE_DATA_SET_COST (sizeof(",{\"dt\":\"\",\"d\":{}}") - 1 + IOTCL_ISO_TIMESTAMP_STR_LEN)
+#define IOTCL_SAMPLE_VALUE_COST 24 // like -1.2345678901234567e-308
+#define IOTCL_SAMPLE_SUMMARY_SUFFIX_COST (sizeof("_min_max_avg_count") - 1)
+
+// Size of the buffer for window summary value names, like <path>_count
+#define IOTCL_SAMPLE_SUMMARY_PATH_SIZE 128
+
+static int iotcl_sample_clz64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    while (!(x & 0x8000000000000000ULL)) {
+        n++;
+        x <<= 1;
+    }
+    return n;
+#endif
+}
+
+static int iotcl_sample_ctz64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while (!(x & 1)) {
+        n++;
+        x >>= 1;
+    }
+    return n;
+#endif
+}
+
+// Estimated length of "a":{"b": for path a.b, and the matching closing brace
+static size_t iotcl_sample_path_cost(const char *path) {
+    size_t cost = 0;
+    for (const char *p = path; *p; p++) {
+        cost += ('.' == *p) ? 5 : 1; // "": and {} for each nesting level
+    }
+    return cost + 3;
+}
+
+int iotcl_sample_ring_init(IotclSampleRing *ring, const char *path, IotclSampleBlock *blocks, size_t num_blocks) {
+    if (!ring || !blocks) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_sample_ring_init: Ring and blocks are required!");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (!path || 0 == strlen(path)) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_sample_ring_init: The path argument is required!");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (strlen(path) + sizeof("_count") > IOTCL_SAMPLE_SUMMARY_PATH_SIZE) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "iotcl_sample_ring_init: Path \"%s\" is too long", path);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    if (num_blocks < 2 || num_blocks > ((size_t) 1 << 30) || 0 != (num_blocks & (num_blocks - 1))) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "iotcl_sample_ring_init: Number of blocks must be a power of two, and at least 2");
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    memset(ring, 0, sizeof(IotclSampleRing));
+    ring->path = path;
+    ring->blocks = blocks;
+    ring->num_blocks = (uint32_t) num_blocks;
+    ring->path_cost = iotcl_sample_path_cost(path);
+    for (size_t i = 0; i < num_blocks; i++) {
+        blocks[i].count = 0;
+    }
+    return IOTCL_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// producer
+
+static void iotcl_sample_write_bits(IotclSampleRing *ring, IotclSampleBlock *block, uint64_t value, int num_bits) {
+    while (num_bits > 0) {
+        const int free_bits = 8 - (int) (ring->writer.bit_pos & 7);
+        const int n = num_bits < free_bits ? num_bits : free_bits;
+        const unsigned int chunk = (unsigned int) (value >> (num_bits - n)) & ((1u << n) - 1);
+        ring->writer.partial_byte = (uint8_t) (ring->writer.partial_byte | (chunk << (free_bits - n)));
+        ring->writer.bit_pos += (size_t) n;
+        num_bits -= n;
+        if (0 == (ring->writer.bit_pos & 7)) {
+            IOTCL_ATOMIC_STORE(&block->data[(ring->writer.bit_pos >> 3) - 1], ring->writer.partial_byte);
+            ring->writer.partial_byte = 0;
+        }
+    }
+}
+
+static void iotcl_sample_encode_timestamp(IotclSampleRing *ring, IotclSampleBlock *block, uint64_t timestamp_us) {
+    IotclSampleCodecState *codec = &ring->writer.codec;
+    const int64_t delta = (int64_t) (timestamp_us - codec->timestamp_us);
+    const int64_t dod = delta - codec->delta_us;
+    if (0 == dod) {
+        iotcl_sample_write_bits(ring, block, 0, 1);
+    } else if (dod >= -64 && dod <= 63) {
+        iotcl_sample_write_bits(ring, block, 0x2, 2);
+        iotcl_sample_write_bits(ring, block, (uint64_t) dod, 7);
+    } else if (dod >= -256 && dod <= 255) {
+        iotcl_sample_write_bits(ring, block, 0x6, 3);
+        iotcl_sample_write_bits(ring, block, (uint64_t) dod, 9);
+    } else if (dod >= -2048 && dod <= 2047) {
+        iotcl_sample_write_bits(ring, block, 0xE, 4);
+        iotcl_sample_write_bits(ring, block, (uint64_t) dod, 12);
+    } else if (dod >= INT32_MIN && dod <= INT32_MAX) {
+        iotcl_sample_write_bits(ring, block, 0x1E, 5);
+        iotcl_sample_write_bits(ring, block, (uint64_t) dod, 32);
+    } else {
+        iotcl_sample_write_bits(ring, block, 0x1F, 5);
+        iotcl_sample_write_bits(ring, block, (uint64_t) dod, 64);
+    }
+    codec->timestamp_us = timestamp_us;
+    codec->delta_us = delta;
+}
+
+static void iotcl_sample_encode_value(IotclSampleRing *ring, IotclSampleBlock *block, uint64_t value_bits) {
+    IotclSampleCodecState *codec = &ring->writer.codec;
+    const uint64_t xored = value_bits ^ codec->value_bits;
+    codec->value_bits = value_bits;
+    if (0 == xored) {
+        iotcl_sample_write_bits(ring, block, 0, 1);
+        return;
+    }
+    int leading = iotcl_sample_clz64(xored);
+    const int trailing = iotcl_sample_ctz64(xored);
+    if (leading > 31) {
+        leading = 31; // needs to fit into 5 bits
+    }
+    if (IOTCL_SAMPLE_RING_NO_WINDOW != codec->leading_zeros
+        && leading >= codec->leading_zeros && trailing >= codec->trailing_zeros) {
+        iotcl_sample_write_bits(ring, block, 0x2, 2);
+        iotcl_sample_write_bits(ring, block, xored >> codec->trailing_zeros,
+                                64 - codec->leading_zeros - codec->trailing_zeros);
+    } else {
+        const int meaningful = 64 - leading - trailing;
+        iotcl_sample_write_bits(ring, block, 0x3, 2);
+        iotcl_sample_write_bits(ring, block, (uint64_t) leading, 5);
+        iotcl_sample_write_bits(ring, block, (uint64_t) (meaningful - 1), 6);
+        iotcl_sample_write_bits(ring, block, xored >> trailing, meaningful);
+        codec->leading_zeros = (uint8_t) leading;
+        codec->trailing_zeros = (uint8_t) trailing;
+    }
+}
+
+int iotcl_sample_ring_add(IotclSampleRing *ring, uint64_t timestamp_us, double value) {
+    if (!ring || !ring->blocks) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_sample_ring_add: The ring is not initialized!");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    uint64_t value_bits;
+    memcpy(&value_bits, &value, sizeof(value_bits));
+
+    uint32_t head = ring->head;
+    IotclSampleBlock *block = &ring->blocks[head & (ring->num_blocks - 1)];
+    if (ring->writer.count > 0 && ring->writer.bit_pos + IOTCL_SAMPLE_MAX_BITS > IOTCL_SAMPLE_BLOCK_BITS) {
+        if (head + 1 - IOTCL_ATOMIC_LOAD(&ring->tail) >= ring->num_blocks) {
+            (void) IOTCL_ATOMIC_ADD_FETCH(&ring->dropped, 1);
+            return IOTCL_ERR_OVERFLOW;
+        }
+        head++;
+        block = &ring->blocks[head & (ring->num_blocks - 1)];
+        IOTCL_ATOMIC_STORE(&block->count, 0);
+        ring->writer.count = 0;
+        ring->writer.bit_pos = 0;
+        ring->writer.partial_byte = 0;
+        IOTCL_ATOMIC_STORE(&ring->head, head);
+    }
+
+    if (0 == ring->writer.count) {
+        iotcl_sample_write_bits(ring, block, timestamp_us, 64);
+        iotcl_sample_write_bits(ring, block, value_bits, 64);
+        ring->writer.codec.timestamp_us = timestamp_us;
+        ring->writer.codec.delta_us = 0;
+        ring->writer.codec.value_bits = value_bits;
+        ring->writer.codec.leading_zeros = IOTCL_SAMPLE_RING_NO_WINDOW;
+        ring->writer.codec.trailing_zeros = 0;
+    } else {
+        iotcl_sample_encode_timestamp(ring, block, timestamp_us);
+        iotcl_sample_encode_value(ring, block, value_bits);
+    }
+    if (ring->writer.bit_pos & 7) {
+        IOTCL_ATOMIC_STORE(&block->data[ring->writer.bit_pos >> 3], ring->writer.partial_byte);
+    }
+    ring->writer.count++;
+    IOTCL_ATOMIC_STORE(&block->count, ring->writer.count);
+    return IOTCL_SUCCESS;
+}
+
+unsigned long iotcl_sample_ring_get_dropped_count(IotclSampleRing *ring) {
+    return ring ? IOTCL_ATOMIC_LOAD(&ring->dropped) : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// consumer
+
+typedef struct {
+    IotclSampleBlock *block;
+    size_t bit_pos;
+    IotclSampleCodecState codec;
+} IotclSampleDecoder;
+
+static uint64_t iotcl_sample_read_bits(IotclSampleDecoder *d, int num_bits) {
+    uint64_t value = 0;
+    while (num_bits > 0) {
+        const unsigned int byte = IOTCL_ATOMIC_LOAD(&d->block->data[d->bit_pos >> 3]);
+        const int available = 8 - (int) (d->bit_pos & 7);
+        const int n = num_bits < available ? num_bits : available;
+        value = (value << n) | ((byte >> (available - n)) & ((1u << n) - 1));
+        d->bit_pos += (size_t) n;
+        num_bits -= n;
+    }
+    return value;
+}
+
+static int64_t iotcl_sample_read_signed(IotclSampleDecoder *d, int num_bits) {
+    uint64_t value = iotcl_sample_read_bits(d, num_bits);
+    if (num_bits < 64 && (value & (1ULL << (num_bits - 1)))) {
+        value |= ~0ULL << num_bits;
+    }
+    return (int64_t) value;
+}
+
+// Returns the number of leading one bits, up to max
+static int iotcl_sample_read_prefix(IotclSampleDecoder *d, int max) {
+    int ones = 0;
+    while (ones < max && iotcl_sample_read_bits(d, 1)) {
+        ones++;
+    }
+    return ones;
+}
+
+static void iotcl_sample_decode(IotclSampleDecoder *d, bool is_first, uint64_t *timestamp_us, double *value) {
+    IotclSampleCodecState *codec = &d->codec;
+    if (is_first) {
+        codec->timestamp_us = iotcl_sample_read_bits(d, 64);
+        codec->value_bits = iotcl_sample_read_bits(d, 64);
+        codec->delta_us = 0;
+    } else {
+        static const int dod_bits[] = {0, 7, 9, 12, 32, 64};
+        const int prefix = iotcl_sample_read_prefix(d, 5);
+        const int64_t dod = prefix ? iotcl_sample_read_signed(d, dod_bits[prefix]) : 0;
+        codec->delta_us += dod;
+        codec->timestamp_us += (uint64_t) codec->delta_us;
+
+        if (iotcl_sample_read_bits(d, 1)) {
+            if (iotcl_sample_read_bits(d, 1)) {
+                codec->leading_zeros = (uint8_t) iotcl_sample_read_bits(d, 5);
+                const int meaningful = (int) iotcl_sample_read_bits(d, 6) + 1;
+                codec->trailing_zeros = (uint8_t) (64 - codec->leading_zeros - meaningful);
+            }
+            const int meaningful = 64 - codec->leading_zeros - codec->trailing_zeros;
+            codec->value_bits ^= iotcl_sample_read_bits(d, meaningful) << codec->trailing_zeros;
+        }
+    }
+    *timestamp_us = codec->timestamp_us;
+    memcpy(value, &codec->value_bits, sizeof(*value));
+}
+
+// Internal status used to stop flushing when the budget is reached
+#define IOTCL_SAMPLE_BUDGET_REACHED (-1)
+
+typedef struct {
+    IotclSampleRing *ring;
+    IotclMessageHandle message;
+    const IotclSampleRingFlushOptions *options;
+    size_t bytes;
+    size_t num_data_sets;
+} IotclSampleFlush;
+
+static int iotcl_sample_add_data_set(IotclSampleFlush *f, uint64_t timestamp_us, size_t cost) {
+    char timestamp[IOTCL_ISO_TIMESTAMP_STR_LEN + 1];
+    if (f->options->max_bytes && f->bytes + cost > f->options->max_bytes) {
+        return IOTCL_SAMPLE_BUDGET_REACHED;
+    }
+    int status = iotcl_to_iso_timestamp((time_t) (timestamp_us / 1000000), timestamp, sizeof(timestamp));
+    if (status) {
+        return status; // called function will print the error
+    }
+    const unsigned int ms = (unsigned int) ((timestamp_us / 1000) % 1000);
+    if ('.' == timestamp[19]) {
+        timestamp[20] = (char) ('0' + ms / 100);
+        timestamp[21] = (char) ('0' + ms / 10 % 10);
+        timestamp[22] = (char) ('0' + ms % 10);
+    }
+    status = iotcl_telemetry_add_new_data_set(f->message, timestamp);
+    if (status) {
+        return status;
+    }
+    f->bytes += cost;
+    f->num_data_sets++;
+    return IOTCL_SUCCESS;
+}
+
+// Sets <path><suffix>. The path length is checked by iotcl_sample_ring_init().
+static int iotcl_sample_set_summary_value(IotclSampleFlush *f, const char *suffix, double value, bool is_count) {
+    char path[IOTCL_SAMPLE_SUMMARY_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s%s", f->ring->path, suffix);
+    if (is_count) {
+        return iotcl_telemetry_set_uint64(f->message, path, f->ring->reader.count);
+    }
+    return iotcl_telemetry_set_number(f->message, path, value);
+}
+
+// Adds the data set for the current window. Once the data set is added, the window is consumed,
+// even if setting one of the values fails, so that the window is not added to the message twice.
+static int iotcl_sample_flush_window(IotclSampleFlush *f) {
+    IotclSampleRing *ring = f->ring;
+    const size_t cost = IOTCL_SAMPLE_DATA_SET_COST + 4 * (ring->path_cost + IOTCL_SAMPLE_VALUE_COST)
+                        + IOTCL_SAMPLE_SUMMARY_SUFFIX_COST + 3;
+    const uint64_t window_us = (uint64_t) f->options->window_ms * 1000;
+    int status = iotcl_sample_add_data_set(f, ring->reader.window_index * window_us, cost);
+    if (status) {
+        return status;
+    }
+    ring->reader.has_window = false;
+    status = iotcl_sample_set_summary_value(f, "_min", ring->reader.min, false);
+    status = status ? status : iotcl_sample_set_summary_value(f, "_max", ring->reader.max, false);
+    status = status ? status : iotcl_sample_set_summary_value(f, "_avg", ring->reader.sum / (double) ring->reader.count, false);
+    status = status ? status : iotcl_sample_set_summary_value(f, "_count", 0, true);
+    return status;
+}
+
+// Adds the sample to the message, or to the current window. is_consumed is set to true if the sample
+// should not be flushed again. That is also the case if its data set was added, but setting the value failed.
+static int iotcl_sample_flush_one(IotclSampleFlush *f, uint64_t timestamp_us, double value, bool *is_consumed) {
+    IotclSampleRing *ring = f->ring;
+    *is_consumed = false;
+    if (0 == f->options->window_ms) {
+        int status = iotcl_sample_add_data_set(
+                f, timestamp_us, IOTCL_SAMPLE_DATA_SET_COST + ring->path_cost + IOTCL_SAMPLE_VALUE_COST);
+        if (status) {
+            return status;
+        }
+        *is_consumed = true;
+        return iotcl_telemetry_set_number(f->message, ring->path, value);
+    }
+
+    const uint64_t window_index = timestamp_us / ((uint64_t) f->options->window_ms * 1000);
+    if (ring->reader.has_window && window_index != ring->reader.window_index) {
+        int status = iotcl_sample_flush_window(f);
+        if (status) {
+            return status;
+        }
+    }
+    if (!ring->reader.has_window) {
+        ring->reader.has_window = true;
+        ring->reader.window_index = window_index;
+        ring->reader.min = value;
+        ring->reader.max = value;
+        ring->reader.sum = 0;
+        ring->reader.count = 0;
+    }
+    ring->reader.min = value < ring->reader.min ? value : ring->reader.min;
+    ring->reader.max = value > ring->reader.max ? value : ring->reader.max;
+    ring->reader.sum += value;
+    ring->reader.count++;
+    *is_consumed = true;
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_sample_ring_flush(
+        IotclSampleRing *ring,
+        IotclMessageHandle message,
+        const IotclSampleRingFlushOptions *options,
+        size_t *num_data_sets
+) {
+    static const IotclSampleRingFlushOptions default_options = {0, 0, false};
+    IotclSampleFlush f = {ring, message, options ? options : &default_options, 0, 0};
+    int status = IOTCL_SUCCESS;
+
+    if (num_data_sets) {
+        *num_data_sets = 0;
+    }
+    if (!ring || !ring->blocks || !message) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_sample_ring_flush: An initialized ring and a message are required!");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+
+    for (;;) {
+        // Read the head first. If the producer has moved past the tail block, the block count is final.
+        const uint32_t head = IOTCL_ATOMIC_LOAD(&ring->head);
+        const uint32_t tail = ring->tail;
+        IotclSampleDecoder d = {&ring->blocks[tail & (ring->num_blocks - 1)], 0, {0, 0, 0, 0, 0}};
+        const uint32_t count = IOTCL_ATOMIC_LOAD(&d.block->count);
+        for (uint32_t i = 0; i < count; i++) {
+            uint64_t timestamp_us;
+            double value;
+            iotcl_sample_decode(&d, 0 == i, &timestamp_us, &value);
+            if (i < ring->reader.read_count) {
+                continue;
+            }
+            bool is_consumed;
+            status = iotcl_sample_flush_one(&f, timestamp_us, value, &is_consumed);
+            if (is_consumed) {
+                ring->reader.read_count = i + 1;
+            }
+            if (status) {
+                goto done;
+            }
+        }
+        if (head == tail) {
+            break;
+        }
+        ring->reader.read_count = 0;
+        IOTCL_ATOMIC_STORE(&ring->tail, tail + 1);
+    }
+    if (ring->reader.has_window && f.options->include_open_window) {
+        status = iotcl_sample_flush_window(&f);
+    }
+
+    done:
+    if (num_data_sets) {
+        *num_data_sets = f.num_data_sets;
+    }
+    return IOTCL_SAMPLE_BUDGET_REACHED == status ? IOTCL_ERR_OVERFLOW : status;
+}
@@ -0,0 +1,199 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "iotcl_internal.h"
+#include "iotcl_cfg.h"
+#include "iotcl_log.h"
+#include "iotcl_stats.h"
+
+static const uint32_t bucket_limits_us[IOTCL_STATS_NUM_BUCKETS - 1] = IOTCL_STATS_BUCKET_LIMITS_US;
+
+static const struct {
+    const char *name;
+    const char *help;
+} counter_info[IOTCL_STATS_COUNTER_MAX] = {
+        {"iotcl_telemetry_created_total", "Telemetry messages created."},
+        {"iotcl_telemetry_values_set_total", "Telemetry values set."},
+        {"iotcl_telemetry_errors_total", "Failed telemetry set, add data set and serialize calls."},
+        {"iotcl_telemetry_serialized_total", "Telemetry messages serialized."},
+        {"iotcl_telemetry_serialized_bytes_total", "Bytes of serialized telemetry."},
+        {"iotcl_mqtt_messages_sent_total", "Messages passed to the MQTT send callback."},
+        {"iotcl_mqtt_sent_bytes_total", "Bytes passed to the MQTT send callback."},
+        {"iotcl_c2d_received_total", "C2D messages received."},
+        {"iotcl_c2d_dispatched_total", "C2D messages parsed and dispatched to callbacks."},
+        {"iotcl_c2d_ignored_total", "C2D messages ignored, including duplicates."},
+        {"iotcl_c2d_rejected_total", "C2D messages that failed to parse or are not supported."},
+        {"iotcl_acks_created_total", "Acknowledgements created."},
+        {"iotcl_acks_sent_total", "Acknowledgements sent."},
+        {"iotcl_dra_responses_parsed_total", "Device REST API responses parsed successfully."},
+        {"iotcl_dra_errors_total", "Device REST API responses that failed to parse or reported an error."},
+};
+
+static const struct {
+    const char *name;
+    const char *help;
+} histogram_info[IOTCL_STATS_HISTOGRAM_MAX] = {
+        {"iotcl_telemetry_set_duration_seconds", "Duration of telemetry set calls."},
+        {"iotcl_telemetry_serialize_duration_seconds", "Duration of telemetry serialization."},
+        {"iotcl_mqtt_send_duration_seconds", "Time spent in the MQTT send callback."},
+        {"iotcl_c2d_process_duration_seconds", "Duration of C2D parsing and dispatch, including callbacks."},
+        {"iotcl_ack_create_duration_seconds", "Duration of acknowledgement creation."},
+        {"iotcl_dra_parse_duration_seconds", "Duration of device REST API response parsing."},
+};
+
+static IotclStatsClockFunction clock_fn = NULL;
+
+#ifdef IOTCL_ENABLE_STATS
+static IotclStatsSnapshot stats;
+
+uint32_t iotcl_stats_now_us(void) {
+    IotclStatsClockFunction fn = IOTCL_ATOMIC_LOAD(&clock_fn);
+    return fn ? fn() : 0;
+}
+
+void iotcl_stats_add(IotclStatsCounter counter, unsigned long value) {
+    IOTCL_ATOMIC_ADD_FETCH(&stats.counters[counter], value);
+}
+
+void iotcl_stats_record_latency(IotclStatsHistogramId histogram, uint32_t start_us) {
+    IotclStatsClockFunction fn = IOTCL_ATOMIC_LOAD(&clock_fn);
+    if (!fn) {
+        return;
+    }
+    const uint32_t elapsed_us = fn() - start_us; // wraps correctly
+    int bucket = 0;
+    while (bucket < IOTCL_STATS_NUM_BUCKETS - 1 && elapsed_us > bucket_limits_us[bucket]) {
+        bucket++;
+    }
+    IotclStatsHistogram *h = &stats.histograms[histogram];
+    IOTCL_ATOMIC_ADD_FETCH(&h->buckets[bucket], 1);
+    IOTCL_ATOMIC_ADD_FETCH(&h->sum_us, (unsigned long) elapsed_us);
+    IOTCL_ATOMIC_ADD_FETCH(&h->count, 1);
+}
+
+int iotcl_stats_snapshot(IotclStatsSnapshot *snapshot) {
+    if (!snapshot) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_stats_snapshot: Snapshot is required");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    for (int i = 0; i < IOTCL_STATS_COUNTER_MAX; i++) {
+        snapshot->counters[i] = IOTCL_ATOMIC_LOAD(&stats.counters[i]);
+    }
+    for (int i = 0; i < IOTCL_STATS_HISTOGRAM_MAX; i++) {
+        const IotclStatsHistogram *h = &stats.histograms[i];
+        IotclStatsHistogram *out = &snapshot->histograms[i];
+        out->count = IOTCL_ATOMIC_LOAD(&h->count);
+        out->sum_us = IOTCL_ATOMIC_LOAD(&h->sum_us);
+        for (int b = 0; b < IOTCL_STATS_NUM_BUCKETS; b++) {
+            out->buckets[b] = IOTCL_ATOMIC_LOAD(&h->buckets[b]);
+        }
+    }
+    return IOTCL_SUCCESS;
+}
+
+void iotcl_stats_reset(void) {
+    for (int i = 0; i < IOTCL_STATS_COUNTER_MAX; i++) {
+        IOTCL_ATOMIC_STORE(&stats.counters[i], 0);
+    }
+    for (int i = 0; i < IOTCL_STATS_HISTOGRAM_MAX; i++) {
+        IotclStatsHistogram *h = &stats.histograms[i];
+        IOTCL_ATOMIC_STORE(&h->count, 0);
+        IOTCL_ATOMIC_STORE(&h->sum_us, 0);
+        for (int b = 0; b < IOTCL_STATS_NUM_BUCKETS; b++) {
+            IOTCL_ATOMIC_STORE(&h->buckets[b], 0);
+        }
+    }
+}
+#else
+int iotcl_stats_snapshot(IotclStatsSnapshot *snapshot) {
+    if (snapshot) {
+        memset(snapshot, 0, sizeof(IotclStatsSnapshot));
+    }
+    // not an error in builds without statistics, so nothing is logged for exporters that poll periodically
+    return IOTCL_ERR_CONFIG_MISSING;
+}
+
+void iotcl_stats_reset(void) {
+}
+#endif
+
+void iotcl_stats_configure_clock(IotclStatsClockFunction now_us_fn) {
+    IOTCL_ATOMIC_STORE(&clock_fn, now_us_fn);
+}
+
+typedef struct {
+    char *buffer;
+    size_t size;
+    size_t length;
+} IotclStatsWriter;
+
+// Appends to the buffer while it fits and keeps counting the length beyond that.
+static void iotcl_stats_write(IotclStatsWriter *w, const char *format, ...) {
+    va_list args;
+    char *dest = NULL;
+    size_t remaining = 0;
+    if (w->buffer && w->length < w->size) {
+        dest = &w->buffer[w->length];
+        remaining = w->size - w->length;
+    }
+    va_start(args, format);
+    const int len = vsnprintf(dest, remaining, format, args);
+    va_end(args);
+    if (len > 0) {
+        w->length += (size_t) len;
+    }
+}
+
+// Writes microseconds as seconds without relying on floating point support in printf
+static void iotcl_stats_write_seconds(IotclStatsWriter *w, unsigned long us) {
+    iotcl_stats_write(w, "%lu.%06lu", us / 1000000UL, us % 1000000UL);
+}
+
+int iotcl_stats_export_prometheus(const IotclStatsSnapshot *snapshot, char *buffer, size_t buffer_size, size_t *length) {
+    IotclStatsWriter w = {buffer, buffer_size, 0};
+    if (!snapshot || !length) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_stats_export_prometheus: Snapshot and length are required");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (buffer && buffer_size > 0) {
+        buffer[0] = '\0';
+    }
+
+    for (int i = 0; i < IOTCL_STATS_COUNTER_MAX; i++) {
+        iotcl_stats_write(&w, "# HELP %s %s\n# TYPE %s counter\n%s %lu\n",
+                          counter_info[i].name, counter_info[i].help, counter_info[i].name,
+                          counter_info[i].name, snapshot->counters[i]);
+    }
+    for (int i = 0; i < IOTCL_STATS_HISTOGRAM_MAX; i++) {
+        const IotclStatsHistogram *h = &snapshot->histograms[i];
+        const char *name = histogram_info[i].name;
+        unsigned long cumulative = 0;
+        iotcl_stats_write(&w, "# HELP %s %s\n# TYPE %s histogram\n", name, histogram_info[i].help, name);
+        for (int b = 0; b < IOTCL_STATS_NUM_BUCKETS - 1; b++) {
+            cumulative += h->buckets[b];
+            iotcl_stats_write(&w, "%s_bucket{le=\"", name);
+            iotcl_stats_write_seconds(&w, bucket_limits_us[b]);
+            iotcl_stats_write(&w, "\"} %lu\n", cumulative);
+        }
+        cumulative += h->buckets[IOTCL_STATS_NUM_BUCKETS - 1];
+        iotcl_stats_write(&w, "%s_bucket{le=\"+Inf\"} %lu\n%s_sum ", name, cumulative, name);
+        iotcl_stats_write_seconds(&w, h->sum_us);
+        // Prometheus expects the count to match the +Inf bucket
+        iotcl_stats_write(&w, "\n%s_count %lu\n", name, cumulative);
+    }
+
+    *length = w.length;
+    if (w.length >= buffer_size) {
+        if (buffer) {
+            IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "iotcl_stats_export_prometheus: %lu bytes are required", (unsigned long) w.length + 1);
+        }
+        return IOTCL_ERR_OVERFLOW;
+    }
+    return IOTCL_SUCCESS;
+}
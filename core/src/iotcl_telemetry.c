@@ -3,7 +3,9 @@
  * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
  */
 
+#include <ctype.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "cJSON.h"
@@ -18,8 +20,158 @@ struct IotclMessageHandleTag {
     cJSON *root_value;       // The root of the message. Only this one needs to be JSON_Delete-d
     cJSON *data_set_array;   // Convenience: The "d" array of data points.
     cJSON *current_data_set; // Convenience: Current data set object inside the "d" array containing current data values.
+    struct IotclTelemetryKeySlot *key_index; // Index of the values and objects in current_data_set. NULL if not built.
+    size_t key_index_size;   // Number of slots in key_index. A power of two.
+    size_t key_count;        // Number of values and objects in current_data_set, including the nested ones
+#ifdef IOTCL_NO_HEAP
+    IotclArena arena;        // The caller provided storage. This handle is the first allocation in it.
+#endif
 };
 
+typedef enum {
+    IOTCL_TELEMETRY_VALUE_NUMBER,
+    IOTCL_TELEMETRY_VALUE_STRING,
+    IOTCL_TELEMETRY_VALUE_BOOL,
+    IOTCL_TELEMETRY_VALUE_NULL,
+    IOTCL_TELEMETRY_VALUE_RAW, // string_value is already valid JSON, like a formatted integer
+} IotclTelemetryValueType;
+
+// An entry of the key index: node is a child of parent with the key node->string.
+// Keys are never removed, so lookups can stop at the first empty slot.
+typedef struct IotclTelemetryKeySlot {
+    cJSON *parent;
+    cJSON *node; // NULL if the slot is not used
+} IotclTelemetryKeySlot;
+
+// In IOTCL_NO_HEAP mode, all allocations made while working on a message need to go into the message storage.
+// Returns the previously active arena that needs to be passed to iotcl_telemetry_end_storage().
+static void *iotcl_telemetry_begin_storage(IotclMessageHandle message) {
+#ifdef IOTCL_NO_HEAP
+    return iotcl_arena_activate(message ? &message->arena : NULL);
+#else
+    (void) message;
+    return NULL;
+#endif
+}
+
+static void iotcl_telemetry_end_storage(void *previous) {
+#ifdef IOTCL_NO_HEAP
+    (void) iotcl_arena_activate((IotclArena *) previous);
+#else
+    (void) previous;
+#endif
+}
+
+// FNV-1a of the ASCII-lowercased key, so that keys which differ only in case land in the same probe sequence
+// and object names can be looked up regardless of case.
+static uint32_t iotcl_telemetry_key_hash(const cJSON *parent, const char *key, size_t key_len) {
+    const uintptr_t parent_bits = (uintptr_t) parent;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < key_len; i++) {
+        hash ^= (uint8_t) tolower((unsigned char) key[i]);
+        hash *= 16777619u;
+    }
+    return hash ^ (uint32_t) (parent_bits >> 4);
+}
+
+static bool iotcl_telemetry_is_key(const cJSON *node, const char *key, size_t key_len, bool ignore_case) {
+    if (!node->string) {
+        return false;
+    }
+    if (!ignore_case) {
+        return 0 == strncmp(node->string, key, key_len) && '\0' == node->string[key_len];
+    }
+    // same as the comparison in cJSON_GetObjectItem()
+    for (size_t i = 0; i < key_len; i++) {
+        if (tolower((unsigned char) node->string[i]) != tolower((unsigned char) key[i])) {
+            return false; // also stops at the terminator of a shorter node->string
+        }
+    }
+    return '\0' == node->string[key_len];
+}
+
+// Returns the index slot holding the key of parent, or the empty slot where it should be inserted.
+// The index must be built.
+static IotclTelemetryKeySlot *iotcl_telemetry_find_slot(
+        IotclMessageHandle message,
+        const cJSON *parent,
+        const char *key,
+        size_t key_len,
+        bool ignore_case
+) {
+    const size_t mask = message->key_index_size - 1;
+    size_t i = iotcl_telemetry_key_hash(parent, key, key_len) & mask;
+    for (;;) {
+        IotclTelemetryKeySlot *slot = &message->key_index[i];
+        if (!slot->node || (slot->parent == parent && iotcl_telemetry_is_key(slot->node, key, key_len, ignore_case))) {
+            return slot;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+// Returns the child of parent (in the current data set) with the key of key_len characters, or NULL.
+// Object names in paths are matched regardless of case, like cJSON_GetObjectItem() does, so that "accel.x"
+// and "Accel.y" are set in the same object. Value names are matched exactly.
+static cJSON *iotcl_telemetry_find_key(
+        IotclMessageHandle message,
+        cJSON *parent,
+        const char *key,
+        size_t key_len,
+        bool ignore_case
+) {
+    if (message->key_index) {
+        return iotcl_telemetry_find_slot(message, parent, key, key_len, ignore_case)->node;
+    }
+    // Small data set, or the index could not be allocated
+    for (cJSON *child = parent->child; child; child = child->next) {
+        if (iotcl_telemetry_is_key(child, key, key_len, ignore_case)) {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+static void iotcl_telemetry_index_children(IotclMessageHandle message, cJSON *parent) {
+    for (cJSON *child = parent->child; child; child = child->next) {
+        IotclTelemetryKeySlot *slot =
+                iotcl_telemetry_find_slot(message, parent, child->string, strlen(child->string), false);
+        slot->parent = parent;
+        slot->node = child;
+        if (cJSON_IsObject(child)) {
+            iotcl_telemetry_index_children(message, child);
+        }
+    }
+}
+
+// Counts a node that was just added to the current data set and adds it to the index.
+// The index is built once the data set has IOTCL_TELEMETRY_KEY_INDEX_MIN_KEYS keys, and rebuilt twice as large
+// when it gets 3/4 full. If it cannot be allocated, lookups fall back to searching linearly.
+static void iotcl_telemetry_add_key(IotclMessageHandle message, cJSON *parent, cJSON *node) {
+    message->key_count++;
+    if (message->key_index && message->key_count * 4 <= message->key_index_size * 3) {
+        IotclTelemetryKeySlot *slot = iotcl_telemetry_find_slot(message, parent, node->string, strlen(node->string), false);
+        slot->parent = parent;
+        slot->node = node;
+        return;
+    }
+    if (message->key_count < IOTCL_TELEMETRY_KEY_INDEX_MIN_KEYS) {
+        return;
+    }
+    size_t size = message->key_index ? message->key_index_size * 2 : 16;
+    while (message->key_count * 4 > size * 3) {
+        size *= 2;
+    }
+    iotcl_free(message->key_index);
+    message->key_index = iotcl_malloc(size * sizeof(IotclTelemetryKeySlot));
+    if (!message->key_index) {
+        return;
+    }
+    memset(message->key_index, 0, size * sizeof(IotclTelemetryKeySlot));
+    message->key_index_size = size;
+    iotcl_telemetry_index_children(message, message->current_data_set);
+}
+
 static int setup_data_set_object(const char *function_name, IotclMessageHandle message, const char *iso_timestamp) {
     cJSON *current_data_set = NULL;
     cJSON *array_item = cJSON_CreateObject();
@@ -31,7 +183,9 @@ static int setup_data_set_object(const char *function_name, IotclMessageHandle m
 
     // If the user didn't pass the timestamp and time function is configured
     if (!iso_timestamp && iotcl_get_global_config()->time_fn) {
+        IOTCL_TRACE_BEGIN(trace_start);
         int status = iotcl_iso_timestamp_now(time_str_buffer, sizeof(time_str_buffer));
+        IOTCL_TRACE_END("timestamp", trace_start);
         if (IOTCL_SUCCESS == status) {
             iso_timestamp = time_str_buffer;
         } else {
@@ -55,6 +209,11 @@ static int setup_data_set_object(const char *function_name, IotclMessageHandle m
 
     // and set this up at last, as it cannot fail
     message->current_data_set = current_data_set;
+    message->key_count = 0;
+    if (message->key_index) {
+        // reuse the index for the new data set
+        memset(message->key_index, 0, message->key_index_size * sizeof(IotclTelemetryKeySlot));
+    }
 
     return IOTCL_SUCCESS; // object inside the "d" array of the the root object
 
@@ -68,10 +227,10 @@ static int setup_data_set_object(const char *function_name, IotclMessageHandle m
 // Common functionality for all set functions.
 // Lazy creates message->current_data_set and sets it up with timestamp (if available).
 // Prints common errors and returns the error if one is encountered.
-// Returns the parent object where the lef needs to be set in case, for example,
-//  coordinate.x needs to be set. In those case, only one level of nesting is allowed.
-//  If coordinate object exists at data top level, it will be returned, or a new one will be created
-//  and added at data top level.
+// Returns the parent object where the leaf needs to be set in case, for example,
+//  coordinate.x or motor.phase_a.current needs to be set. Paths can be nested to any depth.
+//  If the coordinate object exists in the data set, it will be returned, or a new one will be created
+//  and added to the data set, and similarly for each level of nesting.
 static int iotcl_telemetry_set_functions_common(
         const char *function_name,
         cJSON **parent_object,
@@ -79,7 +238,6 @@ static int iotcl_telemetry_set_functions_common(
         IotclMessageHandle message,
         const char *path
 ) {
-    const int DOT_INDEX_NONE = -1;
     int status;
 
     *parent_object = NULL;
@@ -107,68 +265,123 @@ static int iotcl_telemetry_set_functions_common(
     }
     *parent_object = message->current_data_set;
 
-    int dot_index = DOT_INDEX_NONE;
-    size_t path_len = strlen(path);
-    // walk the string and look for dots
-    for (size_t i = 0; i < path_len; i++) {
-        char ch = path[i];
-        if (ch == '.') {
-            if (i == 0) {
-                IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Path \"%s\" cannot start with \".\"!", function_name, path);
-                return IOTCL_ERR_BAD_VALUE;
-            } else if (dot_index == DOT_INDEX_NONE) {
-                dot_index = (int) i;
-            } else {
-                IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Path \"%s\" cannot cannot have more than one \".\"!", function_name, path);
-                return IOTCL_ERR_BAD_VALUE;
-            }
-        }
+    // Fast path: a top level value
+    const char *dot = strchr(path, '.');
+    if (!dot) {
+        *leaf_name = path;
+        return IOTCL_SUCCESS;
+    }
+    if (dot == path) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Path \"%s\" cannot start with \".\"!", function_name, path);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    if ('.' == path[strlen(path) - 1]) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Path \"%s\" cannot end with \".\"!", function_name, path);
+        return IOTCL_ERR_BAD_VALUE;
     }
 
-    if (dot_index == DOT_INDEX_NONE) {
-        *parent_object = message->current_data_set;
-        *leaf_name = path;
-        return  IOTCL_SUCCESS;
-    } else {
-        const char *leaf_name_str = &path[dot_index + 1];
-        if (*leaf_name_str == '\0') {
-            IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Path \"%s\" cannot end with \".\"!", function_name, path);
-            return IOTCL_ERR_BAD_VALUE;
+    // Walk down the objects for each segment of the path, creating the missing ones.
+    // Objects are found with the key index, keyed by the parent object and the segment,
+    // so the cost is proportional to the path depth and not to the number of values in the data set.
+    cJSON *parent = message->current_data_set;
+    const char *segment = path;
+    char *object_name = NULL; // a copy of the path, made only if an object needs to be created
+    status = IOTCL_SUCCESS;
+    while (dot) {
+        if (dot == segment) {
+            IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Path \"%s\" cannot contain \"..\"!", function_name, path);
+            status = IOTCL_ERR_BAD_VALUE;
+            goto cleanup;
         }
-        char *object_name = iotcl_strdup(path);
-        if (!object_name) {
-            IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory!", function_name);
-            return IOTCL_ERR_BAD_VALUE;
+        cJSON *object = iotcl_telemetry_find_key(message, parent, segment, (size_t) (dot - segment), true);
+        if (object && !cJSON_IsObject(object)) {
+            IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Error: \"%.*s\" must be an object type and not a value!",
+                        function_name, (int) (dot - path), path);
+            status = IOTCL_ERR_BAD_VALUE;
+            goto cleanup;
         }
-        // else we need to break down the path string in two on the dot...
-
-        // truncate the duplicate here so we can nest with the object name
-        object_name[dot_index] = '\0';
-
-        cJSON *parent_obj_ptr = cJSON_GetObjectItem(message->current_data_set, object_name);
-        if (parent_obj_ptr) {
-            if (!cJSON_IsObject(parent_obj_ptr)) {
-                iotcl_free(object_name);
-                IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Error: \"%s\" must be an object type and not a value!", function_name, object_name);
-                return IOTCL_ERR_BAD_VALUE;
+        if (!object) {
+            if (!object_name) {
+                object_name = iotcl_strdup(path);
+                if (!object_name) {
+                    IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory!", function_name);
+                    status = IOTCL_ERR_OUT_OF_MEMORY;
+                    goto cleanup;
+                }
             }
-            *parent_object = parent_obj_ptr;
-        } else {
-            *parent_object = cJSON_AddObjectToObject(message->current_data_set, object_name);
-        }
-        iotcl_free(object_name);
-        if (!*parent_object) {
-            IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory!", function_name);
-            return IOTCL_ERR_BAD_VALUE;
+            // terminate the segment in the copy so we can nest with the object name
+            object_name[dot - path] = '\0';
+            object = cJSON_AddObjectToObject(parent, &object_name[segment - path]);
+            if (!object) {
+                IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory!", function_name);
+                status = IOTCL_ERR_OUT_OF_MEMORY;
+                goto cleanup;
+            }
+            iotcl_telemetry_add_key(message, parent, object);
         }
-        *leaf_name = leaf_name_str;
+        parent = object;
+        segment = dot + 1;
+        dot = strchr(segment, '.');
     }
-    return IOTCL_SUCCESS;
+    *parent_object = parent;
+    *leaf_name = segment;
+
+    cleanup:
+    iotcl_free(object_name);
+    return status;
 }
 
+// Sets up the root object of a zeroed out message
+static IotclMessageHandle iotcl_telemetry_setup_message(struct IotclMessageHandleTag *message) {
+    message->root_value = cJSON_CreateObject();
+    if (!message->root_value) goto cleanup;
+
+    message->data_set_array = cJSON_AddArrayToObject(message->root_value, "d");
+    if (!message->data_set_array) goto cleanup;
+
+    IOTCL_STATS_INC(IOTCL_STATS_TELEMETRY_CREATED);
+    return message;
+
+    cleanup:
+    IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "iotcl_telemetry_create: Out of memory error!");
+    cJSON_Delete(message->root_value);
+    message->root_value = NULL;
+    message->data_set_array = NULL;
+    return NULL;
+}
+
+#ifdef IOTCL_NO_HEAP
 IotclMessageHandle iotcl_telemetry_create(void) {
-    const char * FUNCTION_NAME = "iotcl_telemetry_set_null";
+    IOTCL_ERROR(IOTCL_ERR_CONFIG_ERROR, "iotcl_telemetry_create: Use iotcl_telemetry_create_in_storage() when IOTCL_NO_HEAP is defined");
+    return NULL;
+}
 
+IotclMessageHandle iotcl_telemetry_create_in_storage(void *storage, size_t storage_size) {
+    if (!iotcl_get_global_config()->is_valid) {
+        return NULL; // called function will print the error
+    }
+    if (!storage) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_telemetry_create_in_storage: Storage is required!");
+        return NULL;
+    }
+
+    IotclArena arena;
+    iotcl_arena_init(&arena, storage, storage_size);
+    struct IotclMessageHandleTag *message = iotcl_arena_alloc(&arena, sizeof(struct IotclMessageHandleTag));
+    if (!message) {
+        IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "iotcl_telemetry_create_in_storage: Storage is too small!");
+        return NULL;
+    }
+    memset(message, 0, sizeof(struct IotclMessageHandleTag));
+    message->arena = arena;
+
+    void *previous = iotcl_telemetry_begin_storage(message);
+    IotclMessageHandle ret = iotcl_telemetry_setup_message(message);
+    iotcl_telemetry_end_storage(previous);
+    return ret;
+}
+#else
+IotclMessageHandle iotcl_telemetry_create(void) {
     // check early in the call sequence that the config is valid, so it is safe to assume it is configured
     // in subsequent calls to other iotcl_telemetry_* functions.
     if (!iotcl_get_global_config()->is_valid) {
@@ -183,22 +396,13 @@ IotclMessageHandle iotcl_telemetry_create(void) {
     }
     memset(message, 0, sizeof(struct IotclMessageHandleTag));
 
-    message->root_value = cJSON_CreateObject();
-    if (!message->root_value) goto cleanup;
-
-    message->data_set_array = cJSON_AddArrayToObject(message->root_value, "d");
-    if (!message->data_set_array) goto cleanup;
-
+    if (!iotcl_telemetry_setup_message(message)) {
+        iotcl_free(message); // the called function will print the error
+        return NULL;
+    }
     return message;
-
-    cleanup:
-    IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory error!", FUNCTION_NAME);
-    cJSON_Delete(message->root_value);
-    message->root_value = NULL;
-    message->data_set_array = NULL;
-    iotcl_free(message);
-    return NULL;
 }
+#endif
 
 int iotcl_telemetry_add_new_data_set(IotclMessageHandle message, const char *iso_timestamp) {
     const char *FUNCTION_NAME = "iotcl_telemetry_add_new_data_set";
@@ -210,121 +414,258 @@ int iotcl_telemetry_add_new_data_set(IotclMessageHandle message, const char *iso
         IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The iso_timestamp argument is required!", FUNCTION_NAME);
         return IOTCL_ERR_MISSING_VALUE;
     }
+    void *previous = iotcl_telemetry_begin_storage(message);
     int status = setup_data_set_object("iotcl_telemetry_add_with_iso_time", message, iso_timestamp);
+    iotcl_telemetry_end_storage(previous);
     if (status) {
         // called function should print the error message
+        IOTCL_STATS_INC(IOTCL_STATS_TELEMETRY_ERRORS);
         return status;
     }
     return IOTCL_SUCCESS;
 }
 
-int iotcl_telemetry_set_number(IotclMessageHandle message, const char *path, double value) {
-    const char *FUNCTION_NAME = "iotcl_telemetry_set_number";
-
+static int iotcl_telemetry_set_value(
+        const char *function_name,
+        IotclMessageHandle message,
+        const char *path,
+        IotclTelemetryValueType type,
+        double number_value,
+        const char *string_value,
+        bool bool_value
+) {
     if (NULL == message) {
-        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The message handle argument is required!", FUNCTION_NAME);
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The message handle argument is required!", function_name);
         return IOTCL_ERR_MISSING_VALUE;
     }
 
+    IOTCL_STATS_TIME_START(stats_start);
+    IOTCL_TRACE_BEGIN(trace_start);
+    void *previous = iotcl_telemetry_begin_storage(message);
+
+    IOTCL_TRACE_BEGIN(path_start);
     cJSON *parent_object = NULL;
     const char *leaf_name = NULL;
     int status = iotcl_telemetry_set_functions_common(
-            FUNCTION_NAME,
+            function_name,
             &parent_object,
             &leaf_name,
             message,
             path
     );
+    IOTCL_TRACE_END("path", path_start);
     if (status) {
         // called function will print the error
-        return status;
+        goto cleanup;
     }
 
-    if (!cJSON_AddNumberToObject(parent_object, leaf_name, value)) {
-        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory error!", FUNCTION_NAME);
-        return IOTCL_ERR_OUT_OF_MEMORY;
+    IOTCL_TRACE_BEGIN(add_start);
+    // The last value set for a path wins
+    cJSON *existing = iotcl_telemetry_find_key(message, parent_object, leaf_name, strlen(leaf_name), false);
+    if (existing && cJSON_IsObject(existing)) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Error: \"%s\" is an object and cannot be set to a value!", function_name, path);
+        status = IOTCL_ERR_BAD_VALUE;
+        goto cleanup;
+    }
+    if (existing && IOTCL_TELEMETRY_VALUE_NUMBER == type && cJSON_IsNumber(existing)) {
+        cJSON_SetNumberHelper(existing, number_value);
+        IOTCL_TRACE_END("cjson_add", add_start);
+        goto cleanup;
+    }
+    cJSON *item = NULL;
+    switch (type) {
+        case IOTCL_TELEMETRY_VALUE_NUMBER:
+            item = cJSON_CreateNumber(number_value);
+            break;
+        case IOTCL_TELEMETRY_VALUE_STRING:
+            item = cJSON_CreateString(string_value);
+            break;
+        case IOTCL_TELEMETRY_VALUE_BOOL:
+            item = cJSON_CreateBool(bool_value);
+            break;
+        case IOTCL_TELEMETRY_VALUE_NULL:
+            item = cJSON_CreateNull();
+            break;
+        case IOTCL_TELEMETRY_VALUE_RAW:
+            item = cJSON_CreateRaw(string_value);
+            break;
+    }
+    if (item && existing) {
+        // The replacement takes over the key, and the index slot is updated to point to it
+        if (message->key_index) {
+            iotcl_telemetry_find_slot(message, parent_object, leaf_name, strlen(leaf_name), false)->node = item;
+        }
+        item->string = existing->string;
+        existing->string = NULL;
+        cJSON_ReplaceItemViaPointer(parent_object, existing, item);
+    } else if (item) {
+        if (cJSON_AddItemToObject(parent_object, leaf_name, item)) {
+            iotcl_telemetry_add_key(message, parent_object, item);
+        } else {
+            cJSON_Delete(item);
+            item = NULL;
+        }
+    }
+    IOTCL_TRACE_END("cjson_add", add_start);
+    if (!item) {
+        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory error!", function_name);
+        status = IOTCL_ERR_OUT_OF_MEMORY;
     }
 
-    return IOTCL_SUCCESS;
+    cleanup:
+    iotcl_telemetry_end_storage(previous);
+    IOTCL_STATS_INC(status ? IOTCL_STATS_TELEMETRY_ERRORS : IOTCL_STATS_TELEMETRY_VALUES_SET);
+    IOTCL_STATS_TIME_END(IOTCL_STATS_TELEMETRY_SET_LATENCY, stats_start);
+    IOTCL_TRACE_END("iotcl_telemetry_set", trace_start);
+    return status;
 }
 
-int iotcl_telemetry_set_string(IotclMessageHandle message, const char *path, const char *value) {
-    const char *FUNCTION_NAME = "iotcl_telemetry_set_string";
-    if (NULL == message) {
-        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The message handle argument is required!", FUNCTION_NAME);
-        return IOTCL_ERR_MISSING_VALUE;
+bool iotcl_telemetry_round_to_str(double value, int decimals, char *buffer) {
+    static const double powers_of_10[IOTCL_TELEMETRY_MAX_DECIMALS + 1] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9
+    };
+    const double max_exact = 9007199254740992.0; // 2^53
+    const double scaled = value * powers_of_10[decimals];
+    if (!(scaled > -max_exact && scaled < max_exact)) { // also false for NaN
+        return false;
     }
+    const int64_t rounded = (int64_t) (scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+    iotcl_fixed_point_to_str(rounded, decimals, buffer);
+    return true;
+}
 
-    const char *leaf_name = NULL;
-    cJSON *parent_object = NULL;
-
-    int status = iotcl_telemetry_set_functions_common(
-            FUNCTION_NAME,
-            &parent_object,
-            &leaf_name,
-            message,
-            path
-    );
-    if (status) {
-        // called function will print the error
-        return status;
+int iotcl_telemetry_set_number(IotclMessageHandle message, const char *path, double value) {
+    const int decimals = iotcl_telemetry_get_precision(path);
+    if (decimals >= 0) {
+        char value_str[IOTCL_FIXED_POINT_STR_SIZE];
+        if (iotcl_telemetry_round_to_str(value, decimals, value_str)) {
+            return iotcl_telemetry_set_value("iotcl_telemetry_set_number", message, path, IOTCL_TELEMETRY_VALUE_RAW, 0, value_str, false);
+        }
     }
+    return iotcl_telemetry_set_value("iotcl_telemetry_set_number", message, path, IOTCL_TELEMETRY_VALUE_NUMBER, value, NULL, false);
+}
 
-    if (!cJSON_AddStringToObject(parent_object, leaf_name, value)) {
-        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory error!", FUNCTION_NAME);
-        return IOTCL_ERR_OUT_OF_MEMORY;
+int iotcl_telemetry_set_fixed_point(IotclMessageHandle message, const char *path, int64_t value, int decimals) {
+    if (decimals < 0 || decimals > IOTCL_TELEMETRY_MAX_FIXED_POINT_DECIMALS) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "iotcl_telemetry_set_fixed_point: Decimals must be from 0 to %d", IOTCL_TELEMETRY_MAX_FIXED_POINT_DECIMALS);
+        return IOTCL_ERR_BAD_VALUE;
     }
-
-    return IOTCL_SUCCESS;
+    char value_str[IOTCL_FIXED_POINT_STR_SIZE];
+    iotcl_fixed_point_to_str(value, decimals, value_str);
+    return iotcl_telemetry_set_value("iotcl_telemetry_set_fixed_point", message, path, IOTCL_TELEMETRY_VALUE_RAW, 0, value_str, false);
 }
 
-int iotcl_telemetry_set_bool(IotclMessageHandle message, const char *path, bool value) {
-    const char *FUNCTION_NAME = FUNCTION_NAME;
-    const char *leaf_name = NULL;
-    cJSON *parent_object = NULL;
-    int status = iotcl_telemetry_set_functions_common(
-            "iotcl_telemetry_set_bool",
-            &parent_object,
-            &leaf_name,
-            message,
-            path
-    );
-    if (status) {
-        // called function will print the error
-        return status;
-    }
+int iotcl_telemetry_set_int64(IotclMessageHandle message, const char *path, int64_t value) {
+    char value_str[IOTCL_INT64_STR_SIZE];
+    iotcl_int64_to_str(value, value_str);
+    return iotcl_telemetry_set_value("iotcl_telemetry_set_int64", message, path, IOTCL_TELEMETRY_VALUE_RAW, 0, value_str, false);
+}
 
-    if (!cJSON_AddBoolToObject(parent_object, leaf_name, value)) {
-        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory error!", FUNCTION_NAME);
-        return IOTCL_ERR_OUT_OF_MEMORY;
-    }
+int iotcl_telemetry_set_uint64(IotclMessageHandle message, const char *path, uint64_t value) {
+    char value_str[IOTCL_INT64_STR_SIZE];
+    iotcl_uint64_to_str(value, value_str);
+    return iotcl_telemetry_set_value("iotcl_telemetry_set_uint64", message, path, IOTCL_TELEMETRY_VALUE_RAW, 0, value_str, false);
+}
 
-    return IOTCL_SUCCESS;
+int iotcl_telemetry_set_string(IotclMessageHandle message, const char *path, const char *value) {
+    return iotcl_telemetry_set_value("iotcl_telemetry_set_string", message, path, IOTCL_TELEMETRY_VALUE_STRING, 0, value, false);
 }
 
+int iotcl_telemetry_set_bool(IotclMessageHandle message, const char *path, bool value) {
+    return iotcl_telemetry_set_value("iotcl_telemetry_set_bool", message, path, IOTCL_TELEMETRY_VALUE_BOOL, 0, NULL, value);
+}
 
 int iotcl_telemetry_set_null(IotclMessageHandle message, const char *path) {
-    const char *FUNCTION_NAME = "iotcl_telemetry_set_null";
-    const char *leaf_name = NULL;
-    cJSON *parent_object = NULL;
-    int status = iotcl_telemetry_set_functions_common(
-            FUNCTION_NAME,
-            &parent_object,
-            &leaf_name,
-            message,
-            path
-    );
-    if (status) {
-        // called function will print the error
-        return status;
-    }
+    return iotcl_telemetry_set_value("iotcl_telemetry_set_null", message, path, IOTCL_TELEMETRY_VALUE_NULL, 0, NULL, false);
+}
 
-    if (!cJSON_AddNullToObject(parent_object, leaf_name)) {
-        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory error!", FUNCTION_NAME);
-        return IOTCL_ERR_OUT_OF_MEMORY;
+#ifndef IOTCL_NO_HEAP
+// A range of data sets serialized by one parallel job
+typedef struct {
+    cJSON array;     // a detached array that holds the data sets of the range
+    cJSON *last;     // the last data set of the range, whose next pointer is cleared while serializing
+    char *json;      // the serialized array
+    size_t length;
+} IotclTelemetryRange;
+
+static void iotcl_telemetry_serialize_range(void *context, size_t index) {
+    IotclTelemetryRange *range = &((IotclTelemetryRange *) context)[index];
+    range->json = cJSON_PrintUnformatted(&range->array);
+    range->length = range->json ? strlen(range->json) : 0;
+}
+
+// Serializes the message with the configured executor, by splitting the "d" array into ranges.
+// Each range is serialized as an array, and the pieces are joined without their brackets.
+// The data sets themselves are not modified, except for the next pointers at the range boundaries,
+// which are restored before returning.
+static char *iotcl_telemetry_print_parallel(IotclMessageHandle message, size_t num_data_sets) {
+    const IotclParallelConfig *parallel = &iotcl_get_global_config()->parallel;
+    const size_t num_jobs = parallel->num_jobs < num_data_sets ? parallel->num_jobs : num_data_sets;
+    IotclTelemetryRange *ranges = iotcl_malloc(num_jobs * sizeof(IotclTelemetryRange));
+    if (!ranges) {
+        return NULL;
+    }
+    memset(ranges, 0, num_jobs * sizeof(IotclTelemetryRange));
+
+    cJSON *data_set = message->data_set_array->child;
+    for (size_t i = 0; i < num_jobs; i++) {
+        const size_t range_size = num_data_sets / num_jobs + (i < num_data_sets % num_jobs ? 1 : 0);
+        ranges[i].array.type = cJSON_Array;
+        ranges[i].array.child = data_set;
+        for (size_t j = 1; j < range_size; j++) {
+            data_set = data_set->next;
+        }
+        ranges[i].last = data_set;
+        data_set = data_set->next;
+        ranges[i].last->next = NULL;
     }
 
-    return IOTCL_SUCCESS;
+    parallel->executor(iotcl_telemetry_serialize_range, ranges, num_jobs);
+
+    // with the commas between the ranges and the null terminator
+    size_t length = sizeof("{\"d\":[]}") + num_jobs - 1;
+    bool is_ok = true;
+    for (size_t i = 0; i < num_jobs; i++) {
+        if (i + 1 < num_jobs) {
+            ranges[i].last->next = ranges[i + 1].array.child;
+        }
+        is_ok = is_ok && ranges[i].json;
+        length += ranges[i].length - 2;
+    }
+    char *serialized_string = is_ok ? cJSON_malloc(length) : NULL;
+    if (serialized_string) {
+        char *p = serialized_string;
+        memcpy(p, "{\"d\":[", 6);
+        p += 6;
+        for (size_t i = 0; i < num_jobs; i++) {
+            if (i > 0) {
+                *p++ = ',';
+            }
+            memcpy(p, &ranges[i].json[1], ranges[i].length - 2);
+            p += ranges[i].length - 2;
+        }
+        memcpy(p, "]}", 3);
+    }
+    for (size_t i = 0; i < num_jobs; i++) {
+        cJSON_free(ranges[i].json);
+    }
+    iotcl_free(ranges);
+    return serialized_string;
+}
+#endif
+
+static char *iotcl_telemetry_print(IotclMessageHandle message, bool pretty) {
+#ifndef IOTCL_NO_HEAP
+    // The root needs to have only the "d" array for the pieces to be joined
+    if (!pretty && iotcl_get_global_config()->parallel.executor
+        && message->root_value->child == message->data_set_array && !message->data_set_array->next) {
+        const size_t num_data_sets = (size_t) cJSON_GetArraySize(message->data_set_array);
+        if (num_data_sets > 0 && num_data_sets >= IOTCL_TELEMETRY_PARALLEL_MIN_DATA_SETS) {
+            return iotcl_telemetry_print_parallel(message, num_data_sets);
+        }
+    }
+#endif
+    return iotcl_json_print(message->root_value, pretty);
 }
 
 char *iotcl_telemetry_create_serialized_string(IotclMessageHandle message, bool pretty) {
@@ -340,16 +681,34 @@ char *iotcl_telemetry_create_serialized_string(IotclMessageHandle message, bool
         return NULL;
     }
 
-    char *serialized_string = (pretty) ?
-                              cJSON_Print(message->root_value) : cJSON_PrintUnformatted(message->root_value);
+    IOTCL_STATS_TIME_START(stats_start);
+    IOTCL_TRACE_BEGIN(trace_start);
+    void *previous = iotcl_telemetry_begin_storage(message);
+    char *serialized_string = iotcl_telemetry_print(message, pretty);
+    iotcl_telemetry_end_storage(previous);
+    IOTCL_TRACE_END("serialize", trace_start);
+    IOTCL_STATS_TIME_END(IOTCL_STATS_TELEMETRY_SERIALIZE_LATENCY, stats_start);
 
     if (!serialized_string) {
         IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory error!", FUNCTION_NAME);
+        IOTCL_STATS_INC(IOTCL_STATS_TELEMETRY_ERRORS);
         return NULL;
     }
+    IOTCL_STATS_INC(IOTCL_STATS_TELEMETRY_SERIALIZED);
+    IOTCL_STATS_ADD(IOTCL_STATS_TELEMETRY_BYTES, strlen(serialized_string));
     return serialized_string;
 }
 
+cJSON *iotcl_telemetry_get_root(IotclMessageHandle message) {
+    return message->root_value;
+}
+
+#ifdef IOTCL_NO_HEAP
+IotclArena *iotcl_telemetry_get_arena(IotclMessageHandle message) {
+    return &message->arena;
+}
+#endif
+
 void iotcl_telemetry_destroy_serialized_string(char *serialized_string) {
     cJSON_free(serialized_string);
 }
@@ -357,6 +716,7 @@ void iotcl_telemetry_destroy_serialized_string(char *serialized_string) {
 void iotcl_telemetry_destroy(IotclMessageHandle message) {
     if (message) {
         cJSON_Delete(message->root_value);
+        iotcl_free(message->key_index);
         iotcl_free(message);
     }
 }
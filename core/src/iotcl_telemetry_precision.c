@@ -0,0 +1,88 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Telemetry precision registry. See PRECISION REGISTRY in iotcl_telemetry.h.
+ * Decimals are stored in an open addressing (linear probing) hash table keyed by the path.
+ * Entries are never removed individually, so lookups can stop at the first empty slot.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "iotcl_log.h"
+#include "iotcl_internal.h"
+#include "iotcl.h"
+#include "iotcl_telemetry.h"
+
+#if (IOTCL_TELEMETRY_PRECISION_REGISTRY_SIZE <= 0) \
+    || ((IOTCL_TELEMETRY_PRECISION_REGISTRY_SIZE & (IOTCL_TELEMETRY_PRECISION_REGISTRY_SIZE - 1)) != 0)
+#error "IOTCL_TELEMETRY_PRECISION_REGISTRY_SIZE must be a power of two"
+#endif
+
+#define IOTCL_PRECISION_REGISTRY_MASK ((uint32_t) IOTCL_TELEMETRY_PRECISION_REGISTRY_SIZE - 1)
+
+typedef struct {
+    const char *path; // NULL if the slot is not used
+    int decimals;     // -1 if full precision was requested after declaring the path
+} IotclPrecisionSlot;
+
+static struct {
+    IotclPrecisionSlot slots[IOTCL_TELEMETRY_PRECISION_REGISTRY_SIZE];
+    int count;
+} registry;
+
+// Returns the slot holding the path, or the empty slot where it should be inserted,
+// or NULL if the path is not found and the table is full.
+static IotclPrecisionSlot *iotcl_precision_find_slot(const char *path) {
+    uint32_t index = iotcl_hash_fnv1a(path, strlen(path)) & IOTCL_PRECISION_REGISTRY_MASK;
+    for (int i = 0; i < IOTCL_TELEMETRY_PRECISION_REGISTRY_SIZE; i++) {
+        IotclPrecisionSlot *slot = &registry.slots[index];
+        if (!slot->path || slot->path == path || 0 == strcmp(slot->path, path)) {
+            return slot;
+        }
+        index = (index + 1) & IOTCL_PRECISION_REGISTRY_MASK;
+    }
+    return NULL;
+}
+
+int iotcl_telemetry_configure_precision(const char *path, int decimals) {
+    if (!path || 0 == strlen(path)) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_telemetry_configure_precision: The path argument is required!");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (decimals > IOTCL_TELEMETRY_MAX_DECIMALS) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "iotcl_telemetry_configure_precision: Decimals for \"%s\" must be at most %d",
+                    path, IOTCL_TELEMETRY_MAX_DECIMALS);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    IotclPrecisionSlot *slot = iotcl_precision_find_slot(path);
+    if (!slot) {
+        IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "iotcl_telemetry_configure_precision: The precision registry is full. Increase IOTCL_TELEMETRY_PRECISION_REGISTRY_SIZE.");
+        return IOTCL_ERR_OVERFLOW;
+    }
+    if (!slot->path) {
+        slot->path = path;
+        registry.count++;
+    }
+    slot->decimals = decimals < 0 ? -1 : decimals;
+    return IOTCL_SUCCESS;
+}
+
+void iotcl_telemetry_clear_precision(void) {
+    memset(&registry, 0, sizeof(registry));
+}
+
+int iotcl_telemetry_get_precision(const char *path) {
+    if (0 == registry.count || !path) {
+        return -1;
+    }
+    const IotclPrecisionSlot *slot = iotcl_precision_find_slot(path);
+    if (!slot || !slot->path) {
+        return -1;
+    }
+    return slot->decimals;
+}
@@ -0,0 +1,438 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Telemetry templates. See iotcl_telemetry_template.h.
+ * The template is serialized twice from the message: once to measure the string, slots and paths,
+ * and once into a single allocation holding the template, its slots, their paths and the string.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cJSON.h"
+
+#include "iotcl_log.h"
+#include "iotcl_internal.h"
+#include "iotcl_util.h"
+#include "iotcl.h"
+#include "iotcl_telemetry_template.h"
+
+// Width of a boolean slot: "false"
+#define IOTCL_TEMPLATE_BOOL_WIDTH 5
+
+// Buffer size for a number formatted with up to 17 significant digits, like -2.2250738585072014e-308
+#define IOTCL_TEMPLATE_NUMBER_STR_SIZE 32
+
+typedef struct {
+    size_t offset; // of the value in the serialized string
+    size_t width;
+    const char *path;
+    int decimals;  // declared precision of the path, or -1
+} IotclTemplateSlot;
+
+struct IotclTelemetryTemplateTag {
+    char *json;
+    size_t json_length;
+    IotclTemplateSlot *slots;
+    int slot_count;
+    size_t timestamp_offset;
+    size_t timestamp_width; // 0 if the data set has no timestamp
+};
+
+// Keys of the objects enclosing the value being written, innermost first.
+typedef struct IotclTemplatePathPart {
+    const char *key;
+    const struct IotclTemplatePathPart *parent;
+} IotclTemplatePathPart;
+
+// Measures the template when json is NULL, or writes it otherwise
+typedef struct {
+    char *json;
+    size_t length;
+    IotclTemplateSlot *slots;
+    int slot_count;
+    char *paths;
+    size_t paths_length;
+} IotclTemplateWriter;
+
+static void iotcl_template_write_bytes(IotclTemplateWriter *w, const char *bytes, size_t length) {
+    if (w->json) {
+        memcpy(&w->json[w->length], bytes, length);
+    }
+    w->length += length;
+}
+
+static void iotcl_template_write_padding(IotclTemplateWriter *w, size_t length) {
+    if (w->json) {
+        memset(&w->json[w->length], ' ', length);
+    }
+    w->length += length;
+}
+
+// Writes the string in quotes, escaped the same way as cJSON does it
+static void iotcl_template_write_string(IotclTemplateWriter *w, const char *str) {
+    iotcl_template_write_bytes(w, "\"", 1);
+    for (const unsigned char *p = (const unsigned char *) str; *p; p++) {
+        char escaped[7];
+        size_t length = 2;
+        escaped[0] = '\\';
+        switch (*p) {
+            case '"': escaped[1] = '"'; break;
+            case '\\': escaped[1] = '\\'; break;
+            case '\b': escaped[1] = 'b'; break;
+            case '\f': escaped[1] = 'f'; break;
+            case '\n': escaped[1] = 'n'; break;
+            case '\r': escaped[1] = 'r'; break;
+            case '\t': escaped[1] = 't'; break;
+            default:
+                if (*p < 32) {
+                    length = (size_t) snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned int) *p);
+                } else {
+                    escaped[0] = (char) *p;
+                    length = 1;
+                }
+                break;
+        }
+        iotcl_template_write_bytes(w, escaped, length);
+    }
+    iotcl_template_write_bytes(w, "\"", 1);
+}
+
+// Formats the number with the shortest of 15 or 17 significant digits that reads back the same value.
+// JSON has no representation of NaN and infinity, so they are written as null, like cJSON does.
+static size_t iotcl_template_format_number(double value, char *buffer) {
+    if (!isfinite(value)) {
+        strcpy(buffer, "null");
+        return 4;
+    }
+    int length = snprintf(buffer, IOTCL_TEMPLATE_NUMBER_STR_SIZE, "%1.15g", value);
+    if (strtod(buffer, NULL) != value) {
+        length = snprintf(buffer, IOTCL_TEMPLATE_NUMBER_STR_SIZE, "%1.17g", value);
+    }
+    return (size_t) length;
+}
+
+static void iotcl_template_write_path(IotclTemplateWriter *w, const IotclTemplatePathPart *part) {
+    size_t length = 0;
+    for (const IotclTemplatePathPart *p = part; p; p = p->parent) {
+        length += strlen(p->key) + 1; // and the dot or the null terminator
+    }
+    if (w->json) {
+        char *path = &w->paths[w->paths_length];
+        size_t end = length - 1;
+        path[end] = '\0';
+        for (const IotclTemplatePathPart *p = part; p; p = p->parent) {
+            const size_t key_length = strlen(p->key);
+            end -= key_length;
+            memcpy(&path[end], p->key, key_length);
+            if (end > 0) {
+                path[--end] = '.';
+            }
+        }
+        w->slots[w->slot_count].path = path;
+    }
+    w->paths_length += length;
+}
+
+// Writes the value padded to the width of its slot and records the slot
+static void iotcl_template_write_slot(IotclTemplateWriter *w, const cJSON *value, const IotclTemplatePathPart *path) {
+    char number_str[IOTCL_TEMPLATE_NUMBER_STR_SIZE];
+    const size_t offset = w->length;
+    size_t width = IOTCL_TELEMETRY_TEMPLATE_NUMBER_WIDTH;
+    if (cJSON_IsString(value)) {
+        iotcl_template_write_string(w, value->valuestring);
+        width = w->length - offset;
+    } else {
+        const char *text = number_str;
+        size_t length;
+        if (cJSON_IsNumber(value)) {
+            length = iotcl_template_format_number(value->valuedouble, number_str);
+        } else if (cJSON_IsRaw(value)) {
+            text = value->valuestring;
+            length = strlen(text);
+        } else if (cJSON_IsBool(value)) {
+            text = cJSON_IsTrue(value) ? "true" : "false";
+            length = strlen(text);
+            width = IOTCL_TEMPLATE_BOOL_WIDTH;
+        } else {
+            text = "null";
+            length = 4;
+        }
+        iotcl_template_write_bytes(w, text, length);
+        if (length > width) {
+            width = length;
+        }
+        iotcl_template_write_padding(w, width - length);
+    }
+    iotcl_template_write_path(w, path);
+    if (w->json) {
+        IotclTemplateSlot *slot = &w->slots[w->slot_count];
+        slot->offset = offset;
+        slot->width = width;
+        slot->decimals = iotcl_telemetry_get_precision(slot->path);
+    }
+    w->slot_count++;
+}
+
+static void iotcl_template_write_object(IotclTemplateWriter *w, const cJSON *object, const IotclTemplatePathPart *path) {
+    iotcl_template_write_bytes(w, "{", 1);
+    for (const cJSON *child = object->child; child; child = child->next) {
+        const IotclTemplatePathPart part = {child->string, path};
+        if (child != object->child) {
+            iotcl_template_write_bytes(w, ",", 1);
+        }
+        iotcl_template_write_string(w, child->string);
+        iotcl_template_write_bytes(w, ":", 1);
+        if (cJSON_IsObject(child)) {
+            iotcl_template_write_object(w, child, &part);
+        } else {
+            iotcl_template_write_slot(w, child, &part);
+        }
+    }
+    iotcl_template_write_bytes(w, "}", 1);
+}
+
+// Writes the message with the data set, which must be an object with only the "dt" and "d" items
+static int iotcl_template_write_message(IotclTemplateWriter *w, const cJSON *data_set, IotclTelemetryTemplate tmpl) {
+    iotcl_template_write_bytes(w, "{\"d\":[{", 7);
+    for (const cJSON *child = data_set->child; child; child = child->next) {
+        if (child != data_set->child) {
+            iotcl_template_write_bytes(w, ",", 1);
+        }
+        if (0 == strcmp(child->string, "dt") && cJSON_IsString(child)) {
+            iotcl_template_write_bytes(w, "\"dt\":", 5);
+            const size_t offset = w->length;
+            iotcl_template_write_string(w, child->valuestring);
+            size_t length = w->length - offset;
+            if (length < IOTCL_ISO_TIMESTAMP_STR_LEN + 2) {
+                iotcl_template_write_padding(w, IOTCL_ISO_TIMESTAMP_STR_LEN + 2 - length);
+                length = IOTCL_ISO_TIMESTAMP_STR_LEN + 2;
+            }
+            if (tmpl) {
+                tmpl->timestamp_offset = offset;
+                tmpl->timestamp_width = length;
+            }
+        } else if (0 == strcmp(child->string, "d") && cJSON_IsObject(child)) {
+            iotcl_template_write_bytes(w, "\"d\":", 4);
+            iotcl_template_write_object(w, child, NULL);
+        } else {
+            IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "iotcl_telemetry_template_create: Unexpected item \"%s\" in the data set!", child->string);
+            return IOTCL_ERR_BAD_VALUE;
+        }
+    }
+    iotcl_template_write_bytes(w, "}]}", 3);
+    return IOTCL_SUCCESS;
+}
+
+IotclTelemetryTemplate iotcl_telemetry_template_create(IotclMessageHandle message) {
+    const char *FUNCTION_NAME = "iotcl_telemetry_template_create";
+    if (!message) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The message handle argument is required!", FUNCTION_NAME);
+        return NULL;
+    }
+    const cJSON *data_set_array = cJSON_GetObjectItem(iotcl_telemetry_get_root(message), "d");
+    if (1 != cJSON_GetArraySize(data_set_array)) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: The message must have exactly one data set!", FUNCTION_NAME);
+        return NULL;
+    }
+    const cJSON *data_set = cJSON_GetArrayItem(data_set_array, 0);
+
+    IotclTemplateWriter w;
+    memset(&w, 0, sizeof(w));
+    if (iotcl_template_write_message(&w, data_set, NULL)) {
+        return NULL; // called function will print the error
+    }
+
+    const size_t slots_size = (size_t) w.slot_count * sizeof(IotclTemplateSlot);
+    const size_t size = sizeof(struct IotclTelemetryTemplateTag) + slots_size + w.paths_length + w.length + 1;
+#ifdef IOTCL_NO_HEAP
+    IotclArena *previous = iotcl_arena_activate(iotcl_telemetry_get_arena(message));
+    struct IotclTelemetryTemplateTag *tmpl = iotcl_malloc(size);
+    (void) iotcl_arena_activate(previous);
+#else
+    struct IotclTelemetryTemplateTag *tmpl = iotcl_malloc(size);
+#endif
+    if (!tmpl) {
+        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "%s: Out of memory!", FUNCTION_NAME);
+        return NULL;
+    }
+    memset(tmpl, 0, sizeof(struct IotclTelemetryTemplateTag));
+    tmpl->slots = (IotclTemplateSlot *) &tmpl[1];
+    tmpl->slot_count = w.slot_count;
+    tmpl->json_length = w.length;
+
+    w.slots = tmpl->slots;
+    w.paths = (char *) tmpl->slots + slots_size;
+    w.json = w.paths + w.paths_length;
+    w.length = 0;
+    w.slot_count = 0;
+    w.paths_length = 0;
+    (void) iotcl_template_write_message(&w, data_set, tmpl); // succeeded when measuring
+    w.json[w.length] = '\0';
+    tmpl->json = w.json;
+    return tmpl;
+}
+
+void iotcl_telemetry_template_destroy(IotclTelemetryTemplate tmpl) {
+#ifdef IOTCL_NO_HEAP
+    (void) tmpl; // the template is in the message storage, which is owned by the caller
+#else
+    iotcl_free(tmpl);
+#endif
+}
+
+int iotcl_telemetry_template_find_slot(IotclTelemetryTemplate tmpl, const char *path) {
+    if (!tmpl || !path) {
+        return -1;
+    }
+    for (int i = 0; i < tmpl->slot_count; i++) {
+        if (0 == strcmp(tmpl->slots[i].path, path)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Returns the slot, or NULL after printing the error if the arguments are not valid
+static const IotclTemplateSlot *iotcl_template_get_slot(const char *function_name, IotclTelemetryTemplate tmpl, int slot) {
+    if (!tmpl) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The template argument is required!", function_name);
+        return NULL;
+    }
+    if (slot < 0 || slot >= tmpl->slot_count) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "%s: Invalid slot %d!", function_name, slot);
+        return NULL;
+    }
+    return &tmpl->slots[slot];
+}
+
+static int iotcl_template_overflow_error(const char *function_name, const IotclTemplateSlot *s, size_t length) {
+    IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "%s: A value of %lu characters does not fit the %lu characters of \"%s\"!",
+                function_name, (unsigned long) length, (unsigned long) s->width, s->path);
+    return IOTCL_ERR_OVERFLOW;
+}
+
+// Copies the text into the slot and pads it with spaces
+static int iotcl_template_set_slot(const char *function_name, IotclTelemetryTemplate tmpl, int slot, const char *text, size_t length) {
+    const IotclTemplateSlot *s = iotcl_template_get_slot(function_name, tmpl, slot);
+    if (!s) {
+        return IOTCL_ERR_BAD_VALUE; // called function printed the error
+    }
+    if (length > s->width) {
+        return iotcl_template_overflow_error(function_name, s, length);
+    }
+    memcpy(&tmpl->json[s->offset], text, length);
+    memset(&tmpl->json[s->offset + length], ' ', s->width - length);
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_telemetry_template_set_timestamp(IotclTelemetryTemplate tmpl, const char *iso_timestamp) {
+    const char *FUNCTION_NAME = "iotcl_telemetry_template_set_timestamp";
+    char time_str_buffer[IOTCL_ISO_TIMESTAMP_STR_LEN + 1];
+    if (!tmpl) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The template argument is required!", FUNCTION_NAME);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (0 == tmpl->timestamp_width) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The template was created without a timestamp!", FUNCTION_NAME);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (!iso_timestamp) {
+        int status = iotcl_iso_timestamp_now(time_str_buffer, sizeof(time_str_buffer));
+        if (status) {
+            return status; // called function will print the error
+        }
+        iso_timestamp = time_str_buffer;
+    }
+    IotclTemplateWriter w;
+    memset(&w, 0, sizeof(w));
+    iotcl_template_write_string(&w, iso_timestamp);
+    if (w.length > tmpl->timestamp_width) {
+        IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "%s: Timestamp %s is too long!", FUNCTION_NAME, iso_timestamp);
+        return IOTCL_ERR_OVERFLOW;
+    }
+    w.json = &tmpl->json[tmpl->timestamp_offset];
+    w.length = 0;
+    iotcl_template_write_string(&w, iso_timestamp);
+    iotcl_template_write_padding(&w, tmpl->timestamp_width - w.length);
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_telemetry_template_set_number(IotclTelemetryTemplate tmpl, int slot, double value) {
+    char value_str[IOTCL_TEMPLATE_NUMBER_STR_SIZE];
+    size_t length;
+    if (tmpl && slot >= 0 && slot < tmpl->slot_count && tmpl->slots[slot].decimals >= 0
+        && iotcl_telemetry_round_to_str(value, tmpl->slots[slot].decimals, value_str)) {
+        length = strlen(value_str);
+    } else {
+        length = iotcl_template_format_number(value, value_str);
+    }
+    return iotcl_template_set_slot("iotcl_telemetry_template_set_number", tmpl, slot, value_str, length);
+}
+
+int iotcl_telemetry_template_set_int64(IotclTelemetryTemplate tmpl, int slot, int64_t value) {
+    char value_str[IOTCL_INT64_STR_SIZE];
+    const size_t length = iotcl_int64_to_str(value, value_str);
+    return iotcl_template_set_slot("iotcl_telemetry_template_set_int64", tmpl, slot, value_str, length);
+}
+
+int iotcl_telemetry_template_set_uint64(IotclTelemetryTemplate tmpl, int slot, uint64_t value) {
+    char value_str[IOTCL_INT64_STR_SIZE];
+    const size_t length = iotcl_uint64_to_str(value, value_str);
+    return iotcl_template_set_slot("iotcl_telemetry_template_set_uint64", tmpl, slot, value_str, length);
+}
+
+int iotcl_telemetry_template_set_fixed_point(IotclTelemetryTemplate tmpl, int slot, int64_t value, int decimals) {
+    if (decimals < 0 || decimals > IOTCL_TELEMETRY_MAX_FIXED_POINT_DECIMALS) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "iotcl_telemetry_template_set_fixed_point: Decimals must be from 0 to %d", IOTCL_TELEMETRY_MAX_FIXED_POINT_DECIMALS);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    char value_str[IOTCL_FIXED_POINT_STR_SIZE];
+    const size_t length = iotcl_fixed_point_to_str(value, decimals, value_str);
+    return iotcl_template_set_slot("iotcl_telemetry_template_set_fixed_point", tmpl, slot, value_str, length);
+}
+
+int iotcl_telemetry_template_set_string(IotclTelemetryTemplate tmpl, int slot, const char *value) {
+    const char *FUNCTION_NAME = "iotcl_telemetry_template_set_string";
+    const IotclTemplateSlot *s = iotcl_template_get_slot(FUNCTION_NAME, tmpl, slot);
+    if (!s) {
+        return IOTCL_ERR_BAD_VALUE; // called function printed the error
+    }
+    if (!value) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "%s: The value argument is required!", FUNCTION_NAME);
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    IotclTemplateWriter w;
+    memset(&w, 0, sizeof(w));
+    iotcl_template_write_string(&w, value);
+    if (w.length > s->width) {
+        return iotcl_template_overflow_error(FUNCTION_NAME, s, w.length);
+    }
+    w.json = &tmpl->json[s->offset];
+    w.length = 0;
+    iotcl_template_write_string(&w, value);
+    iotcl_template_write_padding(&w, s->width - w.length);
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_telemetry_template_set_bool(IotclTelemetryTemplate tmpl, int slot, bool value) {
+    const char *text = value ? "true" : "false";
+    return iotcl_template_set_slot("iotcl_telemetry_template_set_bool", tmpl, slot, text, strlen(text));
+}
+
+int iotcl_telemetry_template_set_null(IotclTelemetryTemplate tmpl, int slot) {
+    return iotcl_template_set_slot("iotcl_telemetry_template_set_null", tmpl, slot, "null", 4);
+}
+
+const char *iotcl_telemetry_template_get_string(IotclTelemetryTemplate tmpl) {
+    if (!tmpl) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_telemetry_template_get_string: The template argument is required!");
+        return NULL;
+    }
+    return tmpl->json;
+}
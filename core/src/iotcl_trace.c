@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "iotcl_internal.h"
+#include "iotcl_cfg.h"
+#include "iotcl_log.h"
+#include "iotcl_trace.h"
+
+static IotclTraceClockFunction clock_fn = NULL;
+
+void iotcl_trace_configure_clock(IotclTraceClockFunction now_us_fn) {
+    IOTCL_ATOMIC_STORE(&clock_fn, now_us_fn);
+}
+
+#ifdef IOTCL_ENABLE_TRACE
+
+typedef struct {
+    const char *name;
+    uint32_t start_us;
+    uint32_t duration_us;
+} IotclTraceSpan;
+
+// Written only by the thread that owns it
+typedef struct {
+    const char *thread_name;
+    size_t count; // total number of spans recorded. The most recent IOTCL_TRACE_BUFFER_SIZE are kept.
+    IotclTraceSpan spans[IOTCL_TRACE_BUFFER_SIZE];
+} IotclTraceBuffer;
+
+// Special values of the thread buffer index
+#define IOTCL_TRACE_NO_BUFFER (-1)
+#define IOTCL_TRACE_UNASSIGNED 0 // indexes are stored + 1, so that the initial value is unassigned
+
+static IotclTraceBuffer buffers[IOTCL_TRACE_MAX_THREADS];
+static int num_buffers = 0;
+static IOTCL_THREAD_LOCAL int thread_buffer_index = IOTCL_TRACE_UNASSIGNED;
+
+// Returns the buffer of the calling thread, or NULL if all buffers are taken by other threads.
+static IotclTraceBuffer *iotcl_trace_get_thread_buffer(void) {
+    if (IOTCL_TRACE_UNASSIGNED == thread_buffer_index) {
+        const int index = IOTCL_ATOMIC_ADD_FETCH(&num_buffers, 1) - 1;
+        thread_buffer_index = index < IOTCL_TRACE_MAX_THREADS ? index + 1 : IOTCL_TRACE_NO_BUFFER;
+    }
+    if (IOTCL_TRACE_NO_BUFFER == thread_buffer_index) {
+        return NULL;
+    }
+    return &buffers[thread_buffer_index - 1];
+}
+
+uint32_t iotcl_trace_now_us(void) {
+    IotclTraceClockFunction fn = IOTCL_ATOMIC_LOAD(&clock_fn);
+    return fn ? fn() : 0;
+}
+
+void iotcl_trace_record(const char *name, uint32_t start_us) {
+    IotclTraceClockFunction fn = IOTCL_ATOMIC_LOAD(&clock_fn);
+    if (!fn) {
+        return;
+    }
+    const uint32_t end_us = fn();
+    IotclTraceBuffer *b = iotcl_trace_get_thread_buffer();
+    if (!b) {
+        return;
+    }
+    const size_t count = IOTCL_ATOMIC_LOAD(&b->count);
+    IotclTraceSpan *span = &b->spans[count % IOTCL_TRACE_BUFFER_SIZE];
+    span->name = name;
+    span->start_us = start_us;
+    span->duration_us = end_us - start_us; // wraps correctly
+    IOTCL_ATOMIC_STORE(&b->count, count + 1);
+}
+
+void iotcl_trace_set_thread_name(const char *name) {
+    IotclTraceBuffer *b = iotcl_trace_get_thread_buffer();
+    if (b) {
+        b->thread_name = name;
+    }
+}
+
+void iotcl_trace_reset(void) {
+    for (int i = 0; i < IOTCL_TRACE_MAX_THREADS; i++) {
+        IOTCL_ATOMIC_STORE(&buffers[i].count, 0);
+    }
+}
+
+typedef struct {
+    char *buffer;
+    size_t size;
+    size_t length;
+} IotclTraceWriter;
+
+// Appends to the buffer while it fits and keeps counting the length beyond that.
+static void iotcl_trace_write(IotclTraceWriter *w, const char *format, ...) {
+    va_list args;
+    char *dest = NULL;
+    size_t remaining = 0;
+    if (w->buffer && w->length < w->size) {
+        dest = &w->buffer[w->length];
+        remaining = w->size - w->length;
+    }
+    va_start(args, format);
+    const int len = vsnprintf(dest, remaining, format, args);
+    va_end(args);
+    if (len > 0) {
+        w->length += (size_t) len;
+    }
+}
+
+// Thread names come from the user, so quotes, backslashes and control characters are dropped.
+static void iotcl_trace_write_name(IotclTraceWriter *w, const char *name) {
+    for (const char *p = name; *p; p++) {
+        if ('"' != *p && '\\' != *p && (unsigned char) *p >= 0x20) {
+            iotcl_trace_write(w, "%c", *p);
+        }
+    }
+}
+
+int iotcl_trace_export_chrome(char *buffer, size_t buffer_size, size_t *length) {
+    IotclTraceWriter w = {buffer, buffer_size, 0};
+    const char *separator = "";
+    if (!length) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "iotcl_trace_export_chrome: Length is required");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (buffer && buffer_size > 0) {
+        buffer[0] = '\0';
+    }
+
+    iotcl_trace_write(&w, "{\"traceEvents\":[");
+    int used = IOTCL_ATOMIC_LOAD(&num_buffers);
+    if (used > IOTCL_TRACE_MAX_THREADS) {
+        used = IOTCL_TRACE_MAX_THREADS;
+    }
+    for (int i = 0; i < used; i++) {
+        const IotclTraceBuffer *b = &buffers[i];
+        const int tid = i + 1;
+        if (b->thread_name) {
+            iotcl_trace_write(&w, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"",
+                              separator, tid);
+            iotcl_trace_write_name(&w, b->thread_name);
+            iotcl_trace_write(&w, "\"}}");
+            separator = ",";
+        }
+        const size_t count = IOTCL_ATOMIC_LOAD(&b->count);
+        const size_t first = count > IOTCL_TRACE_BUFFER_SIZE ? count - IOTCL_TRACE_BUFFER_SIZE : 0;
+        for (size_t n = first; n < count; n++) {
+            const IotclTraceSpan *span = &b->spans[n % IOTCL_TRACE_BUFFER_SIZE];
+            iotcl_trace_write(&w,
+                              "%s\n{\"name\":\"%s\",\"cat\":\"iotcl\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lu,\"dur\":%lu}",
+                              separator, span->name, tid, (unsigned long) span->start_us,
+                              (unsigned long) span->duration_us);
+            separator = ",";
+        }
+    }
+    iotcl_trace_write(&w, "\n],\"displayTimeUnit\":\"ns\"}\n");
+
+    *length = w.length;
+    if (w.length >= buffer_size) {
+        if (buffer) {
+            IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "iotcl_trace_export_chrome: %lu bytes are required", (unsigned long) w.length + 1);
+        }
+        return IOTCL_ERR_OVERFLOW;
+    }
+    return IOTCL_SUCCESS;
+}
+
+#else
+
+void iotcl_trace_set_thread_name(const char *name) {
+    (void) name;
+}
+
+int iotcl_trace_export_chrome(char *buffer, size_t buffer_size, size_t *length) {
+    if (buffer && buffer_size > 0) {
+        buffer[0] = '\0';
+    }
+    if (length) {
+        *length = 0;
+    }
+    IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "iotcl_trace_export_chrome: IOTCL_ENABLE_TRACE is not defined");
+    return IOTCL_ERR_CONFIG_MISSING;
+}
+
+void iotcl_trace_reset(void) {
+}
+
+#endif // IOTCL_ENABLE_TRACE
@@ -0,0 +1,200 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "cJSON.h"
+
+#include "iotcl_internal.h"
+#include "iotcl_cfg.h"
+#include "iotcl_log.h"
+#include "iotcl_dra_url.h"
+#include "iotcl_dra_identity.h"
+#include "iotcl_dra_cache.h"
+
+// Adds the string to the object, if not NULL. Returns false on OOM.
+static bool iotcl_dra_cache_add_string(cJSON *object, const char *name, const char *value) {
+    return !value || NULL != cJSON_AddStringToObject(object, name, value);
+}
+
+static bool iotcl_dra_cache_add_mqtt_config(cJSON *root, const IotclMqttConfig *mc) {
+    cJSON *j_mqtt = cJSON_AddObjectToObject(root, "mqtt");
+    return j_mqtt
+           && iotcl_dra_cache_add_string(j_mqtt, "un", mc->username)
+           && iotcl_dra_cache_add_string(j_mqtt, "h", mc->host)
+           && iotcl_dra_cache_add_string(j_mqtt, "id", mc->client_id)
+           && iotcl_dra_cache_add_string(j_mqtt, "rpt", mc->pub_rpt)
+           && iotcl_dra_cache_add_string(j_mqtt, "ack", mc->pub_ack)
+           && iotcl_dra_cache_add_string(j_mqtt, "c2d", mc->sub_c2d)
+           && iotcl_dra_cache_add_string(j_mqtt, "cd", mc->cd);
+}
+
+char *iotcl_dra_cache_create(const IotclDraUrlContext *base_url, const char *stamp, int ttl_s) {
+    if (!base_url || !iotcl_dra_url_get_url(base_url)) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "DRA Cache: Base URL is required.");
+        return NULL;
+    }
+    IotclTimeFunction time_fn = iotcl_get_global_config()->time_fn;
+    if (ttl_s > 0 && !time_fn) {
+        IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "DRA Cache: time_fn must be configured in the library to use a TTL.");
+        return NULL;
+    }
+
+    char *ret = NULL;
+    cJSON *root = NULL;
+    // strip any suffix path, like the identity API path
+    char *bu = iotcl_malloc(base_url->idx_suffix_start + 1);
+    const IotclMqttConfig *mc = iotcl_mqtt_acquire_config();
+    if (!mc || !mc->host || !mc->client_id) {
+        IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "DRA Cache: The library MQTT configuration is not set.");
+        goto cleanup;
+    }
+    if (!bu) goto cleanup_oom;
+    memcpy(bu, base_url->url, base_url->idx_suffix_start);
+    bu[base_url->idx_suffix_start] = '\0';
+
+    root = cJSON_CreateObject();
+    if (!root) goto cleanup_oom;
+    if (!cJSON_AddNumberToObject(root, "v", IOTCL_DRA_CACHE_FORMAT_VERSION)) goto cleanup_oom;
+    if (!cJSON_AddStringToObject(root, "stamp", stamp ? stamp : "")) goto cleanup_oom;
+    if (!cJSON_AddNumberToObject(root, "ts", time_fn ? (double) time_fn() : 0)) goto cleanup_oom;
+    if (!cJSON_AddNumberToObject(root, "ttl", ttl_s > 0 ? ttl_s : 0)) goto cleanup_oom;
+    if (!cJSON_AddStringToObject(root, "bu", bu)) goto cleanup_oom;
+    if (!iotcl_dra_cache_add_mqtt_config(root, mc)) goto cleanup_oom;
+
+    ret = iotcl_json_print(root, false);
+    if (!ret) goto cleanup_oom;
+    goto cleanup;
+
+    cleanup_oom:
+    IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "DRA Cache: Out of memory while creating the cache!");
+
+    cleanup:
+    cJSON_Delete(root);
+    iotcl_mqtt_release_config(mc);
+    iotcl_free(bu);
+    return ret;
+}
+
+void iotcl_dra_cache_destroy(char *cache_str) {
+    if (cache_str) {
+        cJSON_free(cache_str);
+    }
+}
+
+static int iotcl_dra_cache_validate(cJSON *root, const char *stamp) {
+    const char *f;
+
+    f = "v";
+    cJSON *j_v = cJSON_GetObjectItem(root, f);
+    if (!j_v || !cJSON_IsNumber(j_v)) goto cleanup;
+    if (IOTCL_DRA_CACHE_FORMAT_VERSION != (int) cJSON_GetNumberValue(j_v)) {
+        IOTCL_WARN(IOTCL_ERR_EXPIRED, "DRA Cache: Cache format version %d is not supported.", (int) cJSON_GetNumberValue(j_v));
+        return IOTCL_ERR_EXPIRED;
+    }
+
+    f = "stamp";
+    const char *cache_stamp = cJSON_GetStringValue(cJSON_GetObjectItem(root, f));
+    if (!cache_stamp) goto cleanup;
+    if (0 != strcmp(cache_stamp, stamp ? stamp : "")) {
+        IOTCL_WARN(IOTCL_ERR_EXPIRED, "DRA Cache: Cache stamp \"%s\" does not match.", cache_stamp);
+        return IOTCL_ERR_EXPIRED;
+    }
+
+    f = "ts";
+    cJSON *j_ts = cJSON_GetObjectItem(root, f);
+    if (!j_ts || !cJSON_IsNumber(j_ts)) goto cleanup;
+    f = "ttl";
+    cJSON *j_ttl = cJSON_GetObjectItem(root, f);
+    if (!j_ttl || !cJSON_IsNumber(j_ttl)) goto cleanup;
+    const double ttl = cJSON_GetNumberValue(j_ttl);
+    if (ttl > 0) {
+        IotclTimeFunction time_fn = iotcl_get_global_config()->time_fn;
+        if (!time_fn) {
+            IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "DRA Cache: time_fn must be configured in the library to validate the cache TTL.");
+            return IOTCL_ERR_CONFIG_MISSING;
+        }
+        const double ts = cJSON_GetNumberValue(j_ts);
+        const double now = (double) time_fn();
+        // a timestamp in the future means that the clock was changed, so we cannot trust the cache
+        if (now < ts || now >= ts + ttl) {
+            IOTCL_WARN(IOTCL_ERR_EXPIRED, "DRA Cache: The cache has expired.");
+            return IOTCL_ERR_EXPIRED;
+        }
+    }
+    return IOTCL_SUCCESS;
+
+    cleanup:
+    IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "DRA Cache: Error encountered while parsing the cache field \"%s\"", f);
+    return IOTCL_ERR_PARSING_ERROR;
+}
+
+static int iotcl_dra_cache_parse_and_configure(IotclDraUrlContext *base_url, size_t base_url_slack, const char *stamp, cJSON *root) {
+    if (!root) {
+        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "DRA Cache: Parsing error or ran out of memory while parsing the cache!");
+        return IOTCL_ERR_PARSING_ERROR;
+    }
+    int status = iotcl_dra_cache_validate(root, stamp);
+    if (IOTCL_SUCCESS != status) {
+        return status; // the called function will print the error
+    }
+
+    const char *bu = cJSON_GetStringValue(cJSON_GetObjectItem(root, "bu"));
+    cJSON *j_mqtt = cJSON_GetObjectItem(root, "mqtt");
+    if (!bu || !j_mqtt || !cJSON_IsObject(j_mqtt)) {
+        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "DRA Cache: One or more cache fields was not found");
+        return IOTCL_ERR_PARSING_ERROR;
+    }
+
+    IotclMqttConfig values = {0};
+    values.username = cJSON_GetStringValue(cJSON_GetObjectItem(j_mqtt, "un"));
+    values.host = cJSON_GetStringValue(cJSON_GetObjectItem(j_mqtt, "h"));
+    values.client_id = cJSON_GetStringValue(cJSON_GetObjectItem(j_mqtt, "id"));
+    values.pub_rpt = cJSON_GetStringValue(cJSON_GetObjectItem(j_mqtt, "rpt"));
+    values.pub_ack = cJSON_GetStringValue(cJSON_GetObjectItem(j_mqtt, "ack"));
+    values.sub_c2d = cJSON_GetStringValue(cJSON_GetObjectItem(j_mqtt, "c2d"));
+    values.cd = cJSON_GetStringValue(cJSON_GetObjectItem(j_mqtt, "cd"));
+
+    if (base_url) {
+        status = iotcl_dra_url_init_with_slack(base_url, base_url_slack, bu);
+        if (IOTCL_SUCCESS != status) {
+            return status; // the called function will print the error
+        }
+    }
+    status = iotcl_dra_identity_configure_library_mqtt_with_values(&values);
+    if (IOTCL_SUCCESS != status && base_url) {
+        iotcl_dra_url_deinit(base_url);
+    }
+    return status; // the called function will print the error
+}
+
+int iotcl_dra_cache_load(IotclDraUrlContext *base_url, int base_url_slack, const char *stamp, const char *cache_str) {
+    if (!cache_str) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "DRA Cache: Cache string is required.");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    cJSON *root = cJSON_Parse(cache_str);
+    int status = iotcl_dra_cache_parse_and_configure(base_url, (size_t) base_url_slack, stamp, root);
+    cJSON_Delete(root);
+    return status;
+}
+
+int iotcl_dra_cache_load_with_length(
+        IotclDraUrlContext *base_url,
+        int base_url_slack,
+        const char *stamp,
+        const uint8_t *cache_data,
+        size_t cache_data_size
+) {
+    if (!cache_data) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "DRA Cache: Cache data is required.");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    cJSON *root = cJSON_ParseWithLength((const char *) cache_data, cache_data_size);
+    int status = iotcl_dra_cache_parse_and_configure(base_url, (size_t) base_url_slack, stamp, root);
+    cJSON_Delete(root);
+    return status;
+}
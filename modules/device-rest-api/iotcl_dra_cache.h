@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * This file contains functions that allow the device to skip the discovery and identity HTTP API calls on startup
+ * by caching their results in persistent storage.
+ *
+ * The cache is a JSON string that contains the discovery base URL and the identity-derived library MQTT configuration
+ * along with a format version, a stamp, a timestamp and a TTL. The library does not do any I/O, so it is up to
+ * the application to store the string (flash, file etc.) and supply it back on startup.
+ *
+ * Suggested flow:
+ *   1. Initialize the library with IOTCL_DCT_CUSTOM (and time_fn if a TTL is used).
+ *   2. Load the stored cache with iotcl_dra_cache_load(). If it succeeds, connect to MQTT.
+ *   3. If loading fails (no cache, stale, or a different stamp), or the MQTT connection with the cached configuration
+ *      fails, discard the cache, re-initialize the library and do discovery and identity over the network.
+ *   4. After the network-based configuration succeeds, store the string returned by iotcl_dra_cache_create().
+ *
+ * The stamp is an application-defined string that identifies what the cache was created for. For example, combine
+ * the CPID, environment, DUID and firmware version into a stamp, so that the cache is invalidated if any of them change.
+ */
+
+#ifndef IOTCL_DRA_CACHE_H
+#define IOTCL_DRA_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "iotcl_dra_url.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Caches created with a different format version are treated as stale.
+#define IOTCL_DRA_CACHE_FORMAT_VERSION 1
+
+// Creates a cache string with the base URL and the current library MQTT configuration.
+// base_url is the context returned by discovery. If a suffix path was used (eg. identity URL), it is not included.
+// stamp is optional. If ttl_s is greater than zero, time_fn must be configured in the library.
+// If ttl_s is zero or less, the cache does not expire.
+// Returns NULL in case of an error. Free the returned string with iotcl_dra_cache_destroy().
+char *iotcl_dra_cache_create(const IotclDraUrlContext *base_url, const char *stamp, int ttl_s);
+
+void iotcl_dra_cache_destroy(char *cache_str);
+
+// Validates a cache string and configures the base URL and the library MQTT configuration with its values.
+// The library must be initialized with IOTCL_DCT_CUSTOM and the MQTT configuration must not be set,
+// same as with iotcl_dra_identity_configure_library_mqtt().
+// base_url is optional. If not NULL, it will be initialized with base_url_slack. See iotcl_dra_discovery_parse().
+// Free the base URL with iotcl_dra_url_deinit() if the function returns success.
+// Returns IOTCL_ERR_EXPIRED if the cache has a different version or stamp, or if its TTL has elapsed.
+// Returns IOTCL_ERR_CONFIG_MISSING if the cache has a TTL, but time_fn is not configured in the library.
+int iotcl_dra_cache_load(IotclDraUrlContext *base_url, int base_url_slack, const char *stamp, const char *cache_str);
+
+// same as iotcl_dra_cache_load(), but with data and data length
+int iotcl_dra_cache_load_with_length(
+        IotclDraUrlContext *base_url,
+        int base_url_slack,
+        const char *stamp,
+        const uint8_t *cache_data,
+        size_t cache_data_size
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCL_DRA_CACHE_H
@@ -12,9 +12,51 @@
 #include "iotcl_dra_url.h"
 #include "iotcl_dra_discovery.h"
 
+// Discovery fields selected by the stream parser. Indexes must match IOTCL_DRA_DISCOVERY_FIELD_*
+static const char *const iotcl_dra_discovery_fields[] = {"status", "message", "d.ec", "d.bu"};
+#define IOTCL_DRA_DISCOVERY_FIELD_STATUS 0
+#define IOTCL_DRA_DISCOVERY_FIELD_MESSAGE 1
+#define IOTCL_DRA_DISCOVERY_FIELD_EC 2
+#define IOTCL_DRA_DISCOVERY_FIELD_BU 3
+
 // NOTE: We assume that v2.1 in the API is not directly tied to the protocol version
 #define IOTCL_DRA_DISCOVERY_URL_FORMAT "https://%s/api/v2.1/dsdk/cpId/%s/env/%s"
 
+// Validates the discovery response values and initializes the base URL. Shared by the cJSON and the stream parser.
+static int iotcl_dra_discovery_apply(IotclDraUrlContext *base_url_context, size_t base_url_slack, int response_status, const char *message, int ec, const char *bu) {
+    if (200 != response_status) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "DRA Discovery: Received status %d! Incorrect environment name?", response_status);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+
+#ifdef IOTCL_DRA_DISCOVERY_IGNORE_SUBSCRIPTION_EXPIRED
+    // Related service ticket https://awspoc.iotconnect.io/support-info/2024031415124727
+    if (3 == ec) {
+        IOTCL_WARN(IOTCL_ERR_FAILED, "DRA Discovery: Received error %d! Server message was: \"%s\". Ignoring...", ec, message);
+        ec = 0; // ignore this error
+    }
+#endif
+
+    if (0 != ec) {
+        IOTCL_ERROR(IOTCL_ERR_FAILED, "DRA Discovery: Received error %d! Server message was: \"%s\"", ec, message);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+
+    if (!bu) {
+        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "DRA: Error encountered while parsing the discovery response field \"bu\"");
+        return IOTCL_ERR_PARSING_ERROR;
+    }
+
+    int status = iotcl_dra_url_init_with_slack(base_url_context, base_url_slack, bu);
+    if (IOTCL_SUCCESS != status) {
+        // the called function will print the error, but we need to be more specific, though return the original cause
+        IOTCL_ERROR(IOTCL_ERR_FAILED, "DRA: Unable to initialize base URL from discovery response!");
+        return status;
+    }
+
+    return IOTCL_SUCCESS;
+}
+
 static int iotcl_dra_parse_discovery_json(IotclDraUrlContext *base_url_context, size_t base_url_slack, cJSON *json_root) {
     const char *f;
 
@@ -29,8 +71,7 @@ static int iotcl_dra_parse_discovery_json(IotclDraUrlContext *base_url_context,
 
     int response_status = (int) cJSON_GetNumberValue(j_status);
     if (200 != response_status) {
-        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "DRA Discovery: Received status %d! Incorrect environment name?", response_status);
-        return IOTCL_ERR_BAD_VALUE;
+        return iotcl_dra_discovery_apply(base_url_context, base_url_slack, response_status, NULL, 0, NULL);
     }
 
     char *message; // in case message cannot be parsed...
@@ -51,31 +92,12 @@ static int iotcl_dra_parse_discovery_json(IotclDraUrlContext *base_url_context,
     if (!j_ec || !cJSON_IsNumber(j_ec)) goto cleanup;
     int ec = (int) cJSON_GetNumberValue(j_ec);
 
-#ifdef IOTCL_DRA_DISCOVERY_IGNORE_SUBSCRIPTION_EXPIRED
-    // Related service ticket https://awspoc.iotconnect.io/support-info/2024031415124727
-    if (3 == ec) {
-        IOTCL_WARN(IOTCL_ERR_FAILED, "DRA Discovery: Received error %d! Server message was: \"%s\". Ignoring...", ec, message);
-        ec = 0; // ignore this error
-    }
-#endif
-
-    if (0 != ec) {
-        IOTCL_ERROR(IOTCL_ERR_FAILED, "DRA Discovery: Received error %d! Server message was: \"%s\"", ec, message);
-        return IOTCL_ERR_BAD_VALUE;
-    }
-
     f = "bu";
     cJSON *j_bu = cJSON_GetObjectItem(j_d, f);
-    if (!j_bu || !cJSON_IsString(j_bu)) goto cleanup;
+    // an error code takes priority over a missing base URL
+    if (0 == ec && (!j_bu || !cJSON_IsString(j_bu))) goto cleanup;
 
-    int status = iotcl_dra_url_init_with_slack(base_url_context, base_url_slack, cJSON_GetStringValue(j_bu));
-    if (IOTCL_SUCCESS != status) {
-        // the called function will print the error, but we need to be more specific, though return the original cause
-        IOTCL_ERROR(IOTCL_ERR_FAILED, "DRA: Unable to initialize base URL from discovery response!");
-        return status;
-    }
-
-    return IOTCL_SUCCESS;
+    return iotcl_dra_discovery_apply(base_url_context, base_url_slack, response_status, message, ec, cJSON_GetStringValue(j_bu));
 
     cleanup:
     IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "DRA: Error encountered while parsing the discovery response field \"%s\"", f);
@@ -108,15 +130,85 @@ int iotcl_dra_discovery_init_url_azure(IotclDraUrlContext *c, const char *cpid,
 }
 
 int iotcl_dra_discovery_parse(IotclDraUrlContext *c, int base_url_slack, const char *response_str) {
+    IOTCL_STATS_TIME_START(stats_start);
+    IOTCL_TRACE_BEGIN(trace_start);
     cJSON *root = cJSON_Parse(response_str);
     int status = iotcl_dra_parse_discovery_json(c, (size_t) base_url_slack, root);
     cJSON_Delete(root);
+    IOTCL_TRACE_END("iotcl_dra_discovery_parse", trace_start);
+    IOTCL_STATS_TIME_END(IOTCL_STATS_DRA_PARSE_LATENCY, stats_start);
+    IOTCL_STATS_INC(status ? IOTCL_STATS_DRA_ERRORS : IOTCL_STATS_DRA_RESPONSES_PARSED);
     return status;
 }
 
 int iotcl_dra_discovery_parse_with_length(IotclDraUrlContext *c, int base_url_slack, const uint8_t *response_data, size_t response_data_size) {
+    IOTCL_STATS_TIME_START(stats_start);
+    IOTCL_TRACE_BEGIN(trace_start);
     cJSON *root = cJSON_ParseWithLength((const char *)response_data, response_data_size);
     int status = iotcl_dra_parse_discovery_json(c, (size_t) base_url_slack, root);
     cJSON_Delete(root);
+    IOTCL_TRACE_END("iotcl_dra_discovery_parse", trace_start);
+    IOTCL_STATS_TIME_END(IOTCL_STATS_DRA_PARSE_LATENCY, stats_start);
+    IOTCL_STATS_INC(status ? IOTCL_STATS_DRA_ERRORS : IOTCL_STATS_DRA_RESPONSES_PARSED);
+    return status;
+}
+
+int iotcl_dra_discovery_stream_init(IotclDraDiscoveryStreamParser *p) {
+    if (!p) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "DRA Discovery: Stream parser is required.");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    return iotcl_dra_json_scanner_init(
+            &p->scanner,
+            iotcl_dra_discovery_fields,
+            (int) (sizeof(iotcl_dra_discovery_fields) / sizeof(iotcl_dra_discovery_fields[0]))
+    );
+}
+
+int iotcl_dra_discovery_stream_feed(IotclDraDiscoveryStreamParser *p, const uint8_t *data, size_t data_len) {
+    return iotcl_dra_json_scanner_feed(&p->scanner, data, data_len);
+}
+
+static int iotcl_dra_discovery_stream_apply(IotclDraDiscoveryStreamParser *p, IotclDraUrlContext *base_url, int base_url_slack) {
+    const IotclDraJsonScanner *s = &p->scanner;
+    int status = iotcl_dra_json_scanner_finish(&p->scanner);
+    if (IOTCL_SUCCESS != status) {
+        return status; // the called function will print the error
+    }
+
+    int response_status;
+    if (!iotcl_dra_json_scanner_get_int(s, IOTCL_DRA_DISCOVERY_FIELD_STATUS, &response_status)) {
+        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "DRA: Error encountered while parsing the discovery response field \"status\"");
+        return IOTCL_ERR_PARSING_ERROR;
+    }
+    int ec = 0;
+    // message is only used for printing, so it can be truncated
+    const char *message = iotcl_dra_json_scanner_get(s, IOTCL_DRA_DISCOVERY_FIELD_MESSAGE);
+    if (200 == response_status && !iotcl_dra_json_scanner_get_int(s, IOTCL_DRA_DISCOVERY_FIELD_EC, &ec)) {
+        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "DRA: Error encountered while parsing the discovery response field \"ec\"");
+        return IOTCL_ERR_PARSING_ERROR;
+    }
+    if (iotcl_dra_json_scanner_is_truncated(s, IOTCL_DRA_DISCOVERY_FIELD_BU)) {
+        IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "DRA Discovery: Base URL is too long. Increase IOTCL_DRA_SCANNER_POOL_SIZE.");
+        return IOTCL_ERR_OVERFLOW;
+    }
+    return iotcl_dra_discovery_apply(
+            base_url,
+            (size_t) base_url_slack,
+            response_status,
+            message ? message : "",
+            ec,
+            iotcl_dra_json_scanner_get_string(s, IOTCL_DRA_DISCOVERY_FIELD_BU)
+    );
+}
+
+int iotcl_dra_discovery_stream_finish(IotclDraDiscoveryStreamParser *p, IotclDraUrlContext *base_url, int base_url_slack) {
+    // the time spent in feed calls is not counted, as it overlaps with receiving the data
+    IOTCL_STATS_TIME_START(stats_start);
+    IOTCL_TRACE_BEGIN(trace_start);
+    int status = iotcl_dra_discovery_stream_apply(p, base_url, base_url_slack);
+    IOTCL_TRACE_END("iotcl_dra_discovery_parse", trace_start);
+    IOTCL_STATS_TIME_END(IOTCL_STATS_DRA_PARSE_LATENCY, stats_start);
+    IOTCL_STATS_INC(status ? IOTCL_STATS_DRA_ERRORS : IOTCL_STATS_DRA_RESPONSES_PARSED);
     return status;
 }
@@ -14,6 +14,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "iotcl_dra_url.h"
+#include "iotcl_dra_json_scanner.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -53,6 +54,21 @@ int iotcl_dra_discovery_parse_with_length(
         size_t response_data_size
 );
 
+// Push-style discovery response parser that can be fed with chunks of the HTTP response body as they are received,
+// so that the whole body does not need to be buffered. Only the needed fields are kept, in bounded memory
+// (see iotcl_dra_json_scanner.h). Does not allocate until the base URL is initialized by the finish function.
+typedef struct {
+    IotclDraJsonScanner scanner;
+} IotclDraDiscoveryStreamParser;
+
+int iotcl_dra_discovery_stream_init(IotclDraDiscoveryStreamParser *p);
+
+// Feed the next chunk of the response body. Stop feeding and discard the response if an error is returned.
+int iotcl_dra_discovery_stream_feed(IotclDraDiscoveryStreamParser *p, const uint8_t *data, size_t data_len);
+
+// Call once the whole body is fed. Same as iotcl_dra_discovery_parse() otherwise.
+int iotcl_dra_discovery_stream_finish(IotclDraDiscoveryStreamParser *p, IotclDraUrlContext *base_url, int base_url_slack);
+
 
 #ifdef __cplusplus
 }
@@ -14,40 +14,110 @@
 
 // from https://docs.iotconnect.io/iotconnect/sdk/message-protocol/device-message-2-1/reference-table/#hellomsg Hello Message & REST API
 static const char* iotcl_dra_ec_error_mapping[] = {
-        "OK – No Error"
-        "Device not found. Device is not whitelisted to platform."
-        "Device is not active."
-        "Un-Associated. Device has not any template associated with it."
-        "Device is not acquired. Device is created but it is in release state."
-        "Device is disabled. It’s disabled from broker by Platform Admin"
-        "Company not found as SID is not valid"
-        "Subscription is expired."
-        "Connection Not Allowed."
-        "Invalid Bootstrap Certificate."
+        "OK – No Error",
+        "Device not found. Device is not whitelisted to platform.",
+        "Device is not active.",
+        "Un-Associated. Device has not any template associated with it.",
+        "Device is not acquired. Device is created but it is in release state.",
+        "Device is disabled. It’s disabled from broker by Platform Admin",
+        "Company not found as SID is not valid",
+        "Subscription is expired.",
+        "Connection Not Allowed.",
+        "Invalid Bootstrap Certificate.",
         "Invalid Operational Certificate."
 };
 
-static void iotcl_dra_clear_and_free_mqtt_config(IotclMqttConfig* c) {
-    iotcl_free(c->username);
-    iotcl_free(c->host);
-    iotcl_free(c->client_id);
-    iotcl_free(c->pub_rpt);
-    iotcl_free(c->pub_ack);
-    iotcl_free(c->sub_c2d);
-    iotcl_free(c->cd);
-    // version is a constant
-    c->username = NULL;
-    c->host = NULL;
-    c->client_id = NULL;
-    c->pub_rpt = NULL;
-    c->pub_ack = NULL;
-    c->sub_c2d = NULL;
-    c->cd = NULL;
-    c->version = NULL;
+// Identity fields selected by the stream parser. Indexes must match IOTCL_DRA_IDENTITY_FIELD_*
+static const char *const iotcl_dra_identity_fields[] = {
+        "status", "d.ec", "d.meta.cd", "d.p.un", "d.p.h", "d.p.id", "d.p.topics.rpt", "d.p.topics.ack", "d.p.topics.c2d"
+};
+#define IOTCL_DRA_IDENTITY_FIELD_STATUS 0
+#define IOTCL_DRA_IDENTITY_FIELD_EC 1
+#define IOTCL_DRA_IDENTITY_FIELD_CD 2
+#define IOTCL_DRA_IDENTITY_FIELD_UN 3
+#define IOTCL_DRA_IDENTITY_FIELD_H 4
+#define IOTCL_DRA_IDENTITY_FIELD_ID 5
+#define IOTCL_DRA_IDENTITY_FIELD_RPT 6
+#define IOTCL_DRA_IDENTITY_FIELD_ACK 7
+#define IOTCL_DRA_IDENTITY_FIELD_C2D 8
+
+// Copies the string (if not NULL) into the mqtt config snapshot strings block at *p and advances *p past the null terminator.
+static char *iotcl_dra_copy_to_block(char **p, const char *str) {
+    if (!str) {
+        return NULL;
+    }
+    const size_t size = strlen(str) + 1;
+    char *ret = *p;
+    memcpy(ret, str, size);
+    *p += size;
+    return ret;
+}
+
+static size_t iotcl_dra_string_size(const char *str) {
+    return str ? strlen(str) + 1 : 0;
 }
+
+// Publishes a new library MQTT configuration with copies of the values.
+static int iotcl_dra_identity_publish_mqtt_config(const IotclMqttConfig *values) {
+    // NOTE: username should be null for aws, but currently identity returns one
+    // We don't know whether this is aws or not just based on identity response
+    if (!values->host || !values->client_id || !values->pub_rpt || !values->pub_ack || !values->sub_c2d || !values->cd) {
+        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "DRA Identity: One or more response fields was not found");
+        return IOTCL_ERR_PARSING_ERROR;
+    }
+
+    // Store all strings in a new mqtt config snapshot (single allocation, reused if large enough)
+    // and publish it, so that threads using the current snapshot are not affected.
+    char *p = NULL;
+    IotclMqttConfig *c = iotcl_mqtt_config_create_snapshot(
+            iotcl_dra_string_size(values->username)
+            + iotcl_dra_string_size(values->host)
+            + iotcl_dra_string_size(values->client_id)
+            + iotcl_dra_string_size(values->pub_rpt)
+            + iotcl_dra_string_size(values->pub_ack)
+            + iotcl_dra_string_size(values->sub_c2d)
+            + iotcl_dra_string_size(values->cd),
+            &p
+    );
+    if (!c) {
+        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "DRA Identity: Out of memory while allocating the MQTT configuration");
+        return IOTCL_ERR_OUT_OF_MEMORY;
+    }
+
+    c->username = iotcl_dra_copy_to_block(&p, values->username);
+    c->host = iotcl_dra_copy_to_block(&p, values->host);
+    c->client_id = iotcl_dra_copy_to_block(&p, values->client_id);
+    c->pub_rpt = iotcl_dra_copy_to_block(&p, values->pub_rpt);
+    c->pub_ack = iotcl_dra_copy_to_block(&p, values->pub_ack);
+    c->sub_c2d = iotcl_dra_copy_to_block(&p, values->sub_c2d);
+    c->cd = iotcl_dra_copy_to_block(&p, values->cd);
+    c->version = IOTCL_PROTOCOL_VERSION_DEFAULT;
+    iotcl_mqtt_config_publish_snapshot(c);
+
+    return IOTCL_SUCCESS;
+}
+
+// Checks the response status and the error code. Shared by the cJSON and the stream parser.
+static int iotcl_dra_identity_check_status(int response_status, int ec) {
+    if (200 != response_status) {
+        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "DRA Identity: Bad response status %d!", response_status);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    if (0 != ec) {
+        const char* ec_message;
+        if (ec > 0 && ec < (int) (sizeof(iotcl_dra_ec_error_mapping) / sizeof(iotcl_dra_ec_error_mapping[0]))) {
+            ec_message = iotcl_dra_ec_error_mapping[ec];
+        } else {
+            ec_message = "<Unknown Error>";
+        }
+        IOTCL_ERROR(IOTCL_ERR_FAILED, "DRA Identity: Identity error received %d. Message: %s", ec, ec_message);
+        return IOTCL_ERR_BAD_VALUE;
+    }
+    return IOTCL_SUCCESS;
+}
+
 static int iotcl_dra_parse_response_and_configure_iotcl(cJSON *json_root) {
     const char *f;
-    IotclMqttConfig* c = NULL;
     if (!json_root) {
         IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "DRA Identity: Parsing error or ran out of memory while parsing the response!");
         return IOTCL_ERR_PARSING_ERROR;
@@ -59,8 +129,7 @@ static int iotcl_dra_parse_response_and_configure_iotcl(cJSON *json_root) {
 
     int response_status = (int) cJSON_GetNumberValue(j_status);
     if (200 != response_status) {
-        IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "DRA Identity: Bad response status %d!", response_status);
-        return IOTCL_ERR_BAD_VALUE;
+        return iotcl_dra_identity_check_status(response_status, 0); // the called function will print the error
     }
 
     f = "d";
@@ -72,16 +141,8 @@ static int iotcl_dra_parse_response_and_configure_iotcl(cJSON *json_root) {
     cJSON *j_ec = cJSON_GetObjectItem(j_d, f);
     if (!j_ec || !cJSON_IsNumber(j_ec)) goto cleanup;
     int ec = (int)cJSON_GetNumberValue(j_ec);
-
     if (0 != ec) {
-        const char* ec_message;
-        if (ec > 0 && ec < (int) sizeof(iotcl_dra_ec_error_mapping)) {
-            ec_message = iotcl_dra_ec_error_mapping[ec];
-        } else {
-            ec_message = "<Unknown Error>";
-        }
-        IOTCL_ERROR(IOTCL_ERR_FAILED, "DRA Identity: Identity error received %d. Message: %s", ec, ec_message);
-        return IOTCL_ERR_BAD_VALUE;
+        return iotcl_dra_identity_check_status(response_status, ec); // the called function will print the error
     }
 
     cJSON *j_meta = cJSON_GetObjectItem(j_d, "meta");
@@ -101,28 +162,15 @@ static int iotcl_dra_parse_response_and_configure_iotcl(cJSON *json_root) {
     cJSON *j_topics = cJSON_GetObjectItem(j_p, f);
     if (!j_topics || !cJSON_IsObject(j_topics)) goto cleanup;
 
-    c = iotcl_mqtt_get_config();
-    // in case custom config was not used, free everything up
-    iotcl_dra_clear_and_free_mqtt_config(c);
-
-    c->username = iotcl_strdup_json_string(j_p, "un");
-    c->host = iotcl_strdup_json_string(j_p, "h");
-    c->client_id = iotcl_strdup_json_string(j_p, "id");
-    c->pub_rpt = iotcl_strdup_json_string(j_topics, "rpt");
-    c->pub_ack = iotcl_strdup_json_string(j_topics, "ack");
-    c->sub_c2d = iotcl_strdup_json_string(j_topics, "c2d");
-    c->cd = iotcl_strdup_json_string(j_meta, "cd");
-    c->version = IOTCL_PROTOCOL_VERSION_DEFAULT;
-
-    // NOTE: username should be null for aws, but currently identity returns one
-    // We don't know whether this is aws or not just based on identity response
-    if (!c->host || !c->client_id || !c->pub_rpt || !c->pub_ack || !c->sub_c2d || !c->cd) {
-        iotcl_dra_clear_and_free_mqtt_config(c);
-        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "DRA Identity: One or more response fields was not found or ran out of memory");
-        return IOTCL_ERR_OUT_OF_MEMORY;
-    }
-
-    return IOTCL_SUCCESS;
+    IotclMqttConfig values = {0};
+    values.username = cJSON_GetStringValue(cJSON_GetObjectItem(j_p, "un"));
+    values.host = cJSON_GetStringValue(cJSON_GetObjectItem(j_p, "h"));
+    values.client_id = cJSON_GetStringValue(cJSON_GetObjectItem(j_p, "id"));
+    values.pub_rpt = cJSON_GetStringValue(cJSON_GetObjectItem(j_topics, "rpt"));
+    values.pub_ack = cJSON_GetStringValue(cJSON_GetObjectItem(j_topics, "ack"));
+    values.sub_c2d = cJSON_GetStringValue(cJSON_GetObjectItem(j_topics, "c2d"));
+    values.cd = cJSON_GetStringValue(j_cd);
+    return iotcl_dra_identity_publish_mqtt_config(&values); // the called function will print the error
 
     cleanup:
     IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "DRA Identity: Error encountered while parsing the response field \"%s\"", f);
@@ -134,10 +182,13 @@ static int iotcl_dra_identity_validate_config(void) {
         IOTCL_ERROR(IOTCL_ERR_CONFIG_MISSING, "DRA Identity: The library is not configured. Please configure the library in custom mode first.");
         return IOTCL_ERR_CONFIG_MISSING;
     }
-    IotclMqttConfig* c = iotcl_mqtt_get_config();
+    const IotclMqttConfig* c = iotcl_mqtt_get_config();
+    if (!c) {
+        return IOTCL_ERR_CONFIG_MISSING; // called function will print the error
+    }
     if (c->host || c->sub_c2d || c->pub_ack || c->pub_rpt || c->client_id || c->username) {
         IOTCL_WARN(IOTCL_ERR_CONFIG_ERROR, "DRA Identity: The library's MQTT configuration should not be set.");
-        iotcl_dra_clear_and_free_mqtt_config(c);
+        iotcl_mqtt_config_clear();
         return IOTCL_ERR_CONFIG_ERROR;
     }
     return IOTCL_SUCCESS;
@@ -153,9 +204,15 @@ int iotcl_dra_identity_build_url(IotclDraUrlContext *base_url_context, const cha
         IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "DRA Identity: DUID is required.");
         return IOTCL_ERR_MISSING_VALUE;
     }
-    int suffix_size = snprintf(NULL, 0, IOTC_DRA_IDENTITY_FORMAT, duid);
-    char* suffix = iotcl_malloc((size_t) suffix_size + 1);
-    sprintf(suffix, IOTC_DRA_IDENTITY_FORMAT, duid);
+    const size_t prefix_len = strlen(IOTCL_DRA_IDENTITY_PREFIX);
+    const size_t duid_len = strlen(duid);
+    char* suffix = iotcl_malloc(prefix_len + duid_len + 1);
+    if (!suffix) {
+        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "DRA Identity: Out of memory while allocating the URL suffix!");
+        return IOTCL_ERR_OUT_OF_MEMORY;
+    }
+    memcpy(suffix, IOTCL_DRA_IDENTITY_PREFIX, prefix_len);
+    memcpy(&suffix[prefix_len], duid, duid_len + 1);
     int status = iotcl_dra_url_use_suffix_path(base_url_context, suffix); // the called function will report error
     iotcl_free(suffix);
     return status;
@@ -167,9 +224,14 @@ int iotcl_dra_identity_configure_library_mqtt(const char *response_str) {
     if (IOTCL_SUCCESS != status) {
         return status; // the called function will print the error
     }
+    IOTCL_STATS_TIME_START(stats_start);
+    IOTCL_TRACE_BEGIN(trace_start);
     cJSON *root = cJSON_Parse(response_str);
     status = iotcl_dra_parse_response_and_configure_iotcl(root);
     cJSON_Delete(root);
+    IOTCL_TRACE_END("iotcl_dra_identity_parse", trace_start);
+    IOTCL_STATS_TIME_END(IOTCL_STATS_DRA_PARSE_LATENCY, stats_start);
+    IOTCL_STATS_INC(status ? IOTCL_STATS_DRA_ERRORS : IOTCL_STATS_DRA_RESPONSES_PARSED);
     return status;
 }
 
@@ -179,8 +241,178 @@ int iotcl_dra_identity_configure_library_mqtt_with_length(const uint8_t *respons
     if (IOTCL_SUCCESS != status) {
         return status; // the called function will print the error
     }
+    IOTCL_STATS_TIME_START(stats_start);
+    IOTCL_TRACE_BEGIN(trace_start);
     cJSON *root = cJSON_ParseWithLength((const char *)response_data, response_data_size);
     status = iotcl_dra_parse_response_and_configure_iotcl(root);
     cJSON_Delete(root);
+    IOTCL_TRACE_END("iotcl_dra_identity_parse", trace_start);
+    IOTCL_STATS_TIME_END(IOTCL_STATS_DRA_PARSE_LATENCY, stats_start);
+    IOTCL_STATS_INC(status ? IOTCL_STATS_DRA_ERRORS : IOTCL_STATS_DRA_RESPONSES_PARSED);
     return status;
 }
+
+int iotcl_dra_identity_configure_library_mqtt_with_values(const IotclMqttConfig *values) {
+    if (!values) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "DRA Identity: MQTT configuration values are required.");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    int status = iotcl_dra_identity_validate_config();
+    if (IOTCL_SUCCESS != status) {
+        return status; // the called function will print the error
+    }
+    return iotcl_dra_identity_publish_mqtt_config(values);
+}
+
+int iotcl_dra_identity_stream_init(IotclDraIdentityStreamParser *p) {
+    if (!p) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "DRA Identity: Stream parser is required.");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    int status = iotcl_dra_identity_validate_config();
+    if (IOTCL_SUCCESS != status) {
+        return status; // the called function will print the error
+    }
+    return iotcl_dra_json_scanner_init(
+            &p->scanner,
+            iotcl_dra_identity_fields,
+            (int) (sizeof(iotcl_dra_identity_fields) / sizeof(iotcl_dra_identity_fields[0]))
+    );
+}
+
+int iotcl_dra_identity_stream_feed(IotclDraIdentityStreamParser *p, const uint8_t *data, size_t data_len) {
+    return iotcl_dra_json_scanner_feed(&p->scanner, data, data_len);
+}
+
+static int iotcl_dra_identity_stream_apply(IotclDraIdentityStreamParser *p) {
+    const IotclDraJsonScanner *s = &p->scanner;
+    int status = iotcl_dra_json_scanner_finish(&p->scanner);
+    if (IOTCL_SUCCESS != status) {
+        return status; // the called function will print the error
+    }
+
+    int response_status;
+    int ec = 0;
+    if (!iotcl_dra_json_scanner_get_int(s, IOTCL_DRA_IDENTITY_FIELD_STATUS, &response_status)
+        || (200 == response_status && !iotcl_dra_json_scanner_get_int(s, IOTCL_DRA_IDENTITY_FIELD_EC, &ec))) {
+        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "DRA Identity: Error encountered while parsing the response status or error code");
+        return IOTCL_ERR_PARSING_ERROR;
+    }
+    status = iotcl_dra_identity_check_status(response_status, ec);
+    if (IOTCL_SUCCESS != status) {
+        return status; // the called function will print the error
+    }
+
+    for (int i = 0; i < (int) (sizeof(iotcl_dra_identity_fields) / sizeof(iotcl_dra_identity_fields[0])); i++) {
+        if (iotcl_dra_json_scanner_is_truncated(s, i)) {
+            IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "DRA Identity: Response field \"%s\" is too long. Increase IOTCL_DRA_SCANNER_POOL_SIZE.", iotcl_dra_identity_fields[i]);
+            return IOTCL_ERR_OVERFLOW;
+        }
+    }
+
+    IotclMqttConfig values = {0};
+    values.username = (char *) iotcl_dra_json_scanner_get_string(s, IOTCL_DRA_IDENTITY_FIELD_UN);
+    values.host = (char *) iotcl_dra_json_scanner_get_string(s, IOTCL_DRA_IDENTITY_FIELD_H);
+    values.client_id = (char *) iotcl_dra_json_scanner_get_string(s, IOTCL_DRA_IDENTITY_FIELD_ID);
+    values.pub_rpt = (char *) iotcl_dra_json_scanner_get_string(s, IOTCL_DRA_IDENTITY_FIELD_RPT);
+    values.pub_ack = (char *) iotcl_dra_json_scanner_get_string(s, IOTCL_DRA_IDENTITY_FIELD_ACK);
+    values.sub_c2d = (char *) iotcl_dra_json_scanner_get_string(s, IOTCL_DRA_IDENTITY_FIELD_C2D);
+    values.cd = (char *) iotcl_dra_json_scanner_get_string(s, IOTCL_DRA_IDENTITY_FIELD_CD);
+    return iotcl_dra_identity_publish_mqtt_config(&values); // the called function will print the error
+}
+
+int iotcl_dra_identity_stream_finish(IotclDraIdentityStreamParser *p) {
+    // the time spent in feed calls is not counted, as it overlaps with receiving the data
+    IOTCL_STATS_TIME_START(stats_start);
+    IOTCL_TRACE_BEGIN(trace_start);
+    int status = iotcl_dra_identity_stream_apply(p);
+    IOTCL_TRACE_END("iotcl_dra_identity_parse", trace_start);
+    IOTCL_STATS_TIME_END(IOTCL_STATS_DRA_PARSE_LATENCY, stats_start);
+    IOTCL_STATS_INC(status ? IOTCL_STATS_DRA_ERRORS : IOTCL_STATS_DRA_RESPONSES_PARSED);
+    return status;
+}
+
+int iotcl_dra_identity_build_url_table(
+        IotclDraIdentityUrlTable *table,
+        const IotclDraUrlContext *base_url_context,
+        const char *const *duids,
+        size_t num_duids
+) {
+    if (!table) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "DRA Identity: URL table is required.");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    memset(table, 0, sizeof(IotclDraIdentityUrlTable));
+    if (!base_url_context || !iotcl_dra_url_get_url(base_url_context)) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "DRA Identity: Base URL is required.");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (!duids || 0 == num_duids) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "DRA Identity: DUIDs are required.");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+
+    // any suffix path that was used on the base URL is not included
+    const size_t base_len = base_url_context->idx_suffix_start;
+    const size_t prefix_len = strlen(IOTCL_DRA_IDENTITY_PREFIX);
+
+    // First pass: compute the total size of the offsets and the packed strings so that we can allocate once
+    if (num_duids > SIZE_MAX / sizeof(size_t)) goto cleanup_overflow;
+    size_t total_size = num_duids * sizeof(size_t);
+    for (size_t i = 0; i < num_duids; i++) {
+        if (!duids[i] || 0 == duids[i][0]) {
+            IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "DRA Identity: DUID at index %lu is empty.", (unsigned long) i);
+            return IOTCL_ERR_MISSING_VALUE;
+        }
+        const size_t url_size = base_len + prefix_len + strlen(duids[i]) + 1;
+        if (url_size > SIZE_MAX - total_size) goto cleanup_overflow;
+        total_size += url_size;
+    }
+
+    uint8_t *block = iotcl_malloc(total_size);
+    if (!block) {
+        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "DRA Identity: Out of memory while allocating the URL table!");
+        return IOTCL_ERR_OUT_OF_MEMORY;
+    }
+    table->offsets = (size_t *) block;
+    table->strings = (char *) &block[num_duids * sizeof(size_t)];
+
+    // Second pass: pack the URLs
+    char *p = table->strings;
+    for (size_t i = 0; i < num_duids; i++) {
+        const size_t duid_size = strlen(duids[i]) + 1;
+        table->offsets[i] = (size_t) (p - table->strings);
+        memcpy(p, base_url_context->url, base_len);
+        p += base_len;
+        memcpy(p, IOTCL_DRA_IDENTITY_PREFIX, prefix_len);
+        p += prefix_len;
+        memcpy(p, duids[i], duid_size);
+        p += duid_size;
+    }
+    table->count = num_duids;
+    table->idx_path = base_url_context->idx_path;
+    return IOTCL_SUCCESS;
+
+    cleanup_overflow:
+    IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "DRA Identity: URL table size would overflow!");
+    return IOTCL_ERR_OVERFLOW;
+}
+
+const char *iotcl_dra_identity_url_table_get_url(const IotclDraIdentityUrlTable *table, size_t index) {
+    if (!table || !table->strings || index >= table->count) {
+        return NULL;
+    }
+    return &table->strings[table->offsets[index]];
+}
+
+const char *iotcl_dra_identity_url_table_get_resource(const IotclDraIdentityUrlTable *table, size_t index) {
+    const char *url = iotcl_dra_identity_url_table_get_url(table, index);
+    return url ? &url[table->idx_path] : NULL;
+}
+
+void iotcl_dra_identity_url_table_deinit(IotclDraIdentityUrlTable *table) {
+    if (table) {
+        iotcl_free(table->offsets); // the strings are in the same allocation
+        memset(table, 0, sizeof(IotclDraIdentityUrlTable));
+    }
+}
@@ -12,7 +12,10 @@
 #define ITOCL_DRA_IDENTITY_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include "iotcl.h"
 #include "iotcl_dra_url.h"
+#include "iotcl_dra_json_scanner.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -24,12 +27,56 @@ extern "C" {
 // Formats an input base url URL to use to call identity REST API
 int iotcl_dra_identity_build_url(IotclDraUrlContext *base_url_context, const char *duid);
 
+// A table of identity URLs for many devices, stored in a single allocation. See iotcl_dra_identity_build_url_table().
+// The user should not access the fields directly.
+typedef struct {
+    size_t *offsets;    // offset of each URL in strings
+    char *strings;      // packed null-terminated URLs
+    size_t count;
+    size_t idx_path;    // offset of the resource path in each URL
+} IotclDraIdentityUrlTable;
+
+// Builds identity URLs for all DUIDs on top of the base URL with a single allocation.
+// The hostname is the same for all URLs and can be obtained from the base URL context.
+// Free the table with iotcl_dra_identity_url_table_deinit() if the function returns success.
+int iotcl_dra_identity_build_url_table(
+        IotclDraIdentityUrlTable *table,
+        const IotclDraUrlContext *base_url_context,
+        const char *const *duids,
+        size_t num_duids
+);
+
+// Returns the identity URL for the DUID at index, or NULL if index is out of range.
+const char *iotcl_dra_identity_url_table_get_url(const IotclDraIdentityUrlTable *table, size_t index);
+
+// Returns the resource path of the identity URL for the DUID at index, or NULL if index is out of range.
+const char *iotcl_dra_identity_url_table_get_resource(const IotclDraIdentityUrlTable *table, size_t index);
+
+void iotcl_dra_identity_url_table_deinit(IotclDraIdentityUrlTable *table);
+
 // Parse an identity response and configure IoTConnect library mqtt settings with the response result
 int iotcl_dra_identity_configure_library_mqtt(const char *response_str);
 
 // Parse an identity response and configure IoTConnect library mqtt settings with the response result
 int iotcl_dra_identity_configure_library_mqtt_with_length(const uint8_t *response_data, size_t response_data_size);
 
+// Configure IoTConnect library mqtt settings with values previously obtained from an identity response (eg. cached).
+// The strings are copied. host, client_id, pub_rpt, pub_ack, sub_c2d and cd are required. version is ignored.
+int iotcl_dra_identity_configure_library_mqtt_with_values(const IotclMqttConfig *values);
+
+// Push-style identity response parser. See IotclDraDiscoveryStreamParser in iotcl_dra_discovery.h.
+typedef struct {
+    IotclDraJsonScanner scanner;
+} IotclDraIdentityStreamParser;
+
+int iotcl_dra_identity_stream_init(IotclDraIdentityStreamParser *p);
+
+// Feed the next chunk of the response body. Stop feeding and discard the response if an error is returned.
+int iotcl_dra_identity_stream_feed(IotclDraIdentityStreamParser *p, const uint8_t *data, size_t data_len);
+
+// Call once the whole body is fed. Configures the library the same way as iotcl_dra_identity_configure_library_mqtt().
+int iotcl_dra_identity_stream_finish(IotclDraIdentityStreamParser *p);
+
 
 
 #ifdef __cplusplus
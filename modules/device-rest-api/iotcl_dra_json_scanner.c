@@ -0,0 +1,444 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * The scanner is a byte-at-a-time state machine. Object keys are tracked only for the first
+ * IOTCL_DRA_SCANNER_KEY_DEPTH nesting levels, and only the container type is tracked beyond that.
+ * It is not a strict validating parser. For example, number and literal tokens are not fully validated.
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iotcl_internal.h"
+#include "iotcl_cfg.h"
+#include "iotcl_log.h"
+#include "iotcl_dra_json_scanner.h"
+
+#if (IOTCL_DRA_SCANNER_POOL_SIZE < 2) || (IOTCL_DRA_SCANNER_POOL_SIZE > UINT16_MAX)
+#error "IOTCL_DRA_SCANNER_POOL_SIZE must be between 2 and 65535"
+#endif
+
+#if (IOTCL_DRA_SCANNER_MAX_NESTING < 1) || (IOTCL_DRA_SCANNER_MAX_NESTING > 32)
+#error "IOTCL_DRA_SCANNER_MAX_NESTING must be between 1 and 32"
+#endif
+
+#define IOTCL_DRA_SCANNER_KEY_TOO_LONG (IOTCL_DRA_SCANNER_KEY_MAX_LEN + 1)
+
+typedef enum {
+    SCANNER_VALUE,          // expecting a value
+    SCANNER_VALUE_OR_END,   // after '['
+    SCANNER_KEY_OR_END,     // after '{'
+    SCANNER_KEY,            // after ',' in an object
+    SCANNER_COLON,
+    SCANNER_STRING,
+    SCANNER_ESCAPE,
+    SCANNER_UNICODE,
+    SCANNER_LITERAL,
+    SCANNER_AFTER_VALUE,
+    SCANNER_DONE
+} IotclDraScannerState;
+
+static bool is_json_whitespace(uint8_t c) {
+    return ' ' == c || '\t' == c || '\r' == c || '\n' == c;
+}
+
+static bool is_literal_char(uint8_t c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || '-' == c || '+' == c || '.' == c;
+}
+
+static int iotcl_dra_scanner_fail(IotclDraJsonScanner *s, int status, const char *reason) {
+    IOTCL_ERROR(status, "DRA JSON: %s at position %lu", reason, (unsigned long) s->position);
+    s->status = status;
+    return status;
+}
+
+// Returns true if the keys of the current nesting levels match the dot-separated path.
+static bool iotcl_dra_scanner_path_matches(const IotclDraJsonScanner *s, const char *path) {
+    if (s->nesting < 1 || s->nesting > IOTCL_DRA_SCANNER_KEY_DEPTH) {
+        return false;
+    }
+    const char *p = path;
+    for (int i = 0; i < s->nesting; i++) {
+        const char *dot = strchr(p, '.');
+        const size_t len = dot ? (size_t) (dot - p) : strlen(p);
+        if ((s->array_bits & (1u << i)) || len != s->key_lengths[i] || 0 != memcmp(p, s->keys[i], len)) {
+            return false;
+        }
+        if (i == s->nesting - 1) {
+            return NULL == dot; // the path must end here
+        }
+        if (!dot) {
+            return false;
+        }
+        p = dot + 1;
+    }
+    return false;
+}
+
+static void iotcl_dra_scanner_begin_capture(IotclDraJsonScanner *s, bool is_string) {
+    s->capture_field = -1;
+    for (int i = 0; i < s->num_fields; i++) {
+        IotclDraJsonScannerField *field = &s->fields[i];
+        if (field->is_set || field->is_truncated || !iotcl_dra_scanner_path_matches(s, s->field_paths[i])) {
+            continue;
+        }
+        if (s->pool_used >= IOTCL_DRA_SCANNER_POOL_SIZE) {
+            field->is_truncated = true; // no room even for the null terminator
+            return;
+        }
+        field->offset = (uint16_t) s->pool_used;
+        field->is_string = is_string;
+        s->capture_field = i;
+        return;
+    }
+}
+
+static void iotcl_dra_scanner_append(IotclDraJsonScanner *s, uint8_t c) {
+    if (s->is_key) {
+        if (s->nesting <= IOTCL_DRA_SCANNER_KEY_DEPTH) {
+            uint8_t *len = &s->key_lengths[s->nesting - 1];
+            if (*len < IOTCL_DRA_SCANNER_KEY_MAX_LEN) {
+                s->keys[s->nesting - 1][*len] = (char) c;
+                (*len)++;
+            } else {
+                *len = IOTCL_DRA_SCANNER_KEY_TOO_LONG;
+            }
+        }
+        return;
+    }
+    if (s->capture_field < 0) {
+        return;
+    }
+    // always leave room for the null terminator
+    if (s->pool_used + 1 < IOTCL_DRA_SCANNER_POOL_SIZE) {
+        s->pool[s->pool_used++] = (char) c;
+    } else {
+        s->fields[s->capture_field].is_truncated = true;
+    }
+}
+
+static void iotcl_dra_scanner_append_code_point(IotclDraJsonScanner *s, uint32_t cp) {
+    if (cp < 0x80) {
+        iotcl_dra_scanner_append(s, (uint8_t) cp);
+    } else if (cp < 0x800) {
+        iotcl_dra_scanner_append(s, (uint8_t) (0xC0 | (cp >> 6)));
+        iotcl_dra_scanner_append(s, (uint8_t) (0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        iotcl_dra_scanner_append(s, (uint8_t) (0xE0 | (cp >> 12)));
+        iotcl_dra_scanner_append(s, (uint8_t) (0x80 | ((cp >> 6) & 0x3F)));
+        iotcl_dra_scanner_append(s, (uint8_t) (0x80 | (cp & 0x3F)));
+    } else {
+        iotcl_dra_scanner_append(s, (uint8_t) (0xF0 | (cp >> 18)));
+        iotcl_dra_scanner_append(s, (uint8_t) (0x80 | ((cp >> 12) & 0x3F)));
+        iotcl_dra_scanner_append(s, (uint8_t) (0x80 | ((cp >> 6) & 0x3F)));
+        iotcl_dra_scanner_append(s, (uint8_t) (0x80 | (cp & 0x3F)));
+    }
+}
+
+// A high surrogate that is not followed by a low surrogate is replaced with '?'
+static void iotcl_dra_scanner_flush_surrogate(IotclDraJsonScanner *s) {
+    if (s->high_surrogate) {
+        s->high_surrogate = 0;
+        iotcl_dra_scanner_append(s, '?');
+    }
+}
+
+static void iotcl_dra_scanner_unicode_unit(IotclDraJsonScanner *s, uint32_t unit) {
+    if (unit >= 0xDC00 && unit <= 0xDFFF && s->high_surrogate) {
+        const uint32_t cp = 0x10000 + ((s->high_surrogate - 0xD800) << 10) + (unit - 0xDC00);
+        s->high_surrogate = 0;
+        iotcl_dra_scanner_append_code_point(s, cp);
+        return;
+    }
+    iotcl_dra_scanner_flush_surrogate(s);
+    if (unit >= 0xD800 && unit <= 0xDBFF) {
+        s->high_surrogate = unit;
+    } else if (unit >= 0xDC00 && unit <= 0xDFFF) {
+        iotcl_dra_scanner_append(s, '?');
+    } else {
+        iotcl_dra_scanner_append_code_point(s, unit);
+    }
+}
+
+static void iotcl_dra_scanner_end_value(IotclDraJsonScanner *s) {
+    if (s->capture_field >= 0) {
+        IotclDraJsonScannerField *field = &s->fields[s->capture_field];
+        const char *value = &s->pool[field->offset];
+        if (!field->is_string && 4 == s->pool_used - field->offset && 0 == memcmp(value, "null", 4)) {
+            s->pool_used = field->offset; // null is the same as not set
+        } else {
+            s->pool[s->pool_used++] = '\0';
+            field->is_set = true;
+        }
+        s->capture_field = -1;
+    }
+    s->state = (0 == s->nesting) ? SCANNER_DONE : SCANNER_AFTER_VALUE;
+}
+
+static int iotcl_dra_scanner_push(IotclDraJsonScanner *s, bool is_array) {
+    if (s->nesting >= IOTCL_DRA_SCANNER_MAX_NESTING) {
+        return iotcl_dra_scanner_fail(s, IOTCL_ERR_OVERFLOW, "Document nesting is too deep");
+    }
+    if (is_array) {
+        s->array_bits |= (1u << s->nesting);
+    } else {
+        s->array_bits &= ~(1u << s->nesting);
+    }
+    if (s->nesting < IOTCL_DRA_SCANNER_KEY_DEPTH) {
+        s->key_lengths[s->nesting] = 0;
+    }
+    s->nesting++;
+    s->state = is_array ? SCANNER_VALUE_OR_END : SCANNER_KEY_OR_END;
+    return IOTCL_SUCCESS;
+}
+
+static int iotcl_dra_scanner_pop(IotclDraJsonScanner *s, bool is_array) {
+    const bool is_current_array = 0 != (s->array_bits & (1u << (s->nesting - 1)));
+    if (is_array != is_current_array) {
+        return iotcl_dra_scanner_fail(s, IOTCL_ERR_PARSING_ERROR, "Mismatched closing bracket");
+    }
+    s->nesting--;
+    iotcl_dra_scanner_end_value(s);
+    return IOTCL_SUCCESS;
+}
+
+static int iotcl_dra_scanner_begin_value(IotclDraJsonScanner *s, uint8_t c) {
+    if ('{' == c || '[' == c) {
+        return iotcl_dra_scanner_push(s, '[' == c);
+    }
+    if ('"' == c) {
+        s->is_key = false;
+        iotcl_dra_scanner_begin_capture(s, true);
+        s->state = SCANNER_STRING;
+        return IOTCL_SUCCESS;
+    }
+    if ('-' == c || (c >= '0' && c <= '9') || 't' == c || 'f' == c || 'n' == c) {
+        s->is_key = false;
+        iotcl_dra_scanner_begin_capture(s, false);
+        iotcl_dra_scanner_append(s, c);
+        s->state = SCANNER_LITERAL;
+        return IOTCL_SUCCESS;
+    }
+    return iotcl_dra_scanner_fail(s, IOTCL_ERR_PARSING_ERROR, "Unexpected character while expecting a value");
+}
+
+static int iotcl_dra_scanner_process(IotclDraJsonScanner *s, uint8_t c) {
+    switch ((IotclDraScannerState) s->state) {
+        case SCANNER_VALUE_OR_END:
+            if (']' == c) {
+                return iotcl_dra_scanner_pop(s, true);
+            }
+            // fall through
+        case SCANNER_VALUE:
+            if (is_json_whitespace(c)) {
+                return IOTCL_SUCCESS;
+            }
+            return iotcl_dra_scanner_begin_value(s, c);
+
+        case SCANNER_KEY_OR_END:
+            if ('}' == c) {
+                return iotcl_dra_scanner_pop(s, false);
+            }
+            // fall through
+        case SCANNER_KEY:
+            if (is_json_whitespace(c)) {
+                return IOTCL_SUCCESS;
+            }
+            if ('"' != c) {
+                return iotcl_dra_scanner_fail(s, IOTCL_ERR_PARSING_ERROR, "Expected an object key");
+            }
+            s->is_key = true;
+            if (s->nesting <= IOTCL_DRA_SCANNER_KEY_DEPTH) {
+                s->key_lengths[s->nesting - 1] = 0;
+            }
+            s->state = SCANNER_STRING;
+            return IOTCL_SUCCESS;
+
+        case SCANNER_COLON:
+            if (is_json_whitespace(c)) {
+                return IOTCL_SUCCESS;
+            }
+            if (':' != c) {
+                return iotcl_dra_scanner_fail(s, IOTCL_ERR_PARSING_ERROR, "Expected a colon");
+            }
+            s->state = SCANNER_VALUE;
+            return IOTCL_SUCCESS;
+
+        case SCANNER_STRING:
+            if ('"' == c) {
+                iotcl_dra_scanner_flush_surrogate(s);
+                if (s->is_key) {
+                    s->is_key = false;
+                    s->state = SCANNER_COLON;
+                } else {
+                    iotcl_dra_scanner_end_value(s);
+                }
+            } else if ('\\' == c) {
+                s->state = SCANNER_ESCAPE;
+            } else if (c < 0x20) {
+                return iotcl_dra_scanner_fail(s, IOTCL_ERR_PARSING_ERROR, "Control character in a string");
+            } else {
+                iotcl_dra_scanner_flush_surrogate(s);
+                iotcl_dra_scanner_append(s, c);
+            }
+            return IOTCL_SUCCESS;
+
+        case SCANNER_ESCAPE: {
+            uint8_t unescaped;
+            switch (c) {
+                case '"': unescaped = '"'; break;
+                case '\\': unescaped = '\\'; break;
+                case '/': unescaped = '/'; break;
+                case 'b': unescaped = '\b'; break;
+                case 'f': unescaped = '\f'; break;
+                case 'n': unescaped = '\n'; break;
+                case 'r': unescaped = '\r'; break;
+                case 't': unescaped = '\t'; break;
+                case 'u':
+                    s->unicode_value = 0;
+                    s->unicode_digits = 0;
+                    s->state = SCANNER_UNICODE;
+                    return IOTCL_SUCCESS;
+                default:
+                    return iotcl_dra_scanner_fail(s, IOTCL_ERR_PARSING_ERROR, "Invalid escape sequence");
+            }
+            iotcl_dra_scanner_flush_surrogate(s);
+            iotcl_dra_scanner_append(s, unescaped);
+            s->state = SCANNER_STRING;
+            return IOTCL_SUCCESS;
+        }
+
+        case SCANNER_UNICODE: {
+            uint32_t digit;
+            if (c >= '0' && c <= '9') {
+                digit = (uint32_t) (c - '0');
+            } else if (c >= 'a' && c <= 'f') {
+                digit = (uint32_t) (c - 'a' + 10);
+            } else if (c >= 'A' && c <= 'F') {
+                digit = (uint32_t) (c - 'A' + 10);
+            } else {
+                return iotcl_dra_scanner_fail(s, IOTCL_ERR_PARSING_ERROR, "Invalid unicode escape sequence");
+            }
+            s->unicode_value = (s->unicode_value << 4) | digit;
+            if (4 == ++s->unicode_digits) {
+                iotcl_dra_scanner_unicode_unit(s, s->unicode_value);
+                s->state = SCANNER_STRING;
+            }
+            return IOTCL_SUCCESS;
+        }
+
+        case SCANNER_LITERAL:
+            if (is_literal_char(c)) {
+                iotcl_dra_scanner_append(s, c);
+                return IOTCL_SUCCESS;
+            }
+            iotcl_dra_scanner_end_value(s);
+            return iotcl_dra_scanner_process(s, c); // the delimiter is processed in the new state
+
+        case SCANNER_AFTER_VALUE: {
+            if (is_json_whitespace(c)) {
+                return IOTCL_SUCCESS;
+            }
+            const bool is_array = 0 != (s->array_bits & (1u << (s->nesting - 1)));
+            if (',' == c) {
+                s->state = is_array ? SCANNER_VALUE : SCANNER_KEY;
+                return IOTCL_SUCCESS;
+            }
+            if (']' == c || '}' == c) {
+                return iotcl_dra_scanner_pop(s, ']' == c);
+            }
+            return iotcl_dra_scanner_fail(s, IOTCL_ERR_PARSING_ERROR, "Expected a comma or a closing bracket");
+        }
+
+        case SCANNER_DONE:
+            if (is_json_whitespace(c)) {
+                return IOTCL_SUCCESS;
+            }
+            return iotcl_dra_scanner_fail(s, IOTCL_ERR_PARSING_ERROR, "Unexpected data after the end of the document");
+
+        default:
+            return iotcl_dra_scanner_fail(s, IOTCL_ERR_FAILED, "Invalid scanner state");
+    }
+}
+
+int iotcl_dra_json_scanner_init(IotclDraJsonScanner *s, const char *const *field_paths, int num_fields) {
+    if (!s || (num_fields > 0 && !field_paths) || num_fields < 0) {
+        IOTCL_ERROR(IOTCL_ERR_MISSING_VALUE, "DRA JSON: Scanner and field paths are required.");
+        return IOTCL_ERR_MISSING_VALUE;
+    }
+    if (num_fields > IOTCL_DRA_SCANNER_MAX_FIELDS) {
+        IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "DRA JSON: Too many fields. Increase IOTCL_DRA_SCANNER_MAX_FIELDS.");
+        return IOTCL_ERR_OVERFLOW;
+    }
+    memset(s, 0, sizeof(IotclDraJsonScanner));
+    s->field_paths = field_paths;
+    s->num_fields = num_fields;
+    s->capture_field = -1;
+    s->state = SCANNER_VALUE;
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_dra_json_scanner_feed(IotclDraJsonScanner *s, const uint8_t *data, size_t data_len) {
+    if (IOTCL_SUCCESS != s->status) {
+        return s->status;
+    }
+    for (size_t i = 0; i < data_len; i++) {
+        int status = iotcl_dra_scanner_process(s, data[i]);
+        if (IOTCL_SUCCESS != status) {
+            return status; // error is already recorded and printed
+        }
+        s->position++;
+    }
+    return IOTCL_SUCCESS;
+}
+
+int iotcl_dra_json_scanner_finish(IotclDraJsonScanner *s) {
+    if (IOTCL_SUCCESS != s->status) {
+        return s->status;
+    }
+    if (SCANNER_LITERAL == s->state && 0 == s->nesting) {
+        iotcl_dra_scanner_end_value(s); // a document that is a single number or literal
+    }
+    if (SCANNER_DONE != s->state) {
+        return iotcl_dra_scanner_fail(s, IOTCL_ERR_PARSING_ERROR, "Incomplete document");
+    }
+    return IOTCL_SUCCESS;
+}
+
+const char *iotcl_dra_json_scanner_get(const IotclDraJsonScanner *s, int index) {
+    if (index < 0 || index >= s->num_fields || !s->fields[index].is_set) {
+        return NULL;
+    }
+    return &s->pool[s->fields[index].offset];
+}
+
+const char *iotcl_dra_json_scanner_get_string(const IotclDraJsonScanner *s, int index) {
+    const char *value = iotcl_dra_json_scanner_get(s, index);
+    if (!value || !s->fields[index].is_string || s->fields[index].is_truncated) {
+        return NULL;
+    }
+    return value;
+}
+
+bool iotcl_dra_json_scanner_get_int(const IotclDraJsonScanner *s, int index, int *value) {
+    const char *str = iotcl_dra_json_scanner_get(s, index);
+    if (!str || s->fields[index].is_string || s->fields[index].is_truncated) {
+        return false;
+    }
+    char *end = NULL;
+    const double number = strtod(str, &end);
+    if (end == str || '\0' != *end || number < INT_MIN || number > INT_MAX) {
+        return false;
+    }
+    // same as cJSON_GetNumberValue() followed by an int cast
+    *value = (int) number;
+    return true;
+}
+
+bool iotcl_dra_json_scanner_is_truncated(const IotclDraJsonScanner *s, int index) {
+    return index >= 0 && index < s->num_fields && s->fields[index].is_truncated;
+}
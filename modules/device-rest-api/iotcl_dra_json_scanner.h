@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * A push-style JSON scanner with bounded memory that picks selected fields out of a JSON document
+ * that is fed in chunks of any size. It is used by the discovery and identity stream parsers,
+ * so that the whole HTTP response body does not need to be buffered.
+ * The user should not typically need to use this scanner directly.
+ *
+ * Fields are selected with dot-separated object key paths, like "d.p.topics.rpt". Values in arrays cannot be selected.
+ * String values are unescaped and stored null-terminated. For other values (numbers, true, false) the raw token
+ * is stored. Null values are treated as not set. If a key is repeated, the first value is used.
+ * All selected values share a pool of IOTCL_DRA_SCANNER_POOL_SIZE bytes. A value that does not fit is not usable:
+ * iotcl_dra_json_scanner_get_string() and iotcl_dra_json_scanner_get_int() fail for it, and the discovery
+ * and identity parsers fail with IOTCL_ERR_OVERFLOW when a value that they need does not fit.
+ */
+
+#ifndef IOTCL_DRA_JSON_SCANNER_H
+#define IOTCL_DRA_JSON_SCANNER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Size of the pool that holds all selected values, including null terminators.
+#ifndef IOTCL_DRA_SCANNER_POOL_SIZE
+#define IOTCL_DRA_SCANNER_POOL_SIZE 768
+#endif
+
+// Maximum length of an object key that can be matched. Longer keys are never matched.
+#ifndef IOTCL_DRA_SCANNER_KEY_MAX_LEN
+#define IOTCL_DRA_SCANNER_KEY_MAX_LEN 15
+#endif
+
+// Maximum number of path components in a selected field.
+#ifndef IOTCL_DRA_SCANNER_KEY_DEPTH
+#define IOTCL_DRA_SCANNER_KEY_DEPTH 6
+#endif
+
+// Maximum nesting of objects and arrays in the document. Deeper documents fail to parse.
+// Must not be greater than 32.
+#ifndef IOTCL_DRA_SCANNER_MAX_NESTING
+#define IOTCL_DRA_SCANNER_MAX_NESTING 32
+#endif
+
+// Maximum number of fields that can be selected.
+#ifndef IOTCL_DRA_SCANNER_MAX_FIELDS
+#define IOTCL_DRA_SCANNER_MAX_FIELDS 12
+#endif
+
+typedef struct {
+    uint16_t offset;    // offset of the value in the pool
+    bool is_set;
+    bool is_string;
+    bool is_truncated;
+} IotclDraJsonScannerField;
+
+// Treat this structure as opaque.
+typedef struct {
+    const char *const *field_paths;
+    int num_fields;
+    IotclDraJsonScannerField fields[IOTCL_DRA_SCANNER_MAX_FIELDS];
+    char pool[IOTCL_DRA_SCANNER_POOL_SIZE];
+    size_t pool_used;
+
+    char keys[IOTCL_DRA_SCANNER_KEY_DEPTH][IOTCL_DRA_SCANNER_KEY_MAX_LEN + 1];
+    uint8_t key_lengths[IOTCL_DRA_SCANNER_KEY_DEPTH]; // greater than IOTCL_DRA_SCANNER_KEY_MAX_LEN if too long
+    uint32_t array_bits;    // bit N is set if the container at nesting N is an array
+    int nesting;            // number of open objects and arrays
+
+    int state;
+    bool is_key;            // the string being read is an object key
+    int capture_field;      // index of the field being captured, or -1
+    uint32_t unicode_value; // \uXXXX escape being decoded
+    int unicode_digits;
+    uint32_t high_surrogate;
+    size_t position;        // number of bytes processed, for error reporting
+    int status;             // sticky error status
+} IotclDraJsonScanner;
+
+// Initializes the scanner to select the fields with the given paths. field_paths must remain valid while scanning.
+int iotcl_dra_json_scanner_init(IotclDraJsonScanner *s, const char *const *field_paths, int num_fields);
+
+// Feeds the next chunk of the document. Returns an error if the document is not valid JSON.
+// Once an error is returned, the same error will be returned by subsequent calls.
+int iotcl_dra_json_scanner_feed(IotclDraJsonScanner *s, const uint8_t *data, size_t data_len);
+
+// Call after all chunks are fed. Returns an error if the document is incomplete or invalid.
+int iotcl_dra_json_scanner_finish(IotclDraJsonScanner *s);
+
+// Returns the value of the field at index (order of field_paths), or NULL if it was not found or was null.
+const char *iotcl_dra_json_scanner_get(const IotclDraJsonScanner *s, int index);
+
+// Returns the string value of the field at index, or NULL if the value is not a string or if it was truncated.
+const char *iotcl_dra_json_scanner_get_string(const IotclDraJsonScanner *s, int index);
+
+// Parses an integer value of the field at index. Returns false if it is not set or is not an integer.
+bool iotcl_dra_json_scanner_get_int(const IotclDraJsonScanner *s, int index, int *value);
+
+// Returns true if the value of the field at index did not fit into the pool.
+bool iotcl_dra_json_scanner_is_truncated(const IotclDraJsonScanner *s, int index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCL_DRA_JSON_SCANNER_H
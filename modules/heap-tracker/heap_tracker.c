@@ -3,26 +3,166 @@
  * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
  */
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include "heap_tracker.h"
 
-#define MAX_ADDRESSES 1000
+// Atomic operations for the counters, so that the hooks can be used from multiple threads.
+// The fallback for other compilers is only suitable for single-threaded tests.
+#if defined(__GNUC__) || defined(__clang__)
+#define HT_ATOMIC_ADD(ptr, value) ((void) __atomic_add_fetch((ptr), (value), __ATOMIC_RELAXED))
+#define HT_ATOMIC_ADD_FETCH(ptr, value) __atomic_add_fetch((ptr), (value), __ATOMIC_RELAXED)
+#define HT_ATOMIC_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define HT_ATOMIC_STORE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELAXED)
+#define HT_ATOMIC_CAS(ptr, expected_ptr, desired) \
+    __atomic_compare_exchange_n((ptr), (expected_ptr), (desired), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define HT_ATOMIC_RELEASE_STORE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define HT_THREAD_LOCAL __thread
+#else
+#define HT_ATOMIC_ADD(ptr, value) ((void) (*(ptr) += (value)))
+#define HT_ATOMIC_ADD_FETCH(ptr, value) (*(ptr) += (value))
+#define HT_ATOMIC_LOAD(ptr) (*(ptr))
+#define HT_ATOMIC_STORE(ptr, value) (*(ptr) = (value))
+#define HT_ATOMIC_CAS(ptr, expected_ptr, desired) \
+    (*(ptr) == *(expected_ptr) ? (*(ptr) = (desired), 1) : (*(expected_ptr) = *(ptr), 0))
+#define HT_ATOMIC_RELEASE_STORE(ptr, value) (*(ptr) = (value))
+#define HT_THREAD_LOCAL
+#endif
+
+// Tracked allocations are kept in an open addressing hash set keyed by address, so that ht_free() can tell
+// tracked blocks from pointers allocated elsewhere without reading memory around them.
+typedef struct {
+    void *ptr; // NULL if the entry is not used
+    size_t size;
+    int scope;
+} HtAllocation;
+
+typedef struct {
+    unsigned long allocations;
+    unsigned long frees;
+    unsigned long failed_allocations;
+    size_t total_bytes;
+    size_t current_bytes;
+    size_t peak_bytes;
+} HtCounters;
 
 HeapSimConfig ht_config = {0};
 struct {
     int malloc_calls; // increments when malloc(), decrements when free(). Should be 0 at the end of test.
     int allocations_on_heap;     // Track how many allocations we make in total.
+    HtCounters counters;
+    unsigned long histogram[HT_HISTOGRAM_BUCKETS];
+} ht_context = {0};
 
-    // we could track heap size for a future implementation. would need to record each malloc size and track when freeing
-    // size_t heap_remaining;
+// Scope 0 collects allocations made outside of any scope
+static struct {
+    const char *name;
+    HtCounters counters;
+} ht_scopes[HT_MAX_SCOPES];
 
-    // we could track allocations for a future implementation. some struct that tracks addresses allocated and sizes
-    // void* allocations[MAX_ADDRESSES];
-} ht_context = {0};
+static HT_THREAD_LOCAL int ht_current_scope = 0;
+
+static HtAllocation ht_allocations[HT_MAX_ALLOCATIONS];
+static int ht_allocations_lock = 0;
+
+static void ht_lock(void) {
+    int unlocked = 0;
+    while (!HT_ATOMIC_CAS(&ht_allocations_lock, &unlocked, 1)) {
+        unlocked = 0;
+    }
+}
+
+static void ht_unlock(void) {
+    HT_ATOMIC_RELEASE_STORE(&ht_allocations_lock, 0);
+}
+
+static size_t ht_allocation_index(const void *ptr) {
+    // Fibonacci hashing. The low bits of heap addresses are mostly zero due to alignment.
+    return (size_t) (((uint64_t) (uintptr_t) ptr * 0x9E3779B97F4A7C15ull) >> 32) % HT_MAX_ALLOCATIONS;
+}
+
+// Must be called with the lock held. Returns 0 if the set is full.
+static int ht_allocation_insert(void *ptr, size_t size, int scope) {
+    size_t i = ht_allocation_index(ptr);
+    for (size_t n = 0; n < HT_MAX_ALLOCATIONS; n++) {
+        if (!ht_allocations[i].ptr) {
+            ht_allocations[i].ptr = ptr;
+            ht_allocations[i].size = size;
+            ht_allocations[i].scope = scope;
+            return 1;
+        }
+        i = (i + 1) % HT_MAX_ALLOCATIONS;
+    }
+    return 0;
+}
+
+// Must be called with the lock held. Returns 0 if ptr is not in the set.
+static int ht_allocation_remove(const void *ptr, HtAllocation *removed) {
+    size_t i = ht_allocation_index(ptr);
+    for (size_t n = 0; n < HT_MAX_ALLOCATIONS && ht_allocations[i].ptr != ptr; n++) {
+        if (!ht_allocations[i].ptr) {
+            return 0;
+        }
+        i = (i + 1) % HT_MAX_ALLOCATIONS;
+    }
+    if (ht_allocations[i].ptr != ptr) {
+        return 0;
+    }
+    *removed = ht_allocations[i];
+    // Shift back the following entries of the probe sequence, so that lookups can stop at the first empty entry
+    size_t hole = i;
+    for (;;) {
+        i = (i + 1) % HT_MAX_ALLOCATIONS;
+        if (!ht_allocations[i].ptr) {
+            break;
+        }
+        const size_t home = ht_allocation_index(ht_allocations[i].ptr);
+        // the entry can fill the hole only if its home is not cyclically in (hole, i]
+        const int can_move = (hole <= i) ? (home <= hole || home > i) : (home <= hole && home > i);
+        if (can_move) {
+            ht_allocations[hole] = ht_allocations[i];
+            hole = i;
+        }
+    }
+    ht_allocations[hole].ptr = NULL;
+    return 1;
+}
+
+static void ht_counters_to_stats(const HtCounters *c, HtStats *stats) {
+    stats->allocations = HT_ATOMIC_LOAD(&c->allocations);
+    stats->frees = HT_ATOMIC_LOAD(&c->frees);
+    stats->failed_allocations = HT_ATOMIC_LOAD(&c->failed_allocations);
+    stats->total_bytes = HT_ATOMIC_LOAD(&c->total_bytes);
+    stats->current_bytes = HT_ATOMIC_LOAD(&c->current_bytes);
+    stats->peak_bytes = HT_ATOMIC_LOAD(&c->peak_bytes);
+}
 
+static void ht_counters_add(HtCounters *c, size_t size) {
+    HT_ATOMIC_ADD(&c->allocations, 1);
+    HT_ATOMIC_ADD(&c->total_bytes, size);
+    const size_t current = HT_ATOMIC_ADD_FETCH(&c->current_bytes, size);
+    size_t peak = HT_ATOMIC_LOAD(&c->peak_bytes);
+    while (current > peak && !HT_ATOMIC_CAS(&c->peak_bytes, &peak, current)) {
+        // peak was updated with the latest value. Try again.
+    }
+}
+
+static void ht_counters_remove(HtCounters *c, size_t size) {
+    HT_ATOMIC_ADD(&c->frees, 1);
+    HT_ATOMIC_ADD(&c->current_bytes, (size_t) 0 - size); // unsigned wraparound subtracts
+}
 
+static int ht_histogram_bucket(size_t size) {
+    int bucket = 0;
+    size_t limit = 16;
+    while (bucket < HT_HISTOGRAM_BUCKETS - 1 && size > limit) {
+        bucket++;
+        limit <<= 1;
+    }
+    return bucket;
+}
 
 void ht_reset_config() {
     memset(&ht_config, 0, sizeof(ht_config));
@@ -32,14 +172,25 @@ void ht_init() {
     // we can init heap remaining based on the left heap size configured
 
     memset(&ht_context, 0, sizeof(ht_context));
+    memset(&ht_scopes, 0, sizeof(ht_scopes));
+    ht_lock();
+    memset(&ht_allocations, 0, sizeof(ht_allocations));
+    ht_unlock();
+    ht_scopes[0].name = "(unscoped)";
+    ht_current_scope = 0;
 }
 
 int ht_get_num_current_allocations(void) {
-    return ht_context.allocations_on_heap;
+    return HT_ATOMIC_LOAD(&ht_context.allocations_on_heap);
 }
 
 void ht_print_status(void) {
-    printf("Mallocs: %d. On heap: %d.\n", ht_context.malloc_calls, ht_context.allocations_on_heap);
+    printf("Mallocs: %d. On heap: %d. Bytes on heap: %lu. Peak bytes: %lu.\n",
+           HT_ATOMIC_LOAD(&ht_context.malloc_calls),
+           HT_ATOMIC_LOAD(&ht_context.allocations_on_heap),
+           (unsigned long) ht_get_current_bytes(),
+           (unsigned long) ht_get_peak_bytes()
+    );
 }
 void ht_print_summary(void) {
     ht_print_status();
@@ -49,28 +200,179 @@ void ht_print_summary(void) {
         printf("No memory leaks detected.");
     }
 }
+
+void ht_get_stats(HtStats *stats) {
+    ht_counters_to_stats(&ht_context.counters, stats);
+}
+
+size_t ht_get_current_bytes(void) {
+    return HT_ATOMIC_LOAD(&ht_context.counters.current_bytes);
+}
+
+size_t ht_get_peak_bytes(void) {
+    return HT_ATOMIC_LOAD(&ht_context.counters.peak_bytes);
+}
+
+void ht_reset_peak(void) {
+    HT_ATOMIC_STORE(&ht_context.counters.peak_bytes, ht_get_current_bytes());
+    for (int i = 0; i < HT_MAX_SCOPES; i++) {
+        HT_ATOMIC_STORE(&ht_scopes[i].counters.peak_bytes, HT_ATOMIC_LOAD(&ht_scopes[i].counters.current_bytes));
+    }
+}
+
+unsigned long ht_get_histogram_bucket(int bucket) {
+    if (bucket < 0 || bucket >= HT_HISTOGRAM_BUCKETS) {
+        return 0;
+    }
+    return HT_ATOMIC_LOAD(&ht_context.histogram[bucket]);
+}
+
+size_t ht_get_histogram_bucket_limit(int bucket) {
+    if (bucket < 0 || bucket >= HT_HISTOGRAM_BUCKETS - 1) {
+        return 0;
+    }
+    return (size_t) 16 << bucket;
+}
+
+void ht_print_histogram(void) {
+    printf("Allocation sizes:\n");
+    for (int i = 0; i < HT_HISTOGRAM_BUCKETS; i++) {
+        const unsigned long count = ht_get_histogram_bucket(i);
+        if (0 == count) {
+            continue;
+        }
+        if (i < HT_HISTOGRAM_BUCKETS - 1) {
+            printf("  <= %6lu: %lu\n", (unsigned long) ht_get_histogram_bucket_limit(i), count);
+        } else {
+            printf("  >  %6lu: %lu\n", (unsigned long) ht_get_histogram_bucket_limit(i - 1), count);
+        }
+    }
+}
+
+static int ht_find_scope(const char *name) {
+    for (int i = 1; i < HT_MAX_SCOPES; i++) {
+        const char *scope_name = HT_ATOMIC_LOAD(&ht_scopes[i].name);
+        if (!scope_name) {
+            return -i; // first free slot
+        }
+        if (scope_name == name || 0 == strcmp(scope_name, name)) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+int ht_scope_enter(const char *name) {
+    const int previous = ht_current_scope;
+    if (!name) {
+        return previous;
+    }
+    for (;;) {
+        int index = ht_find_scope(name);
+        if (index > 0) {
+            ht_current_scope = index;
+            break;
+        }
+        if (0 == index) {
+            // all slots are taken. Allocations will be attributed to the unscoped slot.
+            ht_current_scope = 0;
+            break;
+        }
+        const char *expected = NULL;
+        if (HT_ATOMIC_CAS(&ht_scopes[-index].name, &expected, name)) {
+            ht_current_scope = -index;
+            break;
+        }
+        // another thread registered a scope in this slot, so search again
+    }
+    return previous;
+}
+
+void ht_scope_exit(int token) {
+    ht_current_scope = token;
+}
+
+int ht_get_scope_stats(const char *name, HtStats *stats) {
+    const int index = ht_find_scope(name);
+    if (index <= 0) {
+        memset(stats, 0, sizeof(HtStats));
+        return 0;
+    }
+    ht_counters_to_stats(&ht_scopes[index].counters, stats);
+    return 1;
+}
+
+void ht_print_scopes(void) {
+    printf("%-40s %8s %8s %10s %10s %10s\n", "scope", "allocs", "frees", "bytes", "current", "peak");
+    for (int i = 0; i < HT_MAX_SCOPES; i++) {
+        const char *name = HT_ATOMIC_LOAD(&ht_scopes[i].name);
+        if (!name) {
+            break;
+        }
+        HtStats s;
+        ht_counters_to_stats(&ht_scopes[i].counters, &s);
+        printf("%-40s %8lu %8lu %10lu %10lu %10lu\n", name, s.allocations, s.frees,
+               (unsigned long) s.total_bytes, (unsigned long) s.current_bytes, (unsigned long) s.peak_bytes);
+    }
+}
+
 void *ht_malloc(size_t size) {
-    ht_context.malloc_calls++;
+    const int calls = HT_ATOMIC_ADD_FETCH(&ht_context.malloc_calls, 1);
+    const int scope = ht_current_scope;
 
     if (ht_config.num_successful_allocations > 0) { // has to be at least 1
         // if we want to simulate N successful allocations and all further ones to fail
-        if (ht_context.malloc_calls > ht_config.num_successful_allocations) {
-            return NULL;
+        if (calls > ht_config.num_successful_allocations) {
+            goto fail;
         }
     }
 
     double r = (double) rand() / RAND_MAX;
     if (r < (double) ht_config.random_failure_percentage) {
-        return NULL;
+        goto fail;
+    }
+    void *ptr = malloc(size);
+    if (!ptr) {
+        goto fail;
     }
-    ht_context.allocations_on_heap++;
-    return malloc(size);
+    ht_lock();
+    const int is_inserted = ht_allocation_insert(ptr, size, scope);
+    ht_unlock();
+    if (!is_inserted) {
+        printf(" --- HT_MAX_ALLOCATIONS EXCEEDED --- \n");
+        free(ptr);
+        goto fail;
+    }
+
+    HT_ATOMIC_ADD(&ht_context.allocations_on_heap, 1);
+    HT_ATOMIC_ADD(&ht_context.histogram[ht_histogram_bucket(size)], 1);
+    ht_counters_add(&ht_context.counters, size);
+    ht_counters_add(&ht_scopes[scope].counters, size);
+    return ptr;
+
+    fail:
+    HT_ATOMIC_ADD(&ht_context.counters.failed_allocations, 1);
+    HT_ATOMIC_ADD(&ht_scopes[scope].counters.failed_allocations, 1);
+    return NULL;
 }
 
 
 void ht_free(void *ptr) {
-    if (NULL != ptr) {
-        ht_context.allocations_on_heap--;
+    if (NULL == ptr) {
+        return;
+    }
+    HtAllocation allocation;
+    ht_lock();
+    const int is_tracked = ht_allocation_remove(ptr, &allocation);
+    ht_unlock();
+    if (!is_tracked) {
+        // a double free, or memory that was not allocated with ht_malloc(). free() will report the former.
+        printf(" --- FREE OF UNTRACKED MEMORY --- \n");
+        free(ptr);
+        return;
     }
+    HT_ATOMIC_ADD(&ht_context.allocations_on_heap, -1);
+    ht_counters_remove(&ht_context.counters, allocation.size);
+    ht_counters_remove(&ht_scopes[allocation.scope].counters, allocation.size);
     free(ptr);
 }
@@ -5,6 +5,23 @@
 #ifndef HEAP_TRACKER_H
 #define HEAP_TRACKER_H
 
+#include <stddef.h>
+
+// Number of allocation size histogram buckets. Bucket N counts sizes up to 16 << N bytes. The last bucket counts the rest.
+#ifndef HT_HISTOGRAM_BUCKETS
+#define HT_HISTOGRAM_BUCKETS 12
+#endif
+
+// Maximum number of distinct scopes. See ht_scope_enter().
+#ifndef HT_MAX_SCOPES
+#define HT_MAX_SCOPES 32
+#endif
+
+// Maximum number of allocations that can be tracked at the same time. Allocations beyond this limit fail.
+#ifndef HT_MAX_ALLOCATIONS
+#define HT_MAX_ALLOCATIONS 65536
+#endif
+
 typedef struct {
     float random_failure_percentage;  // from 0.0 to 1.0 a chance that malloc will fail
     int num_successful_allocations;   // Set to a number of allocations that will succeed before all start to fail. 0 otherwise.
@@ -12,11 +29,22 @@ typedef struct {
 
 extern HeapSimConfig ht_config;
 
+typedef struct {
+    unsigned long allocations;          // successful allocations
+    unsigned long frees;
+    unsigned long failed_allocations;   // simulated failures or out of memory
+    size_t total_bytes;                 // sum of all successfully allocated sizes
+    size_t current_bytes;               // bytes allocated and not yet freed
+    size_t peak_bytes;                  // maximum of current_bytes since ht_init() or ht_reset_peak()
+} HtStats;
+
 // hooks:
 void* ht_malloc(size_t size);
 void ht_free(void *);
 
 void ht_reset_config(void);
+
+// Resets all counters. Should be called when nothing allocated by ht_malloc() is on the heap.
 void ht_init(void);
 
 // tracks number of frees and allocs. Negative value means double free, positive value means leak
@@ -24,4 +52,40 @@ int ht_get_num_current_allocations(void);
 void ht_print_status(void);
 void ht_print_summary(void);
 
-#endif // HEAP_SIMULATOR_H
\ No newline at end of file
+// Byte accurate stats. The counters are updated atomically, so hooks can be used from multiple threads.
+void ht_get_stats(HtStats *stats);
+size_t ht_get_current_bytes(void);
+size_t ht_get_peak_bytes(void);
+
+// Sets the peak to the current number of bytes, so that the peak of an operation can be measured.
+void ht_reset_peak(void);
+
+// Returns the number of allocations with size in the histogram bucket, or 0 if bucket is out of range.
+unsigned long ht_get_histogram_bucket(int bucket);
+
+// Returns the upper size limit of the histogram bucket, or 0 for the last bucket that has no limit.
+size_t ht_get_histogram_bucket_limit(int bucket);
+
+void ht_print_histogram(void);
+
+// Scopes attribute allocations to an operation, like the IoTConnect API that is being called.
+// Allocations and frees are attributed to the innermost scope active on the calling thread. Memory freed outside
+// of the scope that allocated it is still attributed to the allocating scope. Use string literals for names.
+// Returns a token that needs to be passed to ht_scope_exit().
+int ht_scope_enter(const char *name);
+void ht_scope_exit(int token);
+
+// Evaluates the statement within a scope. For example: HT_SCOPE("iotcl_telemetry_create", msg = iotcl_telemetry_create());
+#define HT_SCOPE(name, statement) \
+    do { \
+        int ht_scope_token_ = ht_scope_enter(name); \
+        statement; \
+        ht_scope_exit(ht_scope_token_); \
+    } while (0)
+
+// Returns the stats for the scope with the name. Returns 0 if the scope does not exist.
+int ht_get_scope_stats(const char *name, HtStats *stats);
+
+void ht_print_scopes(void);
+
+#endif // HEAP_SIMULATOR_H
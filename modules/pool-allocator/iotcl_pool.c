@@ -0,0 +1,351 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L // for pthread keys, if IOTCL_POOL_THREAD_EXIT_HOOK is enabled
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iotcl_internal.h"
+#include "iotcl_cfg.h"
+#include "iotcl_log.h"
+#include "iotcl_pool.h"
+
+#if IOTCL_POOL_THREAD_EXIT_HOOK
+#include <pthread.h>
+#endif
+
+#define IOTCL_POOL_INDEX_MASK 0xFFFFFFFFu
+
+#if IOTCL_POOL_THREAD_CACHE_SIZE > 0
+#if defined(__GNUC__) || defined(__clang__)
+#define IOTCL_POOL_THREAD_LOCAL __thread
+#else
+#error "Define IOTCL_POOL_THREAD_CACHE_SIZE as 0, or define IOTCL_POOL_THREAD_LOCAL for your compiler"
+#endif
+#endif
+
+// Free blocks of each class are kept on a Treiber stack. The head packs a tag (high 32 bits)
+// and the index of the top block plus one (low 32 bits, zero when empty). The tag is incremented on every change,
+// so that a stale head cannot be swapped in if a block is popped and pushed back between a load and a compare-exchange.
+// Links are kept in a separate array rather than in the blocks themselves, so that popping never reads
+// a block that another thread may have already popped and written to.
+typedef struct {
+    uint64_t head;
+    uint32_t *next;     // index plus one of the next free block, for each block
+    uint8_t *blocks;
+    uint8_t *blocks_end;
+    size_t block_size;
+    uint32_t num_blocks;
+    uint32_t in_use;
+    uint32_t high_water;
+    unsigned long fallbacks;
+} IotclPoolClass;
+
+static struct {
+    uint8_t *arena;
+    uint8_t *blocks_end;
+    IotclPoolClass classes[IOTCL_POOL_NUM_CLASSES];
+    unsigned long large_allocations;
+} pool;
+
+// An arena released by iotcl_pool_deinit() while some of its blocks were still in use. It is kept allocated,
+// so that a late iotcl_pool_free() of such a block can be recognized and ignored. Passing it to free() would
+// corrupt the heap, and if the arena was freed, malloc() could return its addresses for unrelated allocations.
+typedef struct IotclPoolRetiredArena {
+    uint8_t *arena;
+    uint8_t *blocks_end;
+    struct IotclPoolRetiredArena *next;
+} IotclPoolRetiredArena;
+
+static IotclPoolRetiredArena *retired_arenas;
+
+#if IOTCL_POOL_THREAD_CACHE_SIZE > 0
+// Each thread keeps up to IOTCL_POOL_THREAD_CACHE_SIZE freed blocks of each class on a private list,
+// linked through the same next array, so that most allocations and frees avoid atomic operations altogether.
+// The generation ties the cache to a pool instance, so that a cache left over from a previous
+// iotcl_pool_init() is discarded rather than used.
+static unsigned int pool_generation = 1;
+
+typedef struct {
+    unsigned int generation;
+    uint32_t top[IOTCL_POOL_NUM_CLASSES]; // index plus one, or zero if empty
+    uint32_t count[IOTCL_POOL_NUM_CLASSES];
+} IotclPoolThreadCache;
+
+static IOTCL_POOL_THREAD_LOCAL IotclPoolThreadCache thread_cache;
+
+#if IOTCL_POOL_THREAD_EXIT_HOOK
+// The destructor of this key flushes the cache of a thread when it exits
+static pthread_key_t thread_exit_key;
+static pthread_once_t thread_exit_key_once = PTHREAD_ONCE_INIT;
+
+static void iotcl_pool_thread_exit(void *value) {
+    (void) value;
+    iotcl_pool_flush_thread_cache();
+}
+
+static void iotcl_pool_create_thread_exit_key(void) {
+    if (0 != pthread_key_create(&thread_exit_key, iotcl_pool_thread_exit)) {
+        IOTCL_WARN(IOTCL_ERR_FAILED, "iotcl_pool: Unable to create the thread exit hook. Call iotcl_pool_flush_thread_cache() before threads exit.");
+    }
+}
+#endif
+
+static IotclPoolThreadCache *iotcl_pool_get_thread_cache(void) {
+    const unsigned int generation = IOTCL_ATOMIC_LOAD(&pool_generation);
+    if (thread_cache.generation != generation) {
+        memset(&thread_cache, 0, sizeof(thread_cache));
+        thread_cache.generation = generation;
+#if IOTCL_POOL_THREAD_EXIT_HOOK
+        // any non-NULL value makes the destructor run
+        (void) pthread_setspecific(thread_exit_key, &thread_cache);
+#endif
+    }
+    return &thread_cache;
+}
+#endif
+
+static void *iotcl_pool_class_pop(IotclPoolClass *c) {
+    uint64_t head = IOTCL_ATOMIC_LOAD(&c->head);
+    for (;;) {
+        const uint32_t top = (uint32_t) (head & IOTCL_POOL_INDEX_MASK);
+        if (0 == top) {
+            return NULL;
+        }
+        const uint32_t next = IOTCL_ATOMIC_LOAD(&c->next[top - 1]);
+        const uint64_t new_head = (((head >> 32) + 1) << 32) | next;
+        if (IOTCL_ATOMIC_COMPARE_EXCHANGE(&c->head, &head, new_head)) {
+            return &c->blocks[(size_t) (top - 1) * c->block_size];
+        }
+    }
+}
+
+static void iotcl_pool_class_push(IotclPoolClass *c, uint32_t index) {
+    uint64_t head = IOTCL_ATOMIC_LOAD(&c->head);
+    uint64_t new_head;
+    do {
+        IOTCL_ATOMIC_STORE(&c->next[index], (uint32_t) (head & IOTCL_POOL_INDEX_MASK));
+        new_head = (((head >> 32) + 1) << 32) | (uint64_t) (index + 1);
+    } while (!IOTCL_ATOMIC_COMPARE_EXCHANGE(&c->head, &head, new_head));
+}
+
+static void iotcl_pool_class_count_use(IotclPoolClass *c) {
+    const uint32_t in_use = IOTCL_ATOMIC_ADD_FETCH(&c->in_use, 1);
+    uint32_t high_water = IOTCL_ATOMIC_LOAD(&c->high_water);
+    while (in_use > high_water && !IOTCL_ATOMIC_COMPARE_EXCHANGE(&c->high_water, &high_water, in_use)) {
+        // high_water was reloaded. Try again.
+    }
+}
+
+void iotcl_pool_init_config(IotclPoolConfig *config) {
+    const uint32_t defaults[IOTCL_POOL_NUM_CLASSES] = IOTCL_POOL_DEFAULT_NUM_BLOCKS;
+    memcpy(config->num_blocks, defaults, sizeof(config->num_blocks));
+}
+
+int iotcl_pool_init(const IotclPoolConfig *config) {
+    IotclPoolConfig default_config;
+    size_t blocks_size = 0;
+    size_t links_size = 0;
+
+    if (pool.arena) {
+        IOTCL_ERROR(IOTCL_ERR_CONFIG_ERROR, "iotcl_pool_init: Already initialized");
+        return IOTCL_ERR_CONFIG_ERROR;
+    }
+    if (!config) {
+        iotcl_pool_init_config(&default_config);
+        config = &default_config;
+    }
+
+    memset(&pool, 0, sizeof(pool));
+    for (int i = 0; i < IOTCL_POOL_NUM_CLASSES; i++) {
+        const size_t block_size = (size_t) IOTCL_POOL_MIN_BLOCK_SIZE << i;
+        const size_t num_blocks = config->num_blocks[i];
+        if (num_blocks >= IOTCL_POOL_INDEX_MASK
+            || (num_blocks > 0 && block_size > (SIZE_MAX - blocks_size) / num_blocks)) {
+            IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "iotcl_pool_init: Too many blocks in class %d", i);
+            return IOTCL_ERR_OVERFLOW;
+        }
+        blocks_size += block_size * num_blocks;
+        links_size += sizeof(uint32_t) * num_blocks;
+        pool.classes[i].block_size = block_size;
+        pool.classes[i].num_blocks = (uint32_t) num_blocks;
+    }
+    if (links_size > SIZE_MAX - blocks_size) {
+        IOTCL_ERROR(IOTCL_ERR_OVERFLOW, "iotcl_pool_init: Pool is too large");
+        return IOTCL_ERR_OVERFLOW;
+    }
+
+    // Blocks come first, so that they keep the alignment of the arena. Links are placed after all blocks.
+    uint8_t *arena = malloc(blocks_size + links_size);
+    if (!arena) {
+        IOTCL_ERROR(IOTCL_ERR_OUT_OF_MEMORY, "iotcl_pool_init: Out of memory while allocating %lu bytes",
+                    (unsigned long) (blocks_size + links_size));
+        return IOTCL_ERR_OUT_OF_MEMORY;
+    }
+
+    uint8_t *blocks = arena;
+    uint32_t *links = (uint32_t *) (void *) &arena[blocks_size];
+    for (int i = 0; i < IOTCL_POOL_NUM_CLASSES; i++) {
+        IotclPoolClass *c = &pool.classes[i];
+        c->blocks = blocks;
+        c->blocks_end = &blocks[c->block_size * c->num_blocks];
+        c->next = links;
+        for (uint32_t b = 0; b < c->num_blocks; b++) {
+            c->next[b] = (b + 1 < c->num_blocks) ? b + 2 : 0;
+        }
+        c->head = c->num_blocks > 0 ? 1 : 0;
+        blocks = c->blocks_end;
+        links = &links[c->num_blocks];
+    }
+    pool.blocks_end = blocks;
+#if IOTCL_POOL_THREAD_EXIT_HOOK
+    (void) pthread_once(&thread_exit_key_once, iotcl_pool_create_thread_exit_key);
+#endif
+    IOTCL_ATOMIC_STORE(&pool.arena, arena);
+    return IOTCL_SUCCESS;
+}
+
+void iotcl_pool_flush_thread_cache(void) {
+#if IOTCL_POOL_THREAD_CACHE_SIZE > 0
+    if (!pool.arena) {
+        return;
+    }
+    IotclPoolThreadCache *cache = iotcl_pool_get_thread_cache();
+    for (int i = 0; i < IOTCL_POOL_NUM_CLASSES; i++) {
+        IotclPoolClass *c = &pool.classes[i];
+        while (cache->top[i]) {
+            const uint32_t index = cache->top[i] - 1;
+            cache->top[i] = IOTCL_ATOMIC_LOAD(&c->next[index]);
+            iotcl_pool_class_push(c, index);
+        }
+        cache->count[i] = 0;
+    }
+#endif
+}
+
+void iotcl_pool_deinit(void) {
+    bool is_in_use = false;
+    iotcl_pool_flush_thread_cache();
+    for (int i = 0; i < IOTCL_POOL_NUM_CLASSES; i++) {
+        if (pool.classes[i].in_use) {
+            IOTCL_WARN(IOTCL_ERR_FAILED, "iotcl_pool_deinit: %lu blocks of size %lu were not freed",
+                       (unsigned long) pool.classes[i].in_use, (unsigned long) pool.classes[i].block_size);
+            is_in_use = true;
+        }
+    }
+    IotclPoolRetiredArena *retired = is_in_use ? malloc(sizeof(IotclPoolRetiredArena)) : NULL;
+    if (retired) {
+        retired->arena = pool.arena;
+        retired->blocks_end = pool.blocks_end;
+        retired->next = retired_arenas;
+        retired_arenas = retired;
+    } else if (is_in_use) {
+        // without a record of the arena, late frees would reach free(), so the arena is leaked instead
+        IOTCL_WARN(IOTCL_ERR_OUT_OF_MEMORY, "iotcl_pool_deinit: Out of memory. The arena is not released.");
+    } else {
+        free(pool.arena);
+    }
+    memset(&pool, 0, sizeof(pool));
+#if IOTCL_POOL_THREAD_CACHE_SIZE > 0
+    IOTCL_ATOMIC_ADD_FETCH(&pool_generation, 1);
+#endif
+}
+
+void *iotcl_pool_malloc(size_t size) {
+    if (!IOTCL_ATOMIC_LOAD(&pool.arena)) {
+        return malloc(size);
+    }
+    for (int i = 0; i < IOTCL_POOL_NUM_CLASSES; i++) {
+        IotclPoolClass *c = &pool.classes[i];
+        if (size > c->block_size) {
+            continue;
+        }
+#if IOTCL_POOL_THREAD_CACHE_SIZE > 0
+        IotclPoolThreadCache *cache = iotcl_pool_get_thread_cache();
+        const uint32_t top = cache->top[i];
+        if (top) {
+            cache->top[i] = IOTCL_ATOMIC_LOAD(&c->next[top - 1]);
+            cache->count[i]--;
+            iotcl_pool_class_count_use(c);
+            return &c->blocks[(size_t) (top - 1) * c->block_size];
+        }
+#endif
+        void *block = iotcl_pool_class_pop(c);
+        if (block) {
+            iotcl_pool_class_count_use(c);
+            return block;
+        }
+        // don't take a block from a larger class. Those are likely needed for larger allocations.
+        IOTCL_ATOMIC_ADD_FETCH(&c->fallbacks, 1);
+        return malloc(size);
+    }
+    IOTCL_ATOMIC_ADD_FETCH(&pool.large_allocations, 1);
+    return malloc(size);
+}
+
+void iotcl_pool_free(void *ptr) {
+    uint8_t *p = (uint8_t *) ptr;
+    if (!p) {
+        return;
+    }
+    if (!pool.arena || p < pool.arena || p >= pool.blocks_end) {
+        for (const IotclPoolRetiredArena *r = retired_arenas; r; r = r->next) {
+            if (p >= r->arena && p < r->blocks_end) {
+                return; // a block of a previous pool. See IotclPoolRetiredArena.
+            }
+        }
+        free(ptr); // allocated by the fallback
+        return;
+    }
+    for (int i = 0; i < IOTCL_POOL_NUM_CLASSES; i++) {
+        IotclPoolClass *c = &pool.classes[i];
+        if (p < c->blocks_end) {
+            const size_t index = (size_t) (p - c->blocks) / c->block_size;
+#if IOTCL_POOL_THREAD_CACHE_SIZE > 0
+            IOTCL_ATOMIC_SUB_FETCH(&c->in_use, 1);
+            IotclPoolThreadCache *cache = iotcl_pool_get_thread_cache();
+            if (cache->count[i] < IOTCL_POOL_THREAD_CACHE_SIZE) {
+                IOTCL_ATOMIC_STORE(&c->next[index], cache->top[i]);
+                cache->top[i] = (uint32_t) (index + 1);
+                cache->count[i]++;
+                return;
+            }
+#else
+            IOTCL_ATOMIC_SUB_FETCH(&c->in_use, 1);
+#endif
+            iotcl_pool_class_push(c, (uint32_t) index);
+            return;
+        }
+    }
+}
+
+void iotcl_pool_get_stats(IotclPoolStats *stats) {
+    for (int i = 0; i < IOTCL_POOL_NUM_CLASSES; i++) {
+        IotclPoolClass *c = &pool.classes[i];
+        stats->classes[i].block_size = (size_t) IOTCL_POOL_MIN_BLOCK_SIZE << i;
+        stats->classes[i].num_blocks = c->num_blocks;
+        stats->classes[i].in_use = IOTCL_ATOMIC_LOAD(&c->in_use);
+        stats->classes[i].high_water = IOTCL_ATOMIC_LOAD(&c->high_water);
+        stats->classes[i].fallbacks = IOTCL_ATOMIC_LOAD(&c->fallbacks);
+    }
+    stats->large_allocations = IOTCL_ATOMIC_LOAD(&pool.large_allocations);
+}
+
+void iotcl_pool_print_stats(void) {
+    IotclPoolStats stats;
+    iotcl_pool_get_stats(&stats);
+    printf("%8s %8s %8s %10s %10s\n", "size", "blocks", "in use", "high water", "fallbacks");
+    for (int i = 0; i < IOTCL_POOL_NUM_CLASSES; i++) {
+        const IotclPoolClassStats *c = &stats.classes[i];
+        printf("%8lu %8lu %8lu %10lu %10lu\n", (unsigned long) c->block_size, (unsigned long) c->num_blocks,
+               (unsigned long) c->in_use, (unsigned long) c->high_water, c->fallbacks);
+    }
+    printf("Large allocations: %lu\n", stats.large_allocations);
+}
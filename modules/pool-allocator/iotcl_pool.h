@@ -0,0 +1,114 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * A size-class pool allocator for the library's dynamic memory.
+ *
+ * Most allocations made by the library and cJSON are small and short-lived: cJSON nodes, object keys, short values
+ * and topic strings. The pool serves those from fixed-size blocks carved out of a single arena. Each size class
+ * keeps its free blocks on a lock-free stack, so iotcl_pool_malloc() and iotcl_pool_free() can be called from
+ * multiple threads without locking. On top of that, each thread caches a few freed blocks of each class,
+ * so that repeated allocate/free cycles on the same thread do not contend on the free stacks.
+ * Requests larger than the largest class, or made when a class is exhausted,
+ * fall back to the system malloc().
+ *
+ * Usage:
+ *   IotclPoolConfig pool_config;
+ *   iotcl_pool_init_config(&pool_config);
+ *   pool_config.num_blocks[2] = 1024; // optionally tune the number of blocks in each class
+ *   iotcl_pool_init(&pool_config);
+ *   iotcl_configure_dynamic_memory(iotcl_pool_malloc, iotcl_pool_free);
+ *   ... iotcl_init(), etc ...
+ *
+ * iotcl_pool_deinit() should be called after everything allocated from the pool was freed. If some blocks are
+ * still in use, the arena is kept allocated, and freeing those blocks later does nothing.
+ * With IOTCL_POOL_THREAD_EXIT_HOOK, the blocks cached by a thread are returned to the pool when the thread exits.
+ * Otherwise, threads that free pool blocks, like the workers of an IotclParallelExecutor, should call
+ * iotcl_pool_flush_thread_cache() before exiting, or the blocks cached by the thread stay unavailable to others.
+ * Use iotcl_pool_get_stats() to tune the number of blocks for your application.
+ */
+
+#ifndef IOTCL_POOL_H
+#define IOTCL_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Size class N holds blocks of IOTCL_POOL_MIN_BLOCK_SIZE << N bytes.
+// The smallest block size should be a multiple of the platform's maximum alignment.
+#ifndef IOTCL_POOL_MIN_BLOCK_SIZE
+#define IOTCL_POOL_MIN_BLOCK_SIZE 16
+#endif
+
+#ifndef IOTCL_POOL_NUM_CLASSES
+#define IOTCL_POOL_NUM_CLASSES 6
+#endif
+
+// Default number of blocks for each class. With 64-bit pointers, a cJSON node takes 64 bytes.
+#ifndef IOTCL_POOL_DEFAULT_NUM_BLOCKS
+#define IOTCL_POOL_DEFAULT_NUM_BLOCKS {256, 128, 512, 64, 32, 16}
+#endif
+
+// Maximum number of freed blocks of each class cached by each thread. Set to 0 to disable thread caches,
+// for example if your compiler does not support thread local storage.
+#ifndef IOTCL_POOL_THREAD_CACHE_SIZE
+#define IOTCL_POOL_THREAD_CACHE_SIZE 32
+#endif
+
+// When enabled, a POSIX thread key destructor flushes the thread cache when a thread exits.
+// Enabled by default on Unix-like systems with thread caches. Requires linking with pthreads.
+#ifndef IOTCL_POOL_THREAD_EXIT_HOOK
+#if IOTCL_POOL_THREAD_CACHE_SIZE > 0 && (defined(__unix__) || defined(__APPLE__))
+#define IOTCL_POOL_THREAD_EXIT_HOOK 1
+#else
+#define IOTCL_POOL_THREAD_EXIT_HOOK 0
+#endif
+#endif
+
+typedef struct {
+    uint32_t num_blocks[IOTCL_POOL_NUM_CLASSES]; // number of blocks for each size class. Can be zero.
+} IotclPoolConfig;
+
+typedef struct {
+    size_t block_size;
+    uint32_t num_blocks;
+    uint32_t in_use;        // blocks currently allocated. Blocks held in thread caches are free.
+    uint32_t high_water;    // maximum value of in_use
+    unsigned long fallbacks; // requests for this class that went to the system allocator because the class was exhausted
+} IotclPoolClassStats;
+
+typedef struct {
+    IotclPoolClassStats classes[IOTCL_POOL_NUM_CLASSES];
+    unsigned long large_allocations; // requests larger than the largest block that went to the system allocator
+} IotclPoolStats;
+
+// Fills the config with default values
+void iotcl_pool_init_config(IotclPoolConfig *config);
+
+// Allocates the arena with the system malloc(). Config is optional. If NULL, default values are used.
+int iotcl_pool_init(const IotclPoolConfig *config);
+
+// Releases the arena and flushes the calling thread's cache. See the note on blocks still in use above.
+void iotcl_pool_deinit(void);
+
+// Returns the blocks cached by the calling thread to the pool, so that other threads can use them.
+void iotcl_pool_flush_thread_cache(void);
+
+// Hooks for iotcl_configure_dynamic_memory()
+void *iotcl_pool_malloc(size_t size);
+void iotcl_pool_free(void *ptr);
+
+void iotcl_pool_get_stats(IotclPoolStats *stats);
+void iotcl_pool_print_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCL_POOL_H
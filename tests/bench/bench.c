@@ -0,0 +1,922 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Repeatable microbenchmarks for the library's hot paths: configuration (iotcl_init for each instance type),
+ * telemetry messages of different sizes, the medium one also sent from a pre-serialized template, a 300 attribute
+ * data set updated twice, values nested three levels deep, a backfill message of 20000 data sets serialized
+ * on one thread and in parallel on all online CPUs, counters set as doubles and as 64-bit integers,
+ * sensor readings serialized with full and with declared precision, buffering 10 kHz samples in a sample ring
+ * and flushing them as summary windows, C2D command and OTA processing, ack creation, and the device REST API
+ * URL and response parsing functions.
+ *
+ * Each benchmark is calibrated so that one sample runs for at least the minimum sample time, and then sampled
+ * several times. The median time per operation is reported. Build in Release mode (the default) and run on an idle
+ * machine for comparable results:
+ *   cmake -S tests/bench -B tests/bench/build && cmake --build tests/bench/build
+ *   tests/bench/build/bench -o baseline.json                      # store a baseline
+ *   tests/bench/build/bench -b baseline.json -o current.json      # compare after making changes
+ *
+ * Options:
+ *   -o <file>      Write the results as JSON to the file.
+ *   -b <file>      Compare the results against a file written previously with -o. The exit code is 1 if any
+ *                  benchmark is slower than the baseline by more than the threshold.
+ *   -t <percent>   Regression threshold for -b. Default 10.
+ *   -f <text>      Only run benchmarks whose name contains the text. Eg. "-f telemetry/".
+ *   -s <samples>   Number of samples for each benchmark. Default 7.
+ *   -m <ms>        Minimum duration of each sample. Default 20.
+ *
+ * The serialized payload sizes of the sensor readings with full and with declared precision are printed
+ * after the results when the filter selects them.
+ *
+ * JSON format:
+ *   {"suite":"iotc-c-lib","version":"3.0","build_type":"Release","samples":7,"results":[
+ *     {"name":"telemetry/small","median_ns":912.4,"min_ns":898.1,"ops_per_s":1096010.5,"iterations":32768}, ...]}
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "cJSON.h"
+#include "iotcl.h"
+#include "iotcl_c2d.h"
+#include "iotcl_telemetry.h"
+#include "iotcl_util.h"
+#include "iotcl_sample_ring.h"
+#include "iotcl_telemetry_template.h"
+#include "iotcl_dra_url.h"
+#include "iotcl_dra_discovery.h"
+#include "iotcl_dra_identity.h"
+
+#define BENCH_MAX_SAMPLES 101
+
+#define BENCH_DISCOVERY_RESPONSE \
+    "{\"d\":{\"ec\":0,\"bu\":\"https://awsdiscovery.iotconnect.io/api/2.1/agent/device-identity/cg/b892c353-e375-4cc3-8841-32e271e26122\",\"log:mqtt\":{\"hn\":\"\",\"un\":\"\",\"pwd\":\"\",\"topic\":\"\"},\"pf\":\"aws\"},\"status\":200,\"message\":\"Success\"}"
+
+#define BENCH_IDENTITY_RESPONSE \
+    "{\"d\":{\"ec\":0,\"ct\":200,\"meta\":{\"at\":3,\"df\":60,\"cd\":\"XG4E2CA\",\"gtw\":null,\"edge\":0,\"pf\":0,\"hwv\":\"\",\"swv\":\"\",\"v\":2.1},\"has\":{\"d\":0,\"attr\":1,\"set\":0,\"r\":0,\"ota\":0},\"p\":{\"n\":\"mqtt\",\"h\":\"a3etk4e19usyja-ats.iot.us-east-1.amazonaws.com\",\"p\":8883,\"id\":\"abcde\",\"topics\":{\"rpt\":\"$aws/rules/msg_d2c_rpt/abcde/2.1/0\",\"flt\":\"$aws/rules/msg_d2c_flt/abcde/2.1/3\",\"od\":\"$aws/rules/msg_d2c_od/abcde/2.1/4\",\"hb\":\"$aws/rules/msg_d2c_hb/abcde/2.1/5\",\"ack\":\"$aws/rules/msg_d2c_ack/abcde/2.1/6\",\"dl\":\"$aws/rules/msg_d2c_dl/abcde/2.1/7\",\"di\":\"$aws/rules/msg_d2c_di/abcde/2.1/1\",\"c2d\":\"iot/abcde/cmd\"}},\"dt\":\"2024-03-06T16:29:56.745Z\"},\"status\":200,\"message\":\"Device info loaded successfully.\"}"
+
+static const char *const BENCH_C2D_COMMAND =
+        "{\"v\":\"2.1\",\"ct\":0,\"cmd\":\"set-led-green off\",\"ack\":\"4d99ed07-0ea0-43c6-97ba-53780faddc5c\"}";
+static const char *const BENCH_C2D_OTA =
+        "{\"v\":\"2.1\",\"ct\":1,\"cmd\":\"ota\",\"ack\":\"0b7d0c4e-6c5c-4d2e-9b59-d0e0c1f4a2aa\",\"sw\":\"1.6\",\"hw\":\"1\",\"urls\":[{\"url\":\"https://first.example.com/fw/app.bin?sig=1\",\"fileName\":\"app.bin\"},{\"url\":\"https://second.example.org/fw/cfg.json\",\"fileName\":\"cfg.json\"}]}";
+
+typedef struct {
+    const char *name;
+    bool (*setup)(void);    // optional. Runs once before sampling and is not timed.
+    bool (*run)(void);      // one operation
+    void (*teardown)(void); // optional
+} BenchCase;
+
+typedef struct {
+    const char *name;
+    double median_ns;
+    double min_ns;
+    unsigned long iterations;
+} BenchResult;
+
+static struct {
+    const char *output_file;
+    const char *baseline_file;
+    const char *filter;
+    double threshold_percent;
+    int num_samples;
+    int min_sample_ms;
+} options = {NULL, NULL, NULL, 10.0, 7, 20};
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// config
+
+static IotclDeviceConfigType init_instance_type;
+
+static bool init_with_type(IotclDeviceConfigType type) {
+    IotclClientConfig config;
+    iotcl_init_client_config(&config);
+    config.device.instance_type = type;
+    config.device.duid = "benchdevice";
+    config.device.cpid = "BENCHCPID";
+    config.device.cd = "XG4E2CA";
+    config.device.host = "poc-iotconnect-iothub-030-eu2.azure-devices.net";
+    return IOTCL_SUCCESS == iotcl_init(&config);
+}
+
+static bool run_init(void) {
+    const bool is_ok = init_with_type(init_instance_type);
+    iotcl_deinit();
+    return is_ok;
+}
+
+static bool setup_init_aws_shared(void) { init_instance_type = IOTCL_DCT_AWS_SHARED; return true; }
+static bool setup_init_aws_dedicated(void) { init_instance_type = IOTCL_DCT_AWS_DEDICATED; return true; }
+static bool setup_init_azure_shared(void) { init_instance_type = IOTCL_DCT_AZURE_SHARED; return true; }
+static bool setup_init_azure_dedicated(void) { init_instance_type = IOTCL_DCT_AZURE_DEDICATED; return true; }
+static bool setup_init_custom(void) { init_instance_type = IOTCL_DCT_CUSTOM; return true; }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// telemetry and c2d
+
+static void bench_transport_send(const char *topic, const char *json_str) {
+    (void) topic;
+    (void) json_str;
+}
+
+static void bench_on_command(IotclC2dEventData data) {
+    (void) iotcl_c2d_get_ack_id(data);
+    (void) iotcl_c2d_get_command(data);
+}
+
+static void bench_on_ota(IotclC2dEventData data) {
+    (void) iotcl_c2d_get_ack_id(data);
+    (void) iotcl_c2d_get_ota_url_hostname(data, 1);
+}
+
+static bool setup_library(void) {
+    IotclClientConfig config;
+    iotcl_init_client_config(&config);
+    config.device.instance_type = IOTCL_DCT_AWS_DEDICATED;
+    config.device.duid = "benchdevice";
+    config.mqtt_send_cb = bench_transport_send;
+    config.events.cmd_cb = bench_on_command;
+    config.events.ota_cb = bench_on_ota;
+    return IOTCL_SUCCESS == iotcl_init(&config);
+}
+
+static void teardown_library(void) {
+    iotcl_deinit();
+}
+
+static bool serialize_and_destroy(IotclMessageHandle msg) {
+    char *str = iotcl_telemetry_create_serialized_string(msg, false);
+    iotcl_telemetry_destroy(msg);
+    if (!str) {
+        return false;
+    }
+    iotcl_telemetry_destroy_serialized_string(str);
+    return true;
+}
+
+static bool run_telemetry_small(void) {
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    if (!msg || iotcl_telemetry_set_number(msg, "temperature", 21.5)) {
+        iotcl_telemetry_destroy(msg);
+        return false;
+    }
+    return serialize_and_destroy(msg);
+}
+
+static int set_medium_values(IotclMessageHandle msg) {
+    int err = 0;
+    err |= iotcl_telemetry_set_number(msg, "temperature", 21.5);
+    err |= iotcl_telemetry_set_number(msg, "humidity", 40);
+    err |= iotcl_telemetry_set_number(msg, "pressure", 1013.25);
+    err |= iotcl_telemetry_set_string(msg, "status", "normal");
+    err |= iotcl_telemetry_set_string(msg, "version", "1.2.3");
+    err |= iotcl_telemetry_set_bool(msg, "door_open", false);
+    err |= iotcl_telemetry_set_null(msg, "error");
+    err |= iotcl_telemetry_set_number(msg, "accel.x", 0.01);
+    err |= iotcl_telemetry_set_number(msg, "accel.y", -0.02);
+    err |= iotcl_telemetry_set_number(msg, "accel.z", 0.98);
+    return err;
+}
+
+static bool run_telemetry_medium(void) {
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    if (!msg || set_medium_values(msg)) {
+        iotcl_telemetry_destroy(msg);
+        return false;
+    }
+    return serialize_and_destroy(msg);
+}
+
+// The same message as telemetry/medium, sent from a template
+static IotclTelemetryTemplate medium_template;
+static int medium_slots[10];
+
+static bool setup_telemetry_template(void) {
+    static const char *const paths[] = {
+            "temperature", "humidity", "pressure", "status", "version", "door_open", "error", "accel.x", "accel.y", "accel.z"
+    };
+    if (!setup_library()) {
+        return false;
+    }
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    if (!msg || set_medium_values(msg)) {
+        iotcl_telemetry_destroy(msg);
+        return false;
+    }
+    medium_template = iotcl_telemetry_template_create(msg);
+    iotcl_telemetry_destroy(msg);
+    for (int i = 0; i < 10; i++) {
+        medium_slots[i] = iotcl_telemetry_template_find_slot(medium_template, paths[i]);
+    }
+    return NULL != medium_template;
+}
+
+static void teardown_telemetry_template(void) {
+    iotcl_telemetry_template_destroy(medium_template);
+    medium_template = NULL;
+    teardown_library();
+}
+
+static bool run_telemetry_template(void) {
+    static char payload[512];
+    int err = 0;
+    err |= iotcl_telemetry_template_set_number(medium_template, medium_slots[0], 21.5);
+    err |= iotcl_telemetry_template_set_number(medium_template, medium_slots[1], 40);
+    err |= iotcl_telemetry_template_set_number(medium_template, medium_slots[2], 1013.25);
+    err |= iotcl_telemetry_template_set_string(medium_template, medium_slots[3], "normal");
+    err |= iotcl_telemetry_template_set_string(medium_template, medium_slots[4], "1.2.3");
+    err |= iotcl_telemetry_template_set_bool(medium_template, medium_slots[5], false);
+    err |= iotcl_telemetry_template_set_null(medium_template, medium_slots[6]);
+    err |= iotcl_telemetry_template_set_number(medium_template, medium_slots[7], 0.01);
+    err |= iotcl_telemetry_template_set_number(medium_template, medium_slots[8], -0.02);
+    err |= iotcl_telemetry_template_set_number(medium_template, medium_slots[9], 0.98);
+    const char *str = iotcl_telemetry_template_get_string(medium_template);
+    const size_t length = strlen(str);
+    if (err || length >= sizeof(payload)) {
+        return false;
+    }
+    memcpy(payload, str, length + 1);
+    return true;
+}
+
+static bool run_telemetry_large(void) {
+    static const char *const names[] = {
+            "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7", "t8", "t9",
+            "s.a", "s.b", "s.c", "s.d", "s.e", "s.f", "s.g", "s.h", "s.i", "s.j"
+    };
+    static const char *const timestamps[] = {
+            "2024-01-02T03:04:00.000Z", "2024-01-02T03:05:00.000Z", "2024-01-02T03:06:00.000Z"
+    };
+    int err = 0;
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    if (!msg) {
+        return false;
+    }
+    for (int ds = 0; ds < 3; ds++) {
+        err |= iotcl_telemetry_add_new_data_set(msg, timestamps[ds]);
+        for (int i = 0; i < 20; i++) {
+            err |= iotcl_telemetry_set_number(msg, names[i], (double) (ds * 100 + i) + 0.5);
+        }
+    }
+    if (err) {
+        iotcl_telemetry_destroy(msg);
+        return false;
+    }
+    return serialize_and_destroy(msg);
+}
+
+// A large data set where every value is set twice, like when updated from several code paths
+static bool run_telemetry_300_updated(void) {
+    static char names[300][8];
+    int err = 0;
+    if (!names[0][0]) {
+        for (int i = 0; i < 300; i++) {
+            snprintf(names[i], sizeof(names[i]), "a%d", i);
+        }
+    }
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    if (!msg) {
+        return false;
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < 300; i++) {
+            err |= iotcl_telemetry_set_number(msg, names[i], (double) (i + pass));
+        }
+    }
+    if (err) {
+        iotcl_telemetry_destroy(msg);
+        return false;
+    }
+    return serialize_and_destroy(msg);
+}
+
+static bool run_telemetry_nested(void) {
+    static const char *const names[] = {
+            "motor.phase_a.current", "motor.phase_a.voltage", "motor.phase_a.power",
+            "motor.phase_b.current", "motor.phase_b.voltage", "motor.phase_b.power",
+            "motor.phase_c.current", "motor.phase_c.voltage", "motor.phase_c.power",
+            "motor.bearing.temperature", "motor.bearing.vibration", "motor.rotor.rpm"
+    };
+    int err = 0;
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    if (!msg) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        err |= iotcl_telemetry_set_number(msg, names[i], (double) i + 0.5);
+    }
+    if (err) {
+        iotcl_telemetry_destroy(msg);
+        return false;
+    }
+    return serialize_and_destroy(msg);
+}
+
+// A backfill upload of 20000 data sets, a few MB serialized, on one thread and on all online CPUs
+#define BENCH_BACKFILL_DATA_SETS 20000
+#define BENCH_MAX_JOBS 64
+
+static IotclMessageHandle backfill_msg;
+
+typedef struct {
+    IotclParallelJob job;
+    void *context;
+    size_t index;
+} BenchJobArgs;
+
+static void *bench_job_thread(void *arg) {
+    const BenchJobArgs *a = (const BenchJobArgs *) arg;
+    a->job(a->context, a->index);
+    return NULL;
+}
+
+// Runs the first job on the calling thread and each of the others on its own thread
+static void bench_thread_executor(IotclParallelJob job, void *context, size_t num_jobs) {
+    pthread_t threads[BENCH_MAX_JOBS];
+    BenchJobArgs args[BENCH_MAX_JOBS];
+    bool is_started[BENCH_MAX_JOBS] = {false};
+    for (size_t i = 1; i < num_jobs; i++) {
+        args[i].job = job;
+        args[i].context = context;
+        args[i].index = i;
+        is_started[i] = 0 == pthread_create(&threads[i], NULL, bench_job_thread, &args[i]);
+        if (!is_started[i]) {
+            job(context, i);
+        }
+    }
+    job(context, 0);
+    for (size_t i = 1; i < num_jobs; i++) {
+        if (is_started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+static bool create_backfill_message(void) {
+    char timestamp[IOTCL_ISO_TIMESTAMP_STR_LEN + 1];
+    int err = 0;
+    backfill_msg = iotcl_telemetry_create();
+    if (!backfill_msg) {
+        return false;
+    }
+    for (int i = 0; i < BENCH_BACKFILL_DATA_SETS; i++) {
+        err |= iotcl_to_iso_timestamp((time_t) (1709742596 + i * 60), timestamp, sizeof(timestamp));
+        err |= iotcl_telemetry_add_new_data_set(backfill_msg, timestamp);
+        err |= iotcl_telemetry_set_number(backfill_msg, "temperature", 20.0 + (double) (i % 97) * 0.13);
+        err |= iotcl_telemetry_set_number(backfill_msg, "humidity", 40.0 + (double) (i % 31) * 0.7);
+        err |= iotcl_telemetry_set_number(backfill_msg, "pressure", 1013.25 - (double) (i % 11));
+        err |= iotcl_telemetry_set_uint64(backfill_msg, "counter", (uint64_t) i);
+        err |= iotcl_telemetry_set_string(backfill_msg, "status", "normal");
+    }
+    return 0 == err;
+}
+
+static bool setup_backfill(void) {
+    return setup_library() && create_backfill_message();
+}
+
+static bool setup_backfill_parallel(void) {
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    IotclClientConfig config;
+    iotcl_init_client_config(&config);
+    config.device.instance_type = IOTCL_DCT_AWS_DEDICATED;
+    config.device.duid = "benchdevice";
+    config.mqtt_send_cb = bench_transport_send;
+    config.parallel.executor = bench_thread_executor;
+    config.parallel.num_jobs = num_cpus < 2 ? 2 : (num_cpus > BENCH_MAX_JOBS ? BENCH_MAX_JOBS : (size_t) num_cpus);
+    return IOTCL_SUCCESS == iotcl_init(&config) && create_backfill_message();
+}
+
+static void teardown_backfill(void) {
+    iotcl_telemetry_destroy(backfill_msg);
+    backfill_msg = NULL;
+    teardown_library();
+}
+
+static bool run_telemetry_backfill(void) {
+    char *str = iotcl_telemetry_create_serialized_string(backfill_msg, false);
+    if (!str) {
+        return false;
+    }
+    iotcl_telemetry_destroy_serialized_string(str);
+    return true;
+}
+
+// Counter-heavy telemetry, set as doubles and as native 64-bit integers
+static const char *const counter_names[] = {
+        "c0", "c1", "c2", "c3", "c4", "c5", "c6", "c7", "c8", "c9",
+        "c10", "c11", "c12", "c13", "c14", "c15", "c16", "c17", "c18", "c19"
+};
+
+static bool run_telemetry_counters(bool use_int64) {
+    int err = 0;
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    if (!msg) {
+        return false;
+    }
+    for (int i = 0; i < 20; i++) {
+        const int64_t value = 1700000000000LL + (int64_t) i * 7919; // millisecond timestamp sized values
+        if (use_int64) {
+            err |= iotcl_telemetry_set_int64(msg, counter_names[i], value);
+        } else {
+            err |= iotcl_telemetry_set_number(msg, counter_names[i], (double) value);
+        }
+    }
+    if (err) {
+        iotcl_telemetry_destroy(msg);
+        return false;
+    }
+    return serialize_and_destroy(msg);
+}
+
+static bool run_telemetry_counters_number(void) {
+    return run_telemetry_counters(false);
+}
+
+static bool run_telemetry_counters_int64(void) {
+    return run_telemetry_counters(true);
+}
+
+// Sensor readings as they come out of ADC scaling. Most of them serialize with 15 to 17 significant digits
+// unless their precision is declared.
+static const char *const sensor_names[] = {
+        "temperature", "humidity", "pressure", "voltage", "current",
+        "accel.x", "accel.y", "accel.z", "gyro.x", "gyro.y", "gyro.z"
+};
+static const int sensor_decimals[] = {2, 1, 2, 3, 3, 3, 3, 3, 2, 2, 2};
+
+#define BENCH_NUM_SENSORS (sizeof(sensor_names) / sizeof(sensor_names[0]))
+
+static IotclMessageHandle create_sensor_message(void) {
+    int err = 0;
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    if (!msg) {
+        return NULL;
+    }
+    for (size_t i = 0; i < BENCH_NUM_SENSORS; i++) {
+        const int raw = 1234 + (int) i * 337; // 12-bit ADC counts
+        err |= iotcl_telemetry_set_number(msg, sensor_names[i], (double) raw * (3.3 / 4095.0) * 12.5);
+    }
+    if (err) {
+        iotcl_telemetry_destroy(msg);
+        return NULL;
+    }
+    return msg;
+}
+
+static bool setup_sensors_precision(void) {
+    if (!setup_library()) {
+        return false;
+    }
+    for (size_t i = 0; i < BENCH_NUM_SENSORS; i++) {
+        if (iotcl_telemetry_configure_precision(sensor_names[i], sensor_decimals[i])) {
+            iotcl_deinit();
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool run_telemetry_sensors(void) {
+    IotclMessageHandle msg = create_sensor_message();
+    return msg && serialize_and_destroy(msg);
+}
+
+// One second of 10 kHz vibration samples, quantized like 12-bit ADC readings
+#define BENCH_NUM_SAMPLES 10000
+
+static IotclSampleBlock sample_blocks[512];
+static IotclSampleRing sample_ring;
+
+static bool add_vibration_samples(void) {
+    if (iotcl_sample_ring_init(&sample_ring, "vibration", sample_blocks, 512)) {
+        return false;
+    }
+    for (int i = 0; i < BENCH_NUM_SAMPLES; i++) {
+        const int raw = 2048 + (i * 7 % 64) - 32;
+        if (iotcl_sample_ring_add(&sample_ring, 1709742596000000ULL + (uint64_t) i * 100, (double) raw * (3.3 / 4095.0))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool run_sample_ring_add(void) {
+    return add_vibration_samples();
+}
+
+static bool run_sample_ring_flush_windows(void) {
+    static const IotclSampleRingFlushOptions options = {0, 100, true};
+    size_t num_data_sets = 0;
+    if (!add_vibration_samples()) {
+        return false;
+    }
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    if (!msg || iotcl_sample_ring_flush(&sample_ring, msg, &options, &num_data_sets) || 10 != num_data_sets) {
+        iotcl_telemetry_destroy(msg);
+        return false;
+    }
+    return serialize_and_destroy(msg);
+}
+
+static bool run_c2d_command(void) {
+    return IOTCL_SUCCESS == iotcl_c2d_process_event(BENCH_C2D_COMMAND);
+}
+
+static bool run_c2d_ota(void) {
+    return IOTCL_SUCCESS == iotcl_c2d_process_event(BENCH_C2D_OTA);
+}
+
+static bool run_ack_cmd(void) {
+    char *ack = iotcl_c2d_create_cmd_ack_json("4d99ed07-0ea0-43c6-97ba-53780faddc5c",
+                                              IOTCL_C2D_EVT_CMD_SUCCESS_WITH_ACK, "done");
+    iotcl_c2d_destroy_ack_json(ack);
+    return NULL != ack;
+}
+
+static bool run_ack_ota(void) {
+    char *ack = iotcl_c2d_create_ota_ack_json("0b7d0c4e-6c5c-4d2e-9b59-d0e0c1f4a2aa",
+                                              IOTCL_C2D_EVT_OTA_DOWNLOAD_DONE, NULL);
+    iotcl_c2d_destroy_ack_json(ack);
+    return NULL != ack;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// device REST API
+
+static IotclDraUrlContext identity_base_url;
+
+static bool setup_custom_library(void) {
+    return init_with_type(IOTCL_DCT_CUSTOM);
+}
+
+static bool run_dra_discovery_url(void) {
+    IotclDraUrlContext url = {0};
+    const int status = iotcl_dra_discovery_init_url_aws(&url, "BENCHCPID", "benchenv");
+    iotcl_dra_url_deinit(&url);
+    return IOTCL_SUCCESS == status;
+}
+
+static bool run_dra_discovery_parse(void) {
+    IotclDraUrlContext url = {0};
+    const int status = iotcl_dra_discovery_parse(&url, 32, BENCH_DISCOVERY_RESPONSE);
+    iotcl_dra_url_deinit(&url);
+    return IOTCL_SUCCESS == status;
+}
+
+static bool run_dra_discovery_stream(void) {
+    static const char response[] = BENCH_DISCOVERY_RESPONSE;
+    IotclDraDiscoveryStreamParser parser;
+    IotclDraUrlContext url = {0};
+    iotcl_dra_discovery_stream_init(&parser);
+    int status = iotcl_dra_discovery_stream_feed(&parser, (const uint8_t *) response, sizeof(response) - 1);
+    if (IOTCL_SUCCESS == status) {
+        status = iotcl_dra_discovery_stream_finish(&parser, &url, 32);
+    }
+    iotcl_dra_url_deinit(&url);
+    return IOTCL_SUCCESS == status;
+}
+
+static bool setup_dra_identity_url(void) {
+    if (!setup_custom_library()) {
+        return false;
+    }
+    return IOTCL_SUCCESS == iotcl_dra_discovery_parse(&identity_base_url, 32, BENCH_DISCOVERY_RESPONSE);
+}
+
+static void teardown_dra_identity_url(void) {
+    iotcl_dra_url_deinit(&identity_base_url);
+    iotcl_deinit();
+}
+
+static bool run_dra_identity_url(void) {
+    return IOTCL_SUCCESS == iotcl_dra_identity_build_url(&identity_base_url, "benchdevice");
+}
+
+// The identity response configures the library, which can be done only once per iotcl_init(),
+// so this benchmark includes a CUSTOM iotcl_init() and iotcl_deinit(). Subtract config/init_custom to get the parsing cost.
+static bool run_dra_identity_configure(void) {
+    bool is_ok = init_with_type(IOTCL_DCT_CUSTOM);
+    is_ok = is_ok && IOTCL_SUCCESS == iotcl_dra_identity_configure_library_mqtt(BENCH_IDENTITY_RESPONSE);
+    iotcl_deinit();
+    return is_ok;
+}
+
+static bool run_dra_identity_stream(void) {
+    static const char response[] = BENCH_IDENTITY_RESPONSE;
+    IotclDraIdentityStreamParser parser;
+    bool is_ok = init_with_type(IOTCL_DCT_CUSTOM);
+    is_ok = is_ok && IOTCL_SUCCESS == iotcl_dra_identity_stream_init(&parser);
+    is_ok = is_ok && IOTCL_SUCCESS == iotcl_dra_identity_stream_feed(&parser, (const uint8_t *) response, sizeof(response) - 1);
+    is_ok = is_ok && IOTCL_SUCCESS == iotcl_dra_identity_stream_finish(&parser);
+    iotcl_deinit();
+    return is_ok;
+}
+
+static const BenchCase bench_cases[] = {
+        {"config/init_aws_shared", setup_init_aws_shared, run_init, NULL},
+        {"config/init_aws_dedicated", setup_init_aws_dedicated, run_init, NULL},
+        {"config/init_azure_shared", setup_init_azure_shared, run_init, NULL},
+        {"config/init_azure_dedicated", setup_init_azure_dedicated, run_init, NULL},
+        {"config/init_custom", setup_init_custom, run_init, NULL},
+        {"telemetry/small", setup_library, run_telemetry_small, teardown_library},
+        {"telemetry/medium", setup_library, run_telemetry_medium, teardown_library},
+        {"telemetry/medium_template", setup_telemetry_template, run_telemetry_template, teardown_telemetry_template},
+        {"telemetry/large", setup_library, run_telemetry_large, teardown_library},
+        {"telemetry/300_updated", setup_library, run_telemetry_300_updated, teardown_library},
+        {"telemetry/nested", setup_library, run_telemetry_nested, teardown_library},
+        {"telemetry/backfill_serial", setup_backfill, run_telemetry_backfill, teardown_backfill},
+        {"telemetry/backfill_parallel", setup_backfill_parallel, run_telemetry_backfill, teardown_backfill},
+        {"telemetry/counters_number", setup_library, run_telemetry_counters_number, teardown_library},
+        {"telemetry/counters_int64", setup_library, run_telemetry_counters_int64, teardown_library},
+        {"telemetry/sensors_full", setup_library, run_telemetry_sensors, teardown_library},
+        {"telemetry/sensors_precision", setup_sensors_precision, run_telemetry_sensors, teardown_library},
+        {"sample_ring/add_10000", NULL, run_sample_ring_add, NULL},
+        {"sample_ring/flush_windows", setup_library, run_sample_ring_flush_windows, teardown_library},
+        {"c2d/command", setup_library, run_c2d_command, teardown_library},
+        {"c2d/ota", setup_library, run_c2d_ota, teardown_library},
+        {"ack/command", setup_library, run_ack_cmd, teardown_library},
+        {"ack/ota", setup_library, run_ack_ota, teardown_library},
+        {"dra/discovery_url", setup_custom_library, run_dra_discovery_url, teardown_library},
+        {"dra/discovery_parse", setup_custom_library, run_dra_discovery_parse, teardown_library},
+        {"dra/discovery_stream", setup_custom_library, run_dra_discovery_stream, teardown_library},
+        {"dra/identity_url", setup_dra_identity_url, run_dra_identity_url, teardown_dra_identity_url},
+        {"dra/identity_configure", NULL, run_dra_identity_configure, NULL},
+        {"dra/identity_stream", NULL, run_dra_identity_stream, NULL},
+};
+
+#define BENCH_NUM_CASES (sizeof(bench_cases) / sizeof(bench_cases[0]))
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// harness
+
+static int compare_doubles(const void *a, const void *b) {
+    const double da = *(const double *) a;
+    const double db = *(const double *) b;
+    return (da > db) - (da < db);
+}
+
+// Runs the operation the given number of times and returns the elapsed time, or a negative value on failure.
+static double time_iterations(const BenchCase *bc, unsigned long iterations) {
+    const double start = now_ns();
+    for (unsigned long i = 0; i < iterations; i++) {
+        if (!bc->run()) {
+            return -1.0;
+        }
+    }
+    return now_ns() - start;
+}
+
+static bool run_case(const BenchCase *bc, BenchResult *result) {
+    double samples[BENCH_MAX_SAMPLES];
+    const double min_sample_ns = (double) options.min_sample_ms * 1e6;
+    unsigned long iterations = 1;
+    bool is_ok = false;
+
+    result->name = bc->name;
+    if (bc->setup && !bc->setup()) {
+        fprintf(stderr, "%s: setup failed\n", bc->name);
+        return false;
+    }
+
+    // calibrate. This also serves as a warm-up.
+    for (;;) {
+        const double elapsed = time_iterations(bc, iterations);
+        if (elapsed < 0) {
+            fprintf(stderr, "%s: operation failed\n", bc->name);
+            goto cleanup;
+        }
+        if (elapsed >= min_sample_ns || iterations >= (1UL << 30)) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    for (int i = 0; i < options.num_samples; i++) {
+        const double elapsed = time_iterations(bc, iterations);
+        if (elapsed < 0) {
+            fprintf(stderr, "%s: operation failed\n", bc->name);
+            goto cleanup;
+        }
+        samples[i] = elapsed / (double) iterations;
+    }
+    qsort(samples, (size_t) options.num_samples, sizeof(double), compare_doubles);
+    result->median_ns = samples[options.num_samples / 2];
+    result->min_ns = samples[0];
+    result->iterations = iterations;
+    is_ok = true;
+
+    cleanup:
+    if (bc->teardown) {
+        bc->teardown();
+    }
+    return is_ok;
+}
+
+static bool write_results(const BenchResult *results, size_t count) {
+    bool is_ok = false;
+    char *str = NULL;
+    FILE *f = NULL;
+    cJSON *root = cJSON_CreateObject();
+    cJSON *array = NULL;
+    if (!root) goto cleanup;
+    if (!cJSON_AddStringToObject(root, "suite", "iotc-c-lib")) goto cleanup;
+    if (!cJSON_AddStringToObject(root, "version", BENCH_LIB_VERSION)) goto cleanup;
+    if (!cJSON_AddStringToObject(root, "build_type", BENCH_BUILD_TYPE)) goto cleanup;
+    if (!cJSON_AddNumberToObject(root, "samples", options.num_samples)) goto cleanup;
+    array = cJSON_AddArrayToObject(root, "results");
+    if (!array) goto cleanup;
+    for (size_t i = 0; i < count; i++) {
+        cJSON *r = cJSON_CreateObject();
+        if (!r || !cJSON_AddItemToArray(array, r)) {
+            cJSON_Delete(r);
+            goto cleanup;
+        }
+        if (!cJSON_AddStringToObject(r, "name", results[i].name)) goto cleanup;
+        if (!cJSON_AddNumberToObject(r, "median_ns", results[i].median_ns)) goto cleanup;
+        if (!cJSON_AddNumberToObject(r, "min_ns", results[i].min_ns)) goto cleanup;
+        if (!cJSON_AddNumberToObject(r, "ops_per_s", 1e9 / results[i].median_ns)) goto cleanup;
+        if (!cJSON_AddNumberToObject(r, "iterations", (double) results[i].iterations)) goto cleanup;
+    }
+    str = cJSON_Print(root);
+    if (!str) goto cleanup;
+    f = fopen(options.output_file, "w");
+    if (!f) {
+        fprintf(stderr, "Unable to open %s for writing\n", options.output_file);
+        goto cleanup;
+    }
+    is_ok = fputs(str, f) >= 0 && fputc('\n', f) != EOF;
+
+    cleanup:
+    if (f && 0 != fclose(f)) {
+        is_ok = false;
+    }
+    cJSON_free(str);
+    cJSON_Delete(root);
+    return is_ok;
+}
+
+static cJSON *read_baseline(void) {
+    FILE *f = fopen(options.baseline_file, "rb");
+    char *data = NULL;
+    cJSON *root = NULL;
+    long size;
+    if (!f) {
+        fprintf(stderr, "Unable to open %s\n", options.baseline_file);
+        return NULL;
+    }
+    if (0 != fseek(f, 0, SEEK_END) || (size = ftell(f)) < 0 || 0 != fseek(f, 0, SEEK_SET)) goto cleanup;
+    data = malloc((size_t) size + 1);
+    if (!data || fread(data, 1, (size_t) size, f) != (size_t) size) goto cleanup;
+    data[size] = '\0';
+    root = cJSON_Parse(data);
+    if (!root || !cJSON_IsArray(cJSON_GetObjectItemCaseSensitive(root, "results"))) {
+        fprintf(stderr, "%s is not a valid benchmark results file\n", options.baseline_file);
+        cJSON_Delete(root);
+        root = NULL;
+    }
+
+    cleanup:
+    free(data);
+    fclose(f);
+    return root;
+}
+
+// Returns the baseline median for the benchmark, or a negative value if it is not in the baseline.
+static double get_baseline_median(const cJSON *baseline, const char *name) {
+    const cJSON *r;
+    cJSON_ArrayForEach(r, cJSON_GetObjectItemCaseSensitive(baseline, "results")) {
+        const cJSON *n = cJSON_GetObjectItemCaseSensitive(r, "name");
+        const cJSON *median = cJSON_GetObjectItemCaseSensitive(r, "median_ns");
+        if (cJSON_IsString(n) && cJSON_IsNumber(median) && 0 == strcmp(n->valuestring, name)) {
+            return median->valuedouble;
+        }
+    }
+    return -1.0;
+}
+
+// Prints the size of the serialized sensor message for each selected sensor benchmark
+static void print_payload_sizes(void) {
+    bool is_header_printed = false;
+    for (size_t i = 0; i < BENCH_NUM_CASES; i++) {
+        const BenchCase *bc = &bench_cases[i];
+        if (run_telemetry_sensors != bc->run || (options.filter && !strstr(bc->name, options.filter))) {
+            continue;
+        }
+        if (!bc->setup()) {
+            continue;
+        }
+        IotclMessageHandle msg = create_sensor_message();
+        char *str = msg ? iotcl_telemetry_create_serialized_string(msg, false) : NULL;
+        if (str) {
+            if (!is_header_printed) {
+                printf("\n%-28s %12s\n", "payload", "bytes");
+                is_header_printed = true;
+            }
+            printf("%-28s %12lu\n", bc->name, (unsigned long) strlen(str));
+        }
+        iotcl_telemetry_destroy_serialized_string(str);
+        iotcl_telemetry_destroy(msg);
+        bc->teardown();
+    }
+}
+
+static void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-o output.json] [-b baseline.json] [-t threshold_percent] [-f filter] [-s samples] [-m min_sample_ms]\n", program);
+}
+
+int main(int argc, char *argv[]) {
+    static BenchResult results[BENCH_NUM_CASES];
+    cJSON *baseline = NULL;
+    size_t num_results = 0;
+    int num_failed = 0;
+    int num_regressions = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc || '-' != argv[i][0] || 2 != strlen(argv[i])) {
+            print_usage(argv[0]);
+            return 2;
+        }
+        const char *value = argv[++i];
+        switch (argv[i - 1][1]) {
+            case 'o': options.output_file = value; break;
+            case 'b': options.baseline_file = value; break;
+            case 'f': options.filter = value; break;
+            case 't': options.threshold_percent = atof(value); break;
+            case 's': options.num_samples = atoi(value); break;
+            case 'm': options.min_sample_ms = atoi(value); break;
+            default:
+                print_usage(argv[0]);
+                return 2;
+        }
+    }
+    if (options.num_samples < 1 || options.num_samples > BENCH_MAX_SAMPLES || options.min_sample_ms < 1
+        || options.threshold_percent < 0) {
+        fprintf(stderr, "Samples must be between 1 and %d, and the sample time and threshold must be positive\n",
+                BENCH_MAX_SAMPLES);
+        return 2;
+    }
+    if (options.baseline_file) {
+        baseline = read_baseline();
+        if (!baseline) {
+            return 2;
+        }
+    }
+
+    printf("%-28s %12s %12s %14s", "benchmark", "median ns", "min ns", "ops/s");
+    printf(baseline ? " %12s %8s\n" : "\n", "baseline ns", "change");
+    for (size_t i = 0; i < BENCH_NUM_CASES; i++) {
+        const BenchCase *bc = &bench_cases[i];
+        if (options.filter && !strstr(bc->name, options.filter)) {
+            continue;
+        }
+        BenchResult *r = &results[num_results];
+        if (!run_case(bc, r)) {
+            num_failed++;
+            continue;
+        }
+        num_results++;
+        printf("%-28s %12.1f %12.1f %14.0f", r->name, r->median_ns, r->min_ns, 1e9 / r->median_ns);
+        if (baseline) {
+            const double base = get_baseline_median(baseline, r->name);
+            if (base <= 0) {
+                printf(" %12s %8s\n", "-", "new");
+            } else {
+                const double change = (r->median_ns - base) * 100.0 / base;
+                const bool is_regression = change > options.threshold_percent;
+                num_regressions += is_regression ? 1 : 0;
+                printf(" %12.1f %+7.1f%%%s\n", base, change, is_regression ? " REGRESSION" : "");
+            }
+        } else {
+            printf("\n");
+        }
+        fflush(stdout);
+    }
+    cJSON_Delete(baseline);
+    print_payload_sizes();
+
+    if (options.output_file && !write_results(results, num_results)) {
+        fprintf(stderr, "Failed to write %s\n", options.output_file);
+        return 1;
+    }
+    if (num_regressions) {
+        printf("%d benchmark(s) regressed by more than %.1f%%\n", num_regressions, options.threshold_percent);
+    }
+    return (num_failed || num_regressions) ? 1 : 0;
+}
@@ -0,0 +1,323 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Drives N simulated devices through the full discovery -> identity bootstrap against dra_mock_server
+ * and reports throughput and latency percentiles for each stage.
+ * The library configuration is global, so devices are bootstrapped one after another.
+ *
+ * Options:
+ *   -p <port>      Mock server port. Default 8080.
+ *   -n <devices>   Number of simulated devices. Default 1000.
+ *   -s             Use the stream parsers, fed directly from the socket as data arrives.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "iotcl.h"
+#include "iotcl_dra_url.h"
+#include "iotcl_dra_discovery.h"
+#include "iotcl_dra_identity.h"
+
+#define BENCH_RESPONSE_MAX_LEN 8192
+#define BENCH_CHUNK_SIZE 256
+
+typedef enum {
+    STAGE_DISCOVERY_URL = 0,
+    STAGE_DISCOVERY_HTTP,
+    STAGE_DISCOVERY_PARSE,
+    STAGE_IDENTITY_URL,
+    STAGE_IDENTITY_HTTP,
+    STAGE_IDENTITY_PARSE,
+    STAGE_TOTAL,
+    STAGE_MAX
+} BenchStage;
+
+static const char *const stage_names[STAGE_MAX] = {
+        "discovery url", "discovery http", "discovery parse", "identity url", "identity http", "identity parse", "total"
+};
+
+static struct {
+    int port;
+    int num_devices;
+    bool use_stream;
+} options = {8080, 1000, false};
+
+static double *samples[STAGE_MAX]; // microseconds
+static int num_samples[STAGE_MAX];
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1e6 + (double) ts.tv_nsec / 1e3;
+}
+
+static void record(BenchStage stage, double start_us) {
+    samples[stage][num_samples[stage]++] = now_us() - start_us;
+}
+
+// Callback for the response body. Returns false to abort.
+typedef bool (*BenchBodyCallback)(void *context, const uint8_t *data, size_t len);
+
+// Minimal HTTP/1.1 GET over plain TCP. The hostname is expected to be "127.0.0.1:<port>".
+// Body chunks are passed to body_cb as they are received. Returns the HTTP status or -1 on error.
+static int http_get(const IotclDraUrlContext *url, BenchBodyCallback body_cb, void *context) {
+    const char *hostname = iotcl_dra_url_get_hostname(url);
+    const char *colon = strchr(hostname, ':');
+    const int port = colon ? atoi(&colon[1]) : 80;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((uint16_t) port);
+    if (0 != connect(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+
+    char buffer[BENCH_CHUNK_SIZE + 1];
+    int len = snprintf(buffer, sizeof(buffer), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
+                       iotcl_dra_url_get_resource(url), hostname);
+    if (len < 0 || len >= (int) sizeof(buffer) || send(fd, buffer, (size_t) len, 0) != len) {
+        close(fd);
+        return -1;
+    }
+
+    // the headers are small, so they are collected in a separate buffer. The body is passed on as it arrives.
+    char headers[1024];
+    size_t headers_len = 0;
+    bool in_body = false;
+    int http_status = -1;
+    for (;;) {
+        ssize_t received = recv(fd, buffer, BENCH_CHUNK_SIZE, 0);
+        if (received < 0 && EINTR == errno) continue;
+        if (received <= 0) break;
+        const uint8_t *data = (const uint8_t *) buffer;
+        size_t data_len = (size_t) received;
+        if (!in_body) {
+            const size_t to_copy = data_len < sizeof(headers) - 1 - headers_len ? data_len : sizeof(headers) - 1 - headers_len;
+            memcpy(&headers[headers_len], data, to_copy);
+            const size_t old_len = headers_len;
+            headers_len += to_copy;
+            headers[headers_len] = '\0';
+            char *end = strstr(headers, "\r\n\r\n");
+            if (!end) {
+                if (headers_len == sizeof(headers) - 1) break; // headers too long
+                continue;
+            }
+            in_body = true;
+            if (1 != sscanf(headers, "HTTP/1.%*d %d", &http_status)) {
+                http_status = -1;
+                break;
+            }
+            const size_t body_start = (size_t) (end - headers) + 4 - old_len;
+            data += body_start;
+            data_len -= body_start;
+        }
+        if (data_len > 0 && !body_cb(context, data, data_len)) {
+            break;
+        }
+    }
+    close(fd);
+    return in_body ? http_status : -1;
+}
+
+typedef struct {
+    uint8_t data[BENCH_RESPONSE_MAX_LEN];
+    size_t len;
+} BenchBuffer;
+
+static bool buffer_body_cb(void *context, const uint8_t *data, size_t len) {
+    BenchBuffer *b = (BenchBuffer *) context;
+    if (len > sizeof(b->data) - 1 - b->len) {
+        return false;
+    }
+    memcpy(&b->data[b->len], data, len);
+    b->len += len;
+    b->data[b->len] = 0;
+    return true;
+}
+
+static bool discovery_stream_cb(void *context, const uint8_t *data, size_t len) {
+    return IOTCL_SUCCESS == iotcl_dra_discovery_stream_feed((IotclDraDiscoveryStreamParser *) context, data, len);
+}
+
+static bool identity_stream_cb(void *context, const uint8_t *data, size_t len) {
+    return IOTCL_SUCCESS == iotcl_dra_identity_stream_feed((IotclDraIdentityStreamParser *) context, data, len);
+}
+
+// With the stream parsers, parsing happens while receiving, so the parse stage only measures the finish call.
+static bool bootstrap_device(const char *duid) {
+    static BenchBuffer buffer;
+    static IotclDraDiscoveryStreamParser discovery_parser;
+    static IotclDraIdentityStreamParser identity_parser;
+    IotclDraUrlContext discovery_url = {0};
+    IotclDraUrlContext identity_url = {0};
+    IotclClientConfig config;
+    bool is_ok = false;
+    char host[32];
+    double start;
+
+    iotcl_init_client_config(&config);
+    config.device.instance_type = IOTCL_DCT_CUSTOM;
+    if (IOTCL_SUCCESS != iotcl_init(&config)) {
+        return false;
+    }
+
+    const double total_start = now_us();
+    start = now_us();
+    snprintf(host, sizeof(host), "127.0.0.1:%d", options.port);
+    if (IOTCL_SUCCESS != iotcl_dra_discovery_init_url_with_host(&discovery_url, host, "MOCKCPID", "mockenv")) goto cleanup;
+    record(STAGE_DISCOVERY_URL, start);
+
+    start = now_us();
+    int status;
+    buffer.len = 0;
+    if (options.use_stream) {
+        iotcl_dra_discovery_stream_init(&discovery_parser);
+        status = http_get(&discovery_url, discovery_stream_cb, &discovery_parser);
+    } else {
+        status = http_get(&discovery_url, buffer_body_cb, &buffer);
+    }
+    if (200 != status) goto cleanup;
+    record(STAGE_DISCOVERY_HTTP, start);
+
+    start = now_us();
+    const int slack = (int) (strlen(IOTCL_DRA_IDENTITY_PREFIX) + strlen(duid));
+    if (options.use_stream) {
+        status = iotcl_dra_discovery_stream_finish(&discovery_parser, &identity_url, slack);
+    } else {
+        status = iotcl_dra_discovery_parse_with_length(&identity_url, slack, buffer.data, buffer.len);
+    }
+    if (IOTCL_SUCCESS != status) goto cleanup;
+    record(STAGE_DISCOVERY_PARSE, start);
+
+    start = now_us();
+    if (IOTCL_SUCCESS != iotcl_dra_identity_build_url(&identity_url, duid)) goto cleanup;
+    record(STAGE_IDENTITY_URL, start);
+
+    start = now_us();
+    buffer.len = 0;
+    if (options.use_stream) {
+        if (IOTCL_SUCCESS != iotcl_dra_identity_stream_init(&identity_parser)) goto cleanup;
+        status = http_get(&identity_url, identity_stream_cb, &identity_parser);
+    } else {
+        status = http_get(&identity_url, buffer_body_cb, &buffer);
+    }
+    if (200 != status) goto cleanup;
+    record(STAGE_IDENTITY_HTTP, start);
+
+    start = now_us();
+    if (options.use_stream) {
+        status = iotcl_dra_identity_stream_finish(&identity_parser);
+    } else {
+        status = iotcl_dra_identity_configure_library_mqtt_with_length(buffer.data, buffer.len);
+    }
+    if (IOTCL_SUCCESS != status) goto cleanup;
+    record(STAGE_IDENTITY_PARSE, start);
+
+    record(STAGE_TOTAL, total_start);
+    is_ok = true;
+
+    cleanup:
+    iotcl_dra_url_deinit(&discovery_url);
+    iotcl_dra_url_deinit(&identity_url);
+    iotcl_deinit();
+    return is_ok;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    const double da = *(const double *) a;
+    const double db = *(const double *) b;
+    return (da > db) - (da < db);
+}
+
+static double percentile(const double *sorted, int count, double p) {
+    int index = (int) (p * (double) count + 0.5) - 1;
+    if (index < 0) index = 0;
+    if (index >= count) index = count - 1;
+    return sorted[index];
+}
+
+static void print_report(int num_ok, double elapsed_us) {
+    printf("\n%d of %d devices bootstrapped in %.3f s (%.1f devices/s)%s\n",
+           num_ok, options.num_devices, elapsed_us / 1e6, (double) num_ok * 1e6 / elapsed_us,
+           options.use_stream ? " using the stream parsers" : "");
+    printf("%-16s %8s %10s %10s %10s %10s\n", "stage", "count", "mean us", "p50 us", "p99 us", "max us");
+    for (int stage = 0; stage < STAGE_MAX; stage++) {
+        const int count = num_samples[stage];
+        if (0 == count) {
+            printf("%-16s %8d\n", stage_names[stage], 0);
+            continue;
+        }
+        qsort(samples[stage], (size_t) count, sizeof(double), compare_doubles);
+        double sum = 0;
+        for (int i = 0; i < count; i++) {
+            sum += samples[stage][i];
+        }
+        printf("%-16s %8d %10.2f %10.2f %10.2f %10.2f\n", stage_names[stage], count, sum / count,
+               percentile(samples[stage], count, 0.50), percentile(samples[stage], count, 0.99),
+               samples[stage][count - 1]);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp("-s", argv[i])) {
+            options.use_stream = true;
+        } else if (0 == strcmp("-p", argv[i]) && i + 1 < argc) {
+            options.port = atoi(argv[++i]);
+        } else if (0 == strcmp("-n", argv[i]) && i + 1 < argc) {
+            options.num_devices = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [-p port] [-n devices] [-s]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (options.num_devices <= 0 || options.port <= 0) {
+        fprintf(stderr, "Port and number of devices must be positive\n");
+        return 2;
+    }
+
+    for (int stage = 0; stage < STAGE_MAX; stage++) {
+        samples[stage] = malloc(sizeof(double) * (size_t) options.num_devices);
+        if (!samples[stage]) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+    }
+
+    int num_ok = 0;
+    const double start = now_us();
+    for (int i = 0; i < options.num_devices; i++) {
+        char duid[32];
+        snprintf(duid, sizeof(duid), "mockdev%06d", i);
+        if (bootstrap_device(duid)) {
+            num_ok++;
+        }
+    }
+    print_report(num_ok, now_us() - start);
+
+    for (int stage = 0; stage < STAGE_MAX; stage++) {
+        free(samples[stage]);
+    }
+    return num_ok == options.num_devices ? 0 : 1;
+}
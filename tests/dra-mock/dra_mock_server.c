@@ -0,0 +1,259 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * A local stand-in for the IoTConnect discovery and identity HTTP REST API (plain HTTP, POSIX only).
+ * Serves responses in the format that iotcl_dra_discovery.c and iotcl_dra_identity.c expect:
+ *   GET /api/v2.1/dsdk/cpId/<cpid>/env/<env>   - discovery, returns a base URL pointing back to this server
+ *   GET <base url path>/uid/<duid>             - identity, returns an AWS-style MQTT configuration for the DUID
+ *
+ * Options:
+ *   -p <port>      Port to listen on. Default 8080. Use 0 to pick any free port.
+ *   -l <ms>        Latency added to each response. Default 0.
+ *   -j <ms>        Random jitter added on top of latency. Default 0.
+ *   -s <status>    HTTP status code for all responses (eg. 503). Default 200.
+ *   -d <ec>        "ec" error code returned in discovery responses. Default 0.
+ *   -i <ec>        "ec" error code returned in identity responses. Default 0.
+ *   -f <n>         Respond with HTTP 500 to every n-th request. Default 0 (never).
+ * The server prints "Listening on port <port>" once it is ready to accept connections.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define MOCK_REQUEST_MAX_LEN 2048
+#define MOCK_RESPONSE_MAX_LEN 4096
+#define MOCK_DISCOVERY_PREFIX "/api/v2.1/dsdk/cpId/"
+#define MOCK_IDENTITY_BASE_PATH "/api/2.1/agent/device-identity/cg/mock"
+#define MOCK_IDENTITY_PREFIX MOCK_IDENTITY_BASE_PATH "/uid/"
+
+static struct {
+    int port;
+    int latency_ms;
+    int jitter_ms;
+    int http_status;
+    int discovery_ec;
+    int identity_ec;
+    int fail_every;
+} options = {8080, 0, 0, 200, 0, 0, 0};
+
+static unsigned long num_requests = 0;
+static pthread_mutex_t num_requests_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void sleep_ms(int ms) {
+    if (ms <= 0) {
+        return;
+    }
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long) (ms % 1000) * 1000000L;
+    while (0 != nanosleep(&ts, &ts) && EINTR == errno);
+}
+
+static const char *status_text(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 404: return "Not Found";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "Error";
+    }
+}
+
+static bool send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(fd, data, len, 0);
+        if (sent <= 0) {
+            if (sent < 0 && EINTR == errno) continue;
+            return false;
+        }
+        data += sent;
+        len -= (size_t) sent;
+    }
+    return true;
+}
+
+static void send_response(int fd, int status, const char *body) {
+    char header[256];
+    const size_t body_len = strlen(body);
+    int header_len = snprintf(header, sizeof(header),
+            "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n",
+            status, status_text(status), (unsigned long) body_len);
+    if (send_all(fd, header, (size_t) header_len)) {
+        (void) send_all(fd, body, body_len);
+    }
+}
+
+// Copies the path segment that follows prefix into out. Returns false if it does not fit or is empty.
+static bool get_segment(const char *path, const char *prefix, char *out, size_t out_size) {
+    if (0 != strncmp(path, prefix, strlen(prefix))) {
+        return false;
+    }
+    const char *start = &path[strlen(prefix)];
+    const size_t len = strcspn(start, "/? ");
+    if (0 == len || len >= out_size) {
+        return false;
+    }
+    memcpy(out, start, len);
+    out[len] = '\0';
+    return true;
+}
+
+static int build_discovery_response(char *body, size_t body_size) {
+    return snprintf(body, body_size,
+            "{\"d\":{\"ec\":%d,\"bu\":\"http://127.0.0.1:%d" MOCK_IDENTITY_BASE_PATH "\","
+            "\"log:mqtt\":{\"hn\":\"\",\"un\":\"\",\"pwd\":\"\",\"topic\":\"\"},\"pf\":\"aws\"},"
+            "\"status\":200,\"message\":\"Success\"}",
+            options.discovery_ec, options.port);
+}
+
+static int build_identity_response(char *body, size_t body_size, const char *duid) {
+    return snprintf(body, body_size,
+            "{\"d\":{\"ec\":%d,\"ct\":200,\"meta\":{\"at\":3,\"df\":60,\"cd\":\"MOCKCD1\",\"gtw\":null,\"edge\":0,\"pf\":0,"
+            "\"hwv\":\"\",\"swv\":\"\",\"v\":2.1},\"has\":{\"d\":0,\"attr\":1,\"set\":0,\"r\":0,\"ota\":0},"
+            "\"p\":{\"n\":\"mqtt\",\"h\":\"mock-ats.iot.us-east-1.amazonaws.com\",\"p\":8883,\"id\":\"%s\","
+            "\"topics\":{\"rpt\":\"$aws/rules/msg_d2c_rpt/%s/2.1/0\",\"flt\":\"$aws/rules/msg_d2c_flt/%s/2.1/3\","
+            "\"od\":\"$aws/rules/msg_d2c_od/%s/2.1/4\",\"hb\":\"$aws/rules/msg_d2c_hb/%s/2.1/5\","
+            "\"ack\":\"$aws/rules/msg_d2c_ack/%s/2.1/6\",\"dl\":\"$aws/rules/msg_d2c_dl/%s/2.1/7\","
+            "\"di\":\"$aws/rules/msg_d2c_di/%s/2.1/1\",\"c2d\":\"iot/%s/cmd\"}},"
+            "\"dt\":\"2024-03-06T16:29:56.745Z\"},\"status\":200,\"message\":\"Device info loaded successfully.\"}",
+            options.identity_ec, duid, duid, duid, duid, duid, duid, duid, duid, duid);
+}
+
+static void *handle_connection(void *arg) {
+    const int fd = (int) (intptr_t) arg;
+    char request[MOCK_REQUEST_MAX_LEN];
+    size_t len = 0;
+
+    // read until the end of the request headers
+    while (len < sizeof(request) - 1) {
+        ssize_t received = recv(fd, &request[len], sizeof(request) - 1 - len, 0);
+        if (received <= 0) {
+            if (received < 0 && EINTR == errno) continue;
+            break;
+        }
+        len += (size_t) received;
+        request[len] = '\0';
+        if (strstr(request, "\r\n\r\n")) break;
+    }
+    request[len] = '\0';
+
+    pthread_mutex_lock(&num_requests_lock);
+    const unsigned long request_number = ++num_requests;
+    pthread_mutex_unlock(&num_requests_lock);
+
+    int latency = options.latency_ms;
+    if (options.jitter_ms > 0) {
+        latency += (int) ((unsigned long) rand() % (unsigned long) (options.jitter_ms + 1));
+    }
+    sleep_ms(latency);
+
+    char body[MOCK_RESPONSE_MAX_LEN];
+    char segment[256];
+    int status = options.http_status;
+    if (options.fail_every > 0 && 0 == request_number % (unsigned long) options.fail_every) {
+        status = 500;
+    }
+
+    if (0 != strncmp(request, "GET ", 4)) {
+        send_response(fd, 404, "{\"status\":404,\"message\":\"Not found\"}");
+    } else if (200 != status) {
+        snprintf(body, sizeof(body), "{\"status\":%d,\"message\":\"Mock error\"}", status);
+        send_response(fd, status, body);
+    } else if (get_segment(&request[4], MOCK_IDENTITY_PREFIX, segment, sizeof(segment))) {
+        build_identity_response(body, sizeof(body), segment);
+        send_response(fd, 200, body);
+    } else if (get_segment(&request[4], MOCK_DISCOVERY_PREFIX, segment, sizeof(segment))) {
+        build_discovery_response(body, sizeof(body));
+        send_response(fd, 200, body);
+    } else {
+        send_response(fd, 404, "{\"status\":404,\"message\":\"Not found\"}");
+    }
+    close(fd);
+    return NULL;
+}
+
+static int parse_int_option(const char *value, int min) {
+    char *end = NULL;
+    long v = strtol(value, &end, 10);
+    if (!value[0] || *end || v < min || v > 1000000) {
+        fprintf(stderr, "Invalid option value \"%s\"\n", value);
+        exit(2);
+    }
+    return (int) v;
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc || '-' != argv[i][0] || 2 != strlen(argv[i])) {
+            fprintf(stderr, "Usage: %s [-p port] [-l latency_ms] [-j jitter_ms] [-s http_status] [-d discovery_ec] [-i identity_ec] [-f fail_every]\n", argv[0]);
+            return 2;
+        }
+        const char *value = argv[++i];
+        switch (argv[i - 1][1]) {
+            case 'p': options.port = parse_int_option(value, 0); break;
+            case 'l': options.latency_ms = parse_int_option(value, 0); break;
+            case 'j': options.jitter_ms = parse_int_option(value, 0); break;
+            case 's': options.http_status = parse_int_option(value, 100); break;
+            case 'd': options.discovery_ec = parse_int_option(value, 0); break;
+            case 'i': options.identity_ec = parse_int_option(value, 0); break;
+            case 'f': options.fail_every = parse_int_option(value, 0); break;
+            default:
+                fprintf(stderr, "Unknown option %s\n", argv[i - 1]);
+                return 2;
+        }
+    }
+
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd < 0) {
+        perror("socket");
+        return 1;
+    }
+    int reuse = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((uint16_t) options.port);
+    if (0 != bind(server_fd, (struct sockaddr *) &addr, sizeof(addr)) || 0 != listen(server_fd, 128)) {
+        perror("bind/listen");
+        return 1;
+    }
+    socklen_t addr_len = sizeof(addr);
+    getsockname(server_fd, (struct sockaddr *) &addr, &addr_len);
+    options.port = ntohs(addr.sin_port);
+    printf("Listening on port %d\n", options.port);
+    fflush(stdout);
+
+    for (;;) {
+        int fd = accept(server_fd, NULL, NULL);
+        if (fd < 0) {
+            if (EINTR == errno) continue;
+            perror("accept");
+            break;
+        }
+        pthread_t thread;
+        if (0 != pthread_create(&thread, NULL, handle_connection, (void *) (intptr_t) fd)) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    close(server_fd);
+    return 0;
+}
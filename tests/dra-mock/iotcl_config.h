@@ -0,0 +1,7 @@
+#ifndef IOTCL_CONFIG_H
+#define IOTCL_CONFIG_H
+
+// This is an example config file where we override IOTCL_ENDLN for our tests
+#define IOTCL_ENDLN "\n"
+
+#endif // IOTCL_CONFIG_H
@@ -0,0 +1,30 @@
+#!/bin/bash
+# Builds the mock server and the benchmark, starts the server and runs the benchmark against it.
+# Usage: run-bench.sh [number of devices] [extra mock server options...]
+# Example with 5ms latency and a failure on every 100th request: run-bench.sh 1000 -l 5 -f 100
+
+this_dir=$(dirname "$0")
+num_devices=${1:-1000}
+shift
+
+set -e
+cmake -S "$this_dir" -B "$this_dir/build" >/dev/null
+cmake --build "$this_dir/build" >/dev/null
+
+port_file=$(mktemp)
+"$this_dir/build/dra-mock-server" -p 0 "$@" > "$port_file" &
+server_pid=$!
+trap 'kill $server_pid 2>/dev/null; rm -f "$port_file"' EXIT
+
+for _ in $(seq 50); do
+  grep -q "Listening" "$port_file" && break
+  sleep 0.1
+done
+port=$(sed -n 's/Listening on port //p' "$port_file")
+
+set +e
+"$this_dir/build/dra-bench" -p "$port" -n "$num_devices"
+status=$?
+"$this_dir/build/dra-bench" -p "$port" -n "$num_devices" -s
+[ $? -ne 0 ] && status=1
+exit $status
@@ -0,0 +1,190 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Compares the pool allocator with the system malloc() for typical library workloads:
+ *   telemetry  - create a message, set a few values, serialize and send it, destroy it
+ *   c2d        - parse a command and send an ack
+ *   threads    - allocate and free cJSON-node-sized and string-sized blocks from several threads at once
+ *
+ * Options:
+ *   -n <cycles>    Number of cycles for each workload. Default 100000.
+ *   -t <threads>   Number of threads for the threads workload. Default 4.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "iotcl.h"
+#include "iotcl_c2d.h"
+#include "iotcl_telemetry.h"
+#include "iotcl_pool.h"
+
+#define BENCH_MAX_THREADS 64
+#define BENCH_LIVE_BLOCKS 32
+
+static const char *const BENCH_C2D_COMMAND =
+        "{\"v\":\"2.1\",\"ct\":0,\"cmd\":\"set-led-green off\",\"ack\":\"4d99ed07-0ea0-43c6-97ba-53780faddc5c\"}";
+
+static struct {
+    int num_cycles;
+    int num_threads;
+} options = {100000, 4};
+
+typedef struct {
+    const char *name;
+    void *(*malloc_fn)(size_t size);
+    void (*free_fn)(void *ptr);
+} BenchAllocator;
+
+static const BenchAllocator allocators[] = {
+        {"system malloc", malloc, free},
+        {"pool", iotcl_pool_malloc, iotcl_pool_free},
+};
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static void bench_transport_send(const char *topic, const char *json_str) {
+    (void) topic;
+    (void) json_str;
+}
+
+static void bench_on_command(IotclC2dEventData data) {
+    iotcl_mqtt_send_cmd_ack(iotcl_c2d_get_ack_id(data), IOTCL_C2D_EVT_CMD_SUCCESS_WITH_ACK, NULL);
+}
+
+static bool bench_telemetry(void) {
+    for (int i = 0; i < options.num_cycles; i++) {
+        IotclMessageHandle msg = iotcl_telemetry_create();
+        if (!msg) {
+            return false;
+        }
+        iotcl_telemetry_set_number(msg, "temperature", 21.5 + i % 10);
+        iotcl_telemetry_set_number(msg, "humidity", 40 + i % 20);
+        iotcl_telemetry_set_string(msg, "status", "normal");
+        iotcl_telemetry_set_number(msg, "accel.x", 0.01);
+        iotcl_telemetry_set_number(msg, "accel.y", -0.02);
+        iotcl_telemetry_set_number(msg, "accel.z", 0.98);
+        iotcl_telemetry_set_bool(msg, "door_open", 0 == i % 2);
+        if (IOTCL_SUCCESS != iotcl_mqtt_send_telemetry(msg, false)) {
+            iotcl_telemetry_destroy(msg);
+            return false;
+        }
+        iotcl_telemetry_destroy(msg);
+    }
+    return true;
+}
+
+static bool bench_c2d(void) {
+    for (int i = 0; i < options.num_cycles; i++) {
+        if (IOTCL_SUCCESS != iotcl_c2d_process_event(BENCH_C2D_COMMAND)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void *bench_thread(void *arg) {
+    const BenchAllocator *a = (const BenchAllocator *) arg;
+    void *live[BENCH_LIVE_BLOCKS] = {0};
+    static const size_t sizes[] = {64, 64, 64, 12, 24, 8, 64, 48};
+    for (int i = 0; i < options.num_cycles; i++) {
+        const int slot = i % BENCH_LIVE_BLOCKS;
+        a->free_fn(live[slot]);
+        live[slot] = a->malloc_fn(sizes[i % (int) (sizeof(sizes) / sizeof(sizes[0]))]);
+        if (live[slot]) {
+            memset(live[slot], 0, 8);
+        }
+    }
+    for (int i = 0; i < BENCH_LIVE_BLOCKS; i++) {
+        a->free_fn(live[i]);
+    }
+    iotcl_pool_flush_thread_cache();
+    return NULL;
+}
+
+static bool bench_threads(const BenchAllocator *a) {
+    pthread_t threads[BENCH_MAX_THREADS];
+    for (int i = 0; i < options.num_threads; i++) {
+        if (0 != pthread_create(&threads[i], NULL, bench_thread, (void *) a)) {
+            return false;
+        }
+    }
+    for (int i = 0; i < options.num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return true;
+}
+
+static bool run_library_workload(const char *name, bool (*workload)(void), const BenchAllocator *a) {
+    IotclClientConfig config;
+    iotcl_configure_dynamic_memory(a->malloc_fn, a->free_fn);
+    iotcl_init_client_config(&config);
+    config.device.instance_type = IOTCL_DCT_AWS_DEDICATED;
+    config.device.duid = "benchdevice";
+    config.mqtt_send_cb = bench_transport_send;
+    config.events.cmd_cb = bench_on_command;
+    if (IOTCL_SUCCESS != iotcl_init(&config)) {
+        return false;
+    }
+    const double start = now_s();
+    const bool is_ok = workload();
+    const double elapsed = now_s() - start;
+    iotcl_deinit();
+    printf("%-10s %-14s %10.3f %12.0f\n", name, a->name, elapsed, (double) options.num_cycles / elapsed);
+    return is_ok;
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp("-n", argv[i]) && i + 1 < argc) {
+            options.num_cycles = atoi(argv[++i]);
+        } else if (0 == strcmp("-t", argv[i]) && i + 1 < argc) {
+            options.num_threads = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [-n cycles] [-t threads]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (options.num_cycles <= 0 || options.num_threads <= 0 || options.num_threads > BENCH_MAX_THREADS) {
+        fprintf(stderr, "Number of cycles must be positive and number of threads between 1 and %d\n",
+                BENCH_MAX_THREADS);
+        return 2;
+    }
+    if (IOTCL_SUCCESS != iotcl_pool_init(NULL)) {
+        return 1;
+    }
+
+    bool is_ok = true;
+    printf("%-10s %-14s %10s %12s\n", "workload", "allocator", "seconds", "cycles/s");
+    for (size_t i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++) {
+        is_ok &= run_library_workload("telemetry", bench_telemetry, &allocators[i]);
+    }
+    for (size_t i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++) {
+        is_ok &= run_library_workload("c2d", bench_c2d, &allocators[i]);
+    }
+    for (size_t i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++) {
+        const double start = now_s();
+        is_ok &= bench_threads(&allocators[i]);
+        const double elapsed = now_s() - start;
+        printf("%-10s %-14s %10.3f %12.0f (%d threads)\n", "threads", allocators[i].name, elapsed,
+               (double) options.num_cycles * options.num_threads / elapsed, options.num_threads);
+    }
+
+    iotcl_pool_flush_thread_cache();
+    printf("\nPool usage:\n");
+    iotcl_pool_print_stats();
+    iotcl_pool_deinit();
+    return is_ok ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+/*
+ * Allocation budget regression tests. Each scenario runs a hot path a fixed way and fails if it makes more allocations
+ * or uses more bytes than its budget. If a change legitimately needs more memory, raise the budget in the same change
+ * and explain why. If a scenario prints that it is under budget, lower the budget to lock in the improvement.
+ * Byte budgets are measured with 64-bit pointers. Platforms with smaller pointers stay under them.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "iotcl.h"
+#include "iotcl_c2d.h"
+#include "iotcl_telemetry.h"
+#include "heap_tracker.h"
+
+static const char *const TEST_STR_COMMAND = "{\"v\":\"2.1\",\"ct\":0,\"cmd\":\"set-led-green off\",\"ack\":\"4d99ed07-0ea0-43c6-97ba-53780faddc5c\"}";
+static const char *const TEST_STR_OTA_2_URLS = "{\"v\":\"2.1\",\"ct\":1,\"cmd\":\"ota\",\"ack\":\"0b7d0c4e-6c5c-4d2e-9b59-d0e0c1f4a2aa\",\"sw\":\"1.6\",\"hw\":\"1\",\"urls\":[{\"url\":\"https://first.example.com/fw/app.bin?sig=1\",\"fileName\":\"app.bin\"},{\"url\":\"https://second.example.org/fw/cfg.json\",\"fileName\":\"cfg.json\"}]}";
+
+typedef struct {
+    const char *name;
+    unsigned long max_allocations;
+    size_t max_total_bytes; // sum of sizes of all allocations
+    size_t max_peak_bytes;  // maximum bytes on the heap at the same time
+} AllocBudget;
+
+static int num_messages_sent = 0;
+
+static void my_transport_send(const char *topic, const char *json_str) {
+    (void) topic;
+    (void) json_str;
+    num_messages_sent++;
+}
+
+static void on_cmd(IotclC2dEventData data) {
+    iotcl_mqtt_send_cmd_ack(iotcl_c2d_get_ack_id(data), IOTCL_C2D_EVT_CMD_SUCCESS_WITH_ACK, NULL);
+}
+
+static void on_ota(IotclC2dEventData data) {
+    if (2 != iotcl_c2d_get_ota_url_count(data) || !iotcl_c2d_get_ota_url_hostname(data, 1)) {
+        return;
+    }
+    iotcl_mqtt_send_ota_ack(iotcl_c2d_get_ack_id(data), IOTCL_C2D_EVT_OTA_DOWNLOAD_DONE, NULL);
+}
+
+static void scenario_telemetry_10_attributes(void) {
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    iotcl_telemetry_set_number(msg, "temperature", 21.5);
+    iotcl_telemetry_set_number(msg, "humidity", 40);
+    iotcl_telemetry_set_number(msg, "pressure", 1013.25);
+    iotcl_telemetry_set_string(msg, "status", "normal");
+    iotcl_telemetry_set_string(msg, "version", "1.2.3");
+    iotcl_telemetry_set_bool(msg, "door_open", false);
+    iotcl_telemetry_set_null(msg, "error");
+    iotcl_telemetry_set_number(msg, "accel.x", 0.01);
+    iotcl_telemetry_set_number(msg, "accel.y", -0.02);
+    iotcl_telemetry_set_number(msg, "accel.z", 0.98);
+    iotcl_mqtt_send_telemetry(msg, false);
+    iotcl_telemetry_destroy(msg);
+}
+
+static void scenario_telemetry_3_data_sets(void) {
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    iotcl_telemetry_set_number(msg, "temperature", 21.5);
+    iotcl_telemetry_set_string(msg, "status", "normal");
+    iotcl_telemetry_add_new_data_set(msg, "2024-01-02T03:04:00.000Z");
+    iotcl_telemetry_set_number(msg, "temperature", 21.7);
+    iotcl_telemetry_set_string(msg, "status", "normal");
+    iotcl_telemetry_add_new_data_set(msg, "2024-01-02T03:05:00.000Z");
+    iotcl_telemetry_set_number(msg, "temperature", 21.9);
+    iotcl_telemetry_set_string(msg, "status", "warning");
+    iotcl_mqtt_send_telemetry(msg, false);
+    iotcl_telemetry_destroy(msg);
+}
+
+static IotclMessageHandle set_number_msg;
+
+static void scenario_set_number(void) {
+    iotcl_telemetry_set_number(set_number_msg, "temperature", 21.5);
+}
+
+static void scenario_c2d_command_with_ack(void) {
+    iotcl_mqtt_receive_c2d(TEST_STR_COMMAND);
+}
+
+static void scenario_c2d_ota_2_urls(void) {
+    iotcl_mqtt_receive_c2d(TEST_STR_OTA_2_URLS);
+}
+
+static bool check_budget(const AllocBudget *budget, void (*scenario)(void), int expected_messages) {
+    HtStats before;
+    HtStats after;
+
+    num_messages_sent = 0;
+    ht_get_stats(&before);
+    ht_reset_peak();
+    scenario();
+    ht_get_stats(&after);
+
+    const unsigned long allocations = after.allocations - before.allocations;
+    const size_t total_bytes = after.total_bytes - before.total_bytes;
+    const size_t peak_bytes = after.peak_bytes - before.current_bytes;
+    bool is_ok = true;
+
+    printf("%-28s allocations %4lu/%-4lu total bytes %6lu/%-6lu peak bytes %6lu/%-6lu", budget->name,
+           allocations, budget->max_allocations,
+           (unsigned long) total_bytes, (unsigned long) budget->max_total_bytes,
+           (unsigned long) peak_bytes, (unsigned long) budget->max_peak_bytes
+    );
+    if (expected_messages != num_messages_sent) {
+        printf(" FAILED: sent %d messages instead of %d\n", num_messages_sent, expected_messages);
+        return false;
+    }
+    if (allocations > budget->max_allocations || total_bytes > budget->max_total_bytes
+        || peak_bytes > budget->max_peak_bytes) {
+        printf(" OVER BUDGET\n");
+        is_ok = false;
+    } else if (allocations < budget->max_allocations
+               || (sizeof(void *) == 8 && total_bytes < budget->max_total_bytes)
+               || (sizeof(void *) == 8 && peak_bytes < budget->max_peak_bytes)) {
+        printf(" under budget, consider lowering it\n");
+    } else {
+        printf(" ok\n");
+    }
+    return is_ok;
+}
+
+int main(void) {
+    // Budgets for each scenario. See the comment at the top.
+    static const AllocBudget BUDGET_TELEMETRY_10_ATTRIBUTES = {"telemetry 10 attributes", 34, 1535, 1527};
+    static const AllocBudget BUDGET_TELEMETRY_3_DATA_SETS = {"telemetry 3 data sets", 36, 1679, 1679};
+    static const AllocBudget BUDGET_SET_NUMBER = {"set_number", 2, 76, 76};
+    static const AllocBudget BUDGET_C2D_COMMAND_WITH_ACK = {"c2d command with ack", 24, 1095, 1095};
+    static const AllocBudget BUDGET_C2D_OTA_2_URLS = {"c2d ota with 2 urls", 47, 1945, 1945};
+    IotclClientConfig config;
+    bool test_result = true; // until proven otherwise
+
+    ht_reset_config();
+    ht_init();
+    iotcl_configure_dynamic_memory(ht_malloc, ht_free);
+
+    iotcl_init_client_config(&config);
+    config.device.instance_type = IOTCL_DCT_AWS_DEDICATED;
+    config.device.duid = "mydevice";
+    config.mqtt_send_cb = my_transport_send;
+    config.events.cmd_cb = on_cmd;
+    config.events.ota_cb = on_ota;
+    if (iotcl_init(&config)) {
+        return 1;
+    }
+
+    test_result &= check_budget(&BUDGET_TELEMETRY_10_ATTRIBUTES, scenario_telemetry_10_attributes, 1);
+    test_result &= check_budget(&BUDGET_TELEMETRY_3_DATA_SETS, scenario_telemetry_3_data_sets, 1);
+
+    set_number_msg = iotcl_telemetry_create();
+    iotcl_telemetry_set_number(set_number_msg, "humidity", 40);
+    test_result &= check_budget(&BUDGET_SET_NUMBER, scenario_set_number, 0);
+    iotcl_telemetry_destroy(set_number_msg);
+
+    test_result &= check_budget(&BUDGET_C2D_COMMAND_WITH_ACK, scenario_c2d_command_with_ack, 1);
+    test_result &= check_budget(&BUDGET_C2D_OTA_2_URLS, scenario_c2d_ota_2_urls, 1);
+
+    iotcl_deinit();
+    ht_print_summary();
+    if (ht_get_num_current_allocations() != 0) {
+        return 2;
+    }
+    return (test_result ? 0 : 1);
+}
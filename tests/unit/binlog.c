@@ -0,0 +1,182 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+// Built with IOTCL_ENABLE_BINARY_LOG defined. See CMakeLists.txt.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "iotcl.h"
+#include "iotcl_log.h"
+#include "iotcl_binlog.h"
+
+static uint32_t fake_time_ms = 0;
+
+static uint32_t fake_clock(void) {
+    return fake_time_ms;
+}
+
+typedef struct {
+    int count;
+    IotclBinlogRecord last_record;
+    char last_text[256];
+} DrainResult;
+
+static void collect_sink(void *context, const IotclBinlogRecord *record, const char *text) {
+    DrainResult *result = (DrainResult *) context;
+    result->count++;
+    memcpy(&result->last_record, record, sizeof(IotclBinlogRecord));
+    strncpy(result->last_text, text, sizeof(result->last_text) - 1);
+    result->last_text[sizeof(result->last_text) - 1] = '\0';
+}
+
+static bool drain_one(DrainResult *result) {
+    memset(result, 0, sizeof(DrainResult));
+    iotcl_binlog_drain(collect_sink, result);
+    if (1 != result->count) {
+        printf("Expected one record, but drained %d\n", result->count);
+        return false;
+    }
+    return true;
+}
+
+static bool expect_text(const DrainResult *result, const char *expected) {
+    if (0 != strcmp(result->last_text, expected)) {
+        printf("Expected \"%s\", but got \"%s\"\n", expected, result->last_text);
+        return false;
+    }
+    return true;
+}
+
+static bool format_test(void) {
+    DrainResult result;
+    char payload[4] = {'a', 'b', 'c', 'd'}; // not null terminated
+    char changing[16];
+    const char *volatile null_str = NULL; // hidden from the compiler format checks
+    bool is_ok = true;
+
+    iotcl_binlog_reset();
+    IOTCL_ERROR(IOTCL_ERR_BAD_VALUE, "value %d of %s is %lu %x %5.2f%% %c", -3, "temp", 12345UL, 255, 3.14159, 'z');
+    is_ok &= drain_one(&result) && expect_text(&result, "value -3 of temp is 12345 ff  3.14% z");
+    if (IOTCL_BINLOG_LEVEL_ERROR != result.last_record.level || IOTCL_ERR_BAD_VALUE != result.last_record.err_code) {
+        printf("Level or error code not recorded correctly\n");
+        is_ok = false;
+    }
+
+    IOTCL_WARN(IOTCL_ERR_PARSING_ERROR, "payload \"%.*s\" %-4s|%*d", 3, payload, "ab", 4, 7);
+    is_ok &= drain_one(&result) && expect_text(&result, "payload \"abc\" ab  |   7");
+
+    // strings are copied, so they can change before the record is decoded
+    strcpy(changing, "original");
+    IOTCL_INFO("%s %s", changing, null_str);
+    strcpy(changing, "changed");
+    is_ok &= drain_one(&result) && expect_text(&result, "original (null)");
+
+    char long_str[IOTCL_BINLOG_STRING_SPACE * 2];
+    memset(long_str, 'x', sizeof(long_str) - 1);
+    long_str[sizeof(long_str) - 1] = '\0';
+    IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "%s|%s", long_str, "next");
+    is_ok &= drain_one(&result);
+    const size_t len = strlen(result.last_text);
+    if (len != IOTCL_BINLOG_STRING_SPACE - 1 + 1 || 0 != strcmp(&result.last_text[len - 4], "...|")) {
+        printf("Long string not truncated as expected: %s\n", result.last_text);
+        is_ok = false;
+    }
+    return is_ok;
+}
+
+static bool ring_full_test(void) {
+    DrainResult result;
+
+    iotcl_binlog_reset();
+    for (int i = 0; i < IOTCL_BINLOG_RING_SIZE + 3; i++) {
+        IOTCL_INFO("message %d", i);
+    }
+    memset(&result, 0, sizeof(result));
+    iotcl_binlog_drain(collect_sink, &result);
+    if (IOTCL_BINLOG_RING_SIZE != result.count || 3 != iotcl_binlog_get_dropped_count()) {
+        printf("Ring full: drained %d, dropped %lu\n", result.count, iotcl_binlog_get_dropped_count());
+        return false;
+    }
+    // the ring wraps around correctly after it has been drained
+    IOTCL_INFO("after %d", 1);
+    return drain_one(&result) && expect_text(&result, "after 1");
+}
+
+static bool rate_limit_test(void) {
+    DrainResult result;
+    bool is_ok = true;
+
+    iotcl_binlog_reset();
+    iotcl_binlog_configure_clock(fake_clock);
+    fake_time_ms = 1000;
+    for (int i = 0; i < IOTCL_BINLOG_RATE_LIMIT_BURST + 10; i++) {
+        IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "flood %d", i);
+        IOTCL_INFO("info is not rate limited %d", i);
+    }
+    memset(&result, 0, sizeof(result));
+    iotcl_binlog_drain(collect_sink, &result);
+    if (IOTCL_BINLOG_RATE_LIMIT_BURST + IOTCL_BINLOG_RATE_LIMIT_BURST + 10 != result.count) {
+        printf("Rate limiting: drained %d records\n", result.count);
+        is_ok = false;
+    }
+
+    // the suppressed count is reported with the first record of the next window
+    fake_time_ms += IOTCL_BINLOG_RATE_LIMIT_WINDOW_MS;
+    IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "flood %d", 99);
+    is_ok &= drain_one(&result);
+    if (10 != result.last_record.suppressed) {
+        printf("Expected 10 suppressed records, but got %u\n", (unsigned int) result.last_record.suppressed);
+        is_ok = false;
+    }
+    fake_time_ms += 5;
+    IOTCL_ERROR(IOTCL_ERR_PARSING_ERROR, "flood %d", 100);
+    is_ok &= drain_one(&result);
+    if (0 != result.last_record.suppressed || 1005 + IOTCL_BINLOG_RATE_LIMIT_WINDOW_MS != result.last_record.timestamp_ms) {
+        printf("Unexpected record after the window: suppressed %u, timestamp %lu\n",
+               (unsigned int) result.last_record.suppressed, (unsigned long) result.last_record.timestamp_ms);
+        is_ok = false;
+    }
+    iotcl_binlog_configure_clock(NULL);
+    return is_ok;
+}
+
+static bool library_test(void) {
+    DrainResult result;
+    IotclClientConfig config;
+
+    iotcl_binlog_reset();
+    iotcl_init_client_config(&config);
+    config.device.instance_type = IOTCL_DCT_AWS_DEDICATED;
+    config.device.duid = "mydevice";
+    if (iotcl_init(&config)) {
+        return false;
+    }
+    iotcl_binlog_drain(NULL, NULL);
+    iotcl_mqtt_receive_c2d("{\"v\":\"2.1\",\"ct\":0,");
+    iotcl_deinit();
+
+    if (!drain_one(&result) || IOTCL_ERR_PARSING_ERROR != result.last_record.err_code
+        || !strstr(result.last_text, "{\"v\":\"2.1\",\"ct\":0,")) {
+        printf("The C2D parsing error was not logged as expected: %s\n", result.last_text);
+        return false;
+    }
+    // make sure that printing works too
+    IOTCL_ERROR(IOTCL_ERR_FAILED, "Printed from the ring: %d", 42);
+    iotcl_binlog_print_pending();
+    return true;
+}
+
+int main(void) {
+    bool test_result = true; // until proven otherwise
+
+    test_result &= format_test();
+    test_result &= ring_full_test();
+    test_result &= rate_limit_test();
+    test_result &= library_test();
+
+    printf("Binary log tests %s\n", test_result ? "passed" : "FAILED");
+    return (test_result ? 0 : 1);
+}
@@ -9,6 +9,6 @@ set -e
 git submodule update --init --recursive
 
 cmake .
-cmake --build . --target test-rest-api test-event test-telemetry
+cmake --build . --target test-rest-api test-event test-telemetry test-no-heap test-alloc-budget test-pool-allocator test-stats test-binlog test-trace test-sample-ring test-telemetry-template
 
 popd
\ No newline at end of file
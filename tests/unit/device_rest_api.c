@@ -10,6 +10,7 @@
 #include "iotcl_dra_url.h"
 #include "iotcl_dra_discovery.h"
 #include "iotcl_dra_identity.h"
+#include "iotcl_dra_cache.h"
 #include "heap_tracker.h"
 
 
@@ -75,17 +76,174 @@ static void discovery_test(void) {
     iotcl_deinit();
 }
 
+static bool stream_test(void) {
+    bool is_ok = true;
+    IotclClientConfig config;
+
+    iotcl_init_client_config(&config);
+    config.device.instance_type = IOTCL_DCT_CUSTOM;
+    iotcl_init(&config);
+
+    printf("\n-- DRA STREAM PARSER TEST --\n");
+    // feed the discovery response one byte at a time
+    IotclDraDiscoveryStreamParser dp;
+    IotclDraUrlContext c = {0};
+    is_ok &= (IOTCL_SUCCESS == iotcl_dra_discovery_stream_init(&dp));
+    const char *response = EXAMPLE_DISCOVERY_RESPONSE;
+    for (size_t i = 0; i < strlen(response); i++) {
+        is_ok &= (IOTCL_SUCCESS == iotcl_dra_discovery_stream_feed(&dp, (const uint8_t *) &response[i], 1));
+    }
+    is_ok &= (IOTCL_SUCCESS == iotcl_dra_discovery_stream_finish(&dp, &c, 0));
+    is_ok &= (0 == strcmp("https://diavnet.iotconnect.io/api/2.1/agent/device-identity/cg/b892c353-e375-4cc3-8841-32e271e26122", iotcl_dra_url_get_url(&c)));
+    iotcl_dra_url_deinit(&c);
+
+    // feed the identity response in uneven chunks
+    IotclDraIdentityStreamParser ip;
+    is_ok &= (IOTCL_SUCCESS == iotcl_dra_identity_stream_init(&ip));
+    response = EXAMPLE_IDENTITY_RESPONSE;
+    for (size_t i = 0; i < strlen(response); i += 7) {
+        const size_t len = strlen(response) - i < 7 ? strlen(response) - i : 7;
+        is_ok &= (IOTCL_SUCCESS == iotcl_dra_identity_stream_feed(&ip, (const uint8_t *) &response[i], len));
+    }
+    is_ok &= (IOTCL_SUCCESS == iotcl_dra_identity_stream_finish(&ip));
+    const IotclMqttConfig *mc = iotcl_mqtt_get_config();
+    is_ok &= (mc && 0 == strcmp("a3etk4e19usyja-ats.iot.us-east-1.amazonaws.com", mc->host));
+    is_ok &= (mc && 0 == strcmp("$aws/rules/msg_d2c_rpt/abcde/2.1/0", mc->pub_rpt) && 0 == strcmp("iot/abcde/cmd", mc->sub_c2d));
+    is_ok &= (mc && 0 == strcmp("XG4E2CA", mc->cd) && NULL == mc->username);
+
+    // escapes, error codes, truncated and malformed responses
+    const char *const escaped = "{\"status\":200,\"message\":\"x\",\"d\":{\"x\":[{\"bu\":1}],\"ec\":0,\"bu\":\"https:\\/\\/h\\u00e9st\\/a\"}}";
+    iotcl_dra_discovery_stream_init(&dp);
+    iotcl_dra_discovery_stream_feed(&dp, (const uint8_t *) escaped, strlen(escaped));
+    is_ok &= (IOTCL_SUCCESS == iotcl_dra_discovery_stream_finish(&dp, &c, 0));
+    is_ok &= (0 == strcmp("https://h\xc3\xa9st/a", iotcl_dra_url_get_url(&c)));
+    iotcl_dra_url_deinit(&c);
+
+    const char *const ec_error = "{\"status\":200,\"message\":\"Subscription expired\",\"d\":{\"ec\":3}}";
+    iotcl_dra_discovery_stream_init(&dp);
+    iotcl_dra_discovery_stream_feed(&dp, (const uint8_t *) ec_error, strlen(ec_error));
+    is_ok &= (IOTCL_ERR_BAD_VALUE == iotcl_dra_discovery_stream_finish(&dp, &c, 0));
+
+    iotcl_dra_discovery_stream_init(&dp);
+    iotcl_dra_discovery_stream_feed(&dp, (const uint8_t *) response, strlen(response) / 2);
+    is_ok &= (IOTCL_ERR_PARSING_ERROR == iotcl_dra_discovery_stream_finish(&dp, &c, 0));
+
+    iotcl_dra_discovery_stream_init(&dp);
+    is_ok &= (IOTCL_ERR_PARSING_ERROR == iotcl_dra_discovery_stream_feed(&dp, (const uint8_t *) "{\"a\":1]", 7));
+    is_ok &= (IOTCL_ERR_PARSING_ERROR == iotcl_dra_discovery_stream_finish(&dp, &c, 0));
+
+    static char long_bu[IOTCL_DRA_SCANNER_POOL_SIZE + 64];
+    snprintf(long_bu, sizeof(long_bu), "{\"status\":200,\"message\":\"\",\"d\":{\"ec\":0,\"bu\":\"https://h/");
+    const size_t prefix_len = strlen(long_bu);
+    memset(&long_bu[prefix_len], 'a', sizeof(long_bu) - prefix_len - 4);
+    strcpy(&long_bu[sizeof(long_bu) - 4], "\"}}");
+    iotcl_dra_discovery_stream_init(&dp);
+    iotcl_dra_discovery_stream_feed(&dp, (const uint8_t *) long_bu, strlen(long_bu));
+    is_ok &= (IOTCL_ERR_OVERFLOW == iotcl_dra_discovery_stream_finish(&dp, &c, 0));
+
+    iotcl_deinit();
+    printf("DRA stream parser test %s.\n", is_ok ? "passed" : "FAILED");
+    return is_ok;
+}
+
+static bool url_table_test(void) {
+    bool is_ok = true;
+    printf("\n-- DRA IDENTITY URL TABLE TEST --\n");
+    IotclDraUrlContext c = {0};
+    iotcl_dra_url_init(&c, "https://myhost.io/api/base");
+    iotcl_dra_url_use_suffix_path(&c, "/some/suffix"); // should be ignored
+
+    const char *const duids[] = {"dev1", "device-02", "d3"};
+    IotclDraIdentityUrlTable table;
+    const int allocations_before = ht_get_num_current_allocations();
+    is_ok &= (IOTCL_SUCCESS == iotcl_dra_identity_build_url_table(&table, &c, duids, 3));
+    is_ok &= (allocations_before + 1 == ht_get_num_current_allocations());
+    is_ok &= (0 == strcmp("https://myhost.io/api/base/uid/dev1", iotcl_dra_identity_url_table_get_url(&table, 0)));
+    is_ok &= (0 == strcmp("https://myhost.io/api/base/uid/device-02", iotcl_dra_identity_url_table_get_url(&table, 1)));
+    is_ok &= (0 == strcmp("/api/base/uid/d3", iotcl_dra_identity_url_table_get_resource(&table, 2)));
+    is_ok &= (NULL == iotcl_dra_identity_url_table_get_url(&table, 3));
+
+    // the single URL version should produce the same result
+    iotcl_dra_identity_build_url(&c, duids[1]);
+    is_ok &= (0 == strcmp(iotcl_dra_url_get_url(&c), iotcl_dra_identity_url_table_get_url(&table, 1)));
+    iotcl_dra_identity_url_table_deinit(&table);
+
+    const char *const bad_duids[] = {"dev1", ""};
+    is_ok &= (IOTCL_ERR_MISSING_VALUE == iotcl_dra_identity_build_url_table(&table, &c, bad_duids, 2));
+    is_ok &= (NULL == iotcl_dra_identity_url_table_get_url(&table, 0));
+    iotcl_dra_identity_url_table_deinit(&table);
+    iotcl_dra_url_deinit(&c);
+
+    printf("DRA identity URL table test %s.\n", is_ok ? "passed" : "FAILED");
+    return is_ok;
+}
+
+static time_t test_now = 1700000000;
+
+static time_t test_time_fn(void) {
+    return test_now;
+}
+
+static bool cache_test(void) {
+    bool is_ok = true;
+    IotclClientConfig config;
+
+    iotcl_init_client_config(&config);
+    config.device.instance_type = IOTCL_DCT_CUSTOM;
+    config.time_fn = test_time_fn;
+    iotcl_init(&config);
+
+    printf("\n-- DRA CACHE TEST --\n");
+    IotclDraUrlContext c = {0};
+    is_ok &= (IOTCL_SUCCESS == iotcl_dra_discovery_parse(&c, 0, EXAMPLE_DISCOVERY_RESPONSE));
+    is_ok &= (IOTCL_SUCCESS == iotcl_dra_identity_build_url(&c, "abcde"));
+    is_ok &= (IOTCL_SUCCESS == iotcl_dra_identity_configure_library_mqtt(EXAMPLE_IDENTITY_RESPONSE));
+    char *cache_str = iotcl_dra_cache_create(&c, "MYCPID/myenv/abcde", 3600);
+    iotcl_dra_url_deinit(&c);
+    is_ok &= (NULL != cache_str);
+    printf("Cache: %s\n", cache_str ? cache_str : "(null)");
+
+    // simulate a reboot and load the cache
+    iotcl_init(&config);
+    test_now += 60;
+    is_ok &= (IOTCL_SUCCESS == iotcl_dra_cache_load(&c, 0, "MYCPID/myenv/abcde", cache_str));
+    is_ok &= (0 == strcmp("https://diavnet.iotconnect.io/api/2.1/agent/device-identity/cg/b892c353-e375-4cc3-8841-32e271e26122", iotcl_dra_url_get_url(&c)));
+    iotcl_dra_url_deinit(&c);
+    const IotclMqttConfig *mc = iotcl_mqtt_get_config();
+    is_ok &= (mc && 0 == strcmp("iot/abcde/cmd", mc->sub_c2d) && 0 == strcmp("XG4E2CA", mc->cd));
+
+    // the mqtt config is already set
+    is_ok &= (IOTCL_ERR_CONFIG_ERROR == iotcl_dra_cache_load(NULL, 0, "MYCPID/myenv/abcde", cache_str));
+
+    // stale caches
+    iotcl_init(&config);
+    is_ok &= (IOTCL_ERR_EXPIRED == iotcl_dra_cache_load(NULL, 0, "MYCPID/myenv/other", cache_str));
+    test_now += 3600;
+    is_ok &= (IOTCL_ERR_EXPIRED == iotcl_dra_cache_load(NULL, 0, "MYCPID/myenv/abcde", cache_str));
+    is_ok &= (IOTCL_ERR_PARSING_ERROR == iotcl_dra_cache_load(NULL, 0, "MYCPID/myenv/abcde", "{\"v\":1}"));
+    mc = iotcl_mqtt_get_config();
+    is_ok &= (mc && NULL == mc->sub_c2d);
+
+    iotcl_dra_cache_destroy(cache_str);
+    iotcl_deinit();
+    printf("DRA cache test %s.\n", is_ok ? "passed" : "FAILED");
+    return is_ok;
+}
+
 int main(void) {
     ht_reset_config();
     ht_init();
     iotcl_configure_dynamic_memory(ht_malloc, ht_free);
 
     discovery_test();
+    bool test_result = cache_test();
+    test_result &= stream_test();
+    test_result &= url_table_test();
 
     ht_print_summary();
 
     if (ht_get_num_current_allocations() != 0) {
         return 2;
     }
-    return 0;
+    return (test_result ? 0 : 1);
 }
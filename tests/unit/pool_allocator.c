@@ -0,0 +1,228 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "iotcl.h"
+#include "iotcl_telemetry.h"
+#include "iotcl_pool.h"
+
+static int num_messages_sent = 0;
+
+static void my_transport_send(const char *topic, const char *json_str) {
+    (void) topic;
+    (void) json_str;
+    num_messages_sent++;
+}
+
+static bool check_in_use(const char *stage, int size_class, uint32_t expected) {
+    IotclPoolStats stats;
+    iotcl_pool_get_stats(&stats);
+    if (expected != stats.classes[size_class].in_use) {
+        printf("%s: Expected %lu blocks in use in class %d, got %lu!\n", stage, (unsigned long) expected, size_class,
+               (unsigned long) stats.classes[size_class].in_use);
+        return false;
+    }
+    return true;
+}
+
+static bool size_class_test(void) {
+    IotclPoolConfig config;
+    IotclPoolStats stats;
+    bool is_ok = true;
+    void *p[4];
+    static const size_t sizes[4] = {1, 16, 10, 17};
+
+    printf("--- Size classes ---\n");
+    iotcl_pool_init_config(&config);
+    memset(config.num_blocks, 0, sizeof(config.num_blocks));
+    config.num_blocks[0] = 2; // 16 bytes
+    config.num_blocks[2] = 1; // 64 bytes
+    if (iotcl_pool_init(&config)) {
+        return false;
+    }
+    if (IOTCL_SUCCESS == iotcl_pool_init(&config)) {
+        printf("Double init should fail!\n");
+        is_ok = false;
+    }
+
+    // The third one comes from malloc(), as the 16 byte class is exhausted, and the fourth one too,
+    // as the 32 byte class has no blocks.
+    for (int i = 0; i < 4; i++) {
+        p[i] = iotcl_pool_malloc(sizes[i]);
+    }
+    if (!p[0] || !p[1] || !p[2] || !p[3] || p[0] == p[1]) {
+        printf("Allocations failed!\n");
+        is_ok = false;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (p[i]) {
+            memset(p[i], 0xA5, sizes[i]);
+        }
+    }
+    is_ok &= check_in_use("After allocations", 0, 2);
+
+    iotcl_pool_free(p[1]);
+    void *reused = iotcl_pool_malloc(5);
+    if (reused != p[1]) {
+        printf("Freed block was not reused!\n");
+        is_ok = false;
+    }
+    void *large = iotcl_pool_malloc(4096);
+    void *node = iotcl_pool_malloc(64);
+    iotcl_pool_get_stats(&stats);
+    if (1 != stats.classes[0].fallbacks || 1 != stats.classes[1].fallbacks || 1 != stats.large_allocations
+        || 1 != stats.classes[2].in_use || 2 != stats.classes[0].high_water) {
+        printf("Unexpected stats!\n");
+        is_ok = false;
+    }
+    iotcl_pool_print_stats();
+
+    iotcl_pool_free(node);
+    iotcl_pool_free(large);
+    iotcl_pool_free(reused);
+    for (int i = 0; i < 4; i++) {
+        if (i != 1) {
+            iotcl_pool_free(p[i]);
+        }
+    }
+    iotcl_pool_free(NULL);
+    // blocks cached by the thread are free
+    is_ok &= check_in_use("Cached after free", 0, 0);
+    iotcl_pool_flush_thread_cache();
+    is_ok &= check_in_use("After free", 0, 0);
+    is_ok &= check_in_use("After free", 2, 0);
+    iotcl_pool_deinit();
+    return is_ok;
+}
+
+static bool telemetry_cycle_test(void) {
+    IotclClientConfig config;
+    bool is_ok = true;
+
+    printf("--- Telemetry cycles with default pool ---\n");
+    if (iotcl_pool_init(NULL)) {
+        return false;
+    }
+    iotcl_configure_dynamic_memory(iotcl_pool_malloc, iotcl_pool_free);
+
+    iotcl_init_client_config(&config);
+    config.device.instance_type = IOTCL_DCT_AWS_DEDICATED;
+    config.device.duid = "mydevice";
+    config.mqtt_send_cb = my_transport_send;
+    if (iotcl_init(&config)) {
+        return false;
+    }
+    for (int i = 0; i < 10; i++) {
+        IotclMessageHandle msg = iotcl_telemetry_create();
+        is_ok &= IOTCL_SUCCESS == iotcl_telemetry_set_number(msg, "coord.x", i);
+        is_ok &= IOTCL_SUCCESS == iotcl_telemetry_set_number(msg, "coord.y", 3.3);
+        is_ok &= IOTCL_SUCCESS == iotcl_telemetry_set_string(msg, "status", "ok");
+        is_ok &= IOTCL_SUCCESS == iotcl_mqtt_send_telemetry(msg, false);
+        iotcl_telemetry_destroy(msg);
+    }
+    iotcl_deinit();
+    iotcl_pool_flush_thread_cache();
+
+    IotclPoolStats stats;
+    iotcl_pool_get_stats(&stats);
+    iotcl_pool_print_stats();
+    for (int i = 0; i < IOTCL_POOL_NUM_CLASSES; i++) {
+        is_ok &= check_in_use("After deinit", i, 0);
+    }
+    if (0 == stats.classes[2].high_water || 10 != num_messages_sent) {
+        printf("Telemetry did not use the pool!\n");
+        is_ok = false;
+    }
+    iotcl_pool_deinit();
+    return is_ok;
+}
+
+#define THREAD_TEST_BLOCKS 8
+
+static void *alloc_free_thread(void *arg) {
+    void *p[THREAD_TEST_BLOCKS];
+    (void) arg;
+    for (int i = 0; i < THREAD_TEST_BLOCKS; i++) {
+        p[i] = iotcl_pool_malloc(16);
+    }
+    for (int i = 0; i < THREAD_TEST_BLOCKS; i++) {
+        iotcl_pool_free(p[i]);
+    }
+    return NULL; // exits without flushing the cache
+}
+
+// Blocks cached by short-lived threads need to go back to the pool when the threads exit
+static bool thread_exit_test(void) {
+    IotclPoolConfig config;
+    IotclPoolStats stats;
+    bool is_ok = true;
+    void *p[THREAD_TEST_BLOCKS];
+
+    printf("--- Thread exit ---\n");
+    iotcl_pool_init_config(&config);
+    memset(config.num_blocks, 0, sizeof(config.num_blocks));
+    config.num_blocks[0] = THREAD_TEST_BLOCKS;
+    if (iotcl_pool_init(&config)) {
+        return false;
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_t thread;
+        if (0 != pthread_create(&thread, NULL, alloc_free_thread, NULL)) {
+            printf("Unable to create a thread!\n");
+            iotcl_pool_deinit();
+            return false;
+        }
+        pthread_join(thread, NULL);
+    }
+    is_ok &= check_in_use("After threads exit", 0, 0);
+#if IOTCL_POOL_THREAD_EXIT_HOOK
+    // all blocks need to be available to this thread without falling back to malloc()
+    for (int i = 0; i < THREAD_TEST_BLOCKS; i++) {
+        p[i] = iotcl_pool_malloc(16);
+    }
+    iotcl_pool_get_stats(&stats);
+    if (0 != stats.classes[0].fallbacks) {
+        printf("Blocks cached by exited threads were not returned to the pool!\n");
+        is_ok = false;
+    }
+    for (int i = 0; i < THREAD_TEST_BLOCKS; i++) {
+        iotcl_pool_free(p[i]);
+    }
+#else
+    (void) p;
+    (void) stats;
+#endif
+    iotcl_pool_deinit();
+    return is_ok;
+}
+
+// Blocks freed after iotcl_pool_deinit() must not be passed to free()
+static bool late_free_test(void) {
+    printf("--- Free after deinit ---\n");
+    if (iotcl_pool_init(NULL)) {
+        return false;
+    }
+    void *block = iotcl_pool_malloc(16);
+    void *fallback = iotcl_pool_malloc(100000);
+    iotcl_pool_deinit(); // warns about the block in use
+    iotcl_pool_free(block);
+    iotcl_pool_free(fallback);
+    return NULL != block;
+}
+
+int main(void) {
+    bool test_result = true; // until proven otherwise
+    test_result &= size_class_test();
+    test_result &= telemetry_cycle_test();
+    test_result &= thread_exit_test();
+    test_result &= late_free_test();
+    printf("%s\n", test_result ? "Pool allocator tests passed." : "Pool allocator tests FAILED!");
+    return (test_result ? 0 : 1);
+}
@@ -0,0 +1,419 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cJSON.h"
+#include "iotcl.h"
+#include "iotcl_util.h"
+#include "iotcl_telemetry.h"
+#include "iotcl_sample_ring.h"
+
+#define TEST_BASE_US 1709742596000000ULL // 2024-03-06T16:29:56.000Z
+
+static IotclSampleBlock blocks[16];
+
+static void expected_timestamp(uint64_t timestamp_us, char *buffer) {
+    iotcl_to_iso_timestamp((time_t) (timestamp_us / 1000000), buffer, IOTCL_ISO_TIMESTAMP_STR_LEN + 1);
+    sprintf(&buffer[20], "%03uZ", (unsigned int) (timestamp_us / 1000 % 1000));
+}
+
+// Serializes the message and returns the parsed "d" array, or NULL
+static cJSON *serialize_and_parse(IotclMessageHandle msg, cJSON **root) {
+    char *str = iotcl_telemetry_create_serialized_string(msg, false);
+    *root = str ? cJSON_Parse(str) : NULL;
+    iotcl_telemetry_destroy_serialized_string(str);
+    return cJSON_GetObjectItem(*root, "d");
+}
+
+// cJSON prints 15 significant digits if the value parses back within DBL_EPSILON
+static bool is_close(double a, double b) {
+    const double diff = a > b ? a - b : b - a;
+    const double magnitude = b < 0 ? -b : b;
+    return diff <= magnitude * 1e-15;
+}
+
+static bool check_data_set(const cJSON *data_set, uint64_t timestamp_us, const char *name, double value) {
+    char expected_dt[IOTCL_ISO_TIMESTAMP_STR_LEN + 1];
+    expected_timestamp(timestamp_us, expected_dt);
+    const cJSON *dt = cJSON_GetObjectItem(data_set, "dt");
+    const cJSON *number = cJSON_GetObjectItem(data_set, "d");
+    const char *dot = strchr(name, '.');
+    if (dot) {
+        char object_name[32] = {0};
+        memcpy(object_name, name, (size_t) (dot - name));
+        number = cJSON_GetObjectItem(number, object_name);
+        name = dot + 1;
+    }
+    number = cJSON_GetObjectItem(number, name);
+    if (!cJSON_IsString(dt) || 0 != strcmp(dt->valuestring, expected_dt)
+        || !cJSON_IsNumber(number) || !is_close(number->valuedouble, value)) {
+        printf("Expected %s %s=%.17g. Got %s %.17g\n", expected_dt, name, value,
+               cJSON_IsString(dt) ? dt->valuestring : "(none)", cJSON_IsNumber(number) ? number->valuedouble : 0.0);
+        return false;
+    }
+    return true;
+}
+
+// Irregular timestamps and values of all kinds must be restored exactly
+static bool round_trip_test(void) {
+    static uint64_t timestamps[200];
+    static double values[200];
+    IotclSampleRing ring;
+    bool is_ok = true;
+    cJSON *root = NULL;
+    size_t num_data_sets = 0;
+    int err_cnt = 0;
+
+    uint64_t timestamp_us = TEST_BASE_US;
+    for (int i = 0; i < 200; i++) {
+        timestamp_us += 1000;
+        if (0 == i % 37) {
+            timestamp_us += 17; // jitter
+        }
+        if (100 == i) {
+            timestamp_us += 3600000000ULL; // a gap over the 32-bit range
+        }
+        if (150 == i) {
+            timestamp_us -= 1000; // same as previous
+        }
+        timestamps[i] = timestamp_us;
+        values[i] = (0 == i % 5 && i > 0) ? values[i - 1] : (double) (i * 37 % 4096) * (3.3 / 4095.0);
+    }
+    values[50] = -1e300;
+    values[51] = 0.0;
+    values[52] = 12345678.0;
+
+    err_cnt += iotcl_sample_ring_init(&ring, "accel.x", blocks, 16) ? 1 : 0;
+    for (int i = 0; i < 200; i++) {
+        err_cnt += iotcl_sample_ring_add(&ring, timestamps[i], values[i]) ? 1 : 0;
+    }
+
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    err_cnt += iotcl_sample_ring_flush(&ring, msg, NULL, &num_data_sets) ? 1 : 0;
+    cJSON *d = serialize_and_parse(msg, &root);
+    if (err_cnt || 200 != num_data_sets || 200 != cJSON_GetArraySize(d)) {
+        printf("Round trip failed with %d errors and %lu data sets\n", err_cnt, (unsigned long) num_data_sets);
+        is_ok = false;
+    }
+    for (int i = 0; is_ok && i < 200; i++) {
+        is_ok = check_data_set(cJSON_GetArrayItem(d, i), timestamps[i], "accel.x", values[i]);
+    }
+    cJSON_Delete(root);
+    iotcl_telemetry_destroy(msg);
+
+    // nothing left
+    msg = iotcl_telemetry_create();
+    if (iotcl_sample_ring_flush(&ring, msg, NULL, &num_data_sets) || 0 != num_data_sets) {
+        printf("Samples were flushed twice\n");
+        is_ok = false;
+    }
+    iotcl_telemetry_destroy(msg);
+    return is_ok;
+}
+
+// The flush stops at the budget and the next flush continues where the previous one stopped
+static bool budget_test(void) {
+    IotclSampleRing ring;
+    IotclSampleRingFlushOptions options = {355, 0, false}; // room for 5 data sets of "vib"
+    bool is_ok = true;
+    cJSON *root = NULL;
+    size_t num_data_sets = 0;
+
+    iotcl_sample_ring_init(&ring, "vib", blocks, 16);
+    for (int i = 0; i < 100; i++) {
+        iotcl_sample_ring_add(&ring, TEST_BASE_US + (uint64_t) i * 1000, (double) i);
+    }
+
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    int status = iotcl_sample_ring_flush(&ring, msg, &options, &num_data_sets);
+    char *str = iotcl_telemetry_create_serialized_string(msg, false);
+    if (IOTCL_ERR_OVERFLOW != status || 5 != num_data_sets || !str
+        || strlen(str) > options.max_bytes + sizeof("{\"d\":[]}")) {
+        printf("Budget was not respected. Status %d, %lu data sets\n", status, (unsigned long) num_data_sets);
+        is_ok = false;
+    }
+    iotcl_telemetry_destroy_serialized_string(str);
+    iotcl_telemetry_destroy(msg);
+
+    msg = iotcl_telemetry_create();
+    status = iotcl_sample_ring_flush(&ring, msg, NULL, &num_data_sets);
+    cJSON *d = serialize_and_parse(msg, &root);
+    if (status || 95 != num_data_sets || !check_data_set(cJSON_GetArrayItem(d, 0), TEST_BASE_US + 5000, "vib", 5)) {
+        printf("Second flush did not continue after the budget. Status %d, %lu data sets\n",
+               status, (unsigned long) num_data_sets);
+        is_ok = false;
+    }
+    cJSON_Delete(root);
+    iotcl_telemetry_destroy(msg);
+    return is_ok;
+}
+
+// Regularly sampled, slowly changing ADC readings need to take only a few bits each
+static bool compression_test(void) {
+    IotclSampleRing ring;
+    bool is_ok = true;
+    size_t num_data_sets = 0;
+    int num_stored = 0;
+
+    iotcl_sample_ring_init(&ring, "current", blocks, 2);
+    for (int i = 0; i < 100000; i++) {
+        const double value = (double) (2048 + i / 10 % 8) * (3.3 / 4095.0);
+        if (iotcl_sample_ring_add(&ring, TEST_BASE_US + (uint64_t) i * 1000, value)) {
+            break;
+        }
+        num_stored++;
+    }
+    for (int i = 0; i < 10; i++) {
+        iotcl_sample_ring_add(&ring, TEST_BASE_US, 0);
+    }
+    // 16 bytes per raw sample
+    const double bytes_per_sample = (double) sizeof(blocks[0].data) * 2 / (double) num_stored;
+    printf("Stored %d samples. %.2f bytes per sample\n", num_stored, bytes_per_sample);
+    if (bytes_per_sample > 1.6 || 11 != iotcl_sample_ring_get_dropped_count(&ring)) {
+        printf("Expected at most 1.6 bytes per sample and 11 dropped samples. Got %lu dropped\n",
+               iotcl_sample_ring_get_dropped_count(&ring));
+        is_ok = false;
+    }
+
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    if (iotcl_sample_ring_flush(&ring, msg, NULL, &num_data_sets) || (size_t) num_stored != num_data_sets) {
+        printf("Expected %d data sets. Got %lu\n", num_stored, (unsigned long) num_data_sets);
+        is_ok = false;
+    }
+    iotcl_telemetry_destroy(msg);
+
+    // flushing frees up the blocks
+    if (iotcl_sample_ring_add(&ring, TEST_BASE_US, 1.0)) {
+        printf("Unable to add samples after flushing\n");
+        is_ok = false;
+    }
+    return is_ok;
+}
+
+static bool check_window(const cJSON *data_set, uint64_t start_us, double min, double max, double avg, double count) {
+    return check_data_set(data_set, start_us, "vib_min", min)
+           && check_data_set(data_set, start_us, "vib_max", max)
+           && check_data_set(data_set, start_us, "vib_avg", avg)
+           && check_data_set(data_set, start_us, "vib_count", count);
+}
+
+// 10 kHz samples are summarized into 10 ms windows
+static bool window_test(void) {
+    IotclSampleRing ring;
+    IotclSampleRingFlushOptions options = {0, 10, false};
+    bool is_ok = true;
+    cJSON *root = NULL;
+    size_t num_data_sets = 0;
+
+    iotcl_sample_ring_init(&ring, "vib", blocks, 16);
+    for (int i = 0; i < 350; i++) {
+        iotcl_sample_ring_add(&ring, TEST_BASE_US + (uint64_t) i * 100, (double) i);
+    }
+
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    int status = iotcl_sample_ring_flush(&ring, msg, &options, &num_data_sets);
+    cJSON *d = serialize_and_parse(msg, &root);
+    if (status || 3 != num_data_sets
+        || !check_window(cJSON_GetArrayItem(d, 0), TEST_BASE_US, 0, 99, 49.5, 100)
+        || !check_window(cJSON_GetArrayItem(d, 2), TEST_BASE_US + 20000, 200, 299, 249.5, 100)) {
+        printf("Windows do not match. Status %d, %lu data sets\n", status, (unsigned long) num_data_sets);
+        is_ok = false;
+    }
+    cJSON_Delete(root);
+    iotcl_telemetry_destroy(msg);
+
+    options.include_open_window = true;
+    msg = iotcl_telemetry_create();
+    status = iotcl_sample_ring_flush(&ring, msg, &options, &num_data_sets);
+    d = serialize_and_parse(msg, &root);
+    if (status || 1 != num_data_sets || !check_window(cJSON_GetArrayItem(d, 0), TEST_BASE_US + 30000, 300, 349, 324.5, 50)) {
+        printf("Open window does not match. Status %d, %lu data sets\n", status, (unsigned long) num_data_sets);
+        is_ok = false;
+    }
+    cJSON_Delete(root);
+    iotcl_telemetry_destroy(msg);
+    return is_ok;
+}
+
+static int num_allocations = 0;
+static int fail_allocation = 0; // 1-based index of the allocation that should fail, or 0
+
+static void *failing_malloc(size_t size) {
+    num_allocations++;
+    return num_allocations == fail_allocation ? NULL : malloc(size);
+}
+
+// Flushes the first of two 10 ms windows into a new message, failing the allocation with the given index
+static int flush_first_window(IotclMessageHandle *msg, int fail_at, size_t *num_data_sets) {
+    IotclSampleRing ring;
+    IotclSampleRingFlushOptions options = {0, 10, false};
+    iotcl_sample_ring_init(&ring, "vib", blocks, 16);
+    for (int i = 0; i < 200; i++) {
+        iotcl_sample_ring_add(&ring, TEST_BASE_US + (uint64_t) i * 100, (double) i);
+    }
+    *msg = iotcl_telemetry_create();
+    iotcl_configure_dynamic_memory(failing_malloc, free);
+    num_allocations = 0;
+    fail_allocation = fail_at;
+    int status = iotcl_sample_ring_flush(&ring, *msg, &options, num_data_sets);
+    fail_allocation = 0;
+    iotcl_configure_dynamic_memory(malloc, free);
+    if (fail_at) {
+        // the window should not be added again
+        size_t num_retried = 0;
+        if (iotcl_sample_ring_flush(&ring, *msg, &options, &num_retried)) {
+            return IOTCL_ERR_FAILED;
+        }
+        *num_data_sets += num_retried;
+    }
+    return status;
+}
+
+// A window data set that was added, but could not be completed, should not be added again
+static bool out_of_memory_test(void) {
+    IotclMessageHandle msg = NULL;
+    bool is_ok = true;
+    cJSON *root = NULL;
+    size_t num_data_sets = 0;
+
+    int status = flush_first_window(&msg, 0, &num_data_sets);
+    iotcl_telemetry_destroy(msg);
+    const int window_allocations = num_allocations;
+    if (status || 1 != num_data_sets) {
+        printf("Window was not flushed. Status %d, %lu data sets\n", status, (unsigned long) num_data_sets);
+        return false;
+    }
+
+    // the last allocation sets <path>_count
+    status = flush_first_window(&msg, window_allocations, &num_data_sets);
+    cJSON *d = serialize_and_parse(msg, &root);
+    if (IOTCL_ERR_OUT_OF_MEMORY != status || 1 != num_data_sets || 1 != cJSON_GetArraySize(d)
+        || !check_data_set(cJSON_GetArrayItem(d, 0), TEST_BASE_US, "vib_avg", 49.5)) {
+        printf("Incomplete window was added again. Status %d, %lu data sets\n", status, (unsigned long) num_data_sets);
+        is_ok = false;
+    }
+    cJSON_Delete(root);
+    iotcl_telemetry_destroy(msg);
+    return is_ok;
+}
+
+#define CONCURRENT_NUM_SAMPLES 20000
+
+static uint64_t concurrent_timestamp(int i) {
+    return TEST_BASE_US + (uint64_t) i * 1000 + (0 == i % 7 ? 3000 : 0);
+}
+
+static double concurrent_value(int i) {
+    return (double) (i * 7919 % 1000) * 0.25 - 100.0;
+}
+
+static void *concurrent_producer(void *arg) {
+    IotclSampleRing *ring = (IotclSampleRing *) arg;
+    for (int i = 0; i < CONCURRENT_NUM_SAMPLES; i++) {
+        // wait for the consumer to free up a block, but give up if it has stopped
+        int num_retries = 0;
+        while (iotcl_sample_ring_add(ring, concurrent_timestamp(i), concurrent_value(i))) {
+            if (++num_retries > 1000000) {
+                return NULL;
+            }
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+// One thread adds samples while another one flushes them. All samples must be received once, in order.
+static bool concurrent_test(void) {
+    static IotclSampleBlock concurrent_blocks[4];
+    IotclSampleRing ring;
+    IotclSampleRingFlushOptions options = {8192, 0, false};
+    pthread_t producer;
+    bool is_ok = true;
+    int num_received = 0;
+    int num_idle_flushes = 0;
+
+    iotcl_sample_ring_init(&ring, "vib", concurrent_blocks, 4);
+    if (0 != pthread_create(&producer, NULL, concurrent_producer, &ring)) {
+        printf("Failed to create the producer thread\n");
+        return false;
+    }
+    while (num_received < CONCURRENT_NUM_SAMPLES && num_idle_flushes < 1000000) {
+        cJSON *root = NULL;
+        size_t num_data_sets = 0;
+        IotclMessageHandle msg = iotcl_telemetry_create();
+        int status = iotcl_sample_ring_flush(&ring, msg, &options, &num_data_sets);
+        if (status && IOTCL_ERR_OVERFLOW != status) {
+            is_ok = false;
+        }
+        cJSON *d = num_data_sets ? serialize_and_parse(msg, &root) : NULL;
+        for (int i = 0; i < (int) num_data_sets && num_received < CONCURRENT_NUM_SAMPLES; i++, num_received++) {
+            if (is_ok && !check_data_set(cJSON_GetArrayItem(d, i), concurrent_timestamp(num_received),
+                                         "vib", concurrent_value(num_received))) {
+                printf("Sample %d does not match\n", num_received);
+                is_ok = false;
+            }
+        }
+        cJSON_Delete(root);
+        iotcl_telemetry_destroy(msg);
+        if (num_data_sets) {
+            num_idle_flushes = 0;
+        } else {
+            num_idle_flushes++;
+            sched_yield();
+        }
+    }
+    pthread_join(producer, NULL);
+    if (CONCURRENT_NUM_SAMPLES != num_received) {
+        printf("Received %d of %d samples\n", num_received, CONCURRENT_NUM_SAMPLES);
+        is_ok = false;
+    }
+    printf("Concurrent flush: %lu retried adds\n", iotcl_sample_ring_get_dropped_count(&ring));
+    return is_ok;
+}
+
+static bool bad_arguments_test(void) {
+    IotclSampleRing ring;
+    int err_cnt = 0;
+    err_cnt += iotcl_sample_ring_init(&ring, "vib", blocks, 3) ? 0 : 1;
+    err_cnt += iotcl_sample_ring_init(&ring, "vib", blocks, 1) ? 0 : 1;
+    err_cnt += iotcl_sample_ring_init(&ring, NULL, blocks, 4) ? 0 : 1;
+    err_cnt += iotcl_sample_ring_init(&ring, "vib", NULL, 4) ? 0 : 1;
+    err_cnt += iotcl_sample_ring_add(NULL, 0, 0) ? 0 : 1;
+    err_cnt += iotcl_sample_ring_flush(NULL, NULL, NULL, NULL) ? 0 : 1;
+    if (err_cnt) {
+        printf("%d bad argument calls succeeded\n", err_cnt);
+        return false;
+    }
+    return true;
+}
+
+int main(void) {
+    IotclClientConfig config;
+    iotcl_init_client_config(&config);
+    config.device.instance_type = IOTCL_DCT_AWS_DEDICATED;
+    config.device.duid = "mydevice";
+    if (iotcl_init(&config)) {
+        return 1;
+    }
+
+    bool test_result = true; // until proven otherwise
+    test_result &= round_trip_test();
+    test_result &= budget_test();
+    test_result &= compression_test();
+    test_result &= window_test();
+    test_result &= out_of_memory_test();
+    test_result &= concurrent_test();
+    test_result &= bad_arguments_test();
+
+    iotcl_deinit();
+    return (test_result ? 0 : 1);
+}
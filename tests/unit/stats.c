@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+// Built with IOTCL_ENABLE_STATS defined. See CMakeLists.txt.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "iotcl.h"
+#include "iotcl_c2d.h"
+#include "iotcl_telemetry.h"
+#include "iotcl_stats.h"
+
+static const char *const TEST_STR_COMMAND = "{\"v\":\"2.1\",\"ct\":0,\"cmd\":\"set-led-green off\",\"ack\":\"4d99ed07-0ea0-43c6-97ba-53780faddc5c\"}";
+static const char *const TEST_STR_BAD_JSON = "{\"v\":\"2.1\",\"ct\":0,";
+
+static uint32_t fake_time_us = 0;
+
+// Every call advances the clock, so each measured operation takes a fixed amount of time.
+static uint32_t fake_clock(void) {
+    fake_time_us += 3;
+    return fake_time_us;
+}
+
+static void my_transport_send(const char *topic, const char *json_str) {
+    (void) topic;
+    (void) json_str;
+}
+
+static void on_cmd(IotclC2dEventData data) {
+    iotcl_mqtt_send_cmd_ack(iotcl_c2d_get_ack_id(data), IOTCL_C2D_EVT_CMD_SUCCESS_WITH_ACK, NULL);
+}
+
+static bool expect_counter(const IotclStatsSnapshot *s, IotclStatsCounter counter, unsigned long expected) {
+    if (expected != s->counters[counter]) {
+        printf("Counter %d is %lu. Expected %lu\n", (int) counter, s->counters[counter], expected);
+        return false;
+    }
+    return true;
+}
+
+static bool counters_test(void) {
+    IotclStatsSnapshot s;
+    bool is_ok = true;
+
+    iotcl_stats_reset();
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    iotcl_telemetry_set_number(msg, "temperature", 21.5);
+    iotcl_telemetry_set_string(msg, "status", "normal");
+    iotcl_telemetry_set_bool(msg, NULL, true); // error
+    iotcl_mqtt_send_telemetry(msg, false);
+    iotcl_telemetry_destroy(msg);
+
+    iotcl_mqtt_receive_c2d(TEST_STR_COMMAND);
+    iotcl_mqtt_receive_c2d(TEST_STR_BAD_JSON);
+
+    if (IOTCL_SUCCESS != iotcl_stats_snapshot(&s)) {
+        printf("Failed to take a snapshot\n");
+        return false;
+    }
+    is_ok &= expect_counter(&s, IOTCL_STATS_TELEMETRY_CREATED, 1);
+    is_ok &= expect_counter(&s, IOTCL_STATS_TELEMETRY_VALUES_SET, 2);
+    is_ok &= expect_counter(&s, IOTCL_STATS_TELEMETRY_ERRORS, 1);
+    is_ok &= expect_counter(&s, IOTCL_STATS_TELEMETRY_SERIALIZED, 1);
+    is_ok &= expect_counter(&s, IOTCL_STATS_MQTT_MESSAGES_SENT, 2); // telemetry and the ack
+    is_ok &= expect_counter(&s, IOTCL_STATS_C2D_RECEIVED, 2);
+    is_ok &= expect_counter(&s, IOTCL_STATS_C2D_DISPATCHED, 1);
+    is_ok &= expect_counter(&s, IOTCL_STATS_C2D_REJECTED, 1);
+    is_ok &= expect_counter(&s, IOTCL_STATS_ACKS_CREATED, 1);
+    is_ok &= expect_counter(&s, IOTCL_STATS_ACKS_SENT, 1);
+    if (0 == s.counters[IOTCL_STATS_TELEMETRY_BYTES]
+        || s.counters[IOTCL_STATS_MQTT_BYTES_SENT] <= s.counters[IOTCL_STATS_TELEMETRY_BYTES]) {
+        printf("Byte counters are not as expected\n");
+        is_ok = false;
+    }
+    const IotclStatsHistogram *h = &s.histograms[IOTCL_STATS_TELEMETRY_SET_LATENCY];
+    if (3 != h->count || 9 != h->sum_us || 3 != h->buckets[2]) { // 3us falls into the <= 5us bucket
+        printf("Telemetry set latency histogram is not as expected. Count: %lu, sum: %lu\n", h->count, h->sum_us);
+        is_ok = false;
+    }
+    if (2 != s.histograms[IOTCL_STATS_C2D_PROCESS_LATENCY].count) {
+        printf("C2D latency count is not as expected\n");
+        is_ok = false;
+    }
+
+    iotcl_stats_reset();
+    iotcl_stats_snapshot(&s);
+    is_ok &= expect_counter(&s, IOTCL_STATS_TELEMETRY_CREATED, 0);
+    if (0 != s.histograms[IOTCL_STATS_TELEMETRY_SET_LATENCY].count) {
+        printf("Histograms were not reset\n");
+        is_ok = false;
+    }
+    return is_ok;
+}
+
+static bool prometheus_test(void) {
+    IotclStatsSnapshot s;
+    static char buffer[16 * 1024];
+    size_t length = 0;
+    size_t required = 0;
+
+    memset(&s, 0, sizeof(s));
+    s.counters[IOTCL_STATS_C2D_RECEIVED] = 7;
+    s.histograms[IOTCL_STATS_MQTT_SEND_LATENCY].count = 2;
+    s.histograms[IOTCL_STATS_MQTT_SEND_LATENCY].sum_us = 1000004;
+    s.histograms[IOTCL_STATS_MQTT_SEND_LATENCY].buckets[0] = 1;
+    s.histograms[IOTCL_STATS_MQTT_SEND_LATENCY].buckets[IOTCL_STATS_NUM_BUCKETS - 1] = 1;
+
+    if (IOTCL_ERR_OVERFLOW != iotcl_stats_export_prometheus(&s, NULL, 0, &required) || 0 == required) {
+        printf("Failed to get the required size\n");
+        return false;
+    }
+    if (IOTCL_SUCCESS != iotcl_stats_export_prometheus(&s, buffer, sizeof(buffer), &length) || length != required
+        || length != strlen(buffer)) {
+        printf("Failed to export. Length: %lu, required: %lu\n", (unsigned long) length, (unsigned long) required);
+        return false;
+    }
+    static const char *const expected_lines[] = {
+            "# TYPE iotcl_c2d_received_total counter\niotcl_c2d_received_total 7\n",
+            "iotcl_mqtt_send_duration_seconds_bucket{le=\"0.000001\"} 1\n",
+            "iotcl_mqtt_send_duration_seconds_bucket{le=\"0.050000\"} 1\n",
+            "iotcl_mqtt_send_duration_seconds_bucket{le=\"+Inf\"} 2\n",
+            "iotcl_mqtt_send_duration_seconds_sum 1.000004\n",
+            "iotcl_mqtt_send_duration_seconds_count 2\n",
+    };
+    for (size_t i = 0; i < sizeof(expected_lines) / sizeof(expected_lines[0]); i++) {
+        if (!strstr(buffer, expected_lines[i])) {
+            printf("Missing in the export: %s", expected_lines[i]);
+            return false;
+        }
+    }
+
+    // one byte short for the null terminator
+    memset(buffer, 'x', sizeof(buffer));
+    if (IOTCL_ERR_OVERFLOW != iotcl_stats_export_prometheus(&s, buffer, required, &length)
+        || length != required || '\0' != buffer[required - 1]) {
+        printf("Overflow was not handled correctly\n");
+        return false;
+    }
+    return true;
+}
+
+int main(void) {
+    IotclClientConfig config;
+    bool test_result = true; // until proven otherwise
+
+    iotcl_init_client_config(&config);
+    config.device.instance_type = IOTCL_DCT_AWS_DEDICATED;
+    config.device.duid = "mydevice";
+    config.mqtt_send_cb = my_transport_send;
+    config.events.cmd_cb = on_cmd;
+    if (iotcl_init(&config)) {
+        return 1;
+    }
+    iotcl_stats_configure_clock(fake_clock);
+
+    test_result &= counters_test();
+    test_result &= prometheus_test();
+
+    iotcl_stats_configure_clock(NULL);
+    iotcl_deinit();
+    printf("Stats tests %s\n", test_result ? "passed" : "FAILED");
+    return (test_result ? 0 : 1);
+}
@@ -3,7 +3,12 @@
  * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "iotcl.h"
 #include "iotcl_util.h"
@@ -14,6 +19,26 @@ static void my_transport_send(const char *topic, const char *json_str) {
     printf("Sending on topic %s:\n%s\n", topic, json_str);
 }
 
+// Initializes the library with a dedicated AWS device, which the serialization tests share
+static bool init_library(IotclClientConfig *config) {
+    iotcl_init_client_config(config);
+    config->device.instance_type = IOTCL_DCT_AWS_DEDICATED;
+    config->device.duid = "mydevice";
+    config->mqtt_send_cb = my_transport_send;
+    return 0 == iotcl_init(config);
+}
+
+// Serializes the message without formatting and compares it with the expected string
+static bool expect_serialized(IotclMessageHandle msg, const char *expected) {
+    char *str = iotcl_telemetry_create_serialized_string(msg, false);
+    const bool is_ok = str && 0 == strcmp(str, expected);
+    if (!is_ok) {
+        printf("Expected:\n%s\nbut got:\n%s\n", expected, str ? str : "(null)");
+    }
+    iotcl_telemetry_destroy_serialized_string(str);
+    return is_ok;
+}
+
 static bool telemetry_test(bool use_time) {
     int err_cnt = 0;
     IotclClientConfig config;
@@ -49,7 +74,7 @@ static bool telemetry_test(bool use_time) {
     printf("START INVALID VALUE TESTING. Expecting %d errors:\n", EXPECTED_CNT);
     printf("---------------------------\n");
     err_cnt += iotcl_telemetry_add_new_data_set(msg, NULL) ? 1 : 0;
-    err_cnt += iotcl_telemetry_set_number(msg, "too.many.dots", 1) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "empty..segment", 1) ? 1 : 0;
     err_cnt += iotcl_telemetry_set_number(msg, ".starts_with_dot", 1) ? 1 : 0;
     err_cnt += iotcl_telemetry_set_bool(msg, "ends_with_dot.", false) ? 1 : 0;
     err_cnt += iotcl_telemetry_set_bool(msg, "ends_with_dot.", false) ? 1 : 0;
@@ -73,6 +98,406 @@ static bool telemetry_test(bool use_time) {
     return err_cnt == EXPECTED_CNT;
 }
 
+// Checks that 64-bit integers are serialized exactly
+static bool int64_test(void) {
+    static const char *const EXPECTED = "{\"d\":[{\"d\":{\"zero\":0,\"min\":-9223372036854775808,"
+                                        "\"max\":9223372036854775807,\"umax\":18446744073709551615,"
+                                        "\"counter\":{\"big\":9007199254740993,\"neg\":-42,\"small\":7}}}]}";
+    IotclClientConfig config;
+    bool is_ok = true;
+
+    if (!init_library(&config)) {
+        return false;
+    }
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    int err_cnt = 0;
+    err_cnt += iotcl_telemetry_set_int64(msg, "zero", 0) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_int64(msg, "min", INT64_MIN) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_int64(msg, "max", INT64_MAX) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_uint64(msg, "umax", UINT64_MAX) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_uint64(msg, "counter.big", 9007199254740993ULL) ? 1 : 0; // 2^53 + 1
+    err_cnt += iotcl_telemetry_set_int64(msg, "counter.neg", -42) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_int64(msg, "counter.small", 7) ? 1 : 0;
+    // expected errors
+    err_cnt += iotcl_telemetry_set_int64(msg, NULL, 1) ? 0 : 1;
+    err_cnt += iotcl_telemetry_set_uint64(NULL, "x", 1) ? 0 : 1;
+
+    if (err_cnt) {
+        printf("64-bit integer test failed with %d errors\n", err_cnt);
+        is_ok = false;
+    }
+    is_ok &= expect_serialized(msg, EXPECTED);
+    iotcl_telemetry_destroy(msg);
+    iotcl_deinit();
+    return is_ok;
+}
+
+// Setting the same path again replaces the value, both in small data sets and in large (indexed) ones
+static bool last_value_wins_test(void) {
+    static const char *const EXPECTED_SMALL = "{\"d\":[{\"d\":{\"temperature\":22,\"status\":42,"
+                                              "\"accel\":{\"x\":null,\"y\":\"fast\"}}}]}";
+    static char expected_large[8192];
+    IotclClientConfig config;
+    bool is_ok = true;
+    int err_cnt = 0;
+    char name[16];
+
+    if (!init_library(&config)) {
+        return false;
+    }
+
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    err_cnt += iotcl_telemetry_set_number(msg, "temperature", 21) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_string(msg, "status", "normal") ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "accel.x", 1) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "accel.y", 2) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "temperature", 22) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_int64(msg, "status", 42) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "accel.x", 3) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_string(msg, "accel.y", "fast") ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_null(msg, "Accel.x") ? 1 : 0; // object names ignore case, like in cJSON_GetObjectItem()
+    // expected errors
+    err_cnt += iotcl_telemetry_set_number(msg, "accel", 1) ? 0 : 1;
+    err_cnt += iotcl_telemetry_set_number(msg, "temperature.x", 1) ? 0 : 1;
+
+    if (err_cnt) {
+        printf("Last value wins test failed with %d errors\n", err_cnt);
+        is_ok = false;
+    }
+    is_ok &= expect_serialized(msg, EXPECTED_SMALL);
+    iotcl_telemetry_destroy(msg);
+
+    // 300 values and an object, each set twice, then a second data set
+    msg = iotcl_telemetry_create();
+    err_cnt = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < 300; i++) {
+            sprintf(name, "a%d", i);
+            err_cnt += iotcl_telemetry_set_number(msg, name, i + pass * 1000) ? 1 : 0;
+        }
+        for (int i = 0; i < 20; i++) {
+            sprintf(name, "obj.k%d", i);
+            err_cnt += iotcl_telemetry_set_number(msg, name, i + pass * 1000) ? 1 : 0;
+        }
+    }
+    err_cnt += iotcl_telemetry_set_string(msg, "a5", "x") ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_null(msg, "obj.k7") ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "OBJ.k1", 5) ? 1 : 0; // also when the data set is indexed
+    err_cnt += iotcl_telemetry_add_new_data_set(msg, "2024-01-02T03:04:00.000Z") ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "a0", 1) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "a0", 2) ? 1 : 0;
+
+    size_t len = (size_t) sprintf(expected_large, "{\"d\":[{\"d\":{");
+    for (int i = 0; i < 300; i++) {
+        if (5 == i) {
+            len += (size_t) sprintf(&expected_large[len], "\"a5\":\"x\",");
+        } else {
+            len += (size_t) sprintf(&expected_large[len], "\"a%d\":%d,", i, i + 1000);
+        }
+    }
+    len += (size_t) sprintf(&expected_large[len], "\"obj\":{");
+    for (int i = 0; i < 20; i++) {
+        if (7 == i) {
+            len += (size_t) sprintf(&expected_large[len], "\"k7\":null%s", ",");
+        } else if (1 == i) {
+            len += (size_t) sprintf(&expected_large[len], "\"k1\":5,");
+        } else {
+            len += (size_t) sprintf(&expected_large[len], "\"k%d\":%d%s", i, i + 1000, i < 19 ? "," : "");
+        }
+    }
+    sprintf(&expected_large[len], "}}},{\"dt\":\"2024-01-02T03:04:00.000Z\",\"d\":{\"a0\":2}}]}");
+
+    if (err_cnt) {
+        printf("Large data set last value wins test failed with %d errors\n", err_cnt);
+        is_ok = false;
+    }
+    is_ok &= expect_serialized(msg, expected_large);
+    iotcl_telemetry_destroy(msg);
+    iotcl_deinit();
+    return is_ok;
+}
+
+// Paths nested deeper than one level
+static bool nested_path_test(void) {
+    static const char *const EXPECTED = "{\"d\":[{\"d\":{\"motor\":{\"phase_a\":{\"current\":1.6,\"voltage\":230},"
+                                        "\"phase_b\":{\"current\":1.4},\"rpm\":1500},"
+                                        "\"a\":{\"b\":{\"c\":{\"d\":{\"e\":true}}}}}}]}";
+    IotclClientConfig config;
+    bool is_ok = true;
+    int err_cnt = 0;
+
+    if (!init_library(&config)) {
+        return false;
+    }
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    err_cnt += iotcl_telemetry_set_number(msg, "motor.phase_a.current", 1.5) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "motor.phase_a.voltage", 230) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "motor.phase_b.current", 1.4) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "motor.rpm", 1500) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "motor.phase_a.current", 1.6) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_bool(msg, "a.b.c.d.e", true) ? 1 : 0;
+    // expected errors
+    err_cnt += iotcl_telemetry_set_number(msg, "motor..current", 1) ? 0 : 1;
+    err_cnt += iotcl_telemetry_set_number(msg, ".motor", 1) ? 0 : 1;
+    err_cnt += iotcl_telemetry_set_number(msg, "motor.", 1) ? 0 : 1;
+    err_cnt += iotcl_telemetry_set_number(msg, "motor.rpm.x", 1) ? 0 : 1;
+    err_cnt += iotcl_telemetry_set_number(msg, "motor.phase_a", 1) ? 0 : 1;
+
+    if (err_cnt) {
+        printf("Nested path test failed with %d errors\n", err_cnt);
+        is_ok = false;
+    }
+    is_ok &= expect_serialized(msg, EXPECTED);
+    iotcl_telemetry_destroy(msg);
+    iotcl_deinit();
+    return is_ok;
+}
+
+// Checks rounding with declared precision and fixed-point values
+static bool precision_test(void) {
+    static const char *const EXPECTED = "{\"d\":[{\"d\":{\"temperature\":21.53,\"t2\":21.5,\"t3\":0,"
+                                        "\"accel\":{\"x\":-0.013},\"count\":42,\"huge\":1e+300,\"full\":0.1,"
+                                        "\"fp\":21.53,\"fp2\":-0.005,\"fp3\":-9.223372036854775808,\"fp4\":1}}]}";
+    static const char *const EXPECTED_AFTER_DEINIT = "{\"d\":[{\"d\":{\"temperature\":21.534}}]}";
+    IotclClientConfig config;
+    bool is_ok = true;
+    int err_cnt = 0;
+
+    if (!init_library(&config)) {
+        return false;
+    }
+    err_cnt += iotcl_telemetry_configure_precision("temperature", 2) ? 1 : 0;
+    err_cnt += iotcl_telemetry_configure_precision("t2", 2) ? 1 : 0;
+    err_cnt += iotcl_telemetry_configure_precision("t3", 2) ? 1 : 0;
+    err_cnt += iotcl_telemetry_configure_precision("accel.x", 3) ? 1 : 0;
+    err_cnt += iotcl_telemetry_configure_precision("count", 0) ? 1 : 0;
+    err_cnt += iotcl_telemetry_configure_precision("huge", 2) ? 1 : 0;
+    err_cnt += iotcl_telemetry_configure_precision("full", 2) ? 1 : 0;
+    err_cnt += iotcl_telemetry_configure_precision("full", -1) ? 1 : 0; // back to full precision
+    // expected errors
+    err_cnt += iotcl_telemetry_configure_precision("too_precise", IOTCL_TELEMETRY_MAX_DECIMALS + 1) ? 0 : 1;
+    err_cnt += iotcl_telemetry_configure_precision(NULL, 2) ? 0 : 1;
+    err_cnt += iotcl_init(&config) ? 1 : 0; // re-init should keep the declared precision
+
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    err_cnt += iotcl_telemetry_set_number(msg, "temperature", 21.530000000000001) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "t2", 21.5) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "t3", -0.004) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "accel.x", -0.0125) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "count", 41.7) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "huge", 1e300) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "full", 0.1) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_fixed_point(msg, "fp", 2153, 2) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_fixed_point(msg, "fp2", -5, 3) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_fixed_point(msg, "fp3", INT64_MIN, 18) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_fixed_point(msg, "fp4", 100, 2) ? 1 : 0;
+    // expected error
+    err_cnt += iotcl_telemetry_set_fixed_point(msg, "fp5", 1, IOTCL_TELEMETRY_MAX_FIXED_POINT_DECIMALS + 1) ? 0 : 1;
+
+    if (err_cnt) {
+        printf("Precision test failed with %d errors\n", err_cnt);
+        is_ok = false;
+    }
+    is_ok &= expect_serialized(msg, EXPECTED);
+    iotcl_telemetry_destroy(msg);
+    iotcl_deinit();
+
+    // the registry is cleared by iotcl_deinit()
+    if (iotcl_init(&config)) {
+        return false;
+    }
+    msg = iotcl_telemetry_create();
+    iotcl_telemetry_set_number(msg, "temperature", 21.534);
+    is_ok &= expect_serialized(msg, EXPECTED_AFTER_DEINIT);
+    iotcl_telemetry_destroy(msg);
+    iotcl_deinit();
+    return is_ok;
+}
+
+static size_t parallel_jobs_run;
+
+// Runs the jobs in reverse order on the calling thread, so that the ranges are not serialized in order
+static void reverse_executor(IotclParallelJob job, void *context, size_t num_jobs) {
+    for (size_t i = num_jobs; i > 0; i--) {
+        job(context, i - 1);
+        parallel_jobs_run++;
+    }
+}
+
+// Large messages are serialized in ranges by the parallel executor and need to match the serial output
+static bool parallel_test(void) {
+    IotclClientConfig config;
+    bool is_ok = true;
+    char timestamp[IOTCL_ISO_TIMESTAMP_STR_LEN + 1];
+
+    if (!init_library(&config)) {
+        return false;
+    }
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    int err_cnt = 0;
+    for (int i = 0; i < 100; i++) {
+        iotcl_to_iso_timestamp((time_t) (1709742596 + i), timestamp, sizeof(timestamp));
+        err_cnt += iotcl_telemetry_add_new_data_set(msg, timestamp) ? 1 : 0;
+        err_cnt += iotcl_telemetry_set_number(msg, "temperature", 20.0 + i / 10.0) ? 1 : 0;
+        err_cnt += iotcl_telemetry_set_int64(msg, "accel.count", i) ? 1 : 0;
+    }
+    char *serial = iotcl_telemetry_create_serialized_string(msg, false);
+
+    config.parallel.executor = reverse_executor;
+    config.parallel.num_jobs = 3;
+    err_cnt += iotcl_init(&config) ? 1 : 0;
+    // the message needs to be intact after the ranges are joined back, so it is serialized twice
+    is_ok &= serial && expect_serialized(msg, serial) && expect_serialized(msg, serial);
+    if (err_cnt || !serial || 6 != parallel_jobs_run) {
+        printf("Parallel serialization failed with %d errors and %lu jobs\n", err_cnt,
+               (unsigned long) parallel_jobs_run);
+        is_ok = false;
+    }
+    iotcl_telemetry_destroy_serialized_string(serial);
+    iotcl_telemetry_destroy(msg);
+
+    // small messages are serialized on the calling thread
+    msg = iotcl_telemetry_create();
+    iotcl_telemetry_set_number(msg, "temperature", 1.0);
+    serial = iotcl_telemetry_create_serialized_string(msg, false);
+    if (!serial || 6 != parallel_jobs_run) {
+        printf("A small message was serialized in parallel\n");
+        is_ok = false;
+    }
+    iotcl_telemetry_destroy_serialized_string(serial);
+    iotcl_telemetry_destroy(msg);
+
+    config.parallel.num_jobs = 1;
+    if (!iotcl_init(&config)) {
+        printf("A parallel executor with a single job was accepted\n");
+        is_ok = false;
+    }
+    iotcl_deinit();
+    return is_ok;
+}
+
+// Checks that allocations made by telemetry APIs are attributed to their scopes and that all bytes are returned
+static bool heap_scopes_test(void) {
+    IotclClientConfig config;
+    IotclMessageHandle msg = NULL;
+    HtStats create_stats;
+    HtStats set_stats;
+    HtStats total_stats;
+    bool is_ok = true;
+
+    iotcl_init_client_config(&config);
+    config.device.instance_type = IOTCL_DCT_AWS_DEDICATED;
+    config.device.duid = "mydevice";
+    if (iotcl_init(&config)) {
+        return false;
+    }
+    const size_t bytes_before = ht_get_current_bytes();
+    ht_reset_peak();
+
+    HT_SCOPE("iotcl_telemetry_create", msg = iotcl_telemetry_create());
+    HT_SCOPE("iotcl_telemetry_set_number", iotcl_telemetry_set_number(msg, "coord.x", 2));
+    HT_SCOPE("iotcl_telemetry_set_number", iotcl_telemetry_set_number(msg, "coord.y", 3));
+    HT_SCOPE("iotcl_telemetry_destroy", iotcl_telemetry_destroy(msg));
+    ht_print_scopes();
+    ht_print_histogram();
+
+    if (!ht_get_scope_stats("iotcl_telemetry_create", &create_stats)
+        || !ht_get_scope_stats("iotcl_telemetry_set_number", &set_stats)) {
+        printf("Scope stats missing!\n");
+        iotcl_deinit();
+        return false;
+    }
+    ht_get_stats(&total_stats);
+    if (0 == create_stats.allocations || 0 == create_stats.total_bytes || 0 == set_stats.allocations) {
+        printf("Allocations were not attributed to scopes!\n");
+        is_ok = false;
+    }
+    // everything was freed by destroy, but is still accounted to the scopes that allocated it
+    if (0 != create_stats.current_bytes || 0 != set_stats.current_bytes || bytes_before != ht_get_current_bytes()) {
+        printf("Bytes were not returned to the heap!\n");
+        is_ok = false;
+    }
+    if (ht_get_peak_bytes() < bytes_before + create_stats.peak_bytes) {
+        printf("Peak bytes are incorrect!\n");
+        is_ok = false;
+    }
+
+    iotcl_deinit();
+    return is_ok;
+}
+
+#define HEAP_THREADS_NUM_THREADS 4
+#define HEAP_THREADS_NUM_MESSAGES 500
+
+static void *heap_threads_worker(void *arg) {
+    int *err_cnt = (int *) arg;
+    for (int i = 0; i < HEAP_THREADS_NUM_MESSAGES; i++) {
+        IotclMessageHandle msg = NULL;
+        char *str = NULL;
+        HT_SCOPE("heap_threads_test", msg = iotcl_telemetry_create());
+        HT_SCOPE("heap_threads_test", *err_cnt += iotcl_telemetry_set_number(msg, "coord.x", (double) i) ? 1 : 0);
+        HT_SCOPE("heap_threads_test", str = iotcl_telemetry_create_serialized_string(msg, false));
+        *err_cnt += str ? 0 : 1;
+        iotcl_telemetry_destroy_serialized_string(str);
+        iotcl_telemetry_destroy(msg);
+        if (0 == i) {
+            // memory that was not allocated by the tracker should be freed without affecting the counters
+            ht_free(malloc(16));
+        }
+    }
+    return NULL;
+}
+
+// The tracker should count allocations and frees made concurrently without losing any
+static bool heap_threads_test(void) {
+    IotclClientConfig config;
+    pthread_t threads[HEAP_THREADS_NUM_THREADS];
+    int err_cnts[HEAP_THREADS_NUM_THREADS] = {0};
+    HtStats before;
+    HtStats after;
+    HtStats scope_stats;
+    bool is_ok = true;
+
+    iotcl_init_client_config(&config);
+    config.device.instance_type = IOTCL_DCT_AWS_DEDICATED;
+    config.device.duid = "mydevice";
+    if (iotcl_init(&config)) {
+        return false;
+    }
+    const int allocations_before = ht_get_num_current_allocations();
+    ht_get_stats(&before);
+
+    int num_threads = 0;
+    for (; num_threads < HEAP_THREADS_NUM_THREADS; num_threads++) {
+        if (0 != pthread_create(&threads[num_threads], NULL, heap_threads_worker, &err_cnts[num_threads])) {
+            printf("Failed to create a thread!\n");
+            is_ok = false;
+            break;
+        }
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+        is_ok &= (0 == err_cnts[i]);
+    }
+
+    ht_get_stats(&after);
+    const unsigned long num_allocations = after.allocations - before.allocations;
+    if (!ht_get_scope_stats("heap_threads_test", &scope_stats)
+        || num_allocations != after.frees - before.frees
+        || num_allocations != scope_stats.allocations
+        || num_allocations < (unsigned long) (num_threads * HEAP_THREADS_NUM_MESSAGES)
+        || scope_stats.allocations != scope_stats.frees || 0 != scope_stats.current_bytes
+        || before.current_bytes != after.current_bytes
+        || allocations_before != ht_get_num_current_allocations()) {
+        printf("Concurrent allocations were not counted correctly! Allocations: %lu, frees: %lu\n",
+               num_allocations, after.frees - before.frees);
+        is_ok = false;
+    }
+
+    iotcl_deinit();
+    return is_ok;
+}
+
 int main(void) {
     ht_reset_config();
     ht_init();
@@ -81,6 +506,13 @@ int main(void) {
     bool test_result = true; // until proven otherwise
     test_result &= telemetry_test(true);
     test_result &= telemetry_test(false);
+    test_result &= int64_test();
+    test_result &= precision_test();
+    test_result &= last_value_wins_test();
+    test_result &= nested_path_test();
+    test_result &= parallel_test();
+    test_result &= heap_scopes_test();
+    test_result &= heap_threads_test();
 
     ht_print_summary();
     if (ht_get_num_current_allocations() != 0) {
@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cJSON.h"
+#include "iotcl.h"
+#include "iotcl_util.h"
+#include "iotcl_telemetry.h"
+#include "iotcl_telemetry_template.h"
+
+static char sent_json[1024];
+
+static void my_transport_send(const char *topic, const char *json_str) {
+    (void) topic;
+    snprintf(sent_json, sizeof(sent_json), "%s", json_str);
+}
+
+// Returns the value at the dot separated path in the data set of the parsed message, or NULL
+static const cJSON *get_value(const cJSON *root, const char *path) {
+    const cJSON *item = cJSON_GetObjectItem(cJSON_GetArrayItem(cJSON_GetObjectItem(root, "d"), 0), "d");
+    char name[32];
+    const char *dot;
+    while ((dot = strchr(path, '.'))) {
+        snprintf(name, sizeof(name), "%.*s", (int) (dot - path), path);
+        item = cJSON_GetObjectItem(item, name);
+        path = dot + 1;
+    }
+    return cJSON_GetObjectItem(item, path);
+}
+
+static IotclTelemetryTemplate create_template(bool with_timestamp) {
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    int err_cnt = 0;
+    if (with_timestamp) {
+        err_cnt += iotcl_telemetry_add_new_data_set(msg, "2024-03-06T16:29:56.000Z") ? 1 : 0;
+    }
+    err_cnt += iotcl_telemetry_set_number(msg, "temperature", 21.5) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_number(msg, "motor.phase_a.current", 1.25) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_int64(msg, "counter", 7) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_bool(msg, "door_open", true) ? 1 : 0;
+    err_cnt += iotcl_telemetry_set_string(msg, "status", "initializing") ? 1 : 0;
+    IotclTelemetryTemplate tmpl = err_cnt ? NULL : iotcl_telemetry_template_create(msg);
+    iotcl_telemetry_destroy(msg);
+    return tmpl;
+}
+
+// The template needs to serialize the same values as the message, and the values that are set afterwards
+static bool set_values_test(void) {
+    bool is_ok = true;
+    IotclTelemetryTemplate tmpl = create_template(true);
+    if (!tmpl) {
+        printf("Failed to create the template\n");
+        return false;
+    }
+    const size_t length = strlen(iotcl_telemetry_template_get_string(tmpl));
+    cJSON *root = cJSON_Parse(iotcl_telemetry_template_get_string(tmpl));
+    if (!cJSON_IsNumber(get_value(root, "temperature")) || 21.5 != get_value(root, "temperature")->valuedouble
+        || !cJSON_IsTrue(get_value(root, "door_open"))
+        || 0 != strcmp("initializing", cJSON_GetStringValue(get_value(root, "status")))) {
+        printf("Template does not have the message values: %s\n", iotcl_telemetry_template_get_string(tmpl));
+        is_ok = false;
+    }
+    cJSON_Delete(root);
+
+    const int temperature = iotcl_telemetry_template_find_slot(tmpl, "temperature");
+    const int current = iotcl_telemetry_template_find_slot(tmpl, "motor.phase_a.current");
+    const int counter = iotcl_telemetry_template_find_slot(tmpl, "counter");
+    const int door_open = iotcl_telemetry_template_find_slot(tmpl, "door_open");
+    const int status = iotcl_telemetry_template_find_slot(tmpl, "status");
+    int err_cnt = 0;
+    err_cnt += iotcl_telemetry_template_set_timestamp(tmpl, "2024-03-06T16:30:56.000Z") ? 1 : 0;
+    err_cnt += iotcl_telemetry_template_set_number(tmpl, temperature, -1.0 / 3.0) ? 1 : 0;
+    err_cnt += iotcl_telemetry_template_set_fixed_point(tmpl, current, -1234, 3) ? 1 : 0;
+    err_cnt += iotcl_telemetry_template_set_uint64(tmpl, counter, UINT64_MAX) ? 1 : 0;
+    err_cnt += iotcl_telemetry_template_set_bool(tmpl, door_open, false) ? 1 : 0;
+    err_cnt += iotcl_telemetry_template_set_string(tmpl, status, "\"ok\"\n") ? 1 : 0;
+    root = cJSON_Parse(iotcl_telemetry_template_get_string(tmpl));
+    const cJSON *dt = cJSON_GetObjectItem(cJSON_GetArrayItem(cJSON_GetObjectItem(root, "d"), 0), "dt");
+    if (err_cnt || length != strlen(iotcl_telemetry_template_get_string(tmpl))
+        || 0 != strcmp("2024-03-06T16:30:56.000Z", cJSON_GetStringValue(dt))
+        || -1.0 / 3.0 != get_value(root, "temperature")->valuedouble
+        || -1.234 != get_value(root, "motor.phase_a.current")->valuedouble
+        || !cJSON_IsFalse(get_value(root, "door_open"))
+        || 0 != strcmp("\"ok\"\n", cJSON_GetStringValue(get_value(root, "status")))
+        || !strstr(iotcl_telemetry_template_get_string(tmpl), "\"counter\":18446744073709551615 ")) {
+        printf("Values were not set. %d errors: %s\n", err_cnt, iotcl_telemetry_template_get_string(tmpl));
+        is_ok = false;
+    }
+    cJSON_Delete(root);
+
+    err_cnt = 0;
+    err_cnt += iotcl_telemetry_template_set_null(tmpl, temperature) ? 1 : 0;
+    err_cnt += iotcl_telemetry_template_set_null(tmpl, door_open) ? 1 : 0;
+    root = cJSON_Parse(iotcl_telemetry_template_get_string(tmpl));
+    if (err_cnt || !cJSON_IsNull(get_value(root, "temperature")) || !cJSON_IsNull(get_value(root, "door_open"))) {
+        printf("Values were not set to null: %s\n", iotcl_telemetry_template_get_string(tmpl));
+        is_ok = false;
+    }
+    cJSON_Delete(root);
+
+    if (0 != iotcl_mqtt_send_telemetry_template(tmpl) || 0 != strcmp(sent_json, iotcl_telemetry_template_get_string(tmpl))) {
+        printf("The template was not sent\n");
+        is_ok = false;
+    }
+    iotcl_telemetry_template_destroy(tmpl);
+    return is_ok;
+}
+
+// Declared precision applies to numbers set on the template
+static bool precision_test(void) {
+    bool is_ok = true;
+    iotcl_telemetry_configure_precision("temperature", 1);
+    IotclTelemetryTemplate tmpl = create_template(false);
+    iotcl_telemetry_template_set_number(tmpl, iotcl_telemetry_template_find_slot(tmpl, "temperature"), 21.5349);
+    if (!strstr(iotcl_telemetry_template_get_string(tmpl), "\"temperature\":21.5 ")) {
+        printf("Precision was not applied: %s\n", iotcl_telemetry_template_get_string(tmpl));
+        is_ok = false;
+    }
+    iotcl_telemetry_template_destroy(tmpl);
+    iotcl_telemetry_clear_precision();
+    return is_ok;
+}
+
+// Values that do not fit their slots are rejected and leave the previous value
+static bool overflow_test(void) {
+    bool is_ok = true;
+    int err_cnt = 0;
+    IotclTelemetryTemplate tmpl = create_template(false);
+    const int status = iotcl_telemetry_template_find_slot(tmpl, "status");
+    const int door_open = iotcl_telemetry_template_find_slot(tmpl, "door_open");
+    err_cnt += IOTCL_ERR_OVERFLOW == iotcl_telemetry_template_set_string(tmpl, status, "initialization failed") ? 0 : 1;
+    err_cnt += IOTCL_ERR_OVERFLOW == iotcl_telemetry_template_set_number(tmpl, door_open, 123.25) ? 0 : 1;
+    err_cnt += IOTCL_ERR_MISSING_VALUE == iotcl_telemetry_template_set_timestamp(tmpl, "2024-03-06T16:30:56.000Z") ? 0 : 1;
+    err_cnt += iotcl_telemetry_template_set_number(tmpl, 100, 1.0) ? 0 : 1;
+    err_cnt += iotcl_telemetry_template_set_bool(tmpl, -1, true) ? 0 : 1;
+    err_cnt += -1 == iotcl_telemetry_template_find_slot(tmpl, "motor.phase_a") ? 0 : 1;
+    err_cnt += -1 == iotcl_telemetry_template_find_slot(tmpl, "humidity") ? 0 : 1;
+    if (err_cnt || !strstr(iotcl_telemetry_template_get_string(tmpl), "\"status\":\"initializing\"")
+        || !strstr(iotcl_telemetry_template_get_string(tmpl), "\"door_open\":true ")) {
+        printf("%d invalid calls succeeded: %s\n", err_cnt, iotcl_telemetry_template_get_string(tmpl));
+        is_ok = false;
+    }
+    iotcl_telemetry_template_destroy(tmpl);
+    return is_ok;
+}
+
+// Templates are created from messages with exactly one data set
+static bool bad_message_test(void) {
+    int err_cnt = 0;
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    err_cnt += iotcl_telemetry_template_create(msg) ? 1 : 0;
+    iotcl_telemetry_add_new_data_set(msg, "2024-03-06T16:29:56.000Z");
+    iotcl_telemetry_set_number(msg, "temperature", 1.0);
+    iotcl_telemetry_add_new_data_set(msg, "2024-03-06T16:30:56.000Z");
+    iotcl_telemetry_set_number(msg, "temperature", 2.0);
+    err_cnt += iotcl_telemetry_template_create(msg) ? 1 : 0;
+    err_cnt += iotcl_telemetry_template_create(NULL) ? 1 : 0;
+    err_cnt += iotcl_mqtt_send_telemetry_template(NULL) ? 0 : 1;
+    iotcl_telemetry_destroy(msg);
+    if (err_cnt) {
+        printf("%d templates were created from invalid messages\n", err_cnt);
+        return false;
+    }
+    return true;
+}
+
+int main(void) {
+    IotclClientConfig config;
+    iotcl_init_client_config(&config);
+    config.device.instance_type = IOTCL_DCT_AWS_DEDICATED;
+    config.device.duid = "mydevice";
+    config.mqtt_send_cb = my_transport_send;
+    if (iotcl_init(&config)) {
+        return 1;
+    }
+
+    bool test_result = true; // until proven otherwise
+    test_result &= set_values_test();
+    test_result &= precision_test();
+    test_result &= overflow_test();
+    test_result &= bad_message_test();
+
+    iotcl_deinit();
+    return (test_result ? 0 : 1);
+}
@@ -0,0 +1,176 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (C) 2024 Avnet
+ * Authors: Nikola Markovic <nikola.markovic@avnet.com> et al.
+ */
+
+// Built with IOTCL_ENABLE_TRACE defined. See CMakeLists.txt.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "iotcl.h"
+#include "iotcl_c2d.h"
+#include "iotcl_telemetry.h"
+#include "iotcl_trace.h"
+#include "cJSON.h"
+
+static const char *const TEST_STR_COMMAND = "{\"v\":\"2.1\",\"ct\":0,\"cmd\":\"set-led-green off\",\"ack\":\"4d99ed07-0ea0-43c6-97ba-53780faddc5c\"}";
+
+static uint32_t fake_time_us = 0;
+
+// Every call advances the clock, so that each span has a non-zero duration.
+static uint32_t fake_clock(void) {
+    fake_time_us += 2;
+    return fake_time_us;
+}
+
+static time_t fake_time(void) {
+    return 1704164645; // 2024-01-02T03:04:05Z
+}
+
+static void my_transport_send(const char *topic, const char *json_str) {
+    (void) topic;
+    (void) json_str;
+}
+
+static void on_cmd(IotclC2dEventData data) {
+    iotcl_mqtt_send_cmd_ack(iotcl_c2d_get_ack_id(data), IOTCL_C2D_EVT_CMD_SUCCESS_WITH_ACK, NULL);
+}
+
+// Returns the number of complete ("X") events with the name, or -1 if the trace is not valid.
+static int count_spans(const cJSON *trace, const char *name) {
+    const cJSON *events = cJSON_GetObjectItem(trace, "traceEvents");
+    const cJSON *event;
+    int count = 0;
+    if (!cJSON_IsArray(events)) {
+        return -1;
+    }
+    cJSON_ArrayForEach(event, events) {
+        const char *ph = cJSON_GetStringValue(cJSON_GetObjectItem(event, "ph"));
+        const char *event_name = cJSON_GetStringValue(cJSON_GetObjectItem(event, "name"));
+        if (!ph || !event_name) {
+            return -1;
+        }
+        if (0 == strcmp(ph, "X") && 0 == strcmp(event_name, name)) {
+            if (!cJSON_IsNumber(cJSON_GetObjectItem(event, "ts")) || !cJSON_IsNumber(cJSON_GetObjectItem(event, "dur"))) {
+                return -1;
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+static bool expect_spans(const cJSON *trace, const char *name, int expected) {
+    const int count = count_spans(trace, name);
+    if (expected != count) {
+        printf("Expected %d \"%s\" spans, but found %d\n", expected, name, count);
+        return false;
+    }
+    return true;
+}
+
+static bool pipeline_test(void) {
+    static char buffer[32 * 1024];
+    size_t length = 0;
+    size_t required = 0;
+    bool is_ok = true;
+
+    iotcl_trace_reset();
+    iotcl_trace_set_thread_name("main \"thread\"");
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    iotcl_telemetry_set_number(msg, "temperature", 21.5);
+    iotcl_telemetry_set_string(msg, "accel.x", "0.1");
+    iotcl_mqtt_send_telemetry(msg, false);
+    iotcl_telemetry_destroy(msg);
+    iotcl_mqtt_receive_c2d(TEST_STR_COMMAND);
+
+    if (IOTCL_ERR_OVERFLOW != iotcl_trace_export_chrome(NULL, 0, &required) || 0 == required) {
+        printf("Failed to get the required size\n");
+        return false;
+    }
+    if (IOTCL_SUCCESS != iotcl_trace_export_chrome(buffer, sizeof(buffer), &length) || length != required
+        || length != strlen(buffer)) {
+        printf("Failed to export the trace\n");
+        return false;
+    }
+    cJSON *trace = cJSON_Parse(buffer);
+    if (!trace) {
+        printf("The trace is not valid JSON:\n%s\n", buffer);
+        return false;
+    }
+    is_ok &= expect_spans(trace, "timestamp", 1);
+    is_ok &= expect_spans(trace, "path", 2);
+    is_ok &= expect_spans(trace, "cjson_add", 2);
+    is_ok &= expect_spans(trace, "iotcl_telemetry_set", 2);
+    is_ok &= expect_spans(trace, "serialize", 1);
+    is_ok &= expect_spans(trace, "mqtt_send_cb", 2); // telemetry and the ack
+    is_ok &= expect_spans(trace, "iotcl_mqtt_send_telemetry", 1);
+    is_ok &= expect_spans(trace, "c2d_dedup", 1);
+    is_ok &= expect_spans(trace, "c2d_json_parse", 1);
+    is_ok &= expect_spans(trace, "c2d_dispatch", 1);
+    is_ok &= expect_spans(trace, "ack_create", 1);
+    is_ok &= expect_spans(trace, "iotcl_mqtt_receive_c2d", 1);
+    if (!strstr(buffer, "\"args\":{\"name\":\"main thread\"}")) {
+        printf("Thread name was not exported as expected\n");
+        is_ok = false;
+    }
+    cJSON_Delete(trace);
+
+    // one byte short for the null terminator
+    if (IOTCL_ERR_OVERFLOW != iotcl_trace_export_chrome(buffer, required, &length) || '\0' != buffer[required - 1]) {
+        printf("Overflow was not handled correctly\n");
+        is_ok = false;
+    }
+    return is_ok;
+}
+
+static bool wraparound_test(void) {
+    static char buffer[64 * 1024];
+    size_t length = 0;
+
+    iotcl_trace_reset();
+    IotclMessageHandle msg = iotcl_telemetry_create();
+    for (int i = 0; i < IOTCL_TRACE_BUFFER_SIZE; i++) {
+        iotcl_telemetry_set_number(msg, "temperature", i);
+    }
+    iotcl_telemetry_destroy(msg);
+    if (IOTCL_SUCCESS != iotcl_trace_export_chrome(buffer, sizeof(buffer), &length)) {
+        printf("Failed to export the trace\n");
+        return false;
+    }
+    cJSON *trace = cJSON_Parse(buffer);
+    // only the most recent spans are kept. Each set call records three spans, but timestamp is recorded only once.
+    const int count = count_spans(trace, "iotcl_telemetry_set") + count_spans(trace, "path") + count_spans(trace, "cjson_add");
+    cJSON_Delete(trace);
+    if (IOTCL_TRACE_BUFFER_SIZE != count) {
+        printf("Expected %d spans after wraparound, but found %d\n", IOTCL_TRACE_BUFFER_SIZE, count);
+        return false;
+    }
+    return true;
+}
+
+int main(void) {
+    IotclClientConfig config;
+    bool test_result = true; // until proven otherwise
+
+    iotcl_init_client_config(&config);
+    config.device.instance_type = IOTCL_DCT_AWS_DEDICATED;
+    config.device.duid = "mydevice";
+    config.mqtt_send_cb = my_transport_send;
+    config.events.cmd_cb = on_cmd;
+    config.time_fn = fake_time;
+    if (iotcl_init(&config)) {
+        return 1;
+    }
+    iotcl_trace_configure_clock(fake_clock);
+
+    test_result &= pipeline_test();
+    test_result &= wraparound_test();
+
+    iotcl_trace_configure_clock(NULL);
+    iotcl_deinit();
+    printf("Trace tests %s\n", test_result ? "passed" : "FAILED");
+    return (test_result ? 0 : 1);
+}